@@ -27,16 +27,20 @@ set(CMAKE_MODULE_PATH ${CMAKE_OLD_MODULE_PATH})
 check_cxx_symbol_exists(backtrace "execinfo.h" HAVE_BACKTRACE)
 check_cxx_symbol_exists(CLOCK_MONOTONIC_RAW "time.h" HAVE_CLOCK_MONOTONIC_RAW)
 check_cxx_symbol_exists(CLOCK_MONOTONIC "time.h" HAVE_CLOCK_MONOTONIC)
+check_cxx_symbol_exists(CLOCK_MONOTONIC_COARSE "time.h" HAVE_CLOCK_MONOTONIC_COARSE)
 check_cxx_symbol_exists(mach_absolute_time "mach/mach.h;mach/mach_time.h" HAVE_MACH_ABSOLUTE_TIME)
 check_cxx_symbol_exists(inotify_init "sys/inotify.h" HAVE_INOTIFY)
 check_cxx_symbol_exists(kqueue "sys/types.h;sys/event.h" HAVE_KQUEUE)
 check_cxx_symbol_exists(epoll_wait "sys/epoll.h" HAVE_EPOLL)
+check_cxx_symbol_exists(eventfd "sys/eventfd.h" HAVE_EVENTFD)
 check_cxx_symbol_exists(select "sys/select.h" HAVE_SELECT)
 check_cxx_symbol_exists(FD_CLOEXEC "fcntl.h" HAVE_CLOEXEC)
 check_cxx_symbol_exists(SO_NOSIGPIPE "sys/types.h;sys/socket.h" HAVE_NOSIGPIPE)
 check_cxx_symbol_exists(MSG_NOSIGNAL "sys/types.h;sys/socket.h" HAVE_NOSIGNAL)
 check_cxx_symbol_exists(GetLogicalProcessorInformation "windows.h" HAVE_PROCESSORINFORMATION)
 check_cxx_symbol_exists(SCHED_IDLE "pthread.h" HAVE_SCHEDIDLE)
+check_cxx_symbol_exists(pthread_setaffinity_np "pthread.h" HAVE_PTHREAD_SETAFFINITY_NP)
+check_cxx_symbol_exists(SO_REUSEPORT "sys/types.h;sys/socket.h" HAVE_REUSEPORT)
 check_cxx_symbol_exists(SHM_DEST "sys/types.h;sys/ipc.h;sys/shm.h" HAVE_SHMDEST)
 
 if (CYGWIN)
@@ -69,6 +73,13 @@ check_cxx_source_compiles("
       return st.st_mtim.tv_sec;
   }" HAVE_STATMTIM)
 
+check_cxx_source_compiles("
+  #include <linux/io_uring.h>
+  #include <sys/syscall.h>
+  int main(int, char**) {
+      return __NR_io_uring_setup + __NR_io_uring_enter + IORING_POLL_ADD_MULTI + IORING_ENTER_EXT_ARG;
+  }" HAVE_IO_URING)
+
 if (NOT DEFINED RCT_INCLUDE_DIR)
   set(RCT_INCLUDE_DIR "${CMAKE_CURRENT_BINARY_DIR}/include")
 endif ()
@@ -96,13 +107,20 @@ list(APPEND RCT_INCLUDE_DIRS ${CMAKE_CURRENT_LIST_DIR} ${RCT_INCLUDE_DIR})
 set(RCT_SOURCES
   ${RCT_SOURCES}
   ${CMAKE_CURRENT_LIST_DIR}/rct/Buffer.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/Compression.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Config.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Connection.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/CpuTopology.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/CpuUsage.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/DataFile.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Date.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/DnsCache.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/EventLoop.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/EventLoopGroup.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/FileSystemWatcher.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/Future.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Log.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/LogFile.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/MemoryMonitor.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Message.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/MessageQueue.cpp
@@ -111,6 +129,7 @@ set(RCT_SOURCES
   ${CMAKE_CURRENT_LIST_DIR}/rct/Process.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Rct.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/ReadWriteLock.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/ScalableReadWriteLock.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Semaphore.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/SharedMemory.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/SocketClient.cpp
@@ -119,9 +138,14 @@ set(RCT_SOURCES
   ${CMAKE_CURRENT_LIST_DIR}/rct/Thread.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/ThreadPool.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Timer.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/rct/TimerWheel.cpp
   ${CMAKE_CURRENT_LIST_DIR}/rct/Value.cpp
   ${CMAKE_CURRENT_LIST_DIR}/cJSON/cJSON.c)
 
+if (HAVE_IO_URING)
+  list(APPEND RCT_SOURCES ${CMAKE_CURRENT_LIST_DIR}/rct/IoUring.cpp)
+endif ()
+
 if (HAVE_INOTIFY EQUAL 1)
   list(APPEND RCT_SOURCES ${CMAKE_CURRENT_LIST_DIR}/rct/FileSystemWatcher_inotify.cpp)
 elseif (HAVE_FSEVENTS EQUAL 1)
@@ -264,16 +288,24 @@ if (NOT RCT_NO_INSTALL)
     rct/AES256CBC.h
     rct/Apply.h
     rct/Buffer.h
+    rct/Compression.h
     rct/Config.h
     rct/Connection.h
+    rct/CpuTopology.h
+    rct/DataFile.h
+    rct/DnsCache.h
     rct/EventLoop.h
+    rct/EventLoopGroup.h
     rct/FileSystemWatcher.h
+    rct/Future.h
     rct/List.h
     rct/Log.h
+    rct/LogFile.h
     rct/Map.h
     rct/MemoryMonitor.h
     rct/Message.h
     rct/MessageQueue.h
+    rct/Parallel.h
     rct/Path.h
     rct/Plugin.h
     rct/Point.h
@@ -284,7 +316,9 @@ if (NOT RCT_NO_INSTALL)
     rct/Rect.h
     rct/ResponseMessage.h
     rct/SHA256.h
+    rct/ScalableReadWriteLock.h
     rct/Semaphore.h
+    rct/SeqLock.h
     rct/Serializer.h
     rct/Set.h
     rct/SharedMemory.h
@@ -101,32 +101,47 @@ class Buffers
 {
 public:
     Buffers()
-        : mBufferOffset(0)
+        : mBufferOffset(0), mSize(0)
     {}
     void push(Buffer &&buf)
     {
+        mSize += buf.size();
         mBuffers.append(std::forward<Buffer>(buf));
     }
     size_t size() const
     {
-        size_t ret = 0;
-        for (const auto &buf : mBuffers)
-            ret += buf.size();
-        return ret - mBufferOffset;
+        return mSize;
+    }
+    // The next size bytes if they're all in one buffer, 0 otherwise. The
+    // pointer is valid until they're read or skipped.
+    const unsigned char *peek(size_t size) const
+    {
+        if (mBuffers.empty() || mBuffers.front().size() - mBufferOffset < size)
+            return 0;
+        return mBuffers.front().data() + mBufferOffset;
+    }
+    size_t skip(size_t size)
+    {
+        return consume(0, size);
     }
     size_t read(void *outPtr, size_t size)
+    {
+        return consume(static_cast<unsigned char *>(outPtr), size);
+    }
+private:
+    size_t consume(unsigned char *out, size_t size)
     {
         if (!size)
             return 0;
 
-        unsigned char *out = static_cast<unsigned char *>(outPtr);
         size_t read = 0, remaining = size;
         while (!mBuffers.empty()) {
             const auto &buf = mBuffers.front();
             const size_t bufferSize = buf.size() - mBufferOffset;
 
             if (remaining <= bufferSize) {
-                memcpy(out + read, buf.data() + mBufferOffset, remaining);
+                if (out)
+                    memcpy(out + read, buf.data() + mBufferOffset, remaining);
                 if (remaining == bufferSize) {
                     mBufferOffset = 0;
                     mBuffers.pop_front();
@@ -136,21 +151,23 @@ public:
                 read += remaining;
                 break;
             }
-            memcpy(out + read, buf.data() + mBufferOffset, bufferSize);
+            if (out)
+                memcpy(out + read, buf.data() + mBufferOffset, bufferSize);
             read += bufferSize;
             mBufferOffset = 0;
             remaining -= bufferSize;
             assert(!mBuffers.isEmpty());
             mBuffers.pop_front();
         }
+        mSize -= read;
         return read;
     }
-private:
+
     Buffers(const Buffers &) = delete;
     Buffers &operator=(const Buffers &) = delete;
 
     LinkedList<Buffer> mBuffers;
-    size_t mBufferOffset;
+    size_t mBufferOffset, mSize;
 };
 
 #endif
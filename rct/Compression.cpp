@@ -0,0 +1,323 @@
+#include "Compression.h"
+
+#include <limits.h>
+#ifdef RCT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "ThreadPool.h"
+
+enum { BufferSize = 64 * 1024 };
+
+class StringOutput : public Serializer::Buffer
+{
+public:
+    StringOutput(String &string)
+        : mString(string)
+    {}
+
+    virtual bool write(const void *data, int len) override
+    {
+        mString.append(static_cast<const char*>(data), len);
+        return true;
+    }
+    virtual int pos() const override { return mString.size(); }
+
+private:
+    String &mString;
+};
+
+Compressor::Compressor(std::unique_ptr<Serializer::Buffer> &&output, int level)
+    : mOutput(std::move(output)), mLevel(level), mStream(0), mStarted(false), mError(false),
+      mIn(0), mOut(0), mBlockSize(0), mPool(0)
+{
+#ifdef RCT_HAVE_ZLIB
+    mStream = new z_stream;
+    memset(mStream, 0, sizeof(z_stream));
+    if (deflateInit(mStream, level) != Z_OK) {
+        delete mStream;
+        mStream = 0;
+        mError = true;
+        return;
+    }
+    mBuffer.reset(new char[BufferSize]);
+    mStream->next_out = reinterpret_cast<Bytef*>(mBuffer.get());
+    mStream->avail_out = BufferSize;
+#else
+    mError = true;
+#endif
+}
+
+Compressor::Compressor(String &output, int level)
+    : Compressor(std::unique_ptr<Serializer::Buffer>(new StringOutput(output)), level)
+{
+}
+
+Compressor::~Compressor()
+{
+    finish();
+#ifdef RCT_HAVE_ZLIB
+    if (mStream) {
+        deflateEnd(mStream);
+        delete mStream;
+    }
+#endif
+}
+
+void Compressor::setBlockSize(size_t blockSize, ThreadPool *pool)
+{
+    assert(!mIn);
+    mBlockSize = blockSize;
+    mPool = pool ? pool : ThreadPool::instance();
+    if (mBlockSize)
+        mBlock.reserve(mBlockSize);
+}
+
+bool Compressor::write(const void *data, int len)
+{
+    if (mError)
+        return false;
+    mIn += len;
+    if (mBlockSize) {
+        const char *bytes = static_cast<const char*>(data);
+        while (len) {
+            const size_t chunk = std::min<size_t>(len, mBlockSize - mBlock.size());
+            mBlock.append(bytes, chunk);
+            bytes += chunk;
+            len -= chunk;
+            if (mBlock.size() == mBlockSize)
+                submitBlock();
+        }
+        return !mError;
+    }
+#ifdef RCT_HAVE_ZLIB
+    mStarted = true;
+    mStream->next_in = reinterpret_cast<Bytef*>(const_cast<void*>(data));
+    mStream->avail_in = len;
+    return run(Z_NO_FLUSH);
+#else
+    return false;
+#endif
+}
+
+// the buffer is only handed on when it's full or the stream finishes
+bool Compressor::run(int flush)
+{
+#ifdef RCT_HAVE_ZLIB
+    for (;;) {
+        const int ret = ::deflate(mStream, flush);
+        if (ret == Z_STREAM_ERROR) {
+            mError = true;
+            return false;
+        }
+        if (!mStream->avail_out) {
+            if (!writeOut(mBuffer.get(), BufferSize))
+                return false;
+            mStream->next_out = reinterpret_cast<Bytef*>(mBuffer.get());
+            mStream->avail_out = BufferSize;
+            continue;
+        }
+        if (flush == Z_FINISH ? ret == Z_STREAM_END : !mStream->avail_in)
+            return true;
+    }
+#else
+    (void)flush;
+    return false;
+#endif
+}
+
+bool Compressor::writeOut(const char *data, size_t len)
+{
+    while (len) {
+        const int chunk = std::min<size_t>(len, INT_MAX);
+        if (!mOutput->write(data, chunk)) {
+            mError = true;
+            return false;
+        }
+        mOut += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool Compressor::finish()
+{
+    if (mError)
+        return false;
+    if (mBlockSize) {
+        if (!mBlock.isEmpty())
+            submitBlock();
+        while (!mBlocks.isEmpty() && writeBlock()) {}
+        return !mError;
+    }
+#ifdef RCT_HAVE_ZLIB
+    if (!mStarted)
+        return true;
+    mStarted = false;
+    mStream->next_in = 0;
+    mStream->avail_in = 0;
+    if (!run(Z_FINISH))
+        return false;
+    const size_t pending = BufferSize - mStream->avail_out;
+    mStream->next_out = reinterpret_cast<Bytef*>(mBuffer.get());
+    mStream->avail_out = BufferSize;
+    deflateReset(mStream);
+    return !pending || writeOut(mBuffer.get(), pending);
+#else
+    return false;
+#endif
+}
+
+// a few blocks per thread are in flight, the oldest is waited for and
+// written before more are started
+void Compressor::submitBlock()
+{
+    std::shared_ptr<String> block = std::make_shared<String>(std::move(mBlock));
+    mBlock = String();
+    mBlock.reserve(mBlockSize);
+    const int level = mLevel;
+    const int threads = mPool->concurrentJobs();
+    if (threads < 1 || ThreadPool::current() == mPool) {
+        // a job on the pool waiting for blocks queued behind it could
+        // wait forever, it compresses them itself
+        while (!mBlocks.isEmpty() && writeBlock()) {}
+        const String compressed = block->compress(level);
+        if (compressed.isEmpty())
+            mError = true;
+        else
+            writeOut(compressed.constData(), compressed.size());
+        return;
+    }
+    mBlocks.append(mPool->submit([block, level]() { return block->compress(level); }));
+    while (mBlocks.size() > static_cast<size_t>(threads) * 2 && writeBlock()) {}
+}
+
+bool Compressor::writeBlock()
+{
+    const Future<String> block = std::move(mBlocks.front());
+    mBlocks.removeFirst();
+    const String &compressed = block.get();
+    if (compressed.isEmpty()) {
+        mError = true;
+        return false;
+    }
+    return writeOut(compressed.constData(), compressed.size());
+}
+
+Decompressor::Decompressor(const char *data, size_t len)
+    : mData(data), mLeft(len), mFile(0), mStream(0), mInStream(false), mEnded(false), mError(false),
+      mHasPeek(false), mPeek(0)
+{
+#ifdef RCT_HAVE_ZLIB
+    mStream = new z_stream;
+    memset(mStream, 0, sizeof(z_stream));
+    if (inflateInit(mStream) != Z_OK) {
+        delete mStream;
+        mStream = 0;
+        mError = mEnded = true;
+    }
+#else
+    mError = mEnded = true;
+#endif
+}
+
+Decompressor::Decompressor(FILE *file)
+    : Decompressor(0, 0)
+{
+    assert(file);
+    mFile = file;
+    mBuffer.reset(new char[BufferSize]);
+}
+
+Decompressor::~Decompressor()
+{
+#ifdef RCT_HAVE_ZLIB
+    if (mStream) {
+        inflateEnd(mStream);
+        delete mStream;
+    }
+#endif
+}
+
+// more input for zlib once it has used up what it had
+bool Decompressor::input()
+{
+#ifdef RCT_HAVE_ZLIB
+    if (mStream->avail_in)
+        return true;
+    if (mFile) {
+        const size_t r = fread(mBuffer.get(), sizeof(char), BufferSize, mFile);
+        mStream->next_in = reinterpret_cast<Bytef*>(mBuffer.get());
+        mStream->avail_in = r;
+        return r;
+    }
+    if (!mLeft)
+        return false;
+    const size_t chunk = std::min<size_t>(mLeft, UINT_MAX);
+    mStream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(mData));
+    mStream->avail_in = chunk;
+    mData += chunk;
+    mLeft -= chunk;
+    return true;
+#else
+    return false;
+#endif
+}
+
+int Decompressor::read(void *data, int len)
+{
+    if (len <= 0)
+        return 0;
+    char *out = static_cast<char*>(data);
+    int produced = 0;
+    if (mHasPeek) {
+        *out++ = mPeek;
+        mHasPeek = false;
+        if (!--len)
+            return 1;
+        produced = 1;
+    }
+#ifdef RCT_HAVE_ZLIB
+    if (mEnded)
+        return produced;
+    mStream->next_out = reinterpret_cast<Bytef*>(out);
+    mStream->avail_out = len;
+    while (mStream->avail_out) {
+        if (!input()) {
+            // the input stopped in the middle of a stream
+            if (mInStream)
+                mError = true;
+            mEnded = true;
+            break;
+        }
+        mInStream = true;
+        const int ret = ::inflate(mStream, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            // another one may follow
+            inflateReset(mStream);
+            mInStream = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            mError = mEnded = true;
+            break;
+        }
+    }
+    return produced + len - mStream->avail_out;
+#else
+    return produced;
+#endif
+}
+
+bool Decompressor::atEnd()
+{
+    if (mHasPeek)
+        return false;
+    if (mEnded)
+        return true;
+    char peek;
+    if (read(&peek, 1) != 1)
+        return true;
+    mPeek = peek;
+    mHasPeek = true;
+    return false;
+}
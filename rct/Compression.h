@@ -0,0 +1,106 @@
+#ifndef Compression_h
+#define Compression_h
+
+#include <stdio.h>
+
+#include <rct/Future.h>
+#include <rct/List.h>
+#include <rct/Serializer.h>
+#include <rct/String.h>
+
+class ThreadPool;
+struct z_stream_s;
+
+// zlib streams written and read a buffer at a time, memory use doesn't
+// depend on how much goes through. Needs zlib, without it writes fail
+// and nothing is read.
+
+// Compresses what's written to it into another Buffer. A Serializer
+// can write through it.
+class Compressor : public Serializer::Buffer
+{
+public:
+    enum {
+        // zlib's levels
+        FastLevel = 1,
+        DefaultLevel = 6,
+        BestLevel = 9
+    };
+
+    Compressor(std::unique_ptr<Serializer::Buffer> &&output, int level = FastLevel);
+    Compressor(String &output, int level = FastLevel);
+    // finishes the stream
+    virtual ~Compressor();
+
+    // Input is cut into blocks of blockSize that are compressed as
+    // streams of their own on pool, or ThreadPool::instance(), a few
+    // per thread at a time. The output is the streams one after the
+    // other, Decompressor reads them like one. Written from a job on
+    // pool they're compressed on the calling thread. Before anything is
+    // written, 0 turns it off again.
+    void setBlockSize(size_t blockSize, ThreadPool *pool = 0);
+
+    virtual bool write(const void *data, int len) override;
+    // what has been written to it, uncompressed
+    virtual int pos() const override { return static_cast<int>(mIn); }
+
+    // ends the stream, what's written next starts another one
+    bool finish();
+    bool hasError() const { return mError; }
+    // written to the output so far
+    size_t compressedSize() const { return mOut; }
+
+private:
+    Compressor(const Compressor &) = delete;
+    Compressor &operator=(const Compressor &) = delete;
+
+    bool run(int flush);
+    bool writeOut(const char *data, size_t len);
+    void submitBlock();
+    bool writeBlock();
+
+    std::unique_ptr<Serializer::Buffer> mOutput;
+    const int mLevel;
+    z_stream_s *mStream;
+    bool mStarted, mError;
+    size_t mIn, mOut;
+    std::unique_ptr<char[]> mBuffer;
+
+    size_t mBlockSize;
+    ThreadPool *mPool;
+    String mBlock;
+    List<Future<String> > mBlocks;
+};
+
+// Uncompresses one or more streams back to back for a Deserializer,
+// from memory or a FILE.
+class Decompressor : public Deserializer::Source
+{
+public:
+    // data has to stay around
+    Decompressor(const char *data, size_t len);
+    Decompressor(FILE *file);
+    virtual ~Decompressor();
+
+    virtual int read(void *data, int len) override;
+    virtual bool atEnd() override;
+
+    // the input is damaged or ends in the middle of a stream
+    bool hasError() const { return mError; }
+
+private:
+    Decompressor(const Decompressor &) = delete;
+    Decompressor &operator=(const Decompressor &) = delete;
+
+    bool input();
+
+    const char *mData;
+    size_t mLeft;
+    FILE *mFile;
+    z_stream_s *mStream;
+    std::unique_ptr<char[]> mBuffer;
+    bool mInStream, mEnded, mError, mHasPeek;
+    char mPeek;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "Connection.h"
 
 #include <assert.h>
+#include <sys/uio.h>
 
 #include "Connection.h"
 #include "EventLoop.h"
@@ -137,12 +138,22 @@ void Connection::onDataAvailable(const SocketClient::SharedPtr &client, Buffer&&
         if (available < static_cast<unsigned int>(mPendingRead))
             break;
 
-        StackBuffer<1024 * 16> buffer(mPendingRead);
-        const int read = mBuffers.read(buffer.buffer(), mPendingRead);
-        assert(read == mPendingRead);
+        // decode frames that arrived in one piece where they are, only
+        // ones split across reads are put together first
+        const int read = mPendingRead;
         mPendingRead = 0;
         Message::MessageError error;
-        std::shared_ptr<Message> message = Message::create(mVersion, buffer, read, &error);
+        std::shared_ptr<Message> message;
+        if (const unsigned char *frame = mBuffers.peek(read)) {
+            message = Message::create(mVersion, reinterpret_cast<const char *>(frame), read, &error);
+            mBuffers.skip(read);
+        } else {
+            StackBuffer<1024 * 16> buffer(read);
+            const int copied = mBuffers.read(buffer.buffer(), read);
+            assert(copied == read);
+            (void)copied;
+            message = Message::create(mVersion, buffer, read, &error);
+        }
         if (message) {
             auto that = shared_from_this();
             if (message->messageId() == FinishMessage::MessageId) {
@@ -221,12 +232,17 @@ bool Connection::send(const Message &message)
         message.prepare(mVersion, header, value);
         mPendingWrite += header.size() + value.size();
         assert(size == String::npos || size == (header.size() + value.size() - 4));
-        return (mSocketClient->write(header) && (value.isEmpty() || mSocketClient->write(value)));
+        iovec vecs[2];
+        vecs[0].iov_base = &header[0];
+        vecs[0].iov_len = header.size();
+        vecs[1].iov_base = &value[0];
+        vecs[1].iov_len = value.size();
+        return mSocketClient->write(vecs, value.isEmpty() ? 1 : 2);
     } else {
         mPendingWrite += (size + Message::HeaderExtra) + sizeof(int);
         Serializer serializer(std::unique_ptr<SocketClientBuffer>(new SocketClientBuffer(mSocketClient)));
         message.encodeHeader(serializer, size, mVersion);
         message.encode(serializer);
-        return !serializer.hasError();
+        return serializer.flush();
     }
 }
@@ -0,0 +1,130 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+
+#include "Map.h"
+
+static String readValue(const Path &path)
+{
+    return path.readAll(1024).trimmed();
+}
+
+static int readInt(const Path &path, int defaultValue)
+{
+    bool ok;
+    const String value = readValue(path);
+    const int ret = value.toLongLong(&ok);
+    return ok && !value.isEmpty() ? ret : defaultValue;
+}
+
+// groups cpus by key, the groups are ordered by their first cpu
+template <typename Key>
+static void group(List<CpuTopology::Cpu> &cpus, const List<Key> &keys, int CpuTopology::Cpu::*field, List<List<int> > &groups)
+{
+    Map<Key, int> indexes;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        typename Map<Key, int>::const_iterator it = indexes.find(keys[i]);
+        if (it == indexes.end()) {
+            it = indexes.insert(std::make_pair(keys[i], static_cast<int>(groups.size()))).first;
+            groups.append(List<int>());
+        }
+        cpus[i].*field = it->second;
+        groups[it->second].append(cpus[i].id);
+    }
+}
+
+List<int> CpuTopology::parseCpuList(const String &list)
+{
+    List<int> ret;
+    for (const String &range : list.trimmed().split(',', String::SkipEmpty)) {
+        const size_t dash = range.indexOf('-');
+        bool ok, ok2 = true;
+        const int first = range.left(dash).toLongLong(&ok);
+        const int last = dash == String::npos ? first : range.mid(dash + 1).toLongLong(&ok2);
+        if (!ok || !ok2 || last < first)
+            return List<int>();
+        for (int cpu = first; cpu <= last; ++cpu)
+            ret.append(cpu);
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+CpuTopology CpuTopology::read(const Path &root)
+{
+    CpuTopology topology;
+#ifdef OS_Linux
+    const Path cpuDir = root.ensureTrailingSlash() + "cpu/";
+    List<int> ids = parseCpuList(readValue(cpuDir + "online"));
+    if (ids.isEmpty())
+        return topology;
+
+    List<std::pair<int, int> > coreKeys;
+    List<String> cacheKeys;
+    for (int id : ids) {
+        const Path dir = cpuDir + "cpu" + String::number(id) + '/';
+        Cpu cpu = { id, readInt(dir + "topology/physical_package_id", 0), 0, 0, 0 };
+        topology.mCpus.append(cpu);
+        // cpus without topology are cores of their own
+        coreKeys.append(std::make_pair(cpu.package, readInt(dir + "topology/core_id", -1 - id)));
+
+        // the highest level data or unified cache
+        int level = -1;
+        String shared;
+        for (int index = 0; ; ++index) {
+            const Path cache = dir + "cache/index" + String::number(index) + '/';
+            if (!cache.isDir())
+                break;
+            const int l = readInt(cache + "level", -1);
+            if (l > level && readValue(cache + "type") != "Instruction") {
+                level = l;
+                shared = readValue(cache + "shared_cpu_list");
+            }
+        }
+        // without cache information a package shares one
+        cacheKeys.append(shared.isEmpty() ? "package" + String::number(cpu.package) : shared);
+    }
+    group(topology.mCpus, coreKeys, &Cpu::core, topology.mCores);
+    group(topology.mCpus, cacheKeys, &Cpu::cache, topology.mCaches);
+
+    List<int> nodeKeys(ids.size(), -1);
+    const Path nodeDir = root.ensureTrailingSlash() + "node/";
+    for (int node : parseCpuList(readValue(nodeDir + "online"))) {
+        for (int id : parseCpuList(readValue(nodeDir + "node" + String::number(node) + "/cpulist"))) {
+            const List<int>::const_iterator it = std::lower_bound(ids.begin(), ids.end(), id);
+            if (it != ids.end() && *it == id)
+                nodeKeys[it - ids.begin()] = node;
+        }
+    }
+    // cpus outside of any node go with the first one
+    int first = -1;
+    for (int node : nodeKeys) {
+        if (node != -1 && (first == -1 || node < first))
+            first = node;
+    }
+    for (int &node : nodeKeys) {
+        if (node == -1)
+            node = std::max(first, 0);
+    }
+    group(topology.mCpus, nodeKeys, &Cpu::node, topology.mNodes);
+#else
+    (void)root;
+#endif
+    return topology;
+}
+
+const CpuTopology &CpuTopology::system()
+{
+    static const CpuTopology topology = read();
+    return topology;
+}
+
+const CpuTopology::Cpu *CpuTopology::cpu(int id) const
+{
+    for (const Cpu &cpu : mCpus) {
+        if (cpu.id == id)
+            return &cpu;
+    }
+    return 0;
+}
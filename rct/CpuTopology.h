@@ -0,0 +1,48 @@
+#ifndef CpuTopology_h
+#define CpuTopology_h
+
+#include <rct/List.h>
+#include <rct/Path.h>
+#include <rct/String.h>
+
+// Logical cpus grouped by core (SMT siblings), last level cache and
+// NUMA node, as described by sysfs. Linux only, elsewhere the topology
+// is empty.
+class CpuTopology
+{
+public:
+    struct Cpu
+    {
+        int id;
+        int package;
+        // indexes into cores(), caches() and nodes()
+        int core, cache, node;
+    };
+
+    CpuTopology() {}
+
+    // root is the directory holding cpu/ and node/, a fake one can be
+    // passed for testing
+    static CpuTopology read(const Path &root = "/sys/devices/system");
+    static const CpuTopology &system();
+
+    bool isValid() const { return !mCpus.isEmpty(); }
+
+    // ordered by id
+    const List<Cpu> &cpus() const { return mCpus; }
+    const Cpu *cpu(int id) const;
+
+    // lists of cpu ids
+    const List<List<int> > &cores() const { return mCores; }
+    const List<List<int> > &caches() const { return mCaches; }
+    const List<List<int> > &nodes() const { return mNodes; }
+
+    // "0-3,8,10-11"
+    static List<int> parseCpuList(const String &list);
+
+private:
+    List<Cpu> mCpus;
+    List<List<int> > mCores, mCaches, mNodes;
+};
+
+#endif
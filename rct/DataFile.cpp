@@ -0,0 +1,463 @@
+#include "DataFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Compression.h"
+#include "Parallel.h"
+
+// The file starts with a header:
+//   uint32 magic, uint32 format, int32 version, uint32 crc of the above
+// followed by the sections back to back, then the index:
+//   per section: uint32 name length, name, uint64 offset, uint64 length,
+//                uint32 crc, uint32 flags
+//   uint32 section count
+// and a trailer:
+//   uint64 index offset, uint32 crc of the index, uint32 magic
+// All of it raw rather than through operator<< so it looks the same
+// with RCT_SERIALIZER_VERIFY_PRIMITIVE_SIZE.
+// The crcs are of what's in the file, compressed or not.
+static const uint32_t HeaderMagic = 0x48464452; // "RDFH"
+static const uint32_t IndexMagic = 0x49464452; // "RDFI"
+enum {
+    Format = 3,
+    HeaderSize = 4 * sizeof(uint32_t),
+    TrailerSize = sizeof(uint64_t) + 2 * sizeof(uint32_t),
+    // large sections are verified in parts of this size
+    VerifyChunkSize = 4 * 1024 * 1024
+};
+
+// Files without the header start with the version and the size of the
+// file, serialized.
+static inline size_t oldHeaderSize()
+{
+    return Serializer::sizeOf<int>() * 2;
+}
+
+template <typename T>
+static inline T readRaw(const char *data)
+{
+    T t;
+    memcpy(&t, data, sizeof(T));
+    return t;
+}
+
+// hands the serializer's output to the file, keeping count of the
+// offset and the checksum of the current section
+class DataFile::Output : public Serializer::Buffer
+{
+public:
+    Output(FILE *file)
+        : mFile(file), mOffset(0), mCrc(0)
+    {}
+
+    virtual bool write(const void *data, int len) override
+    {
+        mCrc = Rct::crc32c(data, len, mCrc);
+        mOffset += len;
+        return fwrite(data, sizeof(char), len, mFile) == static_cast<size_t>(len);
+    }
+    virtual int pos() const override { return static_cast<int>(mOffset); }
+
+    size_t offset() const { return mOffset; }
+    // the crc of what was written since the last call
+    uint32_t takeCrc()
+    {
+        const uint32_t crc = mCrc;
+        mCrc = 0;
+        return crc;
+    }
+
+private:
+    FILE *mFile;
+    size_t mOffset;
+    uint32_t mCrc;
+};
+
+DataFile::DataFile(const Path &path, int version)
+    : mFile(0), mOutput(0), mCompressor(0), mCompression(0), mCompressionBlockSize(0), mCompressionPool(0), mSerializer(0),
+      mDeserializer(0), mPath(path), mData(0), mSize(0), mMap(0), mDataEnd(0), mChecksums(false),
+      mVersion(version)
+{
+}
+
+DataFile::~DataFile()
+{
+    delete mDeserializer;
+    unmap();
+    if (mFile)
+        flush();
+}
+
+void DataFile::unmap()
+{
+    if (mMap) {
+        ::munmap(mMap, mSize);
+        mMap = 0;
+    }
+}
+
+bool DataFile::flush()
+{
+    if (!mFile)
+        return false;
+    endSection();
+    // past the compressor, if any
+    const uint64_t indexOffset = mOutput->offset();
+    String index;
+    for (const Section &section : mSections) {
+        const uint32_t nameLength = section.name.size();
+        index.append(reinterpret_cast<const char*>(&nameLength), sizeof(nameLength));
+        index += section.name;
+        const uint64_t range[] = { section.offset, section.length };
+        index.append(reinterpret_cast<const char*>(range), sizeof(range));
+        const uint32_t check[] = { section.crc, section.flags };
+        index.append(reinterpret_cast<const char*>(check), sizeof(check));
+    }
+    const uint32_t count = mSections.size();
+    index.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    bool ok = mOutput->write(index.constData(), index.size());
+    const uint32_t trailer[] = { static_cast<uint32_t>(indexOffset), static_cast<uint32_t>(indexOffset >> 32),
+                                 mOutput->takeCrc(), IndexMagic };
+    ok = mOutput->write(trailer, sizeof(trailer)) && ok && !mSerializer->hasError()
+        && (!mCompressor || !mCompressor->hasError());
+
+    delete mSerializer;
+    mSerializer = 0;
+    mCompressor = 0;
+    mOutput = 0;
+    // on disk before it's renamed over the old one
+    ok = !fflush(mFile) && !fsync(fileno(mFile)) && ok;
+    const int err = errno;
+    fclose(mFile);
+    mFile = 0;
+    if (!ok) {
+        Path::rm(mTempFilePath);
+        mError = String::format<128>("write error: %d %s", err, Rct::strerror(err).constData());
+        return false;
+    }
+    if (rename(mTempFilePath.constData(), mPath.constData())) {
+        Path::rm(mTempFilePath);
+        mError = String::format<128>("rename error: %d %s", errno, Rct::strerror().constData());
+        return false;
+    }
+    // and the rename too
+    const Path dir = mPath.parentDir();
+    int fd;
+    eintrwrap(fd, ::open(dir.isEmpty() ? "." : dir.constData(), O_RDONLY | O_CLOEXEC));
+    if (fd != -1) {
+        fsync(fd);
+        ::close(fd);
+    }
+    return true;
+}
+
+bool DataFile::open(Mode mode)
+{
+    assert(!mFile);
+    return mode == Write ? openWrite() : openRead();
+}
+
+bool DataFile::openWrite()
+{
+    if (!Path::mkdir(mPath.parentDir()))
+        return false;
+    mTempFilePath = mPath + "XXXXXX";
+    const int ret = mkstemp(&mTempFilePath[0]);
+    if (ret == -1) {
+        mError = String::format<128>("mkstemp failure %d (%s)", errno, Rct::strerror().constData());
+        return false;
+    }
+    mFile = fdopen(ret, "w");
+    if (!mFile) {
+        mError = String::format<128>("fdopen failure %d (%s)", errno, Rct::strerror().constData());
+        ::close(ret);
+        return false;
+    }
+    mOutput = new Output(mFile);
+    uint32_t header[] = { HeaderMagic, Format, static_cast<uint32_t>(mVersion), 0 };
+    header[3] = Rct::crc32c(header, sizeof(header) - sizeof(uint32_t));
+    mOutput->write(header, sizeof(header));
+    mOutput->takeCrc();
+    std::unique_ptr<Serializer::Buffer> output(mOutput);
+    if (mCompression) {
+        mCompressor = new Compressor(std::move(output), mCompression);
+        if (mCompressionBlockSize)
+            mCompressor->setBlockSize(mCompressionBlockSize, mCompressionPool);
+        output.reset(mCompressor);
+    }
+    mSerializer = new Serializer(std::move(output));
+    mSections.clear();
+    const Section unnamed = { String(), mOutput->offset(), 0, 0, 0 };
+    mSections.append(unnamed);
+    return true;
+}
+
+bool DataFile::openRead()
+{
+    int fd;
+    eintrwrap(fd, ::open(mPath.constData(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (fd != -1 && !::fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            mMap = map;
+            mData = static_cast<const char*>(map);
+            mSize = st.st_size;
+            // read front to back unless seek() says otherwise
+            ::madvise(mMap, mSize, MADV_SEQUENTIAL);
+        }
+    }
+    if (fd != -1)
+        ::close(fd);
+    if (!mMap) {
+        // not something that can be mapped, or empty
+        mContents = mPath.readAll();
+        if (mContents.isEmpty()) {
+            if (mPath.exists())
+                mError = "Read error " + mPath;
+            return false;
+        }
+        mData = mContents.constData();
+        mSize = mContents.size();
+    }
+
+    size_t start;
+    if (mSize >= HeaderSize && readRaw<uint32_t>(mData) == HeaderMagic) {
+        if (!readIndex())
+            return false;
+        start = HeaderSize;
+        mChecksums = true;
+        // compressed files have every section compressed
+        if (!mSections.isEmpty() && mSections.first().flags & Compressed) {
+            mDeserializer = deserializer(start, mDataEnd - start, true);
+            return true;
+        }
+    } else {
+        start = oldHeaderSize();
+        if (mSize < start) {
+            mError = String::format<128>("%s seems to be corrupted. Size was %zu", mPath.constData(), mSize);
+            return false;
+        }
+        Deserializer header(mData, start);
+        int version;
+        header >> version;
+        if (version != mVersion) {
+            mError = String::format<128>("Wrong database version. Expected %d, got %d for %s.",
+                                         mVersion, version, mPath.constData());
+            return false;
+        }
+        int fs;
+        header >> fs;
+        if (static_cast<size_t>(fs) != mSize) {
+            mError = String::format<128>("%s seems to be corrupted. Size should have been %zu but was %d",
+                                         mPath.constData(), mSize, fs);
+            return false;
+        }
+        mDataEnd = mSize;
+    }
+    mDeserializer = deserializer(start, mDataEnd - start, false);
+    return true;
+}
+
+bool DataFile::readIndex()
+{
+    if (Rct::crc32c(mData, HeaderSize - sizeof(uint32_t)) != readRaw<uint32_t>(mData + HeaderSize - sizeof(uint32_t))) {
+        mError = String::format<128>("%s seems to be corrupted. Bad header", mPath.constData());
+        return false;
+    }
+    const uint32_t format = readRaw<uint32_t>(mData + sizeof(uint32_t));
+    if (format != Format) {
+        mError = String::format<128>("Unknown format %u for %s", format, mPath.constData());
+        return false;
+    }
+    const int version = readRaw<int32_t>(mData + 2 * sizeof(uint32_t));
+    if (version != mVersion) {
+        mError = String::format<128>("Wrong database version. Expected %d, got %d for %s.",
+                                     mVersion, version, mPath.constData());
+        return false;
+    }
+
+    // from here on anything that doesn't add up is a truncated or
+    // otherwise damaged file
+    mError = String::format<128>("%s seems to be corrupted. Bad index", mPath.constData());
+    if (mSize < HeaderSize + sizeof(uint32_t) + TrailerSize)
+        return false;
+    const char *trailer = mData + mSize - TrailerSize;
+    const uint64_t indexOffset = readRaw<uint32_t>(trailer) | (static_cast<uint64_t>(readRaw<uint32_t>(trailer + 4)) << 32);
+    const size_t indexEnd = mSize - TrailerSize;
+    if (readRaw<uint32_t>(trailer + 12) != IndexMagic || indexOffset < HeaderSize || indexOffset > indexEnd - sizeof(uint32_t))
+        return false;
+    if (Rct::crc32c(mData + indexOffset, indexEnd - indexOffset) != readRaw<uint32_t>(trailer + 8))
+        return false;
+
+    List<Section> sections;
+    size_t pos = indexOffset, end = HeaderSize;
+    const size_t countOffset = indexEnd - sizeof(uint32_t);
+    const uint32_t count = readRaw<uint32_t>(mData + countOffset);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (countOffset - pos < sizeof(uint32_t))
+            return false;
+        const uint32_t nameLength = readRaw<uint32_t>(mData + pos);
+        pos += sizeof(uint32_t);
+        const size_t entrySize = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+        if (countOffset - pos < nameLength || countOffset - pos - nameLength < entrySize)
+            return false;
+        Section section = { String(mData + pos, nameLength), 0, 0, 0, 0 };
+        pos += nameLength;
+        const uint64_t offset = readRaw<uint64_t>(mData + pos), length = readRaw<uint64_t>(mData + pos + 8);
+        section.crc = readRaw<uint32_t>(mData + pos + 16);
+        section.flags = readRaw<uint32_t>(mData + pos + 20);
+        pos += entrySize;
+        // in order, not overlapping
+        if (offset < end || offset > indexOffset || length > indexOffset - offset)
+            return false;
+        section.offset = offset;
+        section.length = length;
+        end = offset + length;
+        sections.append(std::move(section));
+    }
+    if (pos != countOffset)
+        return false;
+    mError.clear();
+    mSections = std::move(sections);
+    mDataEnd = indexOffset;
+    return true;
+}
+
+void DataFile::beginSection(const String &name)
+{
+    assert(mSerializer);
+    endSection();
+    const Section section = { name, mOutput->offset(), 0, 0, 0 };
+    mSections.append(section);
+}
+
+void DataFile::endSection()
+{
+    mSerializer->flush();
+    if (mCompressor)
+        mCompressor->finish();
+    Section &section = mSections.last();
+    section.length = mOutput->offset() - section.offset;
+    section.crc = mOutput->takeCrc();
+    section.flags = mCompressor ? Compressed : 0;
+    // nothing was written before the first named one
+    if (section.name.isEmpty() && !section.length)
+        mSections.removeLast();
+}
+
+const DataFile::Section *DataFile::findSection(const String &name) const
+{
+    for (const Section &section : mSections) {
+        if (section.name == name)
+            return &section;
+    }
+    return 0;
+}
+
+List<String> DataFile::sections() const
+{
+    List<String> ret;
+    ret.reserve(mSections.size());
+    for (const Section &section : mSections) {
+        if (!section.name.isEmpty())
+            ret.append(section.name);
+    }
+    return ret;
+}
+
+bool DataFile::hasSection(const String &name) const
+{
+    return findSection(name);
+}
+
+bool DataFile::seek(const String &name)
+{
+    assert(mData);
+    const Section *section = findSection(name);
+    if (!section)
+        return false;
+    if (mMap) {
+        // only this part is needed, and soon
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t start = section->offset - (section->offset % page);
+        ::madvise(static_cast<char*>(mMap) + start, section->offset + section->length - start, MADV_WILLNEED);
+    }
+    delete mDeserializer;
+    mDeserializer = deserializer(section->offset, section->length, section->flags & Compressed);
+    return true;
+}
+
+Deserializer *DataFile::deserializer(size_t offset, size_t length, bool compressed) const
+{
+    if (compressed)
+        return new Deserializer(std::unique_ptr<Deserializer::Source>(new Decompressor(mData + offset, length)));
+    return new Deserializer(mData + offset, length);
+}
+
+bool DataFile::verifySection(const String &name)
+{
+    const Section *section = findSection(name);
+    if (!section) {
+        mError = String::format<128>("No section %s in %s", name.constData(), mPath.constData());
+        return false;
+    }
+    List<const Section*> sections;
+    sections.append(section);
+    return verifySections(sections, 0);
+}
+
+bool DataFile::verify(ThreadPool *pool)
+{
+    List<const Section*> sections;
+    sections.reserve(mSections.size());
+    for (const Section &section : mSections)
+        sections.append(&section);
+    return verifySections(sections, pool);
+}
+
+// Sections are cut into parts that are checked independently, the
+// crcs of the parts are combined into the section's afterwards
+bool DataFile::verifySections(const List<const Section*> &sections, ThreadPool *pool)
+{
+    assert(mData);
+    if (!mChecksums)
+        return true;
+    struct Part {
+        const Section *section;
+        size_t offset, length;
+    };
+    List<Part> parts;
+    for (const Section *section : sections) {
+        size_t offset = 0;
+        do {
+            const Part part = { section, offset, std::min<size_t>(VerifyChunkSize, section->length - offset) };
+            parts.append(part);
+            offset += part.length;
+        } while (offset < section->length);
+    }
+    List<uint32_t> crcs(parts.size());
+    Rct::parallelFor(0, parts.size(), 1, [this, &parts, &crcs](size_t idx) {
+            const Part &part = parts[idx];
+            crcs[idx] = Rct::crc32c(mData + part.section->offset + part.offset, part.length);
+        }, pool);
+
+    for (size_t idx = 0; idx < parts.size(); ) {
+        const Section *section = parts[idx].section;
+        uint32_t crc = crcs[idx++];
+        while (idx < parts.size() && parts[idx].section == section) {
+            crc = Rct::crc32cCombine(crc, crcs[idx], parts[idx].length);
+            ++idx;
+        }
+        if (crc != section->crc) {
+            mError = String::format<128>("%s seems to be corrupted. Bad checksum for section %s",
+                                         mPath.constData(), section->name.constData());
+            return false;
+        }
+    }
+    return true;
+}
@@ -3,100 +3,72 @@
 
 #include <stdio.h>
 
+#include "List.h"
 #include "Path.h"
 #include "Serializer.h"
 
+class Compressor;
+class ThreadPool;
+
+// A versioned file of serialized data, written to a temporary file
+// that's synced and renamed over the path on flush(). Read from a
+// private mapping of the file.
+//
+// The contents are split into named sections with beginSection(),
+// whatever is written before the first one goes in a section without a
+// name. Each section has a CRC-32C in an index at the end of the file.
+// Readers can seek() to a section and decode only that one, or read
+// everything in order. Checksums are only checked by verify() and
+// verifySection(). Sections can be compressed as they're written, each
+// on its own, and are uncompressed as they're read.
+//
+// Files written before the index existed have the version and their
+// size up front, those are still read, but have no sections or
+// checksums.
 class DataFile
 {
 public:
-    DataFile(const Path &path, int version)
-        : mFile(0), mSizeOffset(-1), mSerializer(0), mDeserializer(0), mPath(path), mVersion(version)
-    {}
-
-    ~DataFile()
-    {
-        delete mDeserializer;
-        if (mFile)
-            flush();
-    }
+    DataFile(const Path &path, int version);
+    ~DataFile();
 
     Path path() const { return mPath; }
 
-    bool flush()
-    {
-        if (!mFile)
-            return false;
-        const int size = ftell(mFile);
-        assert(mSizeOffset != -1);
-        fseek(mFile, mSizeOffset, SEEK_SET);
-        operator<<(size);
-
-        fclose(mFile);
-        mFile = 0;
-        delete mSerializer;
-        mSerializer = 0;
-        if (rename(mTempFilePath.constData(), mPath.constData())) {
-            Path::rm(mTempFilePath);
-            mError = String::format<128>("rename error: %d %s", errno, Rct::strerror().constData());
-            return false;
-        }
-        return true;
-    }
+    bool flush();
 
     enum Mode {
         Read,
         Write
     };
     String error() const { return mError; }
-    bool open(Mode mode)
+    bool open(Mode mode);
+
+    // Before open(Write), a zlib level, 0 for none. With a blockSize
+    // sections are compressed in blocks of that size across pool or
+    // ThreadPool::instance().
+    void setCompression(int level, size_t blockSize = 0, ThreadPool *pool = 0)
     {
-        assert(!mFile);
-        if (mode == Write) {
-            if (!Path::mkdir(mPath.parentDir()))
-                return false;
-            mTempFilePath = mPath + "XXXXXX";
-            const int ret = mkstemp(&mTempFilePath[0]);
-            if (ret == -1) {
-                mError = String::format<128>("mkstemp failure %d (%s)", errno, Rct::strerror().constData());
-                return false;
-            }
-            mFile = fdopen(ret, "w");
-            if (!mFile) {
-                mError = String::format<128>("fdopen failure %d (%s)", errno, Rct::strerror().constData());
-                close(ret);
-                return false;
-            }
-            mSerializer = new Serializer(mFile);
-            operator<<(mVersion);
-            mSizeOffset = ftell(mFile);
-            operator<<(static_cast<int>(0));
-            return true;
-        } else {
-            mContents = mPath.readAll();
-            if (mContents.isEmpty()) {
-                if (mPath.exists())
-                    mError = "Read error " + mPath;
-                return false;
-            }
-            mDeserializer = new Deserializer(mContents);
-            int version;
-            (*mDeserializer) >> version;
-            if (version != mVersion) {
-                mError = String::format<128>("Wrong database version. Expected %d, got %d for %s.",
-                                             mVersion, version, mPath.constData());
-                return false;
-            }
-            int fs;
-            (*mDeserializer) >> fs;
-            if (static_cast<size_t>(fs) != mContents.size()) {
-                mError = String::format<128>("%s seems to be corrupted. Size should have been %zu but was %d",
-                                             mPath.constData(), mContents.size(), fs);
-                return false;
-            }
-            return true;
-        }
+        mCompression = level;
+        mCompressionBlockSize = blockSize;
+        mCompressionPool = pool;
     }
 
+    // ends the previous section and starts one at what's written next
+    void beginSection(const String &name);
+
+    // the named ones
+    List<String> sections() const;
+    bool hasSection(const String &name) const;
+    // reading continues at the start of the section and stops at its end
+    bool seek(const String &name);
+
+    // false if the section's checksum doesn't match, sets error()
+    bool verifySection(const String &name);
+    // every section, large ones in parts, across pool or
+    // ThreadPool::instance()
+    bool verify(ThreadPool *pool = 0);
+
+    bool atEnd() const { return !mDeserializer || mDeserializer->atEnd(); }
+
     template <typename T> DataFile &operator<<(const T &t)
     {
         assert(mSerializer);
@@ -110,12 +82,47 @@ public:
         return *this;
     }
 private:
+    DataFile(const DataFile &) = delete;
+    DataFile &operator=(const DataFile &) = delete;
+
+    bool openWrite();
+    bool openRead();
+    bool readIndex();
+    void endSection();
+    void unmap();
+    Deserializer *deserializer(size_t offset, size_t length, bool compressed) const;
+
+    enum SectionFlag {
+        Compressed = 0x1
+    };
+    struct Section {
+        String name;
+        size_t offset, length;
+        uint32_t crc, flags;
+    };
+    const Section *findSection(const String &name) const;
+    bool verifySections(const List<const Section*> &sections, ThreadPool *pool);
+
+    class Output;
+
     FILE *mFile;
-    int mSizeOffset;
+    Output *mOutput;
+    Compressor *mCompressor;
+    int mCompression;
+    size_t mCompressionBlockSize;
+    ThreadPool *mCompressionPool;
     Serializer *mSerializer;
     Deserializer *mDeserializer;
     Path mPath, mTempFilePath;
+    // the file when it couldn't be mapped
     String mContents;
+    const char *mData;
+    size_t mSize;
+    void *mMap;
+    // where sections stop and the index or table starts
+    size_t mDataEnd;
+    bool mChecksums;
+    List<Section> mSections;
     String mError;
     const int mVersion;
 };
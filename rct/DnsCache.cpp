@@ -0,0 +1,259 @@
+#include "DnsCache.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include "Rct.h"
+#include "Thread.h"
+
+class DnsCacheThread : public Thread
+{
+public:
+    DnsCacheThread(DnsCache* cache)
+        : mCache(cache)
+    {
+        setAutoDelete(false);
+    }
+
+protected:
+    virtual void run() override
+    {
+        mCache->processRequests();
+    }
+
+private:
+    DnsCache* mCache;
+};
+
+DnsCache::DnsCache()
+    : mLookup(&DnsCache::systemLookup), mTtl(60000), mMaxEntries(1024), mLookupCount(0), mStop(false), mThread(0)
+{
+}
+
+DnsCache::~DnsCache()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mStop = true;
+    mCond.notify_one();
+    lock.unlock();
+    if (mThread) {
+        mThread->join();
+        delete mThread;
+    }
+}
+
+DnsCache* DnsCache::instance()
+{
+    static DnsCache cache;
+    return &cache;
+}
+
+String DnsCache::key(const String& host, uint16_t port, int family)
+{
+    return String::format<128>("%s:%u:%d", host.constData(), port, family);
+}
+
+bool DnsCache::parseNumeric(const String& host, uint16_t port, int family, Address* address)
+{
+    if (family != AF_INET6) {
+        sockaddr_in* addr4 = reinterpret_cast<sockaddr_in*>(&address->storage);
+        if (inet_pton(AF_INET, host.constData(), &addr4->sin_addr) == 1) {
+            addr4->sin_family = AF_INET;
+            addr4->sin_port = htons(port);
+            address->size = sizeof(sockaddr_in);
+            return true;
+        }
+    }
+    if (family != AF_INET) {
+        sockaddr_in6* addr6 = reinterpret_cast<sockaddr_in6*>(&address->storage);
+        if (inet_pton(AF_INET6, host.constData(), &addr6->sin6_addr) == 1) {
+            addr6->sin6_family = AF_INET6;
+            addr6->sin6_port = htons(port);
+            address->size = sizeof(sockaddr_in6);
+            return true;
+        }
+    }
+    return false;
+}
+
+DnsCache::Address DnsCache::systemLookup(const String& host, uint16_t port, int family)
+{
+    Address address;
+    addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.constData(), NULL, &hints, &res) != 0)
+        return address;
+
+    for (addrinfo* p = res; p; p = p->ai_next) {
+        if (p->ai_family == AF_INET) {
+            memcpy(&address.storage, p->ai_addr, sizeof(sockaddr_in));
+            reinterpret_cast<sockaddr_in*>(&address.storage)->sin_port = htons(port);
+            address.size = sizeof(sockaddr_in);
+            break;
+        } else if (p->ai_family == AF_INET6) {
+            memcpy(&address.storage, p->ai_addr, sizeof(sockaddr_in6));
+            reinterpret_cast<sockaddr_in6*>(&address.storage)->sin6_port = htons(port);
+            address.size = sizeof(sockaddr_in6);
+            break;
+        }
+    }
+    freeaddrinfo(res);
+    return address;
+}
+
+bool DnsCache::lookup(const String& host, uint16_t port, int family, Address* address)
+{
+    if (parseNumeric(host, port, family, address))
+        return true;
+
+    const String k = key(host, port, family);
+    std::lock_guard<std::mutex> lock(mMutex);
+    Hash<String, Entry>::iterator it = mCache.find(k);
+    if (it == mCache.end())
+        return false;
+    if (it->second.expires <= Rct::monoMs()) {
+        mCache.erase(it);
+        return false;
+    }
+    *address = it->second.address;
+    return true;
+}
+
+DnsCache::Address DnsCache::lookupAndCache(const String& key, const String& host, uint16_t port, int family)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    const Lookup lookup = mLookup;
+    ++mLookupCount;
+    lock.unlock();
+
+    const Address address = lookup(host, port, family);
+
+    // failures aren't cached, the next attempt tries again
+    if (address.isValid()) {
+        lock.lock();
+        if (mCache.size() >= mMaxEntries && !mCache.contains(key))
+            prune(mMaxEntries - 1);
+        Entry& entry = mCache[key];
+        entry.address = address;
+        entry.expires = Rct::monoMs() + mTtl;
+    }
+    return address;
+}
+
+DnsCache::Address DnsCache::resolve(const String& host, uint16_t port, int family)
+{
+    Address address;
+    if (lookup(host, port, family, &address))
+        return address;
+    return lookupAndCache(key(host, port, family), host, port, family);
+}
+
+void DnsCache::resolveAsync(const String& host, uint16_t port, int family, std::function<void(const Address&)>&& callback)
+{
+    Address address;
+    if (lookup(host, port, family, &address)) {
+        callback(address);
+        return;
+    }
+    EventLoop::SharedPtr loop = EventLoop::eventLoop();
+    if (!loop) {
+        // no loop to come back to
+        callback(resolve(host, port, family));
+        return;
+    }
+
+    const String k = key(host, port, family);
+    std::lock_guard<std::mutex> lock(mMutex);
+    List<Waiter>& waiters = mPending[k];
+    waiters.append(Waiter());
+    waiters.last().loop = loop;
+    waiters.last().callback = std::move(callback);
+    if (waiters.size() > 1)
+        return;
+
+    Request request;
+    request.key = k;
+    request.host = host;
+    request.port = port;
+    request.family = family;
+    mRequests.append(std::move(request));
+    if (!mThread) {
+        mThread = new DnsCacheThread(this);
+        mThread->start();
+    }
+    mCond.notify_one();
+}
+
+void DnsCache::setLookup(Lookup&& lookup)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLookup = lookup ? std::move(lookup) : Lookup(&DnsCache::systemLookup);
+    mCache.clear();
+}
+
+void DnsCache::setMaxEntries(size_t maxEntries)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxEntries = std::max<size_t>(maxEntries, 1);
+    prune(mMaxEntries);
+}
+
+void DnsCache::prune(size_t maxEntries)
+{
+    const uint64_t now = Rct::monoMs();
+    Hash<String, Entry>::iterator it = mCache.begin();
+    while (it != mCache.end()) {
+        if (it->second.expires <= now) {
+            it = mCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (mCache.size() > maxEntries) {
+        Hash<String, Entry>::iterator oldest = mCache.begin();
+        for (it = mCache.begin(); it != mCache.end(); ++it) {
+            if (it->second.expires < oldest->second.expires)
+                oldest = it;
+        }
+        mCache.erase(oldest);
+    }
+}
+
+void DnsCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCache.clear();
+}
+
+void DnsCache::processRequests()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        while (mRequests.isEmpty() && !mStop)
+            mCond.wait(lock);
+        if (mStop)
+            return;
+        const Request request = mRequests.first();
+        mRequests.pop_front();
+        lock.unlock();
+
+        const Address address = lookupAndCache(request.key, request.host, request.port, request.family);
+
+        lock.lock();
+        List<Waiter> waiters;
+        std::swap(waiters, mPending[request.key]);
+        mPending.erase(request.key);
+        lock.unlock();
+        for (const Waiter& waiter : waiters) {
+            if (EventLoop::SharedPtr loop = waiter.loop.lock()) {
+                const std::function<void(const Address&)> callback = waiter.callback;
+                loop->callLater([callback, address]() { callback(address); });
+            }
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <rct/EventLoop.h>
+#include <rct/Hash.h>
+#include <rct/LinkedList.h>
+#include <rct/List.h>
+#include <rct/String.h>
+
+class DnsCacheThread;
+
+// Host name resolution for SocketClient. Numeric addresses are parsed
+// in place, names are looked up with getaddrinfo() and the result is
+// kept for ttl() ms keyed by host, port and family, at most
+// maxEntries() of them. resolveAsync() does
+// the lookup on a worker thread and calls back on the caller's
+// EventLoop so nothing blocks the loop. The lookup function can be
+// replaced, e.g. with a stub for tests.
+class DnsCache
+{
+public:
+    struct Address
+    {
+        Address() : size(0) { memset(&storage, 0, sizeof(storage)); }
+
+        bool isValid() const { return size != 0; }
+        const sockaddr* addr() const { return reinterpret_cast<const sockaddr*>(&storage); }
+        int family() const { return storage.ss_family; }
+
+        sockaddr_storage storage;
+        socklen_t size;
+    };
+
+    // family is AF_UNSPEC, AF_INET or AF_INET6. Returns an invalid
+    // address on failure.
+    typedef std::function<Address(const String& host, uint16_t port, int family)> Lookup;
+
+    DnsCache();
+    ~DnsCache();
+
+    static DnsCache* instance();
+
+    // Numeric addresses and cached names only, never blocks
+    bool lookup(const String& host, uint16_t port, int family, Address* address);
+    // Blocks while the name is looked up on a cache miss
+    Address resolve(const String& host, uint16_t port, int family);
+    // Calls back on the calling thread's EventLoop, or right away if
+    // the answer is known. Concurrent requests for the same name are
+    // looked up once.
+    void resolveAsync(const String& host, uint16_t port, int family, std::function<void(const Address&)>&& callback);
+
+    int ttl() const { std::lock_guard<std::mutex> lock(mMutex); return mTtl; }
+    void setTtl(int ttl) { std::lock_guard<std::mutex> lock(mMutex); mTtl = ttl; }
+    // Expired entries are dropped when the cache is full, then the ones
+    // closest to expiring
+    size_t maxEntries() const { std::lock_guard<std::mutex> lock(mMutex); return mMaxEntries; }
+    void setMaxEntries(size_t maxEntries);
+    size_t size() const { std::lock_guard<std::mutex> lock(mMutex); return mCache.size(); }
+    void setLookup(Lookup&& lookup);
+    void clear();
+
+    // number of times the lookup function has been called
+    size_t lookupCount() const { std::lock_guard<std::mutex> lock(mMutex); return mLookupCount; }
+
+    static bool parseNumeric(const String& host, uint16_t port, int family, Address* address);
+    static Address systemLookup(const String& host, uint16_t port, int family);
+
+private:
+    static String key(const String& host, uint16_t port, int family);
+    Address lookupAndCache(const String& key, const String& host, uint16_t port, int family);
+    void processRequests();
+    void prune(size_t maxEntries);
+
+    struct Entry
+    {
+        Address address;
+        uint64_t expires;
+    };
+    struct Request
+    {
+        String key, host;
+        uint16_t port;
+        int family;
+    };
+    struct Waiter
+    {
+        EventLoop::WeakPtr loop;
+        std::function<void(const Address&)> callback;
+    };
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCond;
+    Hash<String, Entry> mCache;
+    Hash<String, List<Waiter> > mPending;
+    LinkedList<Request> mRequests;
+    Lookup mLookup;
+    int mTtl;
+    size_t mMaxEntries;
+    size_t mLookupCount;
+    bool mStop;
+    DnsCacheThread* mThread;
+
+    friend class DnsCacheThread;
+private:
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+};
+
+#endif
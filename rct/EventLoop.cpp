@@ -2,8 +2,10 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,14 +17,21 @@
 #include <algorithm>
 #include <atomic>
 #include <set>
-#ifdef HAVE_MACH_ABSOLUTE_TIME
-#  include <mach/mach.h>
-#  include <mach/mach_time.h>
+#ifdef HAVE_EVENTFD
+#  include <sys/eventfd.h>
+#endif
+#ifdef HAVE_IO_URING
+#  include <poll.h>
 #endif
 
+#include "Buffer.h"
 #include "Rct.h"
 #include "SocketClient.h"
 #include "Timer.h"
+#include "TimerWheel.h"
+#ifdef HAVE_IO_URING
+#  include "IoUring.h"
+#endif
 #if defined(RCT_EVENTLOOP_CALLBACK_TIME_THRESHOLD) && RCT_EVENTLOOP_CALLBACK_TIME_THRESHOLD > 0
 #  include "Log.h"
 #  include "StopWatch.h"
@@ -57,12 +66,25 @@
 EventLoop::WeakPtr EventLoop::sMainLoop;
 std::mutex EventLoop::mMainMutex;
 static std::atomic<int> sMainEventPipe;
+#ifdef HAVE_EVENTFD
+// an eventfd can't carry the 'q' the pipe gets, flag it on the side
+static std::atomic<bool> sSignalCaught;
+#endif
 static std::once_flag sMainOnce;
 static pthread_key_t sEventLoopKey;
 
 // sadly GCC < 4.8 doesn't support thread_local
 // fall back to pthread instead in order to support 4.7
 
+// the loop exec() is running on the calling thread, for cachedTime()
+static pthread_key_t sRunningLoopKey;
+static pthread_once_t sRunningLoopOnce = PTHREAD_ONCE_INIT;
+
+static void createRunningLoopKey()
+{
+    pthread_key_create(&sRunningLoopKey, 0);
+}
+
 static EventLoop::WeakPtr& localEventLoop()
 {
     EventLoop::WeakPtr* ptr = static_cast<EventLoop::WeakPtr*>(pthread_getspecific(sEventLoopKey));
@@ -75,20 +97,32 @@ static EventLoop::WeakPtr& localEventLoop()
 
 static void signalHandler(int /*sig*/)
 {
-    char b = 'q';
     int w;
     const int pipe = sMainEventPipe;
-    if (pipe != -1)
+    if (pipe != -1) {
+#ifdef HAVE_EVENTFD
+        sSignalCaught = true;
+        const uint64_t one = 1;
+        eintrwrap(w, ::write(pipe, &one, sizeof(one)));
+#else
+        char b = 'q';
         eintrwrap(w, ::write(pipe, &b, 1));
+#endif
+    }
 }
 
 EventLoop::EventLoop()
-    :
+    : mPostedEvents(0), mPendingEvents(0), mWakeupPending(false),
 #if defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
     mPollFd(-1),
 #endif
-    mNextTimerId(0), mStop(false), mTimeout(false), mFlags(0), mInactivityTimeout(0)
+    mSocketCount(0), mDispatchDepth(0),
+#if defined(HAVE_IO_URING)
+    mNextPollId(0),
+#endif
+    mNextTimerId(0), mNow(0), mStop(false), mTimeout(false), mFlags(0), mInactivityTimeout(0)
 {
+    mEventPipe[0] = mEventPipe[1] = -1;
     std::call_once(sMainOnce, [this](){
             atexit(&EventLoop::cleanupLocalEventLoop);
             sMainEventPipe = -1;
@@ -111,23 +145,44 @@ void EventLoop::cleanupLocalEventLoop()
     }
 }
 
+static inline uint64_t currentTime();
+
 void EventLoop::init(unsigned int flags)
 {
     std::lock_guard<std::mutex> locker(mMutex);
     mFlags = flags;
+    if (mFlags & EnableTimerWheel)
+        mTimerWheel.reset(new TimerWheel(currentTime()));
+    refreshTime();
 
     threadId = std::this_thread::get_id();
+#ifdef HAVE_EVENTFD
+    int e = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mEventPipe[0] = mEventPipe[1] = e;
+#else
     int e = ::pipe(mEventPipe);
+#endif
     if (e == -1) {
         mEventPipe[0] = -1;
         mEventPipe[1] = -1;
         cleanup();
         return;
     }
+#ifndef HAVE_EVENTFD
     if (!SocketClient::setFlags(mEventPipe[0], O_NONBLOCK, F_GETFL, F_SETFL)) {
         cleanup();
         return;
     }
+#endif
+
+#if defined(HAVE_IO_URING)
+    if ((mFlags & EnableIoUring) && !initRing()) {
+        // too old a kernel or io_uring is disabled, use epoll
+        mFlags &= ~EnableIoUring;
+    }
+#else
+    mFlags &= ~EnableIoUring;
+#endif
 
 #if defined(HAVE_EPOLL)
     mPollFd = epoll_create1(0);
@@ -199,12 +254,15 @@ void EventLoop::init(unsigned int flags)
 void EventLoop::cleanup()
 {
     std::lock_guard<std::mutex> locker(mMutex);
-    localEventLoop().reset();
+    // the last reference to a loop may go away on another thread (e.g.
+    // an EventLoopGroup being stopped), don't forget that thread's loop
+    EventLoop::WeakPtr& local = localEventLoop();
+    if (local.expired())
+        local.reset();
 
-    while (!mEvents.empty()) {
-        delete mEvents.front();
-        mEvents.pop();
-    }
+    deleteEvents(mPendingEvents);
+    mPendingEvents = 0;
+    deleteEvents(mPostedEvents.exchange(0));
 
     for (auto timer : mTimersById) {
         delete timer;
@@ -212,6 +270,8 @@ void EventLoop::cleanup()
     mTimersById.clear();
     mTimersByTime.clear();
     mNextTimerId = 0;
+    if (mTimerWheel)
+        mTimerWheel->clear();
 
     if (mFlags & (EnableSigIntHandler | EnableSigTermHandler)) {
         struct sigaction act;
@@ -227,6 +287,9 @@ void EventLoop::cleanup()
         }
     }
 
+#if defined(HAVE_IO_URING)
+    mRing.reset();
+#endif
 #if defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
     if (mPollFd != -1)
         ::close(mPollFd);
@@ -234,8 +297,9 @@ void EventLoop::cleanup()
 
     if (mEventPipe[0] != -1)
         ::close(mEventPipe[0]);
-    if (mEventPipe[1] != -1)
+    if (mEventPipe[1] != -1 && mEventPipe[1] != mEventPipe[0])
         ::close(mEventPipe[1]);
+    mEventPipe[0] = mEventPipe[1] = -1;
     if (mFlags & MainEventLoop)
         sMainLoop.reset();
     if (mFlags & EnableSigIntHandler) {
@@ -263,8 +327,10 @@ void EventLoop::error(const char* err)
 
 void EventLoop::post(Event* event)
 {
-    std::lock_guard<std::mutex> locker(mMutex);
-    mEvents.push(event);
+    Event* head = mPostedEvents.load(std::memory_order_relaxed);
+    do {
+        event->mNext = head;
+    } while (!mPostedEvents.compare_exchange_weak(head, event));
     wakeup();
 }
 
@@ -273,9 +339,28 @@ void EventLoop::wakeup()
     if (std::this_thread::get_id() == threadId)
         return;
 
-    char b = 'w';
+    // one write per loop iteration is enough, the loop clears the flag
+    // when it reads the wakeup and checks everything after that
+    if (mWakeupPending.exchange(true))
+        return;
+
     int w;
+#ifdef HAVE_EVENTFD
+    const uint64_t one = 1;
+    eintrwrap(w, ::write(mEventPipe[1], &one, sizeof(one)));
+#else
+    char b = 'w';
     eintrwrap(w, ::write(mEventPipe[1], &b, 1));
+#endif
+}
+
+void EventLoop::deleteEvents(Event* events)
+{
+    while (events) {
+        Event* next = events->mNext;
+        delete events;
+        events = next;
+    }
 }
 
 void EventLoop::quit()
@@ -287,16 +372,23 @@ void EventLoop::quit()
 
 inline bool EventLoop::sendPostedEvents()
 {
-    std::unique_lock<std::mutex> locker(mMutex);
-    if (mEvents.empty())
-        return false;
-    while (!mEvents.empty()) {
-        auto event = mEvents.front();
-        mEvents.pop();
-        locker.unlock();
+    if (!mPendingEvents) {
+        // take everything posted so far and put it back in posting order
+        Event* event = mPostedEvents.exchange(0);
+        if (!event)
+            return false;
+        while (event) {
+            Event* next = event->mNext;
+            event->mNext = mPendingEvents;
+            mPendingEvents = event;
+            event = next;
+        }
+    }
+    // events may run a nested exec(), it picks up where this one is
+    while (Event* event = mPendingEvents) {
+        mPendingEvents = event->mNext;
         event->exec();
         delete event;
-        locker.lock();
     }
     return true;
 }
@@ -304,35 +396,36 @@ inline bool EventLoop::sendPostedEvents()
 // milliseconds
 static inline uint64_t currentTime()
 {
-#if defined(HAVE_CLOCK_MONOTONIC_RAW) || defined(HAVE_CLOCK_MONOTONIC)
-    timespec now;
-#if defined(HAVE_CLOCK_MONOTONIC_RAW)
-    if (clock_gettime(CLOCK_MONOTONIC_RAW, &now) == -1)
-        return 0;
-#elif defined(HAVE_CLOCK_MONOTONIC)
-    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
-        return 0;
-#endif
-    const uint64_t t = (now.tv_sec * 1000LLU) + (now.tv_nsec / 1000000LLU);
-#elif defined(HAVE_MACH_ABSOLUTE_TIME)
-    static mach_timebase_info_data_t info;
-    static bool first = true;
-    uint64_t t = mach_absolute_time();
-    if (first) {
-        first = false;
-        mach_timebase_info(&info);
-    }
-    t = t * info.numer / (info.denom * 1000); // microseconds
-    t /= 1000; // milliseconds
-#else
-#error No time getting mechanism
-#endif
-    return t;
+    return Rct::monoMs();
+}
+
+// Never goes back, the coarse clock lags behind the precise one
+uint64_t EventLoop::refreshTime(bool coarse)
+{
+    const uint64_t now = coarse ? Rct::coarseMonoMs() : currentTime();
+    if (now > mNow.load(std::memory_order_relaxed)) {
+        mNow.store(now, std::memory_order_relaxed);
+        return now;
+    }
+    return mNow.load(std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::cachedTime()
+{
+    pthread_once(&sRunningLoopOnce, createRunningLoopKey);
+    if (const EventLoop* loop = static_cast<const EventLoop*>(pthread_getspecific(sRunningLoopKey)))
+        return loop->now();
+    return Rct::monoMs();
 }
 
 int EventLoop::registerTimer(std::function<void(int)>&& func, int timeout, unsigned int flags)
 {
     std::lock_guard<std::mutex> locker(mMutex);
+    if (mTimerWheel) {
+        const int id = mTimerWheel->add(currentTime() + timeout, timeout, flags, std::move(func));
+        wakeup();
+        return id;
+    }
     {
         TimerData data;
         do {
@@ -356,6 +449,10 @@ void EventLoop::unregisterTimer(int id)
 
 void EventLoop::clearTimer(int id)
 {
+    if (mTimerWheel) {
+        mTimerWheel->remove(id);
+        return;
+    }
     TimerData* t = 0;
     {
         TimerData data;
@@ -389,9 +486,33 @@ void EventLoop::clearTimer(int id)
 
 inline bool EventLoop::sendTimers()
 {
+    if (mTimerWheel) {
+        std::vector<int> expired;
+        std::unique_lock<std::mutex> locker(mMutex);
+        // reuse the vector's storage across rounds, a callback running
+        // a nested exec() will find mExpiredTimers empty
+        expired.swap(mExpiredTimers);
+        mTimerWheel->advance(refreshTime(), expired);
+        std::function<void(int)> cb;
+        for (int id : expired) {
+            // each timer fires at most once per round, interval timers
+            // are rescheduled at least one tick ahead
+            if (!mTimerWheel->dispatch(id, cb))
+                continue;
+            locker.unlock();
+            CALLBACK(cb(id));
+            cb = nullptr;
+            locker.lock();
+        }
+        const bool fired = !expired.empty();
+        expired.clear();
+        expired.swap(mExpiredTimers);
+        return fired;
+    }
+
     std::set<uint64_t> fired;
     std::unique_lock<std::mutex> locker(mMutex);
-    const uint64_t now = currentTime();
+    const uint64_t now = refreshTime();
     for (;;) {
         auto timer = mTimersByTime.begin();
         if (timer == mTimersByTime.end())
@@ -452,8 +573,21 @@ inline bool EventLoop::sendTimers()
 bool EventLoop::registerSocket(int fd, unsigned int mode, std::function<void(int, unsigned int)>&& func)
 {
     std::lock_guard<std::mutex> locker(mMutex);
-    mSockets[fd] = std::make_pair(mode, std::forward<std::function<void(int, unsigned int)> >(func));
-
+    SocketData* data = socketData(fd, true);
+    if (data->registered) {
+        removeSocket(data);
+    }
+    data->registered = true;
+    data->mode = mode;
+    if (!++data->generation)
+        ++data->generation;
+    data->callback.reset(new SocketCallback(std::move(func)));
+    ++mSocketCount;
+
+#if defined(HAVE_IO_URING)
+    if (mRing)
+        return armSocket(fd, data);
+#endif
     int e;
 #if defined(HAVE_EPOLL)
     epoll_event ev;
@@ -467,7 +601,7 @@ bool EventLoop::registerSocket(int fd, unsigned int mode, std::function<void(int
         ev.events |= EPOLLOUT;
     if (mode & SocketOneShot)
         ev.events |= EPOLLONESHOT;
-    ev.data.fd = fd;
+    ev.data.u64 = (static_cast<uint64_t>(data->generation) << 32) | static_cast<uint32_t>(fd);
     e = epoll_ctl(mPollFd, EPOLL_CTL_ADD, fd, &ev);
 #elif defined(HAVE_KQUEUE)
     e = 0;
@@ -505,16 +639,20 @@ bool EventLoop::registerSocket(int fd, unsigned int mode, std::function<void(int
 bool EventLoop::updateSocket(int fd, unsigned int mode)
 {
     std::lock_guard<std::mutex> locker(mMutex);
-    auto socket = mSockets.find(fd);
-    if (socket == mSockets.end()) {
+    SocketData* data = socketData(fd);
+    if (!data || !data->registered) {
         fprintf(stderr, "Unable to find socket to update %d\n", fd);
         return false;
     }
 #if defined(HAVE_KQUEUE)
-    const int oldMode = socket->second.first;
+    const int oldMode = data->mode;
 #endif
-    socket->second.first = mode;
+    data->mode = mode;
 
+#if defined(HAVE_IO_URING)
+    if (mRing)
+        return armSocket(fd, data);
+#endif
     int e;
 #if defined(HAVE_EPOLL)
     epoll_event ev;
@@ -528,7 +666,7 @@ bool EventLoop::updateSocket(int fd, unsigned int mode)
         ev.events |= EPOLLOUT;
     if (mode & SocketOneShot)
         ev.events |= EPOLLONESHOT;
-    ev.data.fd = fd;
+    ev.data.u64 = (static_cast<uint64_t>(data->generation) << 32) | static_cast<uint32_t>(fd);
     e = epoll_ctl(mPollFd, EPOLL_CTL_MOD, fd, &ev);
 #elif defined(HAVE_KQUEUE)
     e = 0;
@@ -571,14 +709,21 @@ bool EventLoop::updateSocket(int fd, unsigned int mode)
 void EventLoop::unregisterSocket(int fd)
 {
     std::lock_guard<std::mutex> locker(mMutex);
-    auto socket = mSockets.find(fd);
-    if (socket == mSockets.end())
+    SocketData* data = socketData(fd);
+    if (!data || !data->registered)
         return;
 #ifdef HAVE_KQUEUE
-    const int mode = socket->second.first;
+    const int mode = data->mode;
 #endif
-    mSockets.erase(socket);
+    removeSocket(data);
 
+#if defined(HAVE_IO_URING)
+    if (mRing) {
+        disarmSocket(fd, data);
+        submitRing();
+        return;
+    }
+#endif
     int e;
 #if defined(HAVE_EPOLL)
     epoll_event ev;
@@ -684,15 +829,127 @@ unsigned int EventLoop::processSocket(int fd, int timeout)
     return processSocketEvents(events, eventCount);
 }
 
-unsigned int EventLoop::fireSocket(int fd, unsigned int mode)
+EventLoop::SocketData* EventLoop::socketData(int fd, bool create)
+{
+    if (fd < 0)
+        return 0;
+    const size_t chunk = static_cast<size_t>(fd) >> SocketChunkBits;
+    if (chunk >= mSockets.size()) {
+        if (!create)
+            return 0;
+        mSockets.resize(chunk + 1);
+    }
+    if (!mSockets[chunk]) {
+        if (!create)
+            return 0;
+        mSockets[chunk].reset(new SocketData[SocketChunkSize]);
+    }
+    return &mSockets[chunk][fd & (SocketChunkSize - 1)];
+}
+
+void EventLoop::removeSocket(SocketData* data)
+{
+    assert(data->registered);
+    data->registered = false;
+    data->mode = 0;
+    if (data->dispatching) {
+        mRetiredCallbacks.push_back(std::move(data->callback));
+    } else {
+        data->callback.reset();
+    }
+    --mSocketCount;
+}
+
+unsigned int EventLoop::fireSocket(int fd, unsigned int mode, uint32_t generation)
 {
     std::unique_lock<std::mutex> locker(mMutex);
-    const auto socket = mSockets.find(fd);
-    if (socket != mSockets.end()) {
-        const auto callback = socket->second.second;
+    SocketData* data = socketData(fd);
+    if (!data || !data->registered || (generation && generation != data->generation))
+        return 0;
+    SocketCallback* callback = data->callback.get();
+    ++data->dispatching;
+    ++mDispatchDepth;
+    locker.unlock();
+    CALLBACK((*callback)(fd, mode));
+    locker.lock();
+    --data->dispatching;
+    if (!--mDispatchDepth && !mRetiredCallbacks.empty()) {
+        std::vector<std::unique_ptr<SocketCallback> > retired;
+        retired.swap(mRetiredCallbacks);
         locker.unlock();
-        CALLBACK(callback(fd, mode));
-        return mode;
+    }
+    return mode;
+}
+
+#if defined(HAVE_EPOLL)
+// reports an error or hangup on a socket that's been taken out of the
+// loop and returns the mode to fire it with
+static unsigned int failedSocketMode(int fd, bool error, bool hangup)
+{
+    unsigned int mode = 0;
+    if (error) {
+        int err;
+        socklen_t size = sizeof(err);
+        const int e = ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &size);
+        if (e == -1) {
+            fprintf(stderr, "Error getting error for fd %d: %d (%s)\n", fd, errno, Rct::strerror().constData());
+        } else {
+            fprintf(stderr, "Error on socket %d, removing: %d (%s)\n", fd, err, Rct::strerror().constData());
+        }
+        mode |= EventLoop::SocketError;
+    }
+    if (hangup) {
+        // check if our fd is a socket
+        struct stat st;
+        if (fstat(fd, &st) != -1 && S_ISSOCK(st.st_mode)) {
+            mode |= EventLoop::SocketError;
+            fprintf(stderr, "HUP on socket %d, removing\n", fd);
+        } else {
+            mode |= EventLoop::SocketRead;
+        }
+    }
+    return mode;
+}
+#endif
+
+unsigned int EventLoop::readWakeup()
+{
+    // The flag is only cleared once the wakeup has been drained, a
+    // post that comes in before that is seen by sendPostedEvents()
+    // since the store is ordered before it takes the queue. Clearing it
+    // first would let such a post's write be drained with the flag
+    // left set and no wakeup would get written again.
+    int e;
+#ifdef HAVE_EVENTFD
+    uint64_t count;
+    eintrwrap(e, ::read(mEventPipe[0], &count, sizeof(count)));
+    const int err = errno;
+    mWakeupPending.store(false, std::memory_order_seq_cst);
+    if (sSignalCaught && (mFlags & (EnableSigIntHandler | EnableSigTermHandler))) {
+        // signal caught, we need to shut down
+        sSignalCaught = false;
+        return Success;
+    }
+#else
+    // drain the pipe
+    char q;
+    bool signalCaught = false;
+    do {
+        eintrwrap(e, ::read(mEventPipe[0], &q, 1));
+        if (e == 1 && q == 'q') {
+            // signal caught, we need to shut down
+            signalCaught = true;
+        }
+    } while (e == 1);
+    const int err = errno;
+    mWakeupPending.store(false, std::memory_order_seq_cst);
+    if (signalCaught)
+        return Success;
+#endif
+    if (e == -1 && err != EAGAIN && err != EWOULDBLOCK) {
+        // error
+        fprintf(stderr, "Error reading from event pipe: %d (%s)\n", err, Rct::strerror(err).constData());
+        return GeneralError;
     }
     return 0;
 }
@@ -700,14 +957,21 @@ unsigned int EventLoop::fireSocket(int fd, unsigned int mode)
 unsigned int EventLoop::processSocketEvents(NativeEvent* events, int eventCount)
 {
     unsigned int all = 0;
-    int e;
 
 #if defined(HAVE_SELECT)
-    std::map<int, std::pair<unsigned int, std::function<void(int, unsigned int)> > > local;
+    std::vector<int> local;
     {
 #warning this is not optimal
         std::lock_guard<std::mutex> locker(mMutex);
-        local = mSockets;
+        local.reserve(mSocketCount);
+        for (size_t chunk = 0; chunk < mSockets.size(); ++chunk) {
+            if (!mSockets[chunk])
+                continue;
+            for (int i = 0; i < SocketChunkSize; ++i) {
+                if (mSockets[chunk][i].registered)
+                    local.push_back((chunk << SocketChunkBits) + i);
+            }
+        }
     }
     auto socket = local.begin();
     if (socket == local.end()) {
@@ -718,39 +982,26 @@ unsigned int EventLoop::processSocketEvents(NativeEvent* events, int eventCount)
 
     for (int i = 0; i < eventCount; ++i) {
         unsigned int mode = 0;
+        uint32_t generation = 0;
 #if defined(HAVE_EPOLL)
         const uint32_t ev = events[i].events;
-        const int fd = events[i].data.fd;
+        const int fd = static_cast<int>(events[i].data.u64 & 0xffffffff);
+        generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
         if (ev & (EPOLLERR|EPOLLHUP) && !(ev & EPOLLRDHUP)) {
-            // bad, take the fd out
-            epoll_ctl(mPollFd, EPOLL_CTL_DEL, fd, &events[i]);
             {
                 std::lock_guard<std::mutex> locker(mMutex);
-                mSockets.erase(fd);
-            }
-            if (ev & EPOLLERR) {
-                int err;
-                socklen_t size = sizeof(err);
-                e = ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &size);
-                if (e == -1) {
-                    fprintf(stderr, "Error getting error for fd %d: %d (%s)\n", fd, errno, Rct::strerror().constData());
-                } else {
-                    fprintf(stderr, "Error on socket %d, removing: %d (%s)\n", fd, err, Rct::strerror().constData());
+                SocketData* data = socketData(fd);
+                if (generation && (!data || data->generation != generation)) {
+                    // the fd has been reused since this event was queued
+                    continue;
                 }
-                mode |= SocketError;
+                // bad, take the fd out
+                epoll_ctl(mPollFd, EPOLL_CTL_DEL, fd, &events[i]);
+                if (data && data->registered)
+                    removeSocket(data);
             }
-            if (ev & EPOLLHUP) {
-                // check if our fd is a socket
-                struct stat st;
-                if (fstat(fd, &st) != -1 && S_ISSOCK(st.st_mode)) {
-                    mode |= SocketError;
-                    fprintf(stderr, "HUP on socket %d, removing\n", fd);
-                } else {
-                    mode |= SocketRead;
-                }
-            }
-
-            all |= fireSocket(fd, mode);
+            mode = failedSocketMode(fd, ev & EPOLLERR, ev & EPOLLHUP);
+            all |= fireSocket(fd, mode, generation);
             continue;
         }
         if (ev & (EPOLLIN|EPOLLRDHUP)) {
@@ -773,7 +1024,9 @@ unsigned int EventLoop::processSocketEvents(NativeEvent* events, int eventCount)
             kevent(mPollFd, &kev, 1, 0, 0, 0);
             {
                 std::lock_guard<std::mutex> locker(mMutex);
-                mSockets.erase(fd);
+                SocketData* data = socketData(fd);
+                if (data && data->registered)
+                    removeSocket(data);
             }
             fprintf(stderr, "Error on socket %d, removing: %d (%s)\n", fd, err, Rct::strerror().constData());
 
@@ -789,16 +1042,16 @@ unsigned int EventLoop::processSocketEvents(NativeEvent* events, int eventCount)
         int fd = -1;
         //assert(socket != local.end());
         while (socket != local.end()) {
-            if (FD_ISSET(socket->first, events->rdfd)) {
+            if (FD_ISSET(*socket, events->rdfd)) {
                 // go
-                fd = socket->first;
+                fd = *socket;
                 mode |= SocketRead;
                 ++socket;
                 break;
             }
-            if (events->wrfd && FD_ISSET(socket->first, events->wrfd)) {
+            if (events->wrfd && FD_ISSET(*socket, events->wrfd)) {
                 // go
-                fd = socket->first;
+                fd = *socket;
                 mode |= SocketWrite;
                 ++socket;
                 break;
@@ -815,22 +1068,10 @@ unsigned int EventLoop::processSocketEvents(NativeEvent* events, int eventCount)
 #endif
         if (mode) {
             if (fd == mEventPipe[0]) {
-                // drain the pipe
-                char q;
-                do {
-                    eintrwrap(e, ::read(mEventPipe[0], &q, 1));
-                    if (e == 1 && q == 'q') {
-                        // signal caught, we need to shut down
-                        return Success;
-                    }
-                } while (e == 1);
-                if (e == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
-                    // error
-                    fprintf(stderr, "Error reading from event pipe: %d (%s)\n", errno, Rct::strerror().constData());
-                    return GeneralError;
-                }
+                if (const unsigned int ret = readWakeup())
+                    return ret;
             } else {
-                all |= fireSocket(fd, mode);
+                all |= fireSocket(fd, mode, generation);
             }
         }
     }
@@ -845,10 +1086,18 @@ unsigned int EventLoop::exec(int timeoutTime)
 
     unsigned int ret = 0;
 
+    pthread_once(&sRunningLoopOnce, createRunningLoopKey);
+    void* outerLoop = pthread_getspecific(sRunningLoopKey);
+    pthread_setspecific(sRunningLoopKey, this);
+    const bool coarseClock = mFlags & CoarseClock;
+
 #if defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
     enum { MaxEvents = 64 };
     NativeEvent events[MaxEvents];
 #endif
+#if defined(HAVE_IO_URING)
+    io_uring_cqe completions[MaxEvents];
+#endif
 
     for (;;) {
         for (;;) {
@@ -872,10 +1121,19 @@ unsigned int EventLoop::exec(int timeoutTime)
                 break;
             }
 
-            const auto timer = mTimersByTime.begin();
-            if (timer != mTimersByTime.end()) {
-                const uint64_t now = currentTime();
-                waitUntil = std::max<int>((*timer)->when - now, 0);
+            if (mTimerWheel) {
+                const uint64_t next = mTimerWheel->nextTimeout();
+                if (next != UINT64_MAX) {
+                    // sendTimers() just looked at the clock
+                    const uint64_t now = mNow.load(std::memory_order_relaxed);
+                    waitUntil = next > now ? std::min<uint64_t>(next - now, INT_MAX) : 0;
+                }
+            } else {
+                const auto timer = mTimersByTime.begin();
+                if (timer != mTimersByTime.end()) {
+                    const uint64_t now = mNow.load(std::memory_order_relaxed);
+                    waitUntil = std::max<int>((*timer)->when - now, 0);
+                }
             }
 
             if (mInactivityTimeout > 0) {
@@ -885,6 +1143,27 @@ unsigned int EventLoop::exec(int timeoutTime)
                 }
             }
         }
+#if defined(HAVE_IO_URING)
+        if (mRing) {
+            // submits whatever was queued since the last round as well
+            const int e = mRing->wait(waitUntil);
+            refreshTime(coarseClock);
+            if (e < 0 && e != -ETIME && e != -EINTR && e != -EBUSY) {
+                ret = GeneralError;
+                break;
+            }
+            const unsigned int count = mRing->reap(completions, MaxEvents);
+            if (count) {
+                ret = processCompletions(completions, count);
+                if (ret & (Success|GeneralError|Timeout))
+                    break;
+            } else if (e == -ETIME && waitingForInactivityTimeout) {
+                mTimeout = true;
+                quit();
+            }
+            continue;
+        }
+#endif
         int eventCount;
 #if defined(HAVE_EPOLL)
         eintrwrap(eventCount, epoll_wait(mPollFd, events, MaxEvents, waitUntil));
@@ -914,24 +1193,30 @@ unsigned int EventLoop::exec(int timeoutTime)
         FD_SET(max, &rdfd);
         {
             std::lock_guard<std::mutex> locker(mMutex);
-            auto s = mSockets.begin();
-            const auto e = mSockets.end();
-            while (s != e) {
-                if (s->second.first & SocketRead) {
-                    FD_SET(s->first, &rdfd);
-                }
-                if (s->second.first & SocketWrite) {
-                    if (!wrfdp)
-                        wrfdp = &wrfd;
-                    FD_SET(s->first, wrfdp);
+            for (size_t chunk = 0; chunk < mSockets.size(); ++chunk) {
+                if (!mSockets[chunk])
+                    continue;
+                for (int i = 0; i < SocketChunkSize; ++i) {
+                    const SocketData& data = mSockets[chunk][i];
+                    if (!data.registered)
+                        continue;
+                    const int fd = (chunk << SocketChunkBits) + i;
+                    if (data.mode & SocketRead) {
+                        FD_SET(fd, &rdfd);
+                    }
+                    if (data.mode & SocketWrite) {
+                        if (!wrfdp)
+                            wrfdp = &wrfd;
+                        FD_SET(fd, wrfdp);
+                    }
+                    max = std::max(max, fd);
                 }
-                max = std::max(max, s->first);
-                ++s;
             }
         }
 
         eintrwrap(eventCount, select(max + 1, &rdfd, wrfdp, 0, timeptr));
 #endif
+        refreshTime(coarseClock);
         if (eventCount < 0) {
             // bad
             ret = GeneralError;
@@ -954,5 +1239,203 @@ unsigned int EventLoop::exec(int timeoutTime)
 
     if (quitTimerId != -1)
         clearTimer(quitTimerId);
+    pthread_setspecific(sRunningLoopKey, outerLoop);
     return ret;
 }
+
+bool EventLoop::hasAsyncIO() const
+{
+#if defined(HAVE_IO_URING)
+    // only ever set up by init()
+    return mRing.get() != 0;
+#else
+    return false;
+#endif
+}
+
+int EventLoop::submitRead(int fd, Buffer&& buffer, size_t size, IOCallback&& callback)
+{
+#if defined(HAVE_IO_URING)
+    std::lock_guard<std::mutex> locker(mMutex);
+    if (mRing) {
+        const int id = mRing->read(fd, std::move(buffer), size, std::move(callback));
+        if (id != -1)
+            submitRing();
+        return id;
+    }
+#else
+    (void)fd;
+    (void)buffer;
+    (void)size;
+    (void)callback;
+#endif
+    return -1;
+}
+
+int EventLoop::submitWrite(int fd, Buffer&& data, IOCallback&& callback)
+{
+#if defined(HAVE_IO_URING)
+    std::lock_guard<std::mutex> locker(mMutex);
+    if (mRing) {
+        const int id = mRing->write(fd, std::move(data), std::move(callback));
+        if (id != -1)
+            submitRing();
+        return id;
+    }
+#else
+    (void)fd;
+    (void)data;
+    (void)callback;
+#endif
+    return -1;
+}
+
+void EventLoop::cancelIO(int id)
+{
+#if defined(HAVE_IO_URING)
+    std::lock_guard<std::mutex> locker(mMutex);
+    if (mRing && mRing->cancel(id))
+        submitRing();
+#else
+    (void)id;
+#endif
+}
+
+#if defined(HAVE_IO_URING)
+bool EventLoop::initRing()
+{
+    enum { Entries = 256 };
+    std::unique_ptr<IoUring> ring(new IoUring);
+    if (!ring->init(Entries))
+        return false;
+    // the wakeup fd stays polled for as long as the ring is around
+    if (!ring->poll(mEventPipe[0], POLLIN, true, IoUring::userData(IoUring::Wakeup, 0, mEventPipe[0])) || ring->submit() < 0)
+        return false;
+    mRing = std::move(ring);
+    return true;
+}
+
+// entries queued on the loop's thread go out with the next wait, other
+// threads can't count on the loop coming around
+void EventLoop::submitRing()
+{
+    if (std::this_thread::get_id() != threadId)
+        mRing->submit();
+}
+
+bool EventLoop::armSocket(int fd, SocketData* data)
+{
+    disarmSocket(fd, data);
+    if (data->mode & (SocketRead|SocketWrite)) {
+        uint32_t events = 0;
+        if (data->mode & SocketRead)
+            events |= POLLIN | POLLRDHUP;
+        if (data->mode & SocketWrite)
+            events |= POLLOUT;
+        do {
+            data->pollId = ++mNextPollId & IoUring::IdMask;
+        } while (!data->pollId);
+        // edge triggered sockets keep a multishot poll armed. level
+        // triggered and one shot sockets get single shot polls, the
+        // former are armed again once they've been dispatched
+        const bool multishot = !(data->mode & (SocketOneShot|SocketLevelTriggered));
+        if (!mRing->poll(fd, events, multishot, IoUring::userData(IoUring::Poll, data->pollId, fd))) {
+            fprintf(stderr, "Unable to register socket %d with mode %x: submission queue full\n", fd, data->mode);
+            return false;
+        }
+        data->polling = true;
+    }
+    submitRing();
+    return true;
+}
+
+void EventLoop::disarmSocket(int fd, SocketData* data)
+{
+    if (data->polling)
+        mRing->removePoll(IoUring::userData(IoUring::Poll, data->pollId, fd));
+    data->polling = false;
+    data->pollId = 0;
+}
+
+unsigned int EventLoop::processCompletions(const io_uring_cqe* cqes, int count)
+{
+    unsigned int all = 0, ret = 0;
+    for (int i = 0; i < count; ++i) {
+        const io_uring_cqe& cqe = cqes[i];
+        const int fd = IoUring::fd(cqe.user_data);
+        const uint32_t id = IoUring::id(cqe.user_data);
+        switch (IoUring::kind(cqe.user_data)) {
+        case IoUring::Ignore:
+            break;
+        case IoUring::Wakeup:
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                std::lock_guard<std::mutex> locker(mMutex);
+                mRing->poll(fd, POLLIN, true, cqe.user_data);
+            }
+            // keep going on a signal, the completions have been taken
+            // out of the ring already
+            if (!ret)
+                ret = readWakeup();
+            break;
+        case IoUring::Poll: {
+            uint32_t generation;
+            bool failed;
+            {
+                std::lock_guard<std::mutex> locker(mMutex);
+                SocketData* data = socketData(fd);
+                if (!data || !data->registered || data->pollId != id) {
+                    // unregistered or updated since
+                    break;
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    data->polling = false;
+                generation = data->generation;
+                failed = (cqe.res < 0 && cqe.res != -ECANCELED)
+                    || (cqe.res > 0 && (cqe.res & (POLLERR|POLLHUP)) && !(cqe.res & POLLRDHUP));
+                if (failed) {
+                    // bad, take the fd out
+                    disarmSocket(fd, data);
+                    removeSocket(data);
+                }
+            }
+            if (failed) {
+                unsigned int mode = SocketError;
+                if (cqe.res < 0) {
+                    fprintf(stderr, "Error polling socket %d, removing: %d (%s)\n", fd, -cqe.res, strerror(-cqe.res));
+                } else {
+                    mode = failedSocketMode(fd, cqe.res & POLLERR, cqe.res & POLLHUP);
+                }
+                all |= fireSocket(fd, mode, generation);
+                break;
+            }
+            unsigned int mode = 0;
+            if (cqe.res > 0) {
+                if (cqe.res & (POLLIN|POLLRDHUP))
+                    mode |= SocketRead;
+                if (cqe.res & POLLOUT)
+                    mode |= SocketWrite;
+            }
+            if (mode)
+                all |= fireSocket(fd, mode, generation);
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                std::lock_guard<std::mutex> locker(mMutex);
+                SocketData* data = socketData(fd);
+                if (data && data->registered && data->pollId == id && !data->polling && !(data->mode & SocketOneShot))
+                    armSocket(fd, data);
+            }
+            break; }
+        case IoUring::Operation: {
+            IOCallback callback;
+            Buffer buffer;
+            {
+                std::lock_guard<std::mutex> locker(mMutex);
+                if (!mRing->complete(id, cqe.res, callback, buffer))
+                    break;
+            }
+            CALLBACK(callback(fd, cqe.res, std::move(buffer)));
+            break; }
+        }
+    }
+    return ret ? ret : all;
+}
+#endif
@@ -1,6 +1,7 @@
 #ifndef EVENTLOOP_H // -*- mode:c++ -*-
 #define EVENTLOOP_H
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -23,11 +24,22 @@
 #  include <sys/select.h>
 #endif
 
+class Buffer;
+class IoUring;
+class TimerWheel;
+struct io_uring_cqe;
+
 class Event
 {
 public:
+    Event() : mNext(0) { }
     virtual ~Event() { }
     virtual void exec() = 0;
+
+private:
+    Event* mNext; // link in the EventLoop's posted event queue
+
+    friend class EventLoop;
 };
 
 template<typename Object, typename... Args>
@@ -88,7 +100,16 @@ public:
         None = 0x0,
         MainEventLoop = 0x1,
         EnableSigIntHandler = 0x2,
-        EnableSigTermHandler = 0x4
+        EnableSigTermHandler = 0x4,
+        EnableTimerWheel = 0x8, // O(1) timers, see TimerWheel.h
+        // io_uring socket backend, Linux >= 5.13. Falls back to epoll
+        // if the kernel doesn't support it, in which case the flag is
+        // cleared from flags(). Sockets have to be unregistered before
+        // they're closed, the ring holds on to them until then.
+        EnableIoUring = 0x10,
+        // now() is refreshed from CLOCK_MONOTONIC_COARSE when the loop
+        // wakes up, timers still go by the precise clock
+        CoarseClock = 0x20
     };
     enum PostType {
         Move = 1,
@@ -142,11 +163,35 @@ public:
     bool updateSocket(int fd, unsigned int mode);
     void unregisterSocket(int fd);
     unsigned int processSocket(int fd, int timeout = -1);
+    size_t socketCount() const { std::lock_guard<std::mutex> locker(mMutex); return mSocketCount; }
+
+    // Completion based reads and writes, only available with the
+    // io_uring backend. The loop owns the buffer while the operation is
+    // in flight, the callback gets it back along with the number of
+    // bytes transferred or -errno. Reads append up to size bytes to the
+    // buffer. Reads of a socket shouldn't be mixed with SocketRead
+    // readiness callbacks for it.
+    typedef std::function<void(int, int, Buffer&&)> IOCallback;
+    bool hasAsyncIO() const;
+    // Return an id for cancelIO(), -1 on failure in which case the
+    // buffer is left alone
+    int submitRead(int fd, Buffer&& buffer, size_t size, IOCallback&& callback);
+    int submitWrite(int fd, Buffer&& data, IOCallback&& callback);
+    // The callback of a cancelled operation is never called
+    void cancelIO(int id);
 
     // See Timer.h for the flags
     int registerTimer(std::function<void(int)>&& func, int timeout, unsigned int flags = 0);
     void unregisterTimer(int id);
 
+    // Rct::monoMs() as of when the loop last woke up or checked its
+    // timers, for callbacks that want the time often and can live with
+    // it being as old as the current round of the loop
+    uint64_t now() const { return mNow.load(std::memory_order_relaxed); }
+    // now() of the loop running on the calling thread, Rct::monoMs() if
+    // there's none
+    static uint64_t cachedTime();
+
     // Changes to the inactivity timeout while the loop is running may
     // not be honoured.
     int inactivityTimeout() const { return mInactivityTimeout; }
@@ -178,10 +223,13 @@ private:
 
     void clearTimer(int id);
     bool sendPostedEvents();
+    static void deleteEvents(Event* events);
     bool sendTimers();
     void cleanup();
     unsigned int processSocketEvents(NativeEvent* events, int eventCount);
-    unsigned int fireSocket(int fd, unsigned int mode);
+    unsigned int readWakeup();
+    // generation 0 fires whatever is registered for fd
+    unsigned int fireSocket(int fd, unsigned int mode, uint32_t generation = 0);
 
     static void error(const char* err);
 
@@ -190,13 +238,59 @@ private:
     mutable std::mutex mMutex;
     std::thread::id threadId;
 
-    std::queue<Event*> mEvents;
-    int mEventPipe[2];
+    // posted events, pushed by any thread and taken in one go by the
+    // loop. mPostedEvents is a stack, mPendingEvents is the batch being
+    // processed in posting order.
+    std::atomic<Event*> mPostedEvents;
+    Event* mPendingEvents;
+    std::atomic<bool> mWakeupPending;
+    int mEventPipe[2]; // both ends are the same eventfd if HAVE_EVENTFD
 #if defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
     int mPollFd;
 #endif
 
-    std::map<int, std::pair<unsigned int, std::function<void(int, unsigned int)> > > mSockets;
+    typedef std::function<void(int, unsigned int)> SocketCallback;
+    struct SocketData
+    {
+        SocketData()
+            : mode(0), generation(0), dispatching(0), registered(false)
+#if defined(HAVE_IO_URING)
+            , pollId(0), polling(false)
+#endif
+        { }
+
+        unsigned int mode;
+        uint32_t generation; // bumped on every registration, never 0
+        int dispatching;
+        bool registered;
+        std::unique_ptr<SocketCallback> callback;
+#if defined(HAVE_IO_URING)
+        uint32_t pollId; // user data of the armed poll, 0 if none
+        bool polling;
+#endif
+    };
+    SocketData* socketData(int fd, bool create = false);
+    void removeSocket(SocketData* data);
+
+    // indexed by fd. Chunks never move and a callback that's running
+    // when its socket goes away is retired until dispatch is done, so
+    // callbacks are called in place without holding mMutex.
+    enum { SocketChunkBits = 8, SocketChunkSize = 1 << SocketChunkBits };
+    std::vector<std::unique_ptr<SocketData[]> > mSockets;
+    size_t mSocketCount;
+    int mDispatchDepth;
+    std::vector<std::unique_ptr<SocketCallback> > mRetiredCallbacks;
+
+#if defined(HAVE_IO_URING)
+    bool initRing();
+    bool armSocket(int fd, SocketData* data);
+    void disarmSocket(int fd, SocketData* data);
+    void submitRing();
+    unsigned int processCompletions(const io_uring_cqe* cqes, int count);
+
+    std::unique_ptr<IoUring> mRing;
+    uint32_t mNextPollId;
+#endif
 
     class TimerData
     {
@@ -253,6 +347,12 @@ private:
     TimersById mTimersById;
     uint32_t mNextTimerId;
 
+    std::unique_ptr<TimerWheel> mTimerWheel;
+    std::vector<int> mExpiredTimers;
+
+    uint64_t refreshTime(bool coarse = false);
+    std::atomic<uint64_t> mNow;
+
     bool mStop;
     bool mTimeout;
 
@@ -0,0 +1,139 @@
+#include "EventLoopGroup.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <pthread.h>
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#  include <sched.h>
+#endif
+
+#include "Log.h"
+#include "Thread.h"
+#include "ThreadPool.h"
+#include "rct/rct-config.h"
+
+class EventLoopGroupThread : public Thread
+{
+public:
+    EventLoopGroupThread(EventLoopGroup* group, size_t idx, unsigned int flags, bool pin)
+        : mGroup(group), mIdx(idx), mFlags(flags), mPin(pin)
+    {
+        setAutoDelete(false);
+    }
+
+protected:
+    virtual void run() override
+    {
+        if (mPin)
+            pin();
+        EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+        loop->init(mFlags);
+        mGroup->started(mIdx, loop);
+        loop->exec();
+    }
+
+private:
+    void pin()
+    {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) != 0)
+            return;
+        const int count = CPU_COUNT(&allowed);
+        if (count <= 1)
+            return;
+        int wanted = mIdx % count;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && !wanted--) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+                    error() << "pthread_setaffinity_np failed";
+                break;
+            }
+        }
+#endif
+    }
+
+    EventLoopGroup* mGroup;
+    const size_t mIdx;
+    const unsigned int mFlags;
+    const bool mPin;
+};
+
+EventLoopGroup::EventLoopGroup()
+    : mNext(0)
+{
+}
+
+EventLoopGroup::~EventLoopGroup()
+{
+    stop();
+}
+
+bool EventLoopGroup::start(int count, unsigned int flags, bool pinToCores)
+{
+    if (isRunning())
+        return false;
+    if (count <= 0)
+        count = std::max(ThreadPool::idealThreadCount(), 1);
+    // none of these should take over the process' signals or main loop
+    flags &= ~(EventLoop::MainEventLoop | EventLoop::EnableSigIntHandler | EventLoop::EnableSigTermHandler);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mLoops.resize(count);
+    for (int i = 0; i < count; ++i) {
+        mThreads.append(new EventLoopGroupThread(this, i, flags, pinToCores));
+        mThreads.last()->start();
+    }
+    for (int i = 0; i < count; ++i) {
+        while (!mLoops.at(i))
+            mCond.wait(lock);
+    }
+    return true;
+}
+
+void EventLoopGroup::started(size_t idx, const EventLoop::SharedPtr& loop)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLoops[idx] = loop;
+    mCond.notify_all();
+}
+
+void EventLoopGroup::stop()
+{
+    if (!isRunning())
+        return;
+    for (const EventLoop::SharedPtr& loop : mLoops)
+        loop->quit();
+    for (EventLoopGroupThread* thread : mThreads) {
+        thread->join();
+        delete thread;
+    }
+    mThreads.clear();
+    mLoops.clear();
+}
+
+size_t EventLoopGroup::select(Policy policy)
+{
+    assert(isRunning());
+    if (policy == LeastLoaded) {
+        // start scanning at a different loop each time so ties spread out
+        const size_t count = mLoops.size();
+        const size_t start = mNext++ % count;
+        size_t best = start;
+        size_t bestLoad = mLoops.at(start)->socketCount();
+        for (size_t i = 1; i < count && bestLoad; ++i) {
+            const size_t idx = (start + i) % count;
+            const size_t load = mLoops.at(idx)->socketCount();
+            if (load < bestLoad) {
+                best = idx;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+    return mNext++ % mLoops.size();
+}
@@ -0,0 +1,59 @@
+#ifndef EVENTLOOPGROUP_H
+#define EVENTLOOPGROUP_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <rct/EventLoop.h>
+#include <rct/List.h>
+
+class EventLoopGroupThread;
+
+// A set of event loops, each running exec() on its own thread. Objects
+// that register with EventLoop::eventLoop() (SocketClient, Timer, ...)
+// belong to the loop of the thread that created them, so work is moved
+// onto a loop by posting it there with callLater().
+class EventLoopGroup
+{
+public:
+    typedef std::shared_ptr<EventLoopGroup> SharedPtr;
+    typedef std::weak_ptr<EventLoopGroup> WeakPtr;
+
+    EventLoopGroup();
+    ~EventLoopGroup();
+
+    // count 0 means one loop per core. The flags are passed on to
+    // EventLoop::init(). With pinToCores each thread is bound to one of
+    // the cores the process is allowed to run on.
+    bool start(int count = 0, unsigned int flags = EventLoop::None, bool pinToCores = true);
+    void stop();
+
+    bool isRunning() const { return !mLoops.isEmpty(); }
+    size_t size() const { return mLoops.size(); }
+    EventLoop::SharedPtr loop(size_t idx) const { return idx < mLoops.size() ? mLoops.at(idx) : EventLoop::SharedPtr(); }
+
+    enum Policy {
+        RoundRobin,
+        LeastLoaded // fewest registered sockets
+    };
+    size_t select(Policy policy = RoundRobin);
+    EventLoop::SharedPtr next(Policy policy = RoundRobin) { return loop(select(policy)); }
+
+private:
+    void started(size_t idx, const EventLoop::SharedPtr& loop);
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    List<EventLoopGroupThread*> mThreads;
+    List<EventLoop::SharedPtr> mLoops;
+    std::atomic<size_t> mNext;
+
+    friend class EventLoopGroupThread;
+private:
+    EventLoopGroup(const EventLoopGroup&) = delete;
+    EventLoopGroup& operator=(const EventLoopGroup&) = delete;
+};
+
+#endif
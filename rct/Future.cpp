@@ -0,0 +1,152 @@
+#include "Future.h"
+
+#include <condition_variable>
+
+// waiters sleep on one of a few condition variables picked by the
+// task's address, tasks don't have a mutex of their own
+enum { WaitStripes = 16 };
+static std::mutex sWaitMutexes[WaitStripes];
+static std::condition_variable sWaitConds[WaitStripes];
+
+static inline size_t waitStripe(const ThreadPoolTask* task)
+{
+    return (reinterpret_cast<uintptr_t>(task) / sizeof(void*)) % WaitStripes;
+}
+
+ThreadPoolTask::ThreadPoolTask(ThreadPoolTaskAllocator* allocator)
+    : mRun(0), mDestroy(0), mClaim(0), mRefs(0), mState(0), mAllocator(allocator),
+      mPrev(0), mNext(0), mPriority(0), mNode(0)
+{
+}
+
+void ThreadPoolTask::reset()
+{
+    mRun = 0;
+    mDestroy = 0;
+    mClaim = 0;
+    mRefs.store(1, std::memory_order_relaxed);
+    mState.store(0, std::memory_order_relaxed);
+    mPrev = mNext = 0;
+}
+
+void ThreadPoolTask::release()
+{
+    // a Job's task may go away with the job in mDestroy
+    void (*destroy)(ThreadPoolTask*) = mDestroy;
+    ThreadPoolTaskAllocator* allocator = mAllocator;
+    mDestroy = 0;
+    if (destroy)
+        destroy(this);
+    if (allocator)
+        allocator->release(this);
+}
+
+void ThreadPoolTask::cancel()
+{
+    if (mDestroy && mAllocator) {
+        mDestroy(this);
+        mDestroy = 0;
+    }
+    complete(Done | Cancelled);
+}
+
+void ThreadPoolTask::complete(unsigned flags)
+{
+    const unsigned old = mState.fetch_or(flags, std::memory_order_acq_rel);
+    if (old & Continuation) {
+        if (!(flags & Cancelled))
+            mContinuation();
+        mContinuation = nullptr;
+    }
+    if (old & Waiting) {
+        const size_t stripe = waitStripe(this);
+        std::lock_guard<std::mutex> lock(sWaitMutexes[stripe]);
+        sWaitConds[stripe].notify_all();
+    }
+}
+
+void ThreadPoolTask::wait()
+{
+    if (isDone())
+        return;
+    const size_t stripe = waitStripe(this);
+    std::unique_lock<std::mutex> lock(sWaitMutexes[stripe]);
+    mState.fetch_or(Waiting, std::memory_order_acq_rel);
+    while (!isDone())
+        sWaitConds[stripe].wait(lock);
+}
+
+void ThreadPoolTask::setContinuation(std::function<void()>&& func)
+{
+    assert(!(mState.load() & Continuation));
+    mContinuation = std::move(func);
+    const unsigned old = mState.fetch_or(Continuation, std::memory_order_acq_rel);
+    if (old & Done) {
+        // finished first, complete() didn't see the continuation
+        if (!(old & Cancelled))
+            mContinuation();
+        mContinuation = nullptr;
+    }
+}
+
+ThreadPoolTaskAllocator::ThreadPoolTaskAllocator()
+    : mFree(0), mFreeCount(0), mLive(0), mClosed(false)
+{
+}
+
+ThreadPoolTaskAllocator::~ThreadPoolTaskAllocator()
+{
+    while (mFree) {
+        ThreadPoolTask* next = mFree->mNext;
+        delete mFree;
+        mFree = next;
+    }
+}
+
+ThreadPoolTask* ThreadPoolTaskAllocator::allocate()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    ++mLive;
+    ThreadPoolTask* task = mFree;
+    if (task) {
+        mFree = task->mNext;
+        --mFreeCount;
+    }
+    lock.unlock();
+    if (!task)
+        task = new ThreadPoolTask(this);
+    task->reset();
+    return task;
+}
+
+void ThreadPoolTaskAllocator::release(ThreadPoolTask* task)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    --mLive;
+    if (mClosed) {
+        const bool last = !mLive;
+        lock.unlock();
+        delete task;
+        if (last)
+            delete this;
+        return;
+    }
+    if (mFreeCount == MaxFree) {
+        lock.unlock();
+        delete task;
+        return;
+    }
+    task->mNext = mFree;
+    mFree = task;
+    ++mFreeCount;
+}
+
+void ThreadPoolTaskAllocator::close()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mClosed = true;
+    const bool last = !mLive;
+    lock.unlock();
+    if (last)
+        delete this;
+}
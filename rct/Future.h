@@ -0,0 +1,300 @@
+#ifndef Future_h
+#define Future_h
+
+#include <assert.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#include <rct/EventLoop.h>
+
+class ThreadPoolTaskAllocator;
+
+// A callable started with ThreadPool::submit() along with the result its
+// Future waits for. Tasks are reference counted and come from a
+// freelist owned by the pool, a ThreadPool::Job has one of its own. The
+// callable and then the result are stored inline unless they're larger
+// than InlineSize.
+class ThreadPoolTask
+{
+public:
+    enum { InlineSize = 64 };
+
+    template <typename F, typename R>
+    void init(F&& func);
+
+    void ref() { mRefs.fetch_add(1, std::memory_order_relaxed); }
+    void deref()
+    {
+        // with the only reference nobody else can take one
+        if (mRefs.load(std::memory_order_acquire) == 1 || mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            release();
+    }
+
+    // true if the task is to be run, false if it has been claimed
+    // by someone else and should be dropped
+    bool claim() { return !mClaim || mClaim(this); }
+    void run() { mRun(this); }
+    // drops the callable, waiters wake up and continuations aren't
+    // called. A task that isn't from a freelist keeps its callable until
+    // it's released, the callable may own the task.
+    void cancel();
+
+    bool isDone() const { return mState.load(std::memory_order_acquire) & Done; }
+    bool isCancelled() const { return mState.load(std::memory_order_acquire) & Cancelled; }
+    void wait();
+    // called once done, right away if it already is
+    void setContinuation(std::function<void()>&& func);
+
+    template <typename T>
+    T* value();
+
+    // the callable before the task is run, the result after
+    template <typename T, bool Inline = (sizeof(T) <= InlineSize && std::alignment_of<T>::value <= std::alignment_of<max_align_t>::value)>
+    struct Storage;
+
+private:
+    ThreadPoolTask(ThreadPoolTaskAllocator* allocator);
+    ~ThreadPoolTask() {}
+    void reset();
+    void complete(unsigned flags);
+    void release();
+
+    template <typename F, typename R>
+    struct Functions;
+
+    enum {
+        Done = 0x1,
+        Cancelled = 0x2,
+        Continuation = 0x4,
+        Waiting = 0x8
+    };
+
+    typename std::aligned_storage<InlineSize, std::alignment_of<max_align_t>::value>::type mStorage;
+    void (*mRun)(ThreadPoolTask*);
+    void (*mDestroy)(ThreadPoolTask*);
+    bool (*mClaim)(ThreadPoolTask*);
+    std::atomic<int> mRefs;
+    std::atomic<unsigned> mState;
+    std::function<void()> mContinuation;
+    ThreadPoolTaskAllocator* mAllocator; // 0 if it's a Job's
+    // the freelist, or the pool's queue for the task's priority and node
+    ThreadPoolTask *mPrev, *mNext;
+    int mPriority, mNode;
+
+    friend class ThreadPool;
+    friend class ThreadPoolTaskAllocator;
+};
+
+// Per pool freelist of tasks. Outlives the pool as long as tasks are
+// still referenced by futures.
+class ThreadPoolTaskAllocator
+{
+public:
+    ThreadPoolTaskAllocator();
+
+    ThreadPoolTask* allocate();
+    void release(ThreadPoolTask* task);
+    // called by the pool when it goes away, deletes the allocator once
+    // the last task has been released
+    void close();
+
+    enum { MaxFree = 1024 };
+
+private:
+    ~ThreadPoolTaskAllocator();
+
+    std::mutex mMutex;
+    ThreadPoolTask* mFree;
+    size_t mFreeCount, mLive;
+    bool mClosed;
+};
+
+template <typename T>
+struct ThreadPoolTask::Storage<T, true>
+{
+    static T* get(ThreadPoolTask* task) { return reinterpret_cast<T*>(&task->mStorage); }
+    template <typename A>
+    static void construct(ThreadPoolTask* task, A&& a) { new (&task->mStorage) T(std::forward<A>(a)); }
+    static void destroy(ThreadPoolTask* task) { get(task)->~T(); }
+};
+
+template <typename T>
+struct ThreadPoolTask::Storage<T, false>
+{
+    static T* get(ThreadPoolTask* task) { return *reinterpret_cast<T**>(&task->mStorage); }
+    template <typename A>
+    static void construct(ThreadPoolTask* task, A&& a) { *reinterpret_cast<T**>(&task->mStorage) = new T(std::forward<A>(a)); }
+    static void destroy(ThreadPoolTask* task) { delete get(task); }
+};
+
+template <typename F, typename R>
+struct ThreadPoolTask::Functions
+{
+    static void run(ThreadPoolTask* task)
+    {
+        R result((*Storage<F>::get(task))());
+        Storage<F>::destroy(task);
+        Storage<R>::construct(task, std::move(result));
+        task->mDestroy = &Storage<R>::destroy;
+        task->complete(Done);
+    }
+};
+
+template <typename F>
+struct ThreadPoolTask::Functions<F, void>
+{
+    static void run(ThreadPoolTask* task)
+    {
+        (*Storage<F>::get(task))();
+        Storage<F>::destroy(task);
+        task->mDestroy = 0;
+        task->complete(Done);
+    }
+};
+
+template <typename F, typename R>
+inline void ThreadPoolTask::init(F&& func)
+{
+    typedef typename std::decay<F>::type Func;
+    Storage<Func>::construct(this, std::forward<F>(func));
+    mRun = &Functions<Func, R>::run;
+    mDestroy = &Storage<Func>::destroy;
+}
+
+template <typename T>
+inline T* ThreadPoolTask::value()
+{
+    assert(isDone() && !isCancelled());
+    return Storage<T>::get(this);
+}
+
+template <typename R>
+class Future
+{
+public:
+    Future()
+        : mTask(0)
+    {
+    }
+    explicit Future(ThreadPoolTask* task)
+        : mTask(task)
+    {
+        if (mTask)
+            mTask->ref();
+    }
+    Future(const Future& other)
+        : mTask(other.mTask)
+    {
+        if (mTask)
+            mTask->ref();
+    }
+    Future(Future&& other)
+        : mTask(other.mTask)
+    {
+        other.mTask = 0;
+    }
+    ~Future()
+    {
+        if (mTask)
+            mTask->deref();
+    }
+    Future& operator=(Future other)
+    {
+        std::swap(mTask, other.mTask);
+        return *this;
+    }
+
+    bool isValid() const { return mTask; }
+    bool isDone() const { return mTask->isDone(); }
+    // the task was dropped by ThreadPool::clearBackLog() or the pool
+    // being destroyed before it ran, there's no result
+    bool isCancelled() const { return mTask->isCancelled(); }
+    void wait() const { mTask->wait(); }
+
+    // Blocks until the task is done
+    const R& get() const
+    {
+        mTask->wait();
+        return *mTask->value<R>();
+    }
+
+    // Calls func with the result on loop's thread once the task is
+    // done. Not called if the task is cancelled or the loop is gone.
+    void then(const EventLoop::SharedPtr& loop, std::function<void(const R&)>&& func)
+    {
+        const Future self = *this;
+        const EventLoop::WeakPtr weak = loop;
+        const std::function<void(const R&)> callback = std::move(func);
+        mTask->setContinuation([self, weak, callback]() {
+                if (EventLoop::SharedPtr l = weak.lock())
+                    l->callLater([self, callback]() { callback(self.get()); });
+            });
+    }
+
+private:
+    ThreadPoolTask* mTask;
+};
+
+template <>
+class Future<void>
+{
+public:
+    Future()
+        : mTask(0)
+    {
+    }
+    explicit Future(ThreadPoolTask* task)
+        : mTask(task)
+    {
+        if (mTask)
+            mTask->ref();
+    }
+    Future(const Future& other)
+        : mTask(other.mTask)
+    {
+        if (mTask)
+            mTask->ref();
+    }
+    Future(Future&& other)
+        : mTask(other.mTask)
+    {
+        other.mTask = 0;
+    }
+    ~Future()
+    {
+        if (mTask)
+            mTask->deref();
+    }
+    Future& operator=(Future other)
+    {
+        std::swap(mTask, other.mTask);
+        return *this;
+    }
+
+    bool isValid() const { return mTask; }
+    bool isDone() const { return mTask->isDone(); }
+    bool isCancelled() const { return mTask->isCancelled(); }
+    void wait() const { mTask->wait(); }
+    void get() const { mTask->wait(); }
+
+    void then(const EventLoop::SharedPtr& loop, std::function<void()>&& func)
+    {
+        const EventLoop::WeakPtr weak = loop;
+        const std::function<void()> callback = std::move(func);
+        mTask->setContinuation([weak, callback]() {
+                if (EventLoop::SharedPtr l = weak.lock())
+                    l->callLater(std::function<void()>(callback));
+            });
+    }
+
+private:
+    ThreadPoolTask* mTask;
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "IoUring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+
+static inline int ioUringSetup(unsigned int entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static inline int ioUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags, void* arg, size_t argSize)
+{
+    const int ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    return ret == -1 ? -errno : ret;
+}
+
+template <typename T>
+static inline T* ringPointer(void* ring, unsigned int offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+IoUring::IoUring()
+    : mFd(-1), mRing(MAP_FAILED), mRingSize(0), mSqes(static_cast<io_uring_sqe*>(MAP_FAILED)), mSqesSize(0),
+      mEntries(0), mSqHead(0), mSqTail(0), mSqMask(0), mSqArray(0), mTail(0),
+      mCqHead(0), mCqTail(0), mCqMask(0), mCqes(0), mFreeOperation(0), mOperationCount(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    if (mFd != -1 && mOperationCount) {
+        // the kernel may still be writing to the buffers of pending
+        // reads, don't free them until it says it's done with them
+        for (size_t i = 0; i < mOperations.size(); ++i) {
+            Op& op = mOperations[i];
+            if (op.active && !op.cancelled)
+                cancel((static_cast<int>(op.generation) << IndexBits) | static_cast<int>(i + 1));
+        }
+        io_uring_cqe cqes[64];
+        for (int tries = 0; mOperationCount && tries < 100; ++tries) {
+            const int e = wait(10);
+            if (e < 0 && e != -ETIME && e != -EINTR)
+                break;
+            const unsigned int count = reap(cqes, sizeof(cqes) / sizeof(cqes[0]));
+            for (unsigned int c = 0; c < count; ++c) {
+                if (kind(cqes[c].user_data) == Operation) {
+                    IOCallback callback;
+                    Buffer buffer;
+                    complete(id(cqes[c].user_data), cqes[c].res, callback, buffer);
+                }
+            }
+        }
+    }
+    close();
+}
+
+void IoUring::close()
+{
+    if (mSqes != MAP_FAILED)
+        ::munmap(mSqes, mSqesSize);
+    if (mRing != MAP_FAILED)
+        ::munmap(mRing, mRingSize);
+    if (mFd != -1)
+        ::close(mFd);
+    mSqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    mRing = MAP_FAILED;
+    mFd = -1;
+}
+
+bool IoUring::init(unsigned int entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    mFd = ioUringSetup(entries, &params);
+    if (mFd == -1)
+        return false;
+
+    // RSRC_TAGS came with 5.13, the same release as multishot polls
+    const unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if ((params.features & required) != required) {
+        close();
+        return false;
+    }
+
+    mRingSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                         params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    mRing = ::mmap(0, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    if (mRing == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    mSqes = static_cast<io_uring_sqe*>(::mmap(0, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES));
+    if (mSqes == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    mEntries = params.sq_entries;
+    mSqHead = ringPointer<unsigned int>(mRing, params.sq_off.head);
+    mSqTail = ringPointer<unsigned int>(mRing, params.sq_off.tail);
+    mSqMask = *ringPointer<unsigned int>(mRing, params.sq_off.ring_mask);
+    mSqArray = ringPointer<unsigned int>(mRing, params.sq_off.array);
+    mTail.store(*mSqTail, std::memory_order_relaxed);
+
+    mCqHead = ringPointer<unsigned int>(mRing, params.cq_off.head);
+    mCqTail = ringPointer<unsigned int>(mRing, params.cq_off.tail);
+    mCqMask = *ringPointer<unsigned int>(mRing, params.cq_off.ring_mask);
+    mCqes = ringPointer<io_uring_cqe>(mRing, params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* IoUring::next()
+{
+    if (queued() >= mEntries) {
+        // full, hand what we have to the kernel
+        if (submit() <= 0)
+            return 0;
+    }
+    io_uring_sqe* sqe = &mSqes[mTail.load(std::memory_order_relaxed) & mSqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned int IoUring::queued() const
+{
+    // acquire pairs with push() so the entries up to the tail are
+    // complete when they're handed to the kernel
+    return mTail.load(std::memory_order_acquire) - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+}
+
+void IoUring::push()
+{
+    const unsigned int tail = mTail.load(std::memory_order_relaxed);
+    mSqArray[tail & mSqMask] = tail & mSqMask;
+    mTail.store(tail + 1, std::memory_order_release);
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+bool IoUring::poll(int fd, uint32_t events, bool multishot, uint64_t userData)
+{
+    io_uring_sqe* sqe = next();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    if (multishot)
+        sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = userData;
+    push();
+    return true;
+}
+
+bool IoUring::removePoll(uint64_t userData)
+{
+    io_uring_sqe* sqe = next();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = IoUring::userData(Ignore, 0, 0);
+    push();
+    return true;
+}
+
+IoUring::Op* IoUring::findOperation(uint32_t id, uint32_t* index)
+{
+    const uint32_t idx = (id & ((1 << IndexBits) - 1)) - 1;
+    if (!id || idx >= mOperations.size())
+        return 0;
+    Op& op = mOperations[idx];
+    if (!op.active || op.generation != (id >> IndexBits))
+        return 0;
+    *index = idx;
+    return &op;
+}
+
+int IoUring::queueOperation(uint8_t opcode, int fd, Buffer&& buffer, size_t size, IOCallback&& callback)
+{
+    io_uring_sqe* sqe = next();
+    if (!sqe)
+        return -1;
+
+    uint32_t idx;
+    if (mFreeOperation) {
+        idx = mFreeOperation - 1;
+        mFreeOperation = mOperations[idx].next;
+    } else {
+        if (mOperations.size() >= (1u << IndexBits) - 1)
+            return -1;
+        idx = mOperations.size();
+        mOperations.push_back(Op());
+    }
+    Op& op = mOperations[idx];
+    op.fd = fd;
+    op.opcode = opcode;
+    op.active = true;
+    op.cancelled = false;
+    op.buffer = std::move(buffer);
+    op.callback = std::move(callback);
+    ++mOperationCount;
+    const uint32_t id = (static_cast<uint32_t>(op.generation) << IndexBits) | (idx + 1);
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(opcode == IORING_OP_RECV ? op.buffer.end() : op.buffer.data());
+    sqe->len = size;
+    sqe->user_data = userData(Operation, id, fd);
+    push();
+    return static_cast<int>(id);
+}
+
+int IoUring::read(int fd, Buffer&& buffer, size_t size, IOCallback&& callback)
+{
+    buffer.reserve(buffer.size() + size);
+    return queueOperation(IORING_OP_RECV, fd, std::move(buffer), size, std::move(callback));
+}
+
+int IoUring::write(int fd, Buffer&& data, IOCallback&& callback)
+{
+    const size_t size = data.size();
+    return queueOperation(IORING_OP_SEND, fd, std::move(data), size, std::move(callback));
+}
+
+bool IoUring::cancel(int id)
+{
+    uint32_t idx;
+    Op* op = findOperation(id, &idx);
+    if (!op || op->cancelled)
+        return false;
+    op->cancelled = true;
+    op->callback = nullptr;
+    // if the queue is stuck the operation is left to finish on its own
+    io_uring_sqe* sqe = next();
+    if (!sqe)
+        return true;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData(Operation, id, op->fd);
+    sqe->user_data = userData(Ignore, 0, 0);
+    push();
+    return true;
+}
+
+bool IoUring::complete(uint32_t id, int result, IOCallback& callback, Buffer& buffer)
+{
+    uint32_t idx;
+    Op* op = findOperation(id, &idx);
+    if (!op)
+        return false;
+    const bool cancelled = op->cancelled;
+    if (op->opcode == IORING_OP_RECV && result > 0)
+        op->buffer.resize(op->buffer.size() + result);
+    std::swap(buffer, op->buffer);
+    callback = std::move(op->callback);
+    op->callback = nullptr;
+    op->active = false;
+    op->generation = (op->generation + 1) & ((1 << GenerationBits) - 1);
+    op->next = mFreeOperation;
+    mFreeOperation = idx + 1;
+    --mOperationCount;
+    return !cancelled;
+}
+
+int IoUring::submit()
+{
+    int ret;
+    do {
+        ret = ioUringEnter(mFd, queued(), 0, 0, 0, 0);
+    } while (ret == -EINTR);
+    return ret;
+}
+
+int IoUring::wait(int timeout)
+{
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    __kernel_timespec ts;
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000LL) * 1000000;
+        arg.ts = reinterpret_cast<uintptr_t>(&ts);
+    }
+    // the kernel doesn't wait at all unless everything it was asked to
+    // submit went in, so only ask for what's actually queued
+    const int ret = ioUringEnter(mFd, queued(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    return ret < 0 ? ret : 0;
+}
+
+unsigned int IoUring::reap(io_uring_cqe* cqes, unsigned int max)
+{
+    const unsigned int head = *mCqHead;
+    const unsigned int available = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE) - head;
+    const unsigned int count = std::min(available, max);
+    for (unsigned int i = 0; i < count; ++i)
+        cqes[i] = mCqes[(head + i) & mCqMask];
+    __atomic_store_n(mCqHead, head + count, __ATOMIC_RELEASE);
+    return count;
+}
@@ -0,0 +1,130 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "Buffer.h"
+
+// Minimal io_uring ring driven with raw system calls, the socket backend
+// of an EventLoop initialized with EventLoop::EnableIoUring. Besides
+// readiness polls the ring carries the reads and writes submitted with
+// EventLoop::submitRead()/submitWrite(). Their buffers are owned by the
+// ring until the kernel is done with them.
+//
+// Queueing entries has to be serialized by the caller, the EventLoop
+// does it under its mutex. Completions are reaped by the loop's thread.
+class IoUring
+{
+public:
+    typedef std::function<void(int, int, Buffer&&)> IOCallback;
+
+    // the top two bits of an entry's user data say what it's for, the
+    // rest is an id and the fd it's about
+    enum Kind {
+        Ignore = 0, // poll removals and cancellations
+        Wakeup = 1, // poll of the EventLoop's wakeup fd
+        Poll = 2, // readiness poll of a registered socket
+        Operation = 3 // read or write, the id is the one returned by read()/write()
+    };
+    enum { IdMask = (1 << 30) - 1 };
+    static uint64_t userData(Kind kind, uint32_t id, int fd)
+    {
+        return (static_cast<uint64_t>(kind) << 62) | (static_cast<uint64_t>(id & IdMask) << 32) | static_cast<uint32_t>(fd);
+    }
+    static Kind kind(uint64_t data) { return static_cast<Kind>(data >> 62); }
+    static uint32_t id(uint64_t data) { return (data >> 32) & IdMask; }
+    static int fd(uint64_t data) { return static_cast<int>(data & 0xffffffff); }
+
+    IoUring();
+    ~IoUring();
+
+    // Returns false if io_uring isn't available or lacks any of
+    // multishot polls, waits with a timeout or guaranteed delivery of
+    // completions, i.e. on Linux < 5.13.
+    bool init(unsigned int entries);
+
+    // These queue an entry, it's handed to the kernel by the next
+    // submit() or wait(). They fail if the submission queue is full and
+    // can't be drained.
+    bool poll(int fd, uint32_t events, bool multishot, uint64_t userData);
+    bool removePoll(uint64_t userData);
+    // Return an operation id, -1 on failure. Reads append to the buffer.
+    int read(int fd, Buffer&& buffer, size_t size, IOCallback&& callback);
+    int write(int fd, Buffer&& data, IOCallback&& callback);
+    // The callback of a cancelled operation is never called
+    bool cancel(int id);
+
+    // Returns the number of entries submitted or -errno
+    int submit();
+    // Submits what's queued and waits up to timeout ms, -1 meaning
+    // forever, for a completion. Returns 0 or -errno, -ETIME on timeout.
+    int wait(int timeout);
+    // Copies up to max completions out of the ring
+    unsigned int reap(io_uring_cqe* cqes, unsigned int max);
+
+    // Takes the callback and buffer of the operation a completion is
+    // for. Returns false if the operation has been cancelled.
+    bool complete(uint32_t id, int result, IOCallback& callback, Buffer& buffer);
+
+    size_t operationCount() const { return mOperationCount; }
+
+private:
+    void close();
+    io_uring_sqe* next();
+    void push();
+    // pushed but not taken by the kernel yet
+    unsigned int queued() const;
+    int queueOperation(uint8_t opcode, int fd, Buffer&& buffer, size_t size, IOCallback&& callback);
+    struct Op;
+    Op* findOperation(uint32_t id, uint32_t* index);
+
+    enum { IndexBits = 20, GenerationBits = 10 };
+
+    int mFd;
+    void* mRing;
+    size_t mRingSize;
+    io_uring_sqe* mSqes;
+    size_t mSqesSize;
+    unsigned int mEntries;
+
+    // submission queue
+    unsigned int* mSqHead;
+    unsigned int* mSqTail;
+    unsigned int mSqMask;
+    unsigned int* mSqArray;
+    // pushed under the EventLoop mutex, read by queued() without it
+    std::atomic<unsigned int> mTail;
+
+    // completion queue
+    unsigned int* mCqHead;
+    unsigned int* mCqTail;
+    unsigned int mCqMask;
+    io_uring_cqe* mCqes;
+
+    struct Op
+    {
+        Op() : fd(-1), generation(0), opcode(0), active(false), cancelled(false), next(0) { }
+
+        int fd;
+        uint16_t generation;
+        uint8_t opcode;
+        bool active, cancelled;
+        uint32_t next; // free list
+        Buffer buffer;
+        IOCallback callback;
+    };
+    std::vector<Op> mOperations;
+    uint32_t mFreeOperation; // index + 1, 0 if none
+    size_t mOperationCount;
+
+private:
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+};
+
+#endif
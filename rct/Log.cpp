@@ -1,20 +1,47 @@
 #include "Log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <errno.h>
+#include <limits.h>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <syslog.h>
-#include <mutex>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
 
+#include "LogFile.h"
 #include "Path.h"
+#include "ReadLocker.h"
+#include "ScalableReadWriteLock.h"
 #include "StackBuffer.h"
 #include "StopWatch.h"
+#include "Thread.h"
+#include "WriteLocker.h"
+
+typedef List<std::shared_ptr<LogOutput> > LogOutputs;
 
 static Flags<LogFlag> sFlags;
 static StopWatch sStart;
-static Set<std::shared_ptr<LogOutput> > sOutputs;
-static std::mutex sOutputsMutex;
+// replaced rather than modified, loggers take a reference to the
+// current one and let go of the lock
+static std::shared_ptr<const LogOutputs> sOutputs;
+static ScalableReadWriteLock sOutputsLock;
+// sOutputs for the crash handler, it can't take the lock
+static std::atomic<const LogOutputs*> sCrashOutputs(0);
+// without outputs everything goes to stdout
+enum { NoOutputs = INT_MAX };
+std::atomic<int> Log::sMaxLevel(NoOutputs);
 static LogLevel sLevel = LogLevel::Error;
+// setLogRotation()
+static bool sRotate = false;
+static size_t sRotateSize = 0;
+static int sRotateAge = 0, sRotateFiles = 0;
 
 const LogLevel LogLevel::None(-1);
 const LogLevel LogLevel::Error(0);
@@ -22,9 +49,20 @@ const LogLevel LogLevel::Warning(1);
 const LogLevel LogLevel::Debug(2);
 const LogLevel LogLevel::VerboseDebug(3);
 
+// LogAsync, the thread handing queued lines to the outputs and the
+// time the line it's on was logged
+static std::atomic<bool> sDraining(false);
+static pthread_t sDrainThread;
+static uint64_t sDrainElapsed;
+
+static inline bool isDrainThread()
+{
+    return sDraining.load(std::memory_order_acquire) && pthread_equal(sDrainThread, pthread_self());
+}
+
 static inline size_t prettyTimeSinceStarted(char *buf, size_t max)
 {
-    uint64_t elapsed = sStart.elapsed();
+    uint64_t elapsed = isDrainThread() ? sDrainElapsed : sStart.elapsed();
     enum {
         MS = 1,
         Second = 1000,
@@ -56,6 +94,22 @@ static inline int writeLog(FILE *f, const char *msg, int len, Flags<LogOutput::L
     }
     return ret;
 }
+
+// for crashLog(), whatever stdio still has buffered is lost
+static void writeCrash(int fd, const char *data, int len)
+{
+    while (len > 0) {
+        const ssize_t w = ::write(fd, data, len);
+        if (w <= 0) {
+            if (w == -1 && errno == EINTR)
+                continue;
+            return;
+        }
+        data += w;
+        len -= w;
+    }
+}
+
 class FileOutput : public LogOutput
 {
 public:
@@ -72,11 +126,56 @@ public:
     virtual void log(Flags<LogOutput::LogFlag> flags, const char *msg, int len) override
     {
         writeLog(file, msg, len, flags);
+        // queued lines are flushed a batch at a time
+        if (!isDrainThread())
+            fflush(file);
+    }
+    virtual void flush() override
+    {
         fflush(file);
     }
+    virtual void crashLog(Flags<LogOutput::LogFlag>, const char *line, int len) override
+    {
+        writeCrash(fileno(file), line, len);
+    }
     FILE *file;
 };
 
+class LogFileOutput : public LogOutput
+{
+public:
+    LogFileOutput(LogLevel level)
+        : LogOutput(level)
+    {
+    }
+
+    virtual void log(Flags<LogOutput::LogFlag> flags, const char *msg, int len) override
+    {
+        char time[32];
+        iovec vecs[3];
+        int count = 0;
+        if (flags & LogOutput::TrailingNewLine) {
+            if (sFlags & LogTimeStamp) {
+                vecs[count].iov_base = time;
+                vecs[count++].iov_len = prettyTimeSinceStarted(time, sizeof(time));
+            }
+        }
+        vecs[count].iov_base = const_cast<char*>(msg);
+        vecs[count++].iov_len = len;
+        if (flags & LogOutput::TrailingNewLine) {
+            vecs[count].iov_base = const_cast<char*>("\n");
+            vecs[count++].iov_len = 1;
+        }
+        file.write(vecs, count);
+    }
+    virtual void crashLog(Flags<LogOutput::LogFlag>, const char *line, int len) override
+    {
+        file.writeCrash(line, len);
+    }
+
+    LogFile file;
+};
+
 class TerminalOutput : public LogOutput
 {
 public:
@@ -104,6 +203,10 @@ public:
             }
         }
     }
+    virtual void crashLog(Flags<LogOutput::LogFlag> flags, const char *line, int len) override
+    {
+        writeCrash(flags & StdOut ? STDOUT_FILENO : STDERR_FILENO, line, len);
+    }
 private:
     int mReplaceableLength;
     Flags<::LogFlag> mFlags;
@@ -127,6 +230,439 @@ public:
     }
 };
 
+static std::shared_ptr<const LogOutputs> outputs()
+{
+    ReadLocker lock(&sOutputsLock);
+    return sOutputs;
+}
+
+// called with sOutputsLock held for writing, returns the highest level
+// any of the outputs takes
+static int setOutputs(const std::shared_ptr<const LogOutputs> &outputs)
+{
+    int max = NoOutputs;
+    if (outputs && !outputs->isEmpty()) {
+        max = LogLevel::None.toInt();
+        for (const auto &output : *outputs)
+            max = std::max(max, output->logLevel().toInt());
+    }
+    sCrashOutputs.store(outputs.get(), std::memory_order_release);
+    sOutputs = outputs;
+    return max;
+}
+
+static void dispatch(const LogOutputs *logs, LogLevel level, const char *msg, int len, Flags<LogOutput::LogFlag> flags)
+{
+    if (!logs || logs->isEmpty()) {
+        fwrite(msg, len, 1, stdout);
+        if (flags & LogOutput::TrailingNewLine)
+            fwrite("\n", 1, 1, stdout);
+    } else {
+        for (const auto &output : *logs) {
+            if (output->testLog(level)) {
+                output->log(flags, msg, len);
+            }
+        }
+    }
+}
+
+// LogAsync. Each thread that logs gets a single producer, single
+// consumer ring of records. Buffers are never unlinked, the buffer of
+// a thread that has exited is handed to the next new one once it has
+// been drained. Draining is serialized by sDrainMutex.
+struct LogRecord
+{
+    uint32_t length; // of the message
+    int32_t level;
+    uint32_t flags;
+    uint32_t padding;
+    uint64_t elapsed;
+};
+
+struct LogBuffer
+{
+    enum { Size = 64 * 1024, MaxLength = Size / 4 };
+    enum State { Active, Orphaned, Free };
+
+    LogBuffer()
+        : head(0), tail(0), dropped(0), state(Active), writing(false), next(0)
+    {
+    }
+
+    static size_t recordSize(size_t length)
+    {
+        return (sizeof(LogRecord) + length + 7) & ~static_cast<size_t>(7);
+    }
+
+    void copyIn(uint64_t pos, const void *src, size_t len)
+    {
+        const size_t offset = pos & (Size - 1);
+        const size_t first = std::min<size_t>(len, Size - offset);
+        memcpy(data + offset, src, first);
+        memcpy(data, static_cast<const char*>(src) + first, len - first);
+    }
+
+    void copyOut(uint64_t pos, void *dest, size_t len) const
+    {
+        const size_t offset = pos & (Size - 1);
+        const size_t first = std::min<size_t>(len, Size - offset);
+        memcpy(dest, data + offset, first);
+        memcpy(static_cast<char*>(dest) + first, data, len - first);
+    }
+
+    std::atomic<uint64_t> head; // written by the thread
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail; // drained up to
+    std::atomic<uint64_t> dropped;
+    std::atomic<int> state;
+    // set while the thread is queueing a line, see stopWriter()
+    std::atomic<bool> writing;
+    LogBuffer *next;
+    char data[Size];
+};
+
+static std::atomic<LogBuffer*> sBuffers(0);
+static std::atomic<bool> sAsync(false);
+static std::atomic<uint64_t> sDropped(0);
+static std::mutex sDrainMutex;
+static pthread_key_t sBufferKey;
+static pthread_once_t sBufferOnce = PTHREAD_ONCE_INIT;
+
+// waking up the writer and threads waiting for room
+static std::mutex sWakeMutex;
+static std::condition_variable sWakeCond, sRoomCond;
+static std::atomic<bool> sWriterSleeping(false);
+static std::atomic<int> sBlocked(0);
+static bool sStopWriter = false;
+
+static void releaseBuffer(void *buffer)
+{
+    static_cast<LogBuffer*>(buffer)->state.store(LogBuffer::Orphaned, std::memory_order_release);
+}
+
+static void createBufferKey()
+{
+    pthread_key_create(&sBufferKey, releaseBuffer);
+}
+
+static LogBuffer *threadBuffer()
+{
+    pthread_once(&sBufferOnce, createBufferKey);
+    LogBuffer *buffer = static_cast<LogBuffer*>(pthread_getspecific(sBufferKey));
+    if (buffer)
+        return buffer;
+    for (buffer = sBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        int state = LogBuffer::Free;
+        if (buffer->state.compare_exchange_strong(state, LogBuffer::Active))
+            break;
+    }
+    if (!buffer) {
+        buffer = new LogBuffer;
+        buffer->next = sBuffers.load(std::memory_order_relaxed);
+        while (!sBuffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+    pthread_setspecific(sBufferKey, buffer);
+    return buffer;
+}
+
+static void wakeWriter()
+{
+    if (sWriterSleeping.load(std::memory_order_relaxed) && sWriterSleeping.exchange(false)) {
+        std::lock_guard<std::mutex> lock(sWakeMutex);
+        sWakeCond.notify_one();
+    }
+}
+
+static bool hasQueued()
+{
+    for (LogBuffer *buffer = sBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        if (buffer->head.load(std::memory_order_seq_cst) != buffer->tail.load(std::memory_order_relaxed))
+            return true;
+    }
+    return false;
+}
+
+static size_t drainLogs();
+
+// false if the line has to be logged right away
+static bool queueLog(LogLevel level, const char *msg, int len, Flags<LogOutput::LogFlag> flags)
+{
+    if (len > LogBuffer::MaxLength) {
+        // too long for the ring, what's queued before it goes out first
+        // and the line is logged whole from here
+        if (!isDrainThread())
+            drainLogs();
+        return false;
+    }
+    LogBuffer *buffer = threadBuffer();
+    buffer->writing.store(true);
+    // stopWriter() clears sAsync and then waits for writing to go false
+    if (!sAsync.load()) {
+        buffer->writing.store(false, std::memory_order_release);
+        if (!isDrainThread())
+            drainLogs();
+        return false;
+    }
+    const size_t length = len;
+    const size_t size = LogBuffer::recordSize(length);
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    while (head + size - buffer->tail.load(std::memory_order_acquire) > LogBuffer::Size) {
+        // the writer logging about itself mustn't wait for itself
+        if (!(sFlags & LogAsyncBlock) || isDrainThread()) {
+            ++buffer->dropped;
+            buffer->writing.store(false, std::memory_order_release);
+            return true;
+        }
+        if (!sAsync.load()) {
+            // the writer is gone, log it directly after what's queued
+            buffer->writing.store(false, std::memory_order_release);
+            drainLogs();
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(sWakeMutex);
+        ++sBlocked;
+        sWriterSleeping.store(false);
+        sWakeCond.notify_one();
+        sRoomCond.wait_for(lock, std::chrono::milliseconds(10));
+        --sBlocked;
+    }
+    LogRecord record = { static_cast<uint32_t>(length), level.toInt(), flags.cast<uint32_t>(), 0, 0 };
+    if (sFlags & LogTimeStamp)
+        record.elapsed = sStart.elapsed();
+    buffer->copyIn(head, &record, sizeof(record));
+    buffer->copyIn(head + sizeof(record), msg, length);
+    buffer->head.store(head + size, std::memory_order_release);
+    buffer->writing.store(false, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wakeWriter();
+    return true;
+}
+
+// Hands what's queued to the outputs, the number of lines
+static size_t drainLogs()
+{
+    std::unique_lock<std::mutex> lock(sDrainMutex);
+    const std::shared_ptr<const LogOutputs> logs = outputs();
+
+    sDrainThread = pthread_self();
+    sDraining.store(true, std::memory_order_release);
+    size_t count = 0;
+    String message;
+    for (LogBuffer *buffer = sBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        const int state = buffer->state.load(std::memory_order_acquire);
+        if (state == LogBuffer::Free)
+            continue;
+        uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        while (tail != head) {
+            LogRecord record;
+            buffer->copyOut(tail, &record, sizeof(record));
+            message.resize(record.length);
+            buffer->copyOut(tail + sizeof(record), message.data(), record.length);
+            tail += LogBuffer::recordSize(record.length);
+            sDrainElapsed = record.elapsed;
+            dispatch(logs.get(), LogLevel(record.level), message.constData(), message.size(),
+                     Flags<LogOutput::LogFlag>(static_cast<LogOutput::LogFlag>(record.flags)));
+            ++count;
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+        if (const uint64_t dropped = buffer->dropped.exchange(0)) {
+            sDropped += dropped;
+            sDrainElapsed = sStart.elapsed();
+            const String warning = String::format<64>("%llu log lines dropped", static_cast<unsigned long long>(dropped));
+            dispatch(logs.get(), LogLevel::Error, warning.constData(), warning.size(), LogOutput::DefaultFlags);
+            ++count;
+        }
+        if (state == LogBuffer::Orphaned && buffer->head.load(std::memory_order_acquire) == tail)
+            buffer->state.store(LogBuffer::Free, std::memory_order_release);
+    }
+    if (count && logs) {
+        for (const auto &output : *logs)
+            output->flush();
+    }
+    sDraining.store(false, std::memory_order_release);
+    lock.unlock();
+
+    if (sBlocked.load()) {
+        std::lock_guard<std::mutex> wake(sWakeMutex);
+        sRoomCond.notify_all();
+    }
+    return count;
+}
+
+class LogWriterThread : public Thread
+{
+public:
+    LogWriterThread()
+    {
+        setAutoDelete(false);
+    }
+
+protected:
+    virtual void run() override
+    {
+        for (;;) {
+            if (drainLogs())
+                continue;
+            std::unique_lock<std::mutex> lock(sWakeMutex);
+            if (sStopWriter)
+                break;
+            sWriterSleeping.store(true);
+            if (!hasQueued())
+                sWakeCond.wait_for(lock, std::chrono::milliseconds(100));
+            sWriterSleeping.store(false);
+        }
+    }
+};
+
+static LogWriterThread *sWriter = 0;
+
+static const int sCrashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+// the crash handler's snprintf(), at least width digits
+static char *crashNumber(char *out, uint64_t value, int width)
+{
+    char digits[24];
+    int count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (count < width)
+        digits[count++] = '0';
+    while (count)
+        *out++ = digits[--count];
+    return out;
+}
+
+static void crashDispatch(const LogOutputs *logs, LogLevel level, Flags<LogOutput::LogFlag> flags,
+                          const char *line, int len, int stamp)
+{
+    if (!logs || logs->isEmpty()) {
+        // dispatch() doesn't stamp stdout either
+        writeCrash(STDOUT_FILENO, line + stamp, len - stamp);
+        return;
+    }
+    for (const auto &output : *logs) {
+        if (output->testLog(level))
+            output->crashLog(flags, line, len);
+    }
+}
+
+// The queued lines when a fatal signal comes in. Only storage set
+// aside up front is used and nothing waits for long, the crash may
+// well have happened in malloc() or with a lock held.
+static void drainLogsOnCrash()
+{
+    std::unique_lock<std::mutex> lock(sDrainMutex, std::defer_lock);
+    for (int i = 0; i < 100 && !lock.try_lock(); ++i) {
+        const timespec wait = { 0, 1000000 };
+        nanosleep(&wait, 0);
+    }
+    if (!lock.owns_lock())
+        return;
+
+    // setOutputs() may free it under us, a crash while the outputs
+    // change is a risk we take
+    const LogOutputs *logs = sCrashOutputs.load(std::memory_order_acquire);
+    static char line[32 + LogBuffer::MaxLength + 1];
+    for (LogBuffer *buffer = sBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        if (buffer->state.load(std::memory_order_acquire) == LogBuffer::Free)
+            continue;
+        uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        while (tail != head) {
+            LogRecord record;
+            buffer->copyOut(tail, &record, sizeof(record));
+            const Flags<LogOutput::LogFlag> flags(static_cast<LogOutput::LogFlag>(record.flags));
+            char *out = line;
+            if (sFlags & LogTimeStamp && flags & LogOutput::TrailingNewLine) {
+                // "HH:MM:SS:mmm: " like prettyTimeSinceStarted()
+                out = crashNumber(out, record.elapsed / 3600000, 2);
+                *out++ = ':';
+                out = crashNumber(out, record.elapsed / 60000 % 60, 2);
+                *out++ = ':';
+                out = crashNumber(out, record.elapsed / 1000 % 60, 2);
+                *out++ = ':';
+                out = crashNumber(out, record.elapsed % 1000, 3);
+                *out++ = ':';
+                *out++ = ' ';
+            }
+            const int stamp = out - line;
+            const size_t length = std::min<size_t>(record.length, LogBuffer::MaxLength);
+            buffer->copyOut(tail + sizeof(record), out, length);
+            out += length;
+            if (flags & LogOutput::TrailingNewLine)
+                *out++ = '\n';
+            tail += LogBuffer::recordSize(record.length);
+            crashDispatch(logs, LogLevel(record.level), flags, line, out - line, stamp);
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+        if (const uint64_t dropped = buffer->dropped.exchange(0)) {
+            static const char text[] = " log lines dropped\n";
+            char *out = crashNumber(line, dropped, 1);
+            memcpy(out, text, sizeof(text) - 1);
+            out += sizeof(text) - 1;
+            crashDispatch(logs, LogLevel::Error, LogOutput::DefaultFlags, line, out - line, 0);
+        }
+    }
+}
+
+static void crashHandler(int sig)
+{
+    drainLogsOnCrash();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void startWriter()
+{
+    if (sWriter)
+        return;
+    sStopWriter = false;
+    sWriter = new LogWriterThread;
+    sWriter->start();
+    sAsync.store(true);
+    for (int sig : sCrashSignals) {
+        struct sigaction action;
+        if (!sigaction(sig, 0, &action) && action.sa_handler == SIG_DFL && !(action.sa_flags & SA_SIGINFO))
+            signal(sig, crashHandler);
+    }
+}
+
+static void stopWriter()
+{
+    if (!sWriter)
+        return;
+    sAsync.store(false);
+    {
+        std::lock_guard<std::mutex> lock(sWakeMutex);
+        sStopWriter = true;
+        sWakeCond.notify_one();
+    }
+    sWriter->join();
+    delete sWriter;
+    sWriter = 0;
+    // a thread that saw sAsync before it was cleared may still be
+    // queueing, its line has to make it into the last drain
+    for (LogBuffer *buffer = sBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        while (buffer->writing.load())
+            std::this_thread::yield();
+    }
+    drainLogs();
+}
+
+void flushLogs()
+{
+    drainLogs();
+}
+
+uint64_t droppedLogLines()
+{
+    return sDropped.load();
+}
+
 void restartTime()
 {
     sStart.restart();
@@ -134,7 +670,7 @@ void restartTime()
 
 static void logHelper(LogLevel level, Flags<LogOutput::LogFlag> flags, const char *format, va_list v)
 {
-    if (!testLog(level))
+    if (!Log::isEnabled(level))
         return;
 
     va_list v2;
@@ -159,32 +695,20 @@ static void logHelper(LogLevel level, Flags<LogOutput::LogFlag> flags, const cha
 
 void logDirect(LogLevel level, const char *msg, int len, Flags<LogOutput::LogFlag> flags)
 {
-    Set<std::shared_ptr<LogOutput> > logs;
-    {
-        std::lock_guard<std::mutex> lock(sOutputsMutex);
-        logs = sOutputs;
-    }
-    if (logs.isEmpty()) {
-        fwrite(msg, len, 1, stdout);
-        if (flags & LogOutput::TrailingNewLine)
-            fwrite("\n", 1, 1, stdout);
-    } else {
-        for (const auto &output : logs) {
-            if (output->testLog(level)) {
-                output->log(flags, msg, len);
-            }
-        }
-    }
+    if (!Log::isEnabled(level))
+        return;
+    if (sAsync.load(std::memory_order_relaxed) && queueLog(level, msg, len, flags))
+        return;
+    const std::shared_ptr<const LogOutputs> logs = outputs();
+    dispatch(logs.get(), level, msg, len, flags);
 }
 
 void log(const std::function<void(const std::shared_ptr<LogOutput> &)> &func)
 {
-    Set<std::shared_ptr<LogOutput> > logs;
-    {
-        std::lock_guard<std::mutex> lock(sOutputsMutex);
-        logs = sOutputs;
-    }
-    for (const auto &out : logs) {
+    const std::shared_ptr<const LogOutputs> logs = outputs();
+    if (!logs)
+        return;
+    for (const auto &out : *logs) {
         func(out);
     }
 }
@@ -240,10 +764,12 @@ void error(const char *format, ...)
 
 bool testLog(LogLevel level)
 {
-    std::lock_guard<std::mutex> lock(sOutputsMutex);
-    if (sOutputs.isEmpty())
+    if (!Log::isEnabled(level))
+        return false;
+    const std::shared_ptr<const LogOutputs> logs = outputs();
+    if (!logs || logs->isEmpty())
         return true;
-    for (const auto &output : sOutputs) {
+    for (const auto &output : *logs) {
         if (output->testLog(level))
             return true;
     }
@@ -272,7 +798,16 @@ bool initLogging(const char* ident, Flags<LogFlag> flags, LogLevel level,
         std::shared_ptr<SyslogOutput> out(new SyslogOutput(ident, level));
         out->add();
     }
-    if (!file.isEmpty()) {
+    if (!file.isEmpty() && sRotate) {
+        std::shared_ptr<LogFileOutput> out(new LogFileOutput(logFileLogLevel));
+        out->file.setMaxSize(sRotateSize);
+        out->file.setMaxAge(sRotateAge);
+        out->file.setMaxFiles(sRotateFiles);
+        out->file.setCompress(flags & LogCompress);
+        if (!out->file.open(file, flags & Append ? LogFile::Append : flags & DontRotate ? LogFile::Truncate : LogFile::Rotate))
+            return false;
+        out->add();
+    } else if (!file.isEmpty()) {
         if (!(flags & (Append|DontRotate)) && file.exists()) {
             int i = 0;
             while (true) {
@@ -288,39 +823,83 @@ bool initLogging(const char* ident, Flags<LogFlag> flags, LogLevel level,
         FILE *f = fopen(file.constData(), flags & Append ? "a" : "w");
         if (!f)
             return false;
+        if (flags & LogAsync)
+            setvbuf(f, 0, _IOFBF, 64 * 1024);
         std::shared_ptr<FileOutput> out(new FileOutput(logFileLogLevel, f));
         out->add();
     }
+    if (flags & LogAsync)
+        startWriter();
     return true;
 }
 
+void setLogRotation(size_t maxSize, int maxAge, int maxFiles)
+{
+    sRotate = true;
+    sRotateSize = maxSize;
+    sRotateAge = maxAge;
+    sRotateFiles = maxFiles;
+}
+
 void cleanupLogging()
 {
-    std::lock_guard<std::mutex> lock(sOutputsMutex);
-    sOutputs.clear();
+    sRotate = false;
+    stopWriter();
+    WriteLocker lock(&sOutputsLock);
+    Log::sMaxLevel.store(setOutputs(std::shared_ptr<const LogOutputs>()), std::memory_order_release);
 }
 
-Log::Log(String *out, Flags<LogOutput::LogFlag> flags)
+// a Log::Data per thread to be reused, its String keeps its capacity
+static pthread_key_t sDataKey;
+static pthread_once_t sDataOnce = PTHREAD_ONCE_INIT;
+
+Log::Data *Log::takeData()
 {
-    assert(out);
-    mData.reset(new Data(out, flags));
+    pthread_once(&sDataOnce, []() {
+            pthread_key_create(&sDataKey, [](void *data) { delete static_cast<Data*>(data); });
+        });
+    Data *data = static_cast<Data*>(pthread_getspecific(sDataKey));
+    if (data) {
+        pthread_setspecific(sDataKey, 0);
+    } else {
+        data = new Data;
+    }
+    return data;
 }
 
-Log::Log(LogLevel level, Flags<LogOutput::LogFlag> flags)
+Log::Log(String *out, Flags<LogOutput::LogFlag> flags)
+    : mData(0)
 {
-    if (testLog(level))
-        mData.reset(new Data(level, flags));
+    assert(out);
+    init(LogLevel::None, flags);
+    mData->outPtr = out;
 }
 
-Log::Log(const Log &other)
-    : mData(other.mData)
+void Log::init(LogLevel level, Flags<LogOutput::LogFlag> flags)
 {
+    mData = takeData();
+    mData->outPtr = 0;
+    mData->level = level;
+    mData->spacing = true;
+    mData->disableSpacingOverride = 0;
+    mData->flags = flags;
+    mData->refs = 1;
 }
 
-Log &Log::operator=(const Log &other)
+void Log::release()
 {
-    mData = other.mData;
-    return *this;
+    Data *data = mData;
+    mData = 0;
+    if (!data->out.isEmpty()) {
+        logDirect(data->level, data->out, data->flags);
+        data->out.clear();
+    }
+    // a Log made while logging this one may have put its data back
+    if (data->out.ref().capacity() > 4096 || pthread_getspecific(sDataKey)) {
+        delete data;
+    } else {
+        pthread_setspecific(sDataKey, data);
+    }
 }
 
 LogOutput::LogOutput(LogLevel logLevel)
@@ -334,12 +913,24 @@ LogOutput::~LogOutput()
 
 void LogOutput::add()
 {
-    std::lock_guard<std::mutex> lock(sOutputsMutex);
-    sOutputs.insert(shared_from_this());
+    WriteLocker lock(&sOutputsLock);
+    std::shared_ptr<LogOutputs> logs = std::make_shared<LogOutputs>();
+    if (sOutputs)
+        *logs = *sOutputs;
+    const std::shared_ptr<LogOutput> self = shared_from_this();
+    if (!logs->contains(self))
+        logs->append(self);
+    Log::sMaxLevel.store(setOutputs(logs), std::memory_order_release);
 }
 
 void LogOutput::remove()
 {
-    std::lock_guard<std::mutex> lock(sOutputsMutex);
-    sOutputs.remove(shared_from_this());
+    WriteLocker lock(&sOutputsLock);
+    if (!sOutputs)
+        return;
+    std::shared_ptr<LogOutputs> logs = std::make_shared<LogOutputs>(*sOutputs);
+    const LogOutputs::iterator it = std::find(logs->begin(), logs->end(), shared_from_this());
+    if (it != logs->end())
+        logs->erase(it);
+    Log::sMaxLevel.store(setOutputs(logs), std::memory_order_release);
 }
@@ -1,7 +1,9 @@
 #ifndef Log_h
 #define Log_h
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <cxxabi.h>
 #include <climits>
 #include <ctype.h>
@@ -60,6 +62,8 @@ public:
 
     virtual unsigned int flags() const { return 0; }
 
+    // Levels above logLevel() are turned away before this is asked, an
+    // output can only be pickier than its log level
     virtual bool testLog(LogLevel level) const
     {
         return level >= LogLevel::Error && level <= mLogLevel;
@@ -73,6 +77,14 @@ public:
         DefaultFlags = TrailingNewLine
     };
     virtual void log(Flags<LogFlag> /*flags*/, const char */*msg*/, int /*len*/) { }
+    // called after a batch of lines has been logged by the LogAsync
+    // writer thread
+    virtual void flush() { }
+    // Lines LogAsync still had queued when the process got a fatal
+    // signal, time stamp and newline included. Called from the signal
+    // handler, it mustn't allocate or wait for a lock. The outputs here
+    // write(2) the bytes to their file descriptor.
+    virtual void crashLog(Flags<LogFlag> /*flags*/, const char */*line*/, int /*len*/) { }
     void log(const String &msg) { log(Flags<LogFlag>(DefaultFlags), msg.constData(), msg.length()); }
     template <int StaticBufSize = 256>
     void vlog(const char *format, ...) RCT_PRINTF_WARNING(2, 3);
@@ -113,7 +125,18 @@ enum LogFlag {
     LogStderr = 0x04,
     LogSyslog = 0x08,
     LogTimeStamp = 0x10,
-    LogFlush = 0x20
+    LogFlush = 0x20,
+    // Lines are queued in a ring buffer per thread and handed to the
+    // outputs by a background thread. Lines from one thread stay in
+    // order, lines from different threads may be reordered. A thread
+    // whose buffer is full drops its lines unless LogAsyncBlock is set,
+    // in which case it waits for the writer. Lines longer than 16KB
+    // don't fit, the thread writes those itself once what's queued has
+    // been written.
+    LogAsync = 0x40,
+    LogAsyncBlock = 0x80,
+    // rotated log files are gzipped, see setLogRotation()
+    LogCompress = 0x100
 };
 RCT_FLAGS_OPERATORS(LogFlag);
 
@@ -123,48 +146,104 @@ bool initLogging(const char* ident,
                  const Path &logFile = Path(),
                  LogLevel logFileLogLevel = LogLevel::VerboseDebug);
 void cleanupLogging();
+// Keeps the file given to initLogging() from growing forever, has to be
+// called before it and lasts until cleanupLogging(). The file moves to file.1, file.2, ... once it's
+// larger than maxSize bytes or older than maxAge seconds, only the
+// newest maxFiles of those are kept. 0 turns any of them off. Lines
+// are written to a mapping of the file rather than through a FILE,
+// the old file is closed, compressed with LogCompress and removed on
+// a thread of its own. See LogFile.
+void setLogRotation(size_t maxSize, int maxAge = 0, int maxFiles = 0);
+// Writes everything queued by LogAsync so far, waiting for the writer
+// thread if it's draining. Handlers for fatal signals that don't have
+// one already write what they can before the process goes down, they
+// give up rather than wait on a lock for long.
+void flushLogs();
+// lines LogAsync has dropped because a buffer was full
+uint64_t droppedLogLines();
 LogLevel logLevel();
 void restartTime();
+// Formats one line. Copies of a Log share the line, which is logged
+// once the last of them goes away. A Log and its copies belong to the
+// thread that made them. A Log for a level no output takes does
+// nothing, all it costs is a check of the level.
 class Log
 {
 public:
     Log(String *out, Flags<LogOutput::LogFlag> flags = LogOutput::DefaultFlags);
-    Log(LogLevel level = LogLevel::Error, Flags<LogOutput::LogFlag> flags = LogOutput::DefaultFlags);
-    Log(const Log &other);
-    Log &operator=(const Log &other);
+    Log(LogLevel level = LogLevel::Error, Flags<LogOutput::LogFlag> flags = LogOutput::DefaultFlags)
+        : mData(0)
+    {
+        // the outputs have another look once there's something to log
+        if (isEnabled(level))
+            init(level, flags);
+    }
+    Log(const Log &other)
+        : mData(other.mData)
+    {
+        if (mData)
+            ++mData->refs;
+    }
+    Log(Log &&other)
+        : mData(other.mData)
+    {
+        other.mData = 0;
+    }
+    ~Log()
+    {
+        if (mData && !--mData->refs)
+            release();
+    }
+    Log &operator=(Log other)
+    {
+        std::swap(mData, other.mData);
+        return *this;
+    }
+
+    // false if no output takes level, testLog() asks the outputs
+    static bool isEnabled(LogLevel level)
+    {
+        return level.toInt() <= sMaxLevel.load(std::memory_order_relaxed);
+    }
+
 #if defined(OS_Darwin)
 #ifndef __i386__
-    Log operator<<(long number) { return addStringStream(number); }
+    Log &operator<<(long number) { return addSigned(number); }
 #endif
-    Log operator<<(size_t number) { return addStringStream(number); }
+    Log &operator<<(size_t number) { return addUnsigned(number); }
 #elif (ULONG_MAX) != (UINT_MAX)
-    Log operator<<(uint64_t number) { return addStringStream(number); }
-    Log operator<<(int64_t number) { return addStringStream(number); }
+    Log &operator<<(uint64_t number) { return addUnsigned(number); }
+    Log &operator<<(int64_t number) { return addSigned(number); }
 #endif
 #if defined(__i386__)
-    Log operator<<(long number) { return addStringStream(number); }
+    Log &operator<<(long number) { return addSigned(number); }
 #endif
-    Log operator<<(unsigned long long number) { return addStringStream(number); }
-    Log operator<<(long long number) { return addStringStream(number); }
-    Log operator<<(uint32_t number) { return addStringStream(number); }
-    Log operator<<(int32_t number) { return addStringStream(number); }
-    Log operator<<(uint16_t number) { return addStringStream(number); }
-    Log operator<<(int16_t number) { return addStringStream(number); }
-    Log operator<<(uint8_t number) { return addStringStream<uint16_t>(number); }
-    Log operator<<(int8_t number) { return addStringStream(number); }
-    Log operator<<(float number) { return addStringStream(number); }
-    Log operator<<(double number) { return addStringStream(number); }
-    Log operator<<(long double number) { return addStringStream(number); }
-    Log operator<<(char ch) { return write(&ch, 1); }
-    Log operator<<(bool b) { return write(b ? "true" : "false"); }
-    Log operator<<(void *ptr)
+    Log &operator<<(unsigned long long number) { return addUnsigned(number); }
+    Log &operator<<(long long number) { return addSigned(number); }
+    Log &operator<<(uint32_t number) { return addUnsigned(number); }
+    Log &operator<<(int32_t number) { return addSigned(number); }
+    Log &operator<<(uint16_t number) { return addUnsigned(number); }
+    Log &operator<<(int16_t number) { return addSigned(number); }
+    Log &operator<<(uint8_t number) { return addUnsigned(number); }
+    // like std::ostream, int8_t is a character
+    Log &operator<<(int8_t number) { return write(reinterpret_cast<const char*>(&number), 1); }
+    Log &operator<<(float number) { return addFloat("%g", number); }
+    Log &operator<<(double number) { return addFloat("%g", number); }
+    Log &operator<<(long double number) { return addFloat("%Lg", number); }
+    Log &operator<<(char ch) { return write(&ch, 1); }
+    Log &operator<<(bool b) { return write(b ? "true" : "false"); }
+    Log &operator<<(void *ptr)
     {
-        char buf[16];
-        const int w = snprintf(buf, sizeof(buf), "%p", ptr);
-        return write(buf, w);
+        if (mData) {
+            char buf[24];
+            const int w = snprintf(buf, sizeof(buf), "%p", ptr);
+            write(buf, w);
+        }
+        return *this;
     }
-    Log operator<<(const char *string) { return write(string); }
-    Log write(const char *data, int len = -1)
+    Log &operator<<(const char *string) { return write(string); }
+    Log &operator<<(const String &string) { return write(string.constData(), string.size()); }
+    Log &write(const char *data, int len = -1)
     {
         if (data && mData) {
             if (len == -1)
@@ -190,7 +269,7 @@ public:
         return *this;
     }
     template <int StaticBufSize = 256>
-    Log log(const char *format, ...) RCT_PRINTF_WARNING(2, 3);
+    Log &log(const char *format, ...) RCT_PRINTF_WARNING(2, 3);
     void disableNextSpacing()
     {
         if (mData)
@@ -227,46 +306,66 @@ public:
         return Flags<LogOutput::LogFlag>();
     }
 private:
-    template <typename T> Log addStringStream(T t)
+    // numbers are formatted on the stack, snprintf doesn't allocate
+    Log &addSigned(long long number)
+    {
+        return addUnsigned(number < 0 ? 0ull - static_cast<unsigned long long>(number) : number, number < 0);
+    }
+    Log &addUnsigned(unsigned long long number, bool negative = false)
     {
         if (mData) {
-            std::ostringstream str;
-            str << t;
-            const std::string string = str.str();
-            return write(string.data(), string.size());
+            char buf[24];
+            char *end = buf + sizeof(buf), *ch = end;
+            do {
+                *--ch = '0' + number % 10;
+                number /= 10;
+            } while (number);
+            if (negative)
+                *--ch = '-';
+            write(ch, end - ch);
         }
         return *this;
     }
-    class Data
+    template <typename T> Log &addFloat(const char *format, T number)
     {
-    public:
-        Data(String *string, Flags<LogOutput::LogFlag> f)
-            : outPtr(string), level(LogLevel::None), spacing(true), disableSpacingOverride(0), flags(f)
-        {}
-        Data(LogLevel lvl, Flags<LogOutput::LogFlag> f)
-            : outPtr(0), level(lvl), spacing(true), disableSpacingOverride(0), flags(f)
-        {
-        }
-        ~Data()
-        {
-            if (!out.isEmpty()) {
-                logDirect(level, out, flags);
-            }
+        if (mData) {
+            char buf[64];
+            const int w = snprintf(buf, sizeof(buf), format, number);
+            write(buf, std::min<int>(w, sizeof(buf) - 1));
         }
+        return *this;
+    }
+    struct Data;
+    static Data *takeData();
+    void init(LogLevel level, Flags<LogOutput::LogFlag> flags);
+    // logs the line, the data is kept for the thread's next Log
+    void release();
+
+    struct Data
+    {
+        Data()
+            : outPtr(0), level(LogLevel::None), out(), spacing(true), disableSpacingOverride(0), flags(), refs(0)
+        {}
 
         String *outPtr;
-        const LogLevel level;
+        LogLevel level;
         String out;
         bool spacing;
         int disableSpacingOverride;
         Flags<LogOutput::LogFlag> flags;
+        int refs;
     };
 
-    std::shared_ptr<Data> mData;
+    Data *mData;
+
+    // the highest level any output takes, set by LogOutput
+    static std::atomic<int> sMaxLevel;
+    friend class LogOutput;
+    friend void cleanupLogging();
 };
 
 template <int StaticBufSize>
-inline Log Log::log(const char *format, ...)
+inline Log &Log::log(const char *format, ...)
 {
     if (mData) {
         va_list args;
@@ -458,12 +557,6 @@ inline Log operator<<(Log log, Flags<T> f)
     return log;
 }
 
-inline Log operator<<(Log stream, const String &byteArray)
-{
-    stream.write(byteArray.constData(), byteArray.size());
-    return stream;
-}
-
 template <typename T>
 String &operator<<(String &str, const T &t)
 {
@@ -0,0 +1,567 @@
+#include "LogFile.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef RCT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Rct.h"
+#include "Thread.h"
+
+class LogFileThread : public Thread
+{
+public:
+    LogFileThread()
+        : mStop(false), mBusy(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void post(std::function<void()> &&job)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.append(std::move(job));
+        mCond.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mBusy || !mJobs.isEmpty())
+            mCond.wait(lock);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+            mCond.notify_all();
+        }
+        join();
+    }
+
+protected:
+    virtual void run() override
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (;;) {
+            if (mJobs.isEmpty()) {
+                // whatever was posted before stop() still gets done
+                if (mStop)
+                    break;
+                mCond.wait(lock);
+                continue;
+            }
+            std::function<void()> job = std::move(mJobs.front());
+            mJobs.removeFirst();
+            mBusy = true;
+            lock.unlock();
+            job();
+            lock.lock();
+            mBusy = false;
+            mCond.notify_all();
+        }
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    List<std::function<void()> > mJobs;
+    bool mStop, mBusy;
+};
+
+static Path rotatedPath(const Path &path, int index)
+{
+    return String::format<256>("%s.%d", path.constData(), index);
+}
+
+// N for path.N and path.N.gz, 0 for anything else
+static int rotatedIndex(const String &prefix, const char *name)
+{
+    if (strncmp(name, prefix.constData(), prefix.size()))
+        return 0;
+    char *end;
+    const long index = strtol(name + prefix.size(), &end, 10);
+    if (end == name + prefix.size() || (*end && strcmp(end, ".gz")))
+        return 0;
+    return std::max<int>(index, 0);
+}
+
+static List<Path> rotatedFiles(const Path &path)
+{
+    const Path dir = path.parentDir();
+    return (dir.isEmpty() ? Path("./") : dir).files(Path::File);
+}
+
+// the highest N of path.N and path.N.gz
+static int lastRotatedIndex(const Path &path)
+{
+    const String prefix = String(path.fileName()) + '.';
+    int last = 0;
+    for (const Path &file : rotatedFiles(path))
+        last = std::max(last, rotatedIndex(prefix, file.fileName()));
+    return last;
+}
+
+// removes path.N and path.N.gz for every N up to last
+static void removeRotated(const Path &path, int last)
+{
+    const String prefix = String(path.fileName()) + '.';
+    for (const Path &file : rotatedFiles(path)) {
+        const int index = rotatedIndex(prefix, file.fileName());
+        if (index && index <= last)
+            Path::rm(file);
+    }
+}
+
+// drops zeroes left at the end by a segment that was never cut back
+static size_t trimmedSize(int fd, size_t size)
+{
+    char buf[4096];
+    while (size) {
+        const size_t chunk = std::min(size, sizeof(buf));
+        ssize_t r;
+        eintrwrap(r, ::pread(fd, buf, chunk, size - chunk));
+        if (r != static_cast<ssize_t>(chunk))
+            break;
+        size_t len = chunk;
+        while (len && !buf[len - 1])
+            --len;
+        size -= chunk - len;
+        if (len)
+            break;
+    }
+    return size;
+}
+
+// for file systems that can't allocate, false if the disk is full
+static bool fillZeroes(int fd, size_t from, size_t to)
+{
+    static const char zeroes[65536] = { 0 };
+    while (from < to) {
+        ssize_t w;
+        eintrwrap(w, ::pwrite(fd, zeroes, std::min(to - from, sizeof(zeroes)), from));
+        if (w <= 0)
+            return false;
+        from += w;
+    }
+    return true;
+}
+
+// grows the file to cover the segment at offset and maps it, 0 if it
+// can't be
+static char *mapAt(int fd, size_t offset, size_t size, size_t written)
+{
+    // the blocks have to be there before they're written through the
+    // mapping, writing to a hole on a full disk is a SIGBUS
+    if (::posix_fallocate(fd, offset, size) && !fillZeroes(fd, written, offset + size))
+        return 0;
+    void *map = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    return map == MAP_FAILED ? 0 : static_cast<char*>(map);
+}
+
+// where the file rotate() moves to path is made ready
+static Path nextPath(const Path &path)
+{
+    return path + ".next";
+}
+
+LogFile::LogFile()
+    : mMaxSize(0), mSegmentSize(DefaultSegmentSize), mMaxAge(0), mMaxFiles(0), mCompress(false),
+      mFd(-1), mMap(0), mMapOffset(0), mSize(0), mOpened(0), mLastIndex(0),
+      mNextMap(0), mNextFd(-1), mNextFileMap(0), mPreparingSegment(false), mPreparingFile(false), mThread(0)
+{
+}
+
+LogFile::~LogFile()
+{
+    close();
+}
+
+bool LogFile::open(const Path &path, OpenMode mode)
+{
+    close();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPath = path;
+    mLastIndex = lastRotatedIndex(path);
+    if (mode == Rotate && path.exists() && !::rename(path.constData(), rotatedPath(path, mLastIndex + 1).constData())) {
+        ++mLastIndex;
+        if (mCompress) {
+            const Path rotated = rotatedPath(path, mLastIndex);
+            post([rotated]() {
+                    if (compress(rotated, rotated + ".gz"))
+                        Path::rm(rotated);
+                });
+        }
+    }
+    if (mMaxFiles && mLastIndex > mMaxFiles) {
+        // the ones a previous run left beyond the limit
+        const Path p = mPath;
+        const int last = mLastIndex - mMaxFiles;
+        post([p, last]() { removeRotated(p, last); });
+    }
+    return openFile(mode != Append);
+}
+
+bool LogFile::openFile(bool truncate)
+{
+    int fd;
+    eintrwrap(fd, ::open(mPath.constData(), O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644));
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (::fstat(fd, &st)) {
+        ::close(fd);
+        return false;
+    }
+    mFd = fd;
+    mSize = trimmedSize(fd, st.st_size);
+    mOpened = Rct::coarseMonoMs();
+    if (!mapSegment()) {
+        ::close(mFd);
+        mFd = -1;
+        return false;
+    }
+    prepareSegment();
+    prepareFile();
+    return true;
+}
+
+// maps the segment mSize is in, growing the file to cover it
+bool LogFile::mapSegment()
+{
+    unmap();
+    mMapOffset = mSize - (mSize % mSegmentSize);
+    mMap = mapAt(mFd, mMapOffset, mSegmentSize, mSize);
+    return mMap;
+}
+
+// moves on to the segment after the current one, the one the thread
+// made ready if it has
+bool LogFile::nextSegment()
+{
+    if (mNextMap) {
+        char *const map = mMap;
+        const size_t segmentSize = mSegmentSize;
+        mMap = mNextMap;
+        mNextMap = 0;
+        mMapOffset += mSegmentSize;
+        post([map, segmentSize]() { ::munmap(map, segmentSize); });
+    } else if (!mapSegment()) {
+        return false;
+    }
+    prepareSegment();
+    return true;
+}
+
+void LogFile::unmap()
+{
+    if (mMap) {
+        ::munmap(mMap, mSegmentSize);
+        mMap = 0;
+    }
+}
+
+// Called with mMutex held, the segment after the current one is grown
+// and mapped on the thread
+void LogFile::prepareSegment()
+{
+    if (mNextMap || mPreparingSegment)
+        return;
+    mPreparingSegment = true;
+    const int fd = mFd;
+    const size_t offset = mMapOffset + mSegmentSize, segmentSize = mSegmentSize;
+    post([this, fd, offset, segmentSize]() {
+            char *map = mapAt(fd, offset, segmentSize, offset);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPreparingSegment = false;
+            if (fd == mFd && offset == mMapOffset + mSegmentSize) {
+                mNextMap = map;
+                return;
+            }
+            // rotated or written past in the meantime, the fd is only
+            // closed on this thread so it can't be another file's
+            if (map)
+                ::munmap(map, segmentSize);
+            if (fd == mFd)
+                prepareSegment();
+        });
+}
+
+// Called with mMutex held, the file rotate() moves to mPath is created
+// and its first segment mapped on the thread
+void LogFile::prepareFile()
+{
+    if ((!mMaxSize && !mMaxAge) || mNextFd != -1 || mPreparingFile)
+        return;
+    mPreparingFile = true;
+    const Path next = nextPath(mPath);
+    const size_t segmentSize = mSegmentSize;
+    post([this, next, segmentSize]() {
+            int fd;
+            eintrwrap(fd, ::open(next.constData(), O_RDWR | O_CREAT | O_CLOEXEC | O_TRUNC, 0644));
+            char *map = 0;
+            if (fd != -1 && !(map = mapAt(fd, 0, segmentSize, 0))) {
+                ::close(fd);
+                fd = -1;
+            }
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPreparingFile = false;
+            mNextFd = fd;
+            mNextFileMap = map;
+        });
+}
+
+void LogFile::close()
+{
+    // what's posted may still use the file
+    if (mThread) {
+        mThread->stop();
+        delete mThread;
+        mThread = 0;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mNextMap) {
+        ::munmap(mNextMap, mSegmentSize);
+        mNextMap = 0;
+    }
+    if (mNextFd != -1) {
+        ::munmap(mNextFileMap, mSegmentSize);
+        ::close(mNextFd);
+        Path::rm(nextPath(mPath));
+        mNextFileMap = 0;
+        mNextFd = -1;
+    }
+    if (mFd != -1) {
+        unmap();
+        int ret;
+        eintrwrap(ret, ::ftruncate(mFd, mSize));
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+bool LogFile::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mFd != -1;
+}
+
+size_t LogFile::size() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSize;
+}
+
+int LogFile::lastIndex() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLastIndex;
+}
+
+void LogFile::write(const iovec *vecs, int count)
+{
+    size_t total = 0;
+    for (int i = 0; i < count; ++i)
+        total += vecs[i].iov_len;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFd == -1)
+        return;
+    if (mSize && ((mMaxSize && mSize + total > mMaxSize)
+                  || (mMaxAge && Rct::coarseMonoMs() - mOpened >= static_cast<uint64_t>(mMaxAge) * 1000))) {
+        rotate();
+    }
+    for (int i = 0; i < count; ++i) {
+        const char *data = static_cast<const char*>(vecs[i].iov_base);
+        size_t len = vecs[i].iov_len;
+        while (len) {
+            if (!mMap ? !mapSegment() : mSize == mMapOffset + mSegmentSize && !nextSegment())
+                return;
+            const size_t chunk = std::min(len, mMapOffset + mSegmentSize - mSize);
+            memcpy(mMap + (mSize - mMapOffset), data, chunk);
+            mSize += chunk;
+            data += chunk;
+            len -= chunk;
+        }
+    }
+}
+
+bool LogFile::writeCrash(const char *data, size_t len)
+{
+    std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+    if (!lock.owns_lock() || mFd == -1)
+        return false;
+    if (mMap) {
+        const size_t chunk = std::min(len, mMapOffset + mSegmentSize - mSize);
+        memcpy(mMap + (mSize - mMapOffset), data, chunk);
+        mSize += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    // past the mapping, the file is cut back to mSize when it's closed
+    while (len) {
+        const ssize_t w = ::pwrite(mFd, data, len, mSize);
+        if (w <= 0) {
+            if (w == -1 && errno == EINTR)
+                continue;
+            return false;
+        }
+        mSize += w;
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+// Called with mMutex held. The new file is normally ready and only
+// the renames happen here, the old one is cut back and closed on the
+// thread.
+void LogFile::rotate()
+{
+    const Path rotated = rotatedPath(mPath, mLastIndex + 1);
+    if (::rename(mPath.constData(), rotated.constData())) {
+        // keep writing where we are, try again in a while
+        mOpened = Rct::coarseMonoMs();
+        return;
+    }
+    ++mLastIndex;
+    char *const map = mMap, *const nextMap = mNextMap;
+    const int fd = mFd;
+    const size_t size = mSize, mapOffset = mMapOffset, segmentSize = mSegmentSize;
+    const uint64_t opened = mOpened;
+    mMap = mNextMap = 0;
+    if (mNextFd != -1 && !::rename(nextPath(mPath).constData(), mPath.constData())) {
+        mFd = mNextFd;
+        mMap = mNextFileMap;
+        mNextFd = -1;
+        mNextFileMap = 0;
+        mSize = mMapOffset = 0;
+        mOpened = Rct::coarseMonoMs();
+        prepareSegment();
+        prepareFile();
+    } else {
+        if (mNextFd != -1) {
+            // the prepared file couldn't be moved in place, drop it so
+            // openFile() prepares a fresh one
+            ::munmap(mNextFileMap, mSegmentSize);
+            ::close(mNextFd);
+            Path::rm(nextPath(mPath));
+            mNextFileMap = 0;
+            mNextFd = -1;
+        }
+        if (!openFile(true)) {
+            // still writing to the rotated file
+            mMap = map;
+            mNextMap = nextMap;
+            mFd = fd;
+            mSize = size;
+            mMapOffset = mapOffset;
+            mOpened = opened;
+            return;
+        }
+    }
+
+    const bool compressed = mCompress;
+    const int drop = mMaxFiles ? mLastIndex - mMaxFiles : 0;
+    const Path path = mPath;
+    post([=]() {
+            ::munmap(map, segmentSize);
+            if (nextMap)
+                ::munmap(nextMap, segmentSize);
+            int ret;
+            eintrwrap(ret, ::ftruncate(fd, size));
+            ::close(fd);
+            if (compressed && compress(rotated, rotated + ".gz"))
+                Path::rm(rotated);
+            // everything beyond the limit, it may have been lowered
+            // since the last rotation
+            if (drop > 0)
+                removeRotated(path, drop);
+        });
+}
+
+void LogFile::post(std::function<void()> &&job)
+{
+    if (!mThread) {
+        mThread = new LogFileThread;
+        mThread->start();
+    }
+    mThread->post(std::move(job));
+}
+
+void LogFile::waitForRotations()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    LogFileThread *thread = mThread;
+    lock.unlock();
+    if (thread)
+        thread->wait();
+}
+
+bool LogFile::compress(const Path &from, const Path &to)
+{
+#ifndef RCT_HAVE_ZLIB
+    (void)from;
+    (void)to;
+    return false;
+#else
+    FILE *in = fopen(from.constData(), "r");
+    if (!in)
+        return false;
+    FILE *out = fopen(to.constData(), "w");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 for a gzip header, zcat can read it
+    bool ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    if (ok) {
+        enum { BufferSize = 64 * 1024 };
+        char inBuffer[BufferSize], outBuffer[BufferSize];
+        int flush = Z_NO_FLUSH;
+        while (ok && flush != Z_FINISH) {
+            stream.avail_in = fread(inBuffer, 1, sizeof(inBuffer), in);
+            stream.next_in = reinterpret_cast<Bytef*>(inBuffer);
+            if (ferror(in)) {
+                ok = false;
+                break;
+            }
+            if (feof(in))
+                flush = Z_FINISH;
+            do {
+                stream.next_out = reinterpret_cast<Bytef*>(outBuffer);
+                stream.avail_out = sizeof(outBuffer);
+                if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                    ok = false;
+                    break;
+                }
+                const size_t len = sizeof(outBuffer) - stream.avail_out;
+                if (len && fwrite(outBuffer, 1, len, out) != len) {
+                    ok = false;
+                    break;
+                }
+            } while (!stream.avail_out);
+        }
+        deflateEnd(&stream);
+    }
+    fclose(in);
+    if (fclose(out))
+        ok = false;
+    if (!ok)
+        Path::rm(to);
+    return ok;
+#endif
+}
@@ -0,0 +1,104 @@
+#ifndef LogFile_h
+#define LogFile_h
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <sys/uio.h>
+
+#include <rct/List.h>
+#include <rct/Path.h>
+
+class LogFileThread;
+
+// A log file written through a shared mapping of it. The file is grown
+// a segment at a time and cut back to what was written when it's
+// closed or rotated, a crash leaves zeroes at the end of the last
+// segment. Once the file grows past maxSize or gets older than maxAge
+// it's renamed to path.1, path.2, ... and a new one is started.
+// Growing and mapping the next segment, creating the next file,
+// closing the old one, compressing it and removing the oldest ones
+// happens on a thread of its own, a writer only does it when the thread
+// hasn't got to it yet. The next file waits as path.next.
+class LogFile
+{
+public:
+    LogFile();
+    ~LogFile();
+
+    enum { DefaultSegmentSize = 4 * 1024 * 1024 };
+
+    // bytes, seconds and files, 0 for no limit. The size and age are
+    // set before open().
+    void setMaxSize(size_t maxSize) { mMaxSize = maxSize; }
+    void setMaxAge(int maxAge) { mMaxAge = maxAge; }
+    void setMaxFiles(int maxFiles) { mMaxFiles = maxFiles; }
+    // rotated files are gzipped to path.N.gz, needs zlib
+    void setCompress(bool on) { mCompress = on; }
+    // a multiple of the page size
+    void setSegmentSize(size_t size) { mSegmentSize = size; }
+
+    enum OpenMode {
+        Truncate,
+        Append,
+        // an existing file is rotated away first
+        Rotate
+    };
+    bool open(const Path &path, OpenMode mode);
+    void close();
+    bool isOpen() const;
+
+    void write(const char *data, size_t len)
+    {
+        const iovec vec = { const_cast<char*>(data), len };
+        write(&vec, 1);
+    }
+    // the pieces of a line, they go in the same file
+    void write(const iovec *vecs, int count);
+    // For a signal handler, neither rotates nor maps anything nor waits
+    // for the lock. False if the line couldn't be written.
+    bool writeCrash(const char *data, size_t len);
+
+    Path path() const { return mPath; }
+    // bytes written to the current file
+    size_t size() const;
+    // the index the last rotated file got
+    int lastIndex() const;
+
+    // blocks until rotated files have been compressed and removed and
+    // the next segment and file are ready
+    void waitForRotations();
+
+    static bool compress(const Path &from, const Path &to);
+
+private:
+    bool openFile(bool truncate);
+    bool mapSegment();
+    bool nextSegment();
+    void unmap();
+    void prepareSegment();
+    void prepareFile();
+    void rotate();
+    void post(std::function<void()> &&job);
+
+    Path mPath;
+    size_t mMaxSize, mSegmentSize;
+    int mMaxAge, mMaxFiles;
+    bool mCompress;
+
+    mutable std::mutex mMutex;
+    int mFd;
+    char *mMap;
+    size_t mMapOffset, mSize;
+    uint64_t mOpened;
+    int mLastIndex;
+    // made ready on the thread: the segment after mMap and the next
+    // file with its first segment mapped
+    char *mNextMap;
+    int mNextFd;
+    char *mNextFileMap;
+    bool mPreparingSegment, mPreparingFile;
+    LogFileThread *mThread;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef Parallel_h
+#define Parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include <rct/List.h>
+#include <rct/ThreadPool.h>
+
+// Data parallel loops on top of ThreadPool. The input is handed out in
+// chunks of grain items, the calling thread works through them along
+// with up to one helper per pool thread, whichever gets to a chunk
+// first. Calls made from a thread of the pool and inputs that fit in
+// one chunk run inline. A grain of 0 aims for about eight chunks per
+// thread.
+namespace Rct {
+
+class ParallelChunks
+{
+public:
+    ParallelChunks(size_t count, size_t grain)
+        : mCount(count), mGrain(grain), mNext(0), mActive(0)
+    {
+    }
+
+    size_t chunkCount() const { return (mCount + mGrain - 1) / mGrain; }
+
+    // func(chunk, begin, end) until every chunk has been taken
+    template <typename Func>
+    void run(const Func &func)
+    {
+        for (;;) {
+            const size_t begin = mNext.fetch_add(mGrain);
+            if (begin >= mCount)
+                return;
+            func(begin / mGrain, begin, std::min(begin + mGrain, mCount));
+        }
+    }
+
+    // Helpers that start after the last chunk is gone never touch func,
+    // the caller only waits for the ones that took one
+    template <typename Func>
+    void help(const Func &func)
+    {
+        ++mActive;
+        run(func);
+        if (!--mActive) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCond.notify_all();
+        }
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mActive.load())
+            mCond.wait(lock);
+    }
+
+private:
+    const size_t mCount, mGrain;
+    std::atomic<size_t> mNext;
+    std::atomic<int> mActive;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+};
+
+// func(chunk, begin, end) for every chunk of [0, count), returns once
+// all of them are done
+template <typename Func>
+void parallelChunks(size_t count, size_t grain, const Func &func, ThreadPool *pool = 0)
+{
+    if (!count)
+        return;
+    if (!pool)
+        pool = ThreadPool::instance();
+    const int threads = pool->concurrentJobs();
+    if (!grain)
+        grain = std::max<size_t>(1, count / (std::max(threads, 1) * 8));
+    if (count <= grain || threads < 1 || ThreadPool::current() == pool) {
+        for (size_t begin = 0, chunk = 0; begin < count; begin += grain, ++chunk)
+            func(chunk, begin, std::min(begin + grain, count));
+        return;
+    }
+
+    std::shared_ptr<ParallelChunks> chunks = std::make_shared<ParallelChunks>(count, grain);
+    const size_t helpers = std::min<size_t>(threads, chunks->chunkCount() - 1);
+    const Func *f = &func;
+    for (size_t i = 0; i < helpers; ++i)
+        pool->submit([chunks, f]() { chunks->help(*f); });
+    chunks->run(func);
+    chunks->wait();
+}
+
+// index access to a container, containers without random access
+// iterators (Hash, Map, Set) are walked once up front
+template <typename Iterator,
+          bool RandomAccess = std::is_same<typename std::iterator_traits<Iterator>::iterator_category,
+                                           std::random_access_iterator_tag>::value>
+class ParallelRange
+{
+public:
+    ParallelRange(Iterator begin, Iterator end)
+        : mBegin(begin), mSize(end - begin)
+    {
+    }
+
+    size_t size() const { return mSize; }
+    typename std::iterator_traits<Iterator>::reference operator[](size_t idx) const { return mBegin[idx]; }
+
+private:
+    const Iterator mBegin;
+    const size_t mSize;
+};
+
+template <typename Iterator>
+class ParallelRange<Iterator, false>
+{
+public:
+    ParallelRange(Iterator begin, Iterator end)
+    {
+        for (Iterator it = begin; it != end; ++it)
+            mItems.append(&*it);
+    }
+
+    size_t size() const { return mItems.size(); }
+    typename std::iterator_traits<Iterator>::reference operator[](size_t idx) const { return *mItems[idx]; }
+
+private:
+    List<typename std::iterator_traits<Iterator>::pointer> mItems;
+};
+
+template <typename Iterator>
+ParallelRange<Iterator> parallelRange(Iterator begin, Iterator end)
+{
+    return ParallelRange<Iterator>(begin, end);
+}
+
+// func(idx) for every idx in [begin, end)
+template <typename Func>
+void parallelFor(size_t begin, size_t end, size_t grain, const Func &func, ThreadPool *pool = 0)
+{
+    if (end <= begin)
+        return;
+    parallelChunks(end - begin, grain, [begin, &func](size_t, size_t from, size_t to) {
+            for (size_t idx = from; idx < to; ++idx)
+                func(begin + idx);
+        }, pool);
+}
+
+// func(item) for every item in container
+template <typename Container, typename Func>
+void parallelFor(Container &container, size_t grain, const Func &func, ThreadPool *pool = 0)
+{
+    const auto range = parallelRange(std::begin(container), std::end(container));
+    parallelChunks(range.size(), grain, [&range, &func](size_t, size_t from, size_t to) {
+            for (size_t idx = from; idx < to; ++idx)
+                func(range[idx]);
+        }, pool);
+}
+
+// func(item) for every item in container, in the container's order.
+// The result type has to be default constructible.
+template <typename Container, typename Func>
+auto parallelMap(const Container &container, size_t grain, const Func &func, ThreadPool *pool = 0)
+    -> List<typename std::decay<decltype(func(*std::begin(container)))>::type>
+{
+    typedef typename std::decay<decltype(func(*std::begin(container)))>::type Result;
+    static_assert(!std::is_same<Result, bool>::value, "List<bool> packs its items, they can't be written concurrently");
+    const auto range = parallelRange(std::begin(container), std::end(container));
+    List<Result> results(range.size());
+    parallelChunks(range.size(), grain, [&range, &func, &results](size_t, size_t from, size_t to) {
+            for (size_t idx = from; idx < to; ++idx)
+                results[idx] = func(range[idx]);
+        }, pool);
+    return results;
+}
+
+// reduce(reduce(reduce(init, map(a)), map(b)), ...) for the items in
+// container. Chunks are reduced on their own starting from init and
+// then in order with each other, so reduce has to be associative and
+// init an identity for it but it doesn't have to be commutative.
+template <typename Container, typename T, typename Map, typename Reduce>
+T parallelReduce(const Container &container, size_t grain, const T &init,
+                 const Map &map, const Reduce &reduce, ThreadPool *pool = 0)
+{
+    const auto range = parallelRange(std::begin(container), std::end(container));
+    if (!range.size())
+        return init;
+    if (!grain) {
+        const int threads = (pool ? pool : ThreadPool::instance())->concurrentJobs();
+        grain = std::max<size_t>(1, range.size() / (std::max(threads, 1) * 8));
+    }
+    List<T> partials((range.size() + grain - 1) / grain, init);
+    parallelChunks(range.size(), grain, [&](size_t chunk, size_t from, size_t to) {
+            T value = init;
+            for (size_t idx = from; idx < to; ++idx)
+                value = reduce(value, map(range[idx]));
+            partials[chunk] = std::move(value);
+        }, pool);
+    T value = init;
+    for (const T &partial : partials)
+        value = reduce(value, partial);
+    return value;
+}
+
+}
+
+#endif
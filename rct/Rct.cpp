@@ -4,6 +4,7 @@
 #include <dirent.h>
 #include <limits.h>
 #include <netdb.h>
+#include <string.h>
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -313,46 +314,60 @@ String backtrace(int)
 #endif
 
 
-bool gettime(timeval* time)
+// CLOCK_MONOTONIC is read in user space on every kernel that has a
+// vdso, CLOCK_MONOTONIC_RAW only since 5.3. It's also the clock
+// CLOCK_MONOTONIC_COARSE follows.
+uint64_t monoNs()
 {
 #if defined(HAVE_MACH_ABSOLUTE_TIME)
     static mach_timebase_info_data_t info;
     static bool first = true;
-    uint64_t machtime = mach_absolute_time();
+    const uint64_t machtime = mach_absolute_time();
     if (first) {
         first = false;
         mach_timebase_info(&info);
     }
-    machtime = machtime * info.numer / (info.denom * 1000); // microseconds
-    time->tv_sec = machtime / 1000000;
-    time->tv_usec = machtime % 1000000;
-#elif defined(HAVE_CLOCK_MONOTONIC_RAW) || defined(HAVE_CLOCK_MONOTONIC)
+    return (machtime / info.denom) * info.numer + (machtime % info.denom) * info.numer / info.denom;
+#elif defined(HAVE_CLOCK_MONOTONIC) || defined(HAVE_CLOCK_MONOTONIC_RAW)
     timespec spec;
-#if defined(HAVE_CLOCK_MONOTONIC_RAW)
+#if defined(HAVE_CLOCK_MONOTONIC)
+    const clockid_t cid = CLOCK_MONOTONIC;
+#else
     const clockid_t cid = CLOCK_MONOTONIC_RAW;
+#endif
+    if (::clock_gettime(cid, &spec) == -1)
+        return 0;
+    return (spec.tv_sec * static_cast<uint64_t>(1000000000)) + spec.tv_nsec;
 #else
-    const clockid_t cid = CLOCK_MONOTONIC;
+#error No Rct::monoNs() implementation
 #endif
-    const int ret = ::clock_gettime(cid, &spec);
-    if (ret == -1) {
+}
+
+bool gettime(timeval* time)
+{
+    const uint64_t ns = monoNs();
+    if (!ns) {
         memset(time, 0, sizeof(timeval));
         return false;
     }
-    time->tv_sec = spec.tv_sec;
-    time->tv_usec = spec.tv_nsec / 1000;
-#else
-#error No EventLoop::gettime() implementation
-#endif
+    time->tv_sec = ns / 1000000000;
+    time->tv_usec = (ns % 1000000000) / 1000;
     return true;
 }
 
 uint64_t monoMs()
 {
-    timeval time;
-    if (gettime(&time)) {
-        return (time.tv_sec * static_cast<uint64_t>(1000)) + (time.tv_usec / static_cast<uint64_t>(1000));
-    }
-    return 0;
+    return monoNs() / 1000000;
+}
+
+uint64_t coarseMonoMs()
+{
+#if defined(HAVE_CLOCK_MONOTONIC_COARSE) && !defined(HAVE_MACH_ABSOLUTE_TIME)
+    timespec spec;
+    if (::clock_gettime(CLOCK_MONOTONIC_COARSE, &spec) == 0)
+        return (spec.tv_sec * static_cast<uint64_t>(1000)) + (spec.tv_nsec / 1000000);
+#endif
+    return monoMs();
 }
 
 uint64_t currentTimeMs()
@@ -545,6 +560,124 @@ String strerror(int error)
     return ret;
 }
 
+// reflected
+enum { Crc32cPolynomial = 0x82f63b78 };
+
+// slicing by 8, t[k][b] is the crc of b followed by k zero bytes
+struct Crc32cTables
+{
+    Crc32cTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = crc & 1 ? (crc >> 1) ^ Crc32cPolynomial : crc >> 1;
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+
+    uint32_t t[8][256];
+};
+
+static uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data, size_t len)
+{
+    static const Crc32cTables tables;
+    const uint32_t (&t)[8][256] = tables.t;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        const uint32_t lo = static_cast<uint32_t>(word) ^ crc, hi = static_cast<uint32_t>(word >> 32);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+#endif
+    while (len--)
+        crc = t[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const unsigned char *data, size_t len)
+{
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (len--)
+        crc = __builtin_ia32_crc32qi(crc, *data++);
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const void *data, size_t len, uint32_t crc)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+#if defined(__x86_64__) && defined(__GNUC__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~crc32cHardware(~crc, bytes, len);
+#endif
+    return ~crc32cSoftware(~crc, bytes, len);
+}
+
+// multiplies vec by the 32x32 matrix over GF(2) in mat
+static uint32_t gf2Times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1)
+            sum ^= *mat;
+        vec >>= 1;
+        ++mat;
+    }
+    return sum;
+}
+
+static void gf2Square(uint32_t *square, const uint32_t *mat)
+{
+    for (int n = 0; n < 32; ++n)
+        square[n] = gf2Times(mat, mat[n]);
+}
+
+// as zlib's crc32_combine(), crcA is moved past lenB zero bytes by
+// squaring the operator for one zero bit
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t lenB)
+{
+    if (!lenB)
+        return crcA;
+    uint32_t even[32], odd[32];
+    odd[0] = Crc32cPolynomial;
+    for (int n = 1; n < 32; ++n)
+        odd[n] = 1u << (n - 1);
+    gf2Square(even, odd); // two zero bits
+    gf2Square(odd, even); // four
+    do {
+        gf2Square(even, odd);
+        if (lenB & 1)
+            crcA = gf2Times(even, crcA);
+        lenB >>= 1;
+        if (!lenB)
+            break;
+        gf2Square(odd, even);
+        if (lenB & 1)
+            crcA = gf2Times(odd, crcA);
+        lenB >>= 1;
+    } while (lenB);
+    return crcA ^ crcB;
+}
 
 } // namespace Rct
 
@@ -72,7 +72,12 @@ void findExecutablePath(const char *argv0);
 Path executablePath();
 String backtrace(int maxFrames = -1);
 bool gettime(timeval* time);
+// monotonic, gettime() as nanoseconds and milliseconds
+uint64_t monoNs();
 uint64_t monoMs();
+// monoMs() as of the last clock tick, a few milliseconds behind at
+// most but cheaper to read. monoMs() where there's no such clock.
+uint64_t coarseMonoMs();
 uint64_t currentTimeMs();
 String hostName();
 
@@ -251,6 +256,12 @@ static inline bool wildCmp(const char *wild, const char *string, String::CaseSen
 }
 
 String strerror(int error = errno);
+
+// CRC-32C (Castagnoli), with the SSE 4.2 instruction when the cpu has
+// it. Pass the crc of what came before to continue it.
+uint32_t crc32c(const void *data, size_t len, uint32_t crc = 0);
+// the crc of a followed by b from the crcs of both and b's length
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t lenB);
 }
 
 #define eintrwrap(VAR, BLOCK)                   \
@@ -3,23 +3,33 @@
 
 #include <rct/ReadWriteLock.h>
 
+// Works with anything that has lockForRead() and unlock(),
+// ReadWriteLock, ScalableReadWriteLock and SeqLock
 class ReadLocker
 {
 public:
-    ReadLocker(ReadWriteLock* lock)
-        : mLock(lock)
+    template <typename Lock>
+    ReadLocker(Lock* lock)
+        : mLock(lock), mUnlock(&ReadLocker::unlock<Lock>)
     {
-        if (mLock && !mLock->lockForRead())
+        if (lock && !lock->lockForRead())
             mLock = 0;
     }
     ~ReadLocker()
     {
         if (mLock)
-            mLock->unlock();
+            mUnlock(mLock);
     }
 
 private:
-    ReadWriteLock* mLock;
+    ReadLocker(const ReadLocker &) = delete;
+    ReadLocker &operator=(const ReadLocker &) = delete;
+
+    template <typename Lock>
+    static void unlock(void* lock) { static_cast<Lock*>(lock)->unlock(); }
+
+    void* mLock;
+    void (*mUnlock)(void*);
 };
 
 #endif
@@ -0,0 +1,129 @@
+#include "ScalableReadWriteLock.h"
+
+#include <assert.h>
+#include <chrono>
+#include <pthread.h>
+#include <stdint.h>
+
+// the slot of the calling thread, a thread always gets the same one
+static inline size_t slotIndex()
+{
+    const uint64_t self = reinterpret_cast<uintptr_t>(reinterpret_cast<void*>(pthread_self()));
+    return ((self >> 4) * 0x9E3779B97F4A7C15ull >> 32) % ScalableReadWriteLock::Slots;
+}
+
+ScalableReadWriteLock::ScalableReadWriteLock()
+    : mState(Unlocked)
+{
+    for (int i = 0; i < Slots; ++i)
+        mSlots[i].count.store(0, std::memory_order_relaxed);
+}
+
+// Readers announce themselves before looking for a writer and writers
+// announce themselves before counting readers, with both sequentially
+// consistent one of them always sees the other
+bool ScalableReadWriteLock::tryLockForReadSlot(std::atomic<int> &slot)
+{
+    slot.fetch_add(1, std::memory_order_seq_cst);
+    if (mState.load(std::memory_order_seq_cst) == Unlocked)
+        return true;
+    unlockForRead(slot);
+    return false;
+}
+
+void ScalableReadWriteLock::unlockForRead(std::atomic<int> &slot)
+{
+    slot.fetch_sub(1, std::memory_order_seq_cst);
+    if (mState.load(std::memory_order_seq_cst) == Pending) {
+        std::lock_guard<std::mutex> locker(mMutex);
+        mCond.notify_all();
+    }
+}
+
+// A thread that unlocks on another thread's slot leaves one counter
+// too high and the other too low, only the sum is meaningful
+int ScalableReadWriteLock::readers() const
+{
+    int count = 0;
+    for (int i = 0; i < Slots; ++i)
+        count += mSlots[i].count.load(std::memory_order_seq_cst);
+    return count;
+}
+
+bool ScalableReadWriteLock::lock(LockType type, int maxTime)
+{
+    std::atomic<int> &slot = mSlots[slotIndex()].count;
+    if (type == ReadWriteLock::Read && tryLockForReadSlot(slot))
+        return true;
+
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(maxTime);
+    if (type == ReadWriteLock::Read) {
+        while (!tryLockForReadSlot(slot)) {
+            std::unique_lock<std::mutex> locker(mMutex);
+            while (mState.load() != Unlocked) {
+                if (maxTime > 0) {
+                    if (mCond.wait_until(locker, deadline) == std::cv_status::timeout && mState.load() != Unlocked)
+                        return false;
+                } else {
+                    mCond.wait(locker);
+                }
+            }
+        }
+        return true;
+    }
+
+    std::unique_lock<std::mutex> locker(mMutex);
+    while (mState.load() != Unlocked) {
+        if (maxTime > 0) {
+            if (mCond.wait_until(locker, deadline) == std::cv_status::timeout && mState.load() != Unlocked)
+                return false;
+        } else {
+            mCond.wait(locker);
+        }
+    }
+    mState.store(Pending, std::memory_order_seq_cst);
+    while (readers()) {
+        if (maxTime > 0) {
+            if (mCond.wait_until(locker, deadline) == std::cv_status::timeout && readers()) {
+                mState.store(Unlocked);
+                mCond.notify_all();
+                return false;
+            }
+        } else {
+            mCond.wait(locker);
+        }
+    }
+    mState.store(Locked);
+    return true;
+}
+
+bool ScalableReadWriteLock::tryLock(LockType type)
+{
+    if (type == ReadWriteLock::Read)
+        return tryLockForReadSlot(mSlots[slotIndex()].count);
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    if (mState.load() != Unlocked)
+        return false;
+    mState.store(Pending, std::memory_order_seq_cst);
+    if (readers()) {
+        mState.store(Unlocked);
+        mCond.notify_all();
+        return false;
+    }
+    mState.store(Locked);
+    return true;
+}
+
+// nobody reads while a writer holds the lock, so it's the writer
+// unlocking if it's held for writing
+void ScalableReadWriteLock::unlock()
+{
+    if (mState.load() == Locked) {
+        std::lock_guard<std::mutex> locker(mMutex);
+        mState.store(Unlocked);
+        mCond.notify_all();
+        return;
+    }
+    unlockForRead(mSlots[slotIndex()].count);
+}
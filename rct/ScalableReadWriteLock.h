@@ -0,0 +1,57 @@
+#ifndef SCALABLEREADWRITELOCK_H
+#define SCALABLEREADWRITELOCK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include <rct/ReadWriteLock.h>
+
+// A ReadWriteLock for read-mostly data. Readers only touch one of
+// Slots counters picked by their thread, so readers on different
+// threads don't contend with each other unless a writer comes along.
+// Writers are preferred: once one is waiting new readers wait for it.
+// Takes about 4k, for locks that aren't hot ReadWriteLock is smaller.
+class ScalableReadWriteLock
+{
+public:
+    ScalableReadWriteLock();
+
+    typedef ReadWriteLock::LockType LockType;
+
+    bool lockForRead(int maxTime = 0) { return lock(ReadWriteLock::Read, maxTime); }
+    bool lockForWrite(int maxTime = 0) { return lock(ReadWriteLock::Write, maxTime); }
+    bool lock(LockType type, int maxTime = 0);
+
+    bool tryLockForRead() { return tryLock(ReadWriteLock::Read); }
+    bool tryLockForWrite() { return tryLock(ReadWriteLock::Write); }
+    bool tryLock(LockType type);
+
+    void unlock();
+
+    enum { Slots = 64 };
+
+private:
+    bool tryLockForReadSlot(std::atomic<int> &slot);
+    void unlockForRead(std::atomic<int> &slot);
+    int readers() const;
+
+    enum {
+        Unlocked,
+        Pending, // a writer is waiting for the readers to leave
+        Locked
+    };
+
+    // padded to a cache line each
+    struct Slot
+    {
+        std::atomic<int> count;
+        char padding[64 - sizeof(std::atomic<int>)];
+    };
+    Slot mSlots[Slots];
+    std::atomic<int> mState;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+};
+
+#endif
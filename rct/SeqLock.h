@@ -0,0 +1,121 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include <rct/ReadWriteLock.h>
+
+// A small POD value that's read far more often than it's written.
+// load() doesn't write to shared memory, it copies the value and
+// tries again if a writer got in the way. Writers are serialized by a
+// mutex, store() takes it or the value can be set() under a
+// WriteLocker. A ReadLocker keeps writers out as well, for callers
+// that rather wait than retry.
+template <typename T>
+class SeqLock
+{
+public:
+    static_assert(std::is_pod<T>::value, "SeqLock values are copied while they may be written");
+
+    SeqLock(const T &value = T())
+        : mSequence(0), mWriting(false)
+    {
+        storeWords(value);
+    }
+
+    T load() const
+    {
+        uintptr_t words[WordCount];
+        for (;;) {
+            const unsigned int sequence = mSequence.load(std::memory_order_acquire);
+            if (sequence & 1)
+                continue;
+            for (size_t i = 0; i < WordCount; ++i)
+                words[i] = mWords[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) == sequence)
+                break;
+        }
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    void store(const T &value)
+    {
+        lockForWrite();
+        set(value);
+        unlock();
+    }
+
+    // with the lock held for writing
+    void set(const T &value) { storeWords(value); }
+
+    bool lockForRead(int maxTime = 0) { return lock(ReadWriteLock::Read, maxTime); }
+    bool lockForWrite(int maxTime = 0) { return lock(ReadWriteLock::Write, maxTime); }
+    bool lock(ReadWriteLock::LockType type, int maxTime = 0)
+    {
+        if (maxTime > 0) {
+            if (!mMutex.try_lock_for(std::chrono::milliseconds(maxTime)))
+                return false;
+        } else {
+            mMutex.lock();
+        }
+        begin(type);
+        return true;
+    }
+
+    bool tryLockForRead() { return tryLock(ReadWriteLock::Read); }
+    bool tryLockForWrite() { return tryLock(ReadWriteLock::Write); }
+    bool tryLock(ReadWriteLock::LockType type)
+    {
+        if (!mMutex.try_lock())
+            return false;
+        begin(type);
+        return true;
+    }
+
+    void unlock()
+    {
+        if (mWriting) {
+            mWriting = false;
+            mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        mMutex.unlock();
+    }
+
+private:
+    enum { WordCount = (sizeof(T) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t) };
+
+    // an odd sequence sends readers back to retry
+    void begin(ReadWriteLock::LockType type)
+    {
+        if (type == ReadWriteLock::Write) {
+            mWriting = true;
+            mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+    }
+
+    // copied through atomic words so readers racing a writer get a
+    // torn copy they throw away rather than undefined behavior
+    void storeWords(const T &value)
+    {
+        uintptr_t words[WordCount] = { 0 };
+        memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < WordCount; ++i)
+            mWords[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    std::atomic<unsigned int> mSequence;
+    std::atomic<uintptr_t> mWords[WordCount];
+    std::timed_mutex mMutex;
+    bool mWriting; // under mMutex
+};
+
+#endif
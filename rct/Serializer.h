@@ -6,8 +6,11 @@
 #include <stdint.h>
 #include <string.h>
 
-#include <utility>
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include <rct/Hash.h>
 #include <rct/List.h>
@@ -18,6 +21,11 @@
 #include <rct/Set.h>
 #include <rct/String.h>
 
+// Writing to a String appends to it right away. For a Buffer or a FILE
+// fields are copied into a window inside the Serializer and handed to
+// the output a window at a time, or right away if they don't fit. What
+// has been written is only in those after flush() or once the
+// Serializer is gone, the same goes for errors from them.
 class Serializer
 {
 public:
@@ -30,23 +38,31 @@ public:
     };
 
     Serializer(std::unique_ptr<Buffer> &&buffer)
-        : mError(false), mBuffer(std::move(buffer))
+        : mError(false), mBuffer(std::move(buffer)), mString(0), mPos(mWindow)
     {}
 
     Serializer(std::string &out)
-        : mError(false), mBuffer(new StringBuffer(out))
+        : mError(false), mString(&out), mPos(mWindow + WindowSize)
     {}
 
     Serializer(String &out)
-        : mError(false), mBuffer(new StringBuffer(out))
+        : mError(false), mString(&out.ref()), mPos(mWindow + WindowSize)
     {}
 
     Serializer(FILE *f)
-        : mError(false), mBuffer(new FileBuffer(f))
+        : mError(false), mBuffer(new FileBuffer(f)), mString(0), mPos(mWindow)
     {
         assert(f);
     }
 
+    ~Serializer()
+    {
+        flush();
+    }
+
+    Serializer(const Serializer &) = delete;
+    Serializer &operator=(const Serializer &) = delete;
+
     bool write(const String &string)
     {
         return write(string.constData(), string.size());
@@ -55,18 +71,26 @@ public:
     bool write(const void *data, int len)
     {
         assert(len > 0);
-        if (mError)
-            return false;
-        if (!mBuffer->write(data, len)) {
-            mError = true;
-            return false;
+        if (static_cast<size_t>(len) <= static_cast<size_t>(mWindow + WindowSize - mPos)) {
+            memcpy(mPos, data, len);
+            mPos += len;
+            return true;
         }
-        return true;
+        return writeLarge(data, len);
+    }
+
+    bool flush()
+    {
+        if (mString)
+            return true;
+        const int pending = mPos - mWindow;
+        mPos = mWindow;
+        return !pending || writeOut(mWindow, pending);
     }
 
     int pos() const
     {
-        return mBuffer->pos();
+        return mString ? static_cast<int>(mString->size()) : mBuffer->pos() + static_cast<int>(mPos - mWindow);
     }
 
     bool hasError() const { return mError; }
@@ -83,25 +107,36 @@ public:
     template <typename T> bool encodeType() { return true; }
 #endif
 private:
-    class StringBuffer : public Buffer
+    enum { WindowSize = 4096 };
+
+    bool writeOut(const void *data, int len)
     {
-    public:
-        StringBuffer(std::string &out)
-            : mString(&out)
-        {}
-        StringBuffer(String &out)
-            : mString(&out.ref())
-        {}
+        if (mError)
+            return false;
+        if (!mBuffer->write(data, len)) {
+            mError = true;
+            return false;
+        }
+        return true;
+    }
 
-        virtual bool write(const void *data, int len) override
-        {
+    bool writeLarge(const void *data, int len)
+    {
+        if (mString) {
+            // the window is kept full, everything ends up here
             mString->append(static_cast<const char*>(data), len);
             return true;
         }
-        virtual int pos() const override { return mString->size(); }
-    private:
-        std::string *mString;
-    };
+        if (!flush())
+            return false;
+        if (len < WindowSize) {
+            memcpy(mPos, data, len);
+            mPos += len;
+            return true;
+        }
+        return writeOut(data, len);
+    }
+
     class FileBuffer : public Buffer
     {
     public:
@@ -117,7 +152,6 @@ private:
             const size_t ret = fwrite(data, sizeof(char), len, mFile);
             return (ret == static_cast<size_t>(len));
         }
-
         virtual int pos() const override
         {
             return static_cast<int>(ftell(mFile));
@@ -128,30 +162,55 @@ private:
 
     bool mError;
     std::unique_ptr<Buffer> mBuffer;
+    std::string *mString;
+    char *mPos;
+    char mWindow[WindowSize];
 };
 
+// Reads from memory, a FILE or a Source. What comes from a Source is
+// read into a window inside the Deserializer a window at a time, reads
+// that are larger than it go straight to the Source.
 class Deserializer
 {
 public:
+    class Source
+    {
+    public:
+        virtual ~Source() {}
+        // up to len bytes, 0 once there are no more
+        virtual int read(void *data, int len) = 0;
+        virtual bool atEnd() = 0;
+    };
+
     Deserializer(const char *data, int len, const char *key = "")
-        : mData(data), mLength(len), mPos(0), mFile(0), mKey(key)
+        : mData(data), mLength(len), mPos(0), mFile(0), mKey(key), mConsumed(0)
     {}
 
     Deserializer(const String &string, const char *key = "")
         : mString(string), mData(mString.constData()), mLength(mString.size()),
-          mPos(0), mFile(0), mKey(key)
+          mPos(0), mFile(0), mKey(key), mConsumed(0)
     {}
 
     Deserializer(FILE *file, const char *key = "")
-        : mData(0), mLength(0), mFile(file), mKey(key)
+        : mData(0), mLength(0), mFile(file), mKey(key), mConsumed(0)
     {
         assert(file);
     }
 
+    Deserializer(std::unique_ptr<Source> &&source, const char *key = "")
+        : mData(0), mLength(0), mPos(0), mFile(0), mKey(key),
+          mSource(std::move(source)), mWindow(new char[WindowSize]), mConsumed(0)
+    {
+        assert(mSource);
+        mData = mWindow.get();
+    }
+
     int peek(char *target, int len)
     {
         if (len) {
             if (mData) {
+                if (mSource && mPos + len > mLength && (len > WindowSize || !fill(len)))
+                    len = std::min(len, mLength - mPos);
                 assert(mPos + len <= mLength);
                 memcpy(target, mData + mPos, len);
                 return len;
@@ -174,6 +233,8 @@ public:
         if (len) {
             if (mData) {
                 if (mPos + len > mLength) {
+                    if (mSource)
+                        return readSource(static_cast<char*>(target), len);
                     error() << "About to die" << mPos << len << mLength << '\n' << Rct::backtrace();
 
                 }
@@ -189,10 +250,11 @@ public:
         return 0;
     }
 
-    bool atEnd() const { return mPos == mLength; }
+    bool atEnd() const { return mPos == mLength && (!mSource || mSource->atEnd()); }
 
-    int pos() const { return mFile ? ftell(mFile) : mPos; }
-    int length() const { return mFile ? Rct::fileSize(mFile) : mLength; }
+    // a Source's length isn't known
+    int pos() const { return mFile ? ftell(mFile) : mConsumed + mPos; }
+    int length() const { return mFile ? Rct::fileSize(mFile) : (mSource ? -1 : mLength); }
 #ifdef RCT_SERIALIZER_VERIFY_PRIMITIVE_SIZE
     template <typename T>
     bool decodeType()
@@ -210,12 +272,58 @@ public:
     template <typename T> bool decodeType() { return true; }
 #endif
 private:
+    enum { WindowSize = 64 * 1024 };
+
+    // moves what's left to the front of the window and tops it up,
+    // false if there's less than len after
+    bool fill(int len)
+    {
+        const int left = mLength - mPos;
+        memmove(mWindow.get(), mWindow.get() + mPos, left);
+        mConsumed += mPos;
+        mPos = 0;
+        mLength = left;
+        while (mLength < len) {
+            const int r = mSource->read(mWindow.get() + mLength, WindowSize - mLength);
+            if (r <= 0)
+                break;
+            mLength += r;
+        }
+        return mLength >= len;
+    }
+
+    int readSource(char *target, int len)
+    {
+        if (len <= WindowSize) {
+            fill(len);
+            const int r = std::min(len, mLength);
+            memcpy(target, mData, r);
+            mPos = r;
+            return r;
+        }
+        int r = mLength - mPos;
+        memcpy(target, mData + mPos, r);
+        mConsumed += mLength;
+        mPos = mLength = 0;
+        while (r < len) {
+            const int chunk = mSource->read(target + r, len - r);
+            if (chunk <= 0)
+                break;
+            r += chunk;
+            mConsumed += chunk;
+        }
+        return r;
+    }
+
     String mString;
     const char *mData;
-    const int mLength;
+    int mLength;
     int mPos;
     FILE *mFile;
     const char *mKey;
+    std::unique_ptr<Source> mSource;
+    std::unique_ptr<char[]> mWindow;
+    int mConsumed;
 };
 
 template <typename T>
@@ -284,6 +392,66 @@ DECLARE_NATIVE_TYPE(unsigned long long);
 DECLARE_NATIVE_TYPE(float);
 DECLARE_NATIVE_TYPE(double);
 
+// Lists of native types are written and read with one copy rather than
+// item by item, the bytes are the same. Not with the size of every
+// item encoded and not for List<bool> which is a packed std::vector.
+// Can be specialized for trivially copyable types whose operator<<
+// writes exactly their bytes.
+template <typename T>
+struct BulkSerialize
+{
+#ifdef RCT_SERIALIZER_VERIFY_PRIMITIVE_SIZE
+    static constexpr bool value = false;
+#else
+    static constexpr bool value = std::is_arithmetic<T>::value && FixedSize<T>::value == sizeof(T)
+        && !std::is_same<T, bool>::value;
+#endif
+};
+
+// len can be larger than write() and read() take in one go
+inline void serializeBytes(Serializer &s, const void *data, size_t len)
+{
+    enum { Chunk = 1024 * 1024 * 1024 };
+    for (size_t pos = 0; pos < len; pos += Chunk)
+        s.write(static_cast<const char*>(data) + pos, std::min<size_t>(len - pos, Chunk));
+}
+
+inline void deserializeBytes(Deserializer &s, void *data, size_t len)
+{
+    enum { Chunk = 1024 * 1024 * 1024 };
+    for (size_t pos = 0; pos < len; pos += Chunk)
+        s.read(static_cast<char*>(data) + pos, std::min<size_t>(len - pos, Chunk));
+}
+
+template <typename T>
+inline void serializeItems(Serializer &s, const List<T> &list, std::true_type)
+{
+    if (!list.isEmpty())
+        serializeBytes(s, list.data(), list.size() * sizeof(T));
+}
+
+template <typename T>
+inline void serializeItems(Serializer &s, const List<T> &list, std::false_type)
+{
+    for (size_t i=0; i<list.size(); ++i) {
+        s << list.at(i);
+    }
+}
+
+template <typename T>
+inline void deserializeItems(Deserializer &s, List<T> &list, std::true_type)
+{
+    deserializeBytes(s, list.data(), list.size() * sizeof(T));
+}
+
+template <typename T>
+inline void deserializeItems(Deserializer &s, List<T> &list, std::false_type)
+{
+    for (size_t i=0; i<list.size(); ++i) {
+        s >> list[i];
+    }
+}
+
 template <>
 inline Serializer &operator<<(Serializer &s, const String &string)
 {
@@ -316,9 +484,7 @@ Serializer &operator<<(Serializer &s, const List<T> &list)
 {
     const uint32_t size = list.size();
     s << size;
-    for (uint32_t i=0; i<size; ++i) {
-        s << list.at(i);
-    }
+    serializeItems(s, list, std::integral_constant<bool, BulkSerialize<T>::value>());
     return s;
 }
 
@@ -431,9 +597,7 @@ Deserializer &operator>>(Deserializer &s, List<T> &list)
     s >> size;
     if (size) {
         list.resize(size);
-        for (uint32_t i=0; i<size; ++i) {
-            s >> list[i];
-        }
+        deserializeItems(s, list, std::integral_constant<bool, BulkSerialize<T>::value>());
     }
     return s;
 }
@@ -2,8 +2,11 @@
 #define SIGNALSLOT_H
 
 #include <assert.h>
-#include <map>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <rct/EventLoop.h>
 
@@ -13,23 +16,21 @@ class Signal
 public:
     typedef unsigned int Key;
 
-    Signal() : id(0) { }
-    ~Signal() { }
+    Signal() : id(0), snapshot(0), emitting(0) { }
+    ~Signal() { release(snapshot.load()); }
 
     template<typename Call>
     Key connect(Call&& call)
     {
         std::lock_guard<std::mutex> locker(mutex);
-        connections.insert(std::make_pair(++id, std::forward<Call>(call)));
-        return id;
+        return insert(Signature(std::forward<Call>(call)));
     }
 
     template<size_t Value, typename Call, typename std::enable_if<Value == EventLoop::Async, int>::type = 0>
     Key connect(Call&& call)
     {
         std::lock_guard<std::mutex> locker(mutex);
-        connections.insert(std::make_pair(++id, SignatureWrapper(std::forward<Call>(call))));
-        return id;
+        return insert(SignatureWrapper(std::forward<Call>(call)));
     }
 
     // this connection type will std::move all the call arguments so if this type is used
@@ -38,22 +39,42 @@ public:
     Key connect(Call&& call)
     {
         std::lock_guard<std::mutex> locker(mutex);
-        assert(connections.empty());
-        connections.insert(std::make_pair(++id, SignatureMoveWrapper(std::forward<Call>(call))));
-        return id;
+        assert(!snapshot.load());
+        return insert(SignatureMoveWrapper(std::forward<Call>(call)));
     }
 
     bool disconnect(Key key)
     {
         std::lock_guard<std::mutex> locker(mutex);
-        return connections.erase(key) == 1;
+        const Connections* old = snapshot.load();
+        if (!old)
+            return false;
+        const size_t count = old->calls.size();
+        size_t idx = 0;
+        while (idx < count && old->calls[idx].first != key)
+            ++idx;
+        if (idx == count)
+            return false;
+        Connections* conns = 0;
+        if (count > 1) {
+            conns = new Connections;
+            conns->calls.reserve(count - 1);
+            for (size_t i = 0; i < count; ++i) {
+                if (i != idx)
+                    conns->calls.push_back(old->calls[i]);
+            }
+        }
+        replace(conns);
+        return true;
     }
 
     int disconnect()
     {
         std::lock_guard<std::mutex> locker(mutex);
-        const int ret = connections.size();
-        connections.clear();
+        const Connections* old = snapshot.load();
+        const int ret = old ? old->calls.size() : 0;
+        if (old)
+            replace(0);
         return ret;
     }
 
@@ -61,43 +82,101 @@ public:
     template<typename... Args>
     void operator()(Args&&... args)
     {
-        std::map<Key, Signature> conn;
-        {
-            std::lock_guard<std::mutex> locker(mutex);
-            conn = connections;
-        }
-        for (auto& connection : conn) {
-            connection.second(std::forward<Args>(args)...);
+        const Emission emission(this);
+        if (const Connections* conns = emission.connections) {
+            for (const auto& connection : conns->calls) {
+                connection.second(std::forward<Args>(args)...);
+            }
         }
     }
 
     template<typename... Args>
     void operator()(const Args&... args)
     {
-        std::map<Key, Signature> conn;
-        {
-            std::lock_guard<std::mutex> locker(mutex);
-            conn = connections;
-        }
-        for (auto& connection : conn) {
-            connection.second(std::forward<const Args &>(args)...);
+        const Emission emission(this);
+        if (const Connections* conns = emission.connections) {
+            for (const auto& connection : conns->calls) {
+                connection.second(std::forward<const Args &>(args)...);
+            }
         }
     }
 
     template<typename... Args>
     void operator()()
     {
-        std::map<Key, Signature> conn;
+        const Emission emission(this);
+        if (const Connections* conns = emission.connections) {
+            for (const auto& connection : conns->calls) {
+                connection.second();
+            }
+        }
+    }
+
+private:
+    // Immutable once published. Emitters take a reference and iterate
+    // without holding any lock, connect/disconnect build a new one.
+    class Connections
+    {
+    public:
+        Connections() : ref(1) { }
+
+        mutable std::atomic<int> ref;
+        std::vector<std::pair<Key, Signature> > calls;
+    };
+
+    static void release(const Connections* conns)
+    {
+        if (conns && conns->ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete conns;
+    }
+
+    // Grabs a reference to the current snapshot. The emitting counter
+    // keeps replace() from dropping the snapshot between the load and
+    // the ref increment. Nothing here touches the signal once the
+    // reference is taken, so slots may destroy the signal they're
+    // called from.
+    class Emission
+    {
+    public:
+        Emission(Signal* signal)
+            : connections(0)
         {
-            std::lock_guard<std::mutex> locker(mutex);
-            conn = connections;
+            if (!signal->snapshot.load(std::memory_order_relaxed))
+                return;
+            ++signal->emitting;
+            connections = signal->snapshot.load();
+            if (connections)
+                connections->ref.fetch_add(1, std::memory_order_relaxed);
+            --signal->emitting;
         }
-        for (auto& connection : conn) {
-            connection.second();
+        ~Emission() { release(connections); }
+
+        const Connections* connections;
+    };
+
+    // mutex must be held
+    Key insert(Signature&& call)
+    {
+        const Connections* old = snapshot.load();
+        Connections* conns = new Connections;
+        if (old) {
+            conns->calls.reserve(old->calls.size() + 1);
+            conns->calls.insert(conns->calls.end(), old->calls.begin(), old->calls.end());
         }
+        conns->calls.push_back(std::make_pair(++id, std::move(call)));
+        replace(conns);
+        return id;
+    }
+
+    // mutex must be held
+    void replace(Connections* conns)
+    {
+        const Connections* old = snapshot.exchange(conns);
+        while (emitting.load())
+            std::this_thread::yield();
+        release(old);
     }
 
-private:
     class SignatureWrapper
     {
     public:
@@ -143,7 +222,11 @@ private:
 private:
     Key id;
     std::mutex mutex;
-    std::map<Key, Signature> connections;
+    std::atomic<Connections*> snapshot;
+    std::atomic<int> emitting;
+
+    Signal(const Signal&) = delete;
+    Signal& operator=(const Signal&) = delete;
 };
 
 #endif
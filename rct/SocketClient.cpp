@@ -3,16 +3,23 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <algorithm>
 
+#include "DnsCache.h"
 #include "EventLoop.h"
 #include "Log.h"
 #include "rct/rct-config.h"
@@ -27,14 +34,16 @@ struct Null { template <typename T> Null operator<<(const T &) { return *this; }
 
 SocketClient::SocketClient(unsigned int mode)
     : fd(-1), socketPort(0), socketState(Disconnected), socketMode(None),
-      wMode(Asynchronous), writeWait(false), mLogsEnabled(true), writeOffset(0)
+      wMode(Asynchronous), writeWait(false), mLogsEnabled(true), asyncRead(false), readId(0),
+      asyncReadSize(4096), writeOffset(0)
 {
     blocking = (mode & Blocking);
 }
 
 SocketClient::SocketClient(int f, unsigned int mode)
     : fd(f), socketPort(0), socketState(Connected), socketMode(mode),
-      wMode(Asynchronous), writeWait(false), mLogsEnabled(true), writeOffset(0)
+      wMode(Asynchronous), writeWait(false), mLogsEnabled(true), asyncRead(false), readId(0),
+      asyncReadSize(4096), writeOffset(0)
 {
     assert(fd >= 0);
 #ifdef HAVE_NOSIGPIPE
@@ -48,13 +57,15 @@ SocketClient::SocketClient(int f, unsigned int mode)
 
     if (!blocking) {
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-            loop->registerSocket(fd, EventLoop::SocketRead,
+            asyncRead = !(mode & Udp) && loop->hasAsyncIO();
+            loop->registerSocket(fd, readMode(),
                                  std::bind(&SocketClient::socketCallback, this, std::placeholders::_1, std::placeholders::_2));
             if (!setFlags(fd, O_NONBLOCK, F_GETFL, F_SETFL)) {
                 signalError(shared_from_this(), InitializeError);
                 close();
                 return;
             }
+            startRead();
         }
     }
 }
@@ -66,151 +77,85 @@ SocketClient::~SocketClient()
 
 void SocketClient::close()
 {
-    if (fd == -1)
+    if (fd == -1) {
+        // may be waiting for a name to resolve, drop what was written
+        // in the meantime
+        socketState = Disconnected;
+        writeQueue.clear();
+        writeOffset = 0;
         return;
+    }
     socketState = Disconnected;
     if (!blocking) {
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop())
             loop->unregisterSocket(fd);
     }
+    cancelRead();
+    asyncRead = false;
     ::close(fd);
     socketPort = 0;
     address.clear();
     fd = -1;
 }
 
-class Resolver
-{
-public:
-    Resolver();
-    Resolver(const String& host, uint16_t port, const SocketClient::SharedPtr& socket);
-    ~Resolver();
-
-    void resolve(const String& host, uint16_t port, const SocketClient::SharedPtr& socket);
-
-    addrinfo* res;
-    sockaddr* addr;
-    size_t size;
-};
-
-Resolver::Resolver()
-    : res(0), addr(0), size(0)
-{
-}
-
-Resolver::Resolver(const String& host, uint16_t port, const SocketClient::SharedPtr& socket)
-    : res(0), addr(0), size(0)
-{
-    resolve(host, port, socket);
-}
-
-void Resolver::resolve(const String& host, uint16_t port, const SocketClient::SharedPtr& socket)
-{
-    // first, see if this parses as an IP address
-    {
-        struct in_addr inaddr4;
-        struct in6_addr inaddr6;
-        struct { int af; void* dst; } addrs[2] = {
-            { AF_INET, &inaddr4 },
-            { AF_INET6, &inaddr6 }
-        };
-        for (int i = 0; i < 2; ++i) {
-            if (inet_pton(addrs[i].af, host.constData(), addrs[i].dst) == 1) {
-                // yes, use that
-                if (addrs[i].af == AF_INET) {
-                    sockaddr_in* newaddr = new sockaddr_in;
-                    memset(newaddr, '\0', sizeof(sockaddr_in));
-                    memcpy(&newaddr->sin_addr, &inaddr4, sizeof(struct in_addr));
-                    newaddr->sin_family = AF_INET;
-                    newaddr->sin_port = htons(port);
-                    addr = reinterpret_cast<sockaddr*>(newaddr);
-                    size = sizeof(sockaddr_in);
-                } else {
-                    assert(addrs[i].af == AF_INET6);
-                    sockaddr_in6* newaddr = new sockaddr_in6;
-                    memset(newaddr, '\0', sizeof(sockaddr_in6));
-                    memcpy(&newaddr->sin6_addr, &inaddr6, sizeof(struct in6_addr));
-                    newaddr->sin6_family = AF_INET6;
-                    newaddr->sin6_port = htons(port);
-                    addr = reinterpret_cast<sockaddr*>(newaddr);
-                    size = sizeof(sockaddr_in6);
-                }
-                return;
-            }
+bool SocketClient::connect(const String& host, uint16_t port)
+{
+    SocketClient::SharedPtr tcpSocket = shared_from_this();
+    DnsCache* cache = DnsCache::instance();
+    DnsCache::Address addr;
+    if (!cache->lookup(host, port, AF_UNSPEC, &addr)) {
+        if (!blocking && EventLoop::eventLoop()) {
+            // connect once the name is resolved, off the loop's thread
+            socketState = Connecting;
+            address = host;
+            socketPort = port;
+            SocketClient::WeakPtr weak = tcpSocket;
+            cache->resolveAsync(host, port, AF_UNSPEC, [weak, host, port](const DnsCache::Address& resolved) {
+                    SocketClient::SharedPtr socket = weak.lock();
+                    if (!socket || socket->fd != -1 || socket->socketState != Connecting || socket->address != host)
+                        return;
+                    if (!resolved.isValid()) {
+                        socket->close();
+                        socket->signalError(socket, DnsError);
+                        return;
+                    }
+                    if (!socket->connectTo(host, port, resolved.addr(), resolved.size))
+                        socket->close();
+                });
+            return true;
         }
-    }
-
-    // not an ip address, try to resolve it
-    addrinfo hints, *p;
-
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC; // AF_INET or AF_INET6 to force version
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(host.constData(), NULL, &hints, &res) != 0) {
-        // bad
-        socket->signalError(socket, SocketClient::DnsError);
-        socket->close();
-        return;
-    }
-
-    for (p = res; p; p = p->ai_next) {
-        if (p->ai_family == AF_INET) {
-            addr = p->ai_addr;
-            reinterpret_cast<sockaddr_in*>(addr)->sin_port = htons(port);
-            size = sizeof(sockaddr_in);
-            break;
-        } else if (p->ai_family == AF_INET6) {
-            addr = p->ai_addr;
-            reinterpret_cast<sockaddr_in6*>(addr)->sin6_port = htons(port);
-            size = sizeof(sockaddr_in6);
-            break;
+        addr = cache->resolve(host, port, AF_UNSPEC);
+        if (!addr.isValid()) {
+            signalError(tcpSocket, DnsError);
+            close();
+            return false;
         }
     }
-
-    if (!addr) {
-        socket->signalError(socket, SocketClient::DnsError);
-        socket->close();
-        freeaddrinfo(res);
-        res = 0;
-        return;
-    }
-}
-
-Resolver::~Resolver()
-{
-    if (res)
-        freeaddrinfo(res); // free the linked list
-    else if (addr) {
-        if (size == sizeof(sockaddr_in))
-            delete reinterpret_cast<sockaddr_in*>(addr);
-        else
-            delete reinterpret_cast<sockaddr_in6*>(addr);
-    }
+    return connectTo(host, port, addr.addr(), addr.size);
 }
 
-bool SocketClient::connect(const String& host, uint16_t port)
+bool SocketClient::connectTo(const String& host, uint16_t port, const sockaddr* addr, size_t addrSize)
 {
     SocketClient::SharedPtr tcpSocket = shared_from_this();
-    Resolver resolver(host, port, tcpSocket);
-    if (!resolver.addr)
-        return false;
-
     unsigned int mode = Tcp;
-    if (resolver.size == sizeof(sockaddr_in6))
+    if (addr->sa_family == AF_INET6)
         mode |= IPv6;
 
     if (!init(mode))
         return false;
 
     int e;
-    eintrwrap(e, ::connect(fd, resolver.addr, resolver.size));
+    eintrwrap(e, ::connect(fd, addr, addrSize));
     socketPort = port;
     address = host;
     if (e == 0) { // we're done
         socketState = Connected;
 
+        startRead();
         signalConnected(tcpSocket);
+        // written while the name was being resolved
+        if (fd != -1 && !writeQueue.isEmpty())
+            return write(0, 0);
     } else {
         if (errno != EINPROGRESS) {
             // bad
@@ -219,7 +164,7 @@ bool SocketClient::connect(const String& host, uint16_t port)
             return false;
         }
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-            loop->updateSocket(fd, EventLoop::SocketRead|EventLoop::SocketWrite|EventLoop::SocketOneShot);
+            loop->updateSocket(fd, readMode()|EventLoop::SocketWrite|EventLoop::SocketOneShot);
             writeWait = true;
         }
         socketState = Connecting;
@@ -249,6 +194,7 @@ bool SocketClient::connect(const String& path)
     if (e == 0) { // we're done
         socketState = Connected;
 
+        startRead();
         signalConnected(unixSocket);
     } else {
         if (errno != EINPROGRESS) {
@@ -258,7 +204,7 @@ bool SocketClient::connect(const String& path)
             return false;
         }
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-            loop->updateSocket(fd, EventLoop::SocketRead|EventLoop::SocketWrite|EventLoop::SocketOneShot);
+            loop->updateSocket(fd, readMode()|EventLoop::SocketWrite|EventLoop::SocketOneShot);
             writeWait = true;
         }
         socketState = Connecting;
@@ -383,122 +329,201 @@ String SocketClient::sockName(uint16_t* port) const
     return getNameHelper(fd, ::getsockname, port);
 }
 
-bool SocketClient::writeTo(const String& host, uint16_t port, const unsigned char* data, unsigned int size)
+#ifdef IOV_MAX
+enum { MaxWriteVecs = IOV_MAX < 1024 ? IOV_MAX : 1024 };
+#else
+enum { MaxWriteVecs = 16 };
+#endif
+
+static ssize_t sendVecs(int fd, const iovec* vecs, int count, const sockaddr* addr, size_t addrSize)
 {
-    if (size) {
-        mWrites.append(size);
+    ssize_t e;
+    if (addr) {
+#ifdef HAVE_NOSIGNAL
+        const int sendFlags = MSG_NOSIGNAL;
+#else
+        const int sendFlags = 0;
+#endif
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = const_cast<sockaddr*>(addr);
+        msg.msg_namelen = addrSize;
+        msg.msg_iov = const_cast<iovec*>(vecs);
+        msg.msg_iovlen = count;
+        eintrwrap(e, ::sendmsg(fd, &msg, sendFlags));
+    } else {
+        eintrwrap(e, ::writev(fd, vecs, count));
     }
+    return e;
+}
 
-    assert((!size) == (!data));
-    SocketClient::SharedPtr socketPtr = shared_from_this();
+// fills out with what's left of vecs after skipping skip bytes
+static int remainingVecs(const iovec* vecs, int count, size_t skip, iovec* out)
+{
+    int ret = 0;
+    for (int i = 0; i < count && ret < MaxWriteVecs; ++i) {
+        if (skip >= vecs[i].iov_len) {
+            skip -= vecs[i].iov_len;
+            continue;
+        }
+        out[ret].iov_base = static_cast<char*>(vecs[i].iov_base) + skip;
+        out[ret].iov_len = vecs[i].iov_len - skip;
+        skip = 0;
+        ++ret;
+    }
+    return ret;
+}
 
-    Resolver resolver;
-    if (port != 0)
-        resolver.resolve(host, port, socketPtr);
+// Queues what's left of vecs after skip bytes. Small writes are
+// coalesced, data the caller gave up is queued as is.
+void SocketClient::queueWrite(const iovec* vecs, int count, size_t skip, Buffer* owned)
+{
+    if (owned) {
+        assert(!skip || writeQueue.isEmpty());
+        if (writeQueue.isEmpty())
+            writeOffset = skip;
+        writeQueue.append(std::move(*owned));
+        return;
+    }
 
-    int e;
-    unsigned int total = 0;
+    size_t rem = 0;
+    for (int i = 0; i < count; ++i)
+        rem += vecs[i].iov_len;
+    assert(rem > skip);
+    rem -= skip;
 
-#ifdef HAVE_NOSIGNAL
-    const int sendFlags = MSG_NOSIGNAL;
-#else
-    const int sendFlags = 0;
-#endif
+    enum { CoalesceSize = 4096 };
+    if (writeQueue.isEmpty() || (socketMode & Udp) || writeQueue.last().size() + rem > CoalesceSize) {
+        writeQueue.append(Buffer());
+        writeQueue.last().reserve(std::max<size_t>(rem, CoalesceSize));
+    }
+    Buffer& segment = writeQueue.last();
+    segment.reserve(segment.size() + rem);
+    for (int i = 0; i < count; ++i) {
+        if (skip >= vecs[i].iov_len) {
+            skip -= vecs[i].iov_len;
+            continue;
+        }
+        const size_t len = vecs[i].iov_len - skip;
+        memcpy(segment.end(), static_cast<const char*>(vecs[i].iov_base) + skip, len);
+        segment.resize(segment.size() + len);
+        skip = 0;
+    }
+}
 
-    if (!writeWait) {
-        if (!writeBuffer.isEmpty()) {
-            assert(writeOffset < writeBuffer.size());
-            const size_t writeBufferSize = writeBuffer.size() - writeOffset;
-            while (total < writeBufferSize) {
-                assert(writeBuffer.size() > total);
-                if (resolver.addr) {
-                    eintrwrap(e, ::sendto(fd, writeBuffer.data() + total + writeOffset, writeBufferSize - total,
-                                          sendFlags, resolver.addr, resolver.size));
-                } else {
-                    eintrwrap(e, ::write(fd, writeBuffer.data() + total + writeOffset, writeBufferSize - total));
-                }
-                DEBUG() << "SENT(1)" << (writeBufferSize - total) << "BYTES" << e << errno;
-                if (e == -1) {
-                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                        if (wMode == Synchronous) {
-                            if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-                                if (total) {
-                                    if (total < writeBufferSize) {
-                                        writeOffset += total;
-                                    } else {
-                                        writeOffset = 0;
-                                        writeBuffer.clear();
-                                    }
-                                    total = 0;
-                                }
-                                if (loop->processSocket(fd) & EventLoop::SocketWrite)
-                                    break;
-                                if (fd == -1)
-                                    return false;
-                            }
-                        }
-                        assert(!writeWait);
-                        if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-                            loop->updateSocket(fd, EventLoop::SocketRead|EventLoop::SocketWrite|EventLoop::SocketOneShot);
-                            writeWait = true;
-                        }
-                        break;
-                    } else {
-                        // bad
-                        signalError(shared_from_this(), WriteError);
-                        close();
-                        return false;
+// Writes as much of the queue as the socket takes, returns false if the
+// socket was closed
+bool SocketClient::flushWrites(const SocketClient::SharedPtr& socketPtr, const sockaddr* addr, size_t addrSize)
+{
+    // every queued UDP write is a datagram of its own
+    const int maxVecs = (socketMode & Udp) ? 1 : MaxWriteVecs;
+    iovec vecs[MaxWriteVecs];
+    while (!writeQueue.isEmpty()) {
+        assert(writeOffset < writeQueue.first().size());
+        int count = 0;
+        size_t queued = 0, offset = writeOffset;
+        for (LinkedList<Buffer>::iterator it = writeQueue.begin(); it != writeQueue.end() && count < maxVecs; ++it) {
+            vecs[count].iov_base = it->data() + offset;
+            vecs[count].iov_len = it->size() - offset;
+            queued += vecs[count++].iov_len;
+            offset = 0;
+        }
+        const ssize_t e = sendVecs(fd, vecs, count, addr, addrSize);
+        DEBUG() << "SENT(1)" << queued << "BYTES" << e << errno;
+        if (e == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (wMode == Synchronous) {
+                    if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
+                        if (loop->processSocket(fd) & EventLoop::SocketWrite)
+                            return fd != -1;
+                        if (fd == -1)
+                            return false;
                     }
                 }
-                signalBytesWritten(socketPtr, e);
-                total += e;
-            }
-            if (total) {
-                assert(total <= writeBufferSize);
-                if (total < writeBufferSize) {
-                    writeOffset += total;
-                } else {
-                    writeOffset = 0;
-                    writeBuffer.clear();
+                assert(!writeWait);
+                if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
+                    loop->updateSocket(fd, readMode()|EventLoop::SocketWrite|EventLoop::SocketOneShot);
+                    writeWait = true;
                 }
+                return true;
             }
+            // bad
+            signalError(socketPtr, WriteError);
+            close();
+            return false;
         }
 
-        if (fd == -1 || !data) {
-            return fd != -1;
+        // drop what's been written before telling anyone, they may
+        // write more
+        size_t written = e;
+        while (written) {
+            const size_t left = writeQueue.first().size() - writeOffset;
+            if (written < left) {
+                writeOffset += written;
+                break;
+            }
+            written -= left;
+            writeOffset = 0;
+            writeQueue.pop_front();
         }
-        total = 0;
+        signalBytesWritten(socketPtr, e);
+        if (fd == -1)
+            return false;
+        if (writeWait)
+            return true;
+    }
+    writeOffset = 0;
+    return true;
+}
+
+bool SocketClient::writeVecs(const sockaddr* addr, size_t addrSize, const iovec* vecs, int count, Buffer* owned)
+{
+    size_t size = 0;
+    for (int i = 0; i < count; ++i)
+        size += vecs[i].iov_len;
+    if (size) {
+        mWrites.append(size);
+    }
+
+    if (fd == -1 && socketState == Connecting) {
+        // the name is still being resolved, sent once connected
+        if (size)
+            queueWrite(vecs, count, 0, owned);
+        return true;
+    }
+
+    SocketClient::SharedPtr socketPtr = shared_from_this();
+
+    size_t total = 0;
 
-        assert(data != 0 && size > 0);
+    if (!writeWait) {
+        if (!writeQueue.isEmpty() && !flushWrites(socketPtr, addr, addrSize))
+            return false;
 
-        if (writeBuffer.isEmpty()) {
+        if (fd == -1 || !size) {
+            return fd != -1;
+        }
+
+        if (writeQueue.isEmpty() && !writeWait) {
+            iovec remaining[MaxWriteVecs];
             for (;;) {
                 assert(size > total);
-                if (resolver.addr) {
-                    eintrwrap(e, ::sendto(fd, data + total, size - total,
-                                          sendFlags, resolver.addr, resolver.size));
-                } else {
-                    eintrwrap(e, ::write(fd, data + total, size - total));
-                }
+                const int remainingCount = remainingVecs(vecs, count, total, remaining);
+                const ssize_t e = sendVecs(fd, remaining, remainingCount, addr, addrSize);
                 DEBUG() << "SENT(2)" << (size - total) << "BYTES" << e << errno;
                 if (e == -1) {
                     if (errno == EAGAIN || errno == EWOULDBLOCK) {
                         if (wMode == Synchronous) {
                             if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
                                 // store the rest
-                                const unsigned int rem = size - total;
-                                writeBuffer.reserve(writeBuffer.size() + rem);
-                                memcpy(writeBuffer.end(), data + total, rem);
-                                writeBuffer.resize(writeBuffer.size() + rem);
-                                assert(!writeOffset);
-
+                                queueWrite(vecs, count, total, owned);
                                 (void)loop->processSocket(fd);
                                 return isConnected();
                             }
                         }
                         assert(!writeWait);
                         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-                            loop->updateSocket(fd, EventLoop::SocketRead|EventLoop::SocketWrite|EventLoop::SocketOneShot);
+                            loop->updateSocket(fd, readMode()|EventLoop::SocketWrite|EventLoop::SocketOneShot);
                             writeWait = true;
                         }
                         break;
@@ -522,19 +547,78 @@ bool SocketClient::writeTo(const String& host, uint16_t port, const unsigned cha
 
     if (total < size) {
         // store the rest
-        const unsigned int rem = size - total;
-        writeBuffer.reserve(writeBuffer.size() + rem);
-        memcpy(writeBuffer.end(), data + total, rem);
-        writeBuffer.resize(writeBuffer.size() + rem);
+        queueWrite(vecs, count, total, owned);
     }
     return true;
 }
 
+bool SocketClient::writeTo(const String& host, uint16_t port, const unsigned char* data, unsigned int size)
+{
+    assert((!size) == (!data));
+    iovec vec;
+    vec.iov_base = const_cast<unsigned char*>(data);
+    vec.iov_len = size;
+    if (port == 0)
+        return writeVecs(0, 0, &vec, size ? 1 : 0, 0);
+
+    SocketClient::SharedPtr socketPtr = shared_from_this();
+    DnsCache* cache = DnsCache::instance();
+    DnsCache::Address addr;
+    if (!cache->lookup(host, port, AF_UNSPEC, &addr)) {
+        if (!blocking && EventLoop::eventLoop()) {
+            // send it once the name is resolved
+            std::shared_ptr<Buffer> pending = std::make_shared<Buffer>();
+            if (size) {
+                pending->resize(size);
+                memcpy(pending->data(), data, size);
+            }
+            SocketClient::WeakPtr weak = socketPtr;
+            cache->resolveAsync(host, port, AF_UNSPEC, [weak, pending](const DnsCache::Address& resolved) {
+                    SocketClient::SharedPtr socket = weak.lock();
+                    if (!socket || socket->fd == -1)
+                        return;
+                    if (!resolved.isValid()) {
+                        // only this datagram is dropped
+                        socket->signalError(socket, DnsError);
+                        return;
+                    }
+                    iovec one;
+                    one.iov_base = pending->data();
+                    one.iov_len = pending->size();
+                    socket->writeVecs(resolved.addr(), resolved.size, &one, pending->isEmpty() ? 0 : 1, pending.get());
+                });
+            return true;
+        }
+        addr = cache->resolve(host, port, AF_UNSPEC);
+        if (!addr.isValid()) {
+            signalError(socketPtr, DnsError);
+            close();
+            return false;
+        }
+    }
+    return writeVecs(addr.addr(), addr.size, &vec, size ? 1 : 0, 0);
+}
+
 bool SocketClient::write(const void *data, unsigned int size)
 {
     return writeTo(String(), 0, reinterpret_cast<const unsigned char*>(data), size);
 }
 
+bool SocketClient::write(const iovec* vecs, int count)
+{
+    return writeVecs(0, 0, vecs, count, 0);
+}
+
+bool SocketClient::write(Buffer&& data)
+{
+    if (data.isEmpty())
+        return write(0, 0);
+    iovec vec;
+    vec.iov_base = data.data();
+    vec.iov_len = data.size();
+    return writeVecs(0, 0, &vec, 1, &data);
+}
+
 static String addrToString(const sockaddr* addr, bool IPv6)
 {
     String ip(INET6_ADDRSTRLEN, '\0');
@@ -571,81 +655,58 @@ void SocketClient::socketCallback(int f, int mode)
 
     if (writeWait && (mode & EventLoop::SocketWrite)) {
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-            loop->updateSocket(fd, EventLoop::SocketRead);
+            loop->updateSocket(fd, readMode());
             writeWait = false;
         }
     }
 
-    union {
-        sockaddr_in fromAddr4;
-        sockaddr_in6 fromAddr6;
-        sockaddr fromAddr;
-    };
-
-    socklen_t fromLen = 0;
-    const bool isIPv6 = socketMode & IPv6;
-
     if (mode & EventLoop::SocketRead) {
+        if (socketMode & Udp) {
+            union {
+                sockaddr_in fromAddr4;
+                sockaddr_in6 fromAddr6;
+                sockaddr fromAddr;
+            };
+            const bool isIPv6 = socketMode & IPv6;
 
-        enum { BlockSize = 1024, AllocateAt = 512 };
-        int e;
-
-        unsigned int total = 0;
-        for(;;) {
-            unsigned int rem = readBuffer.capacity() - readBuffer.size();
-            // printf("reading, remaining size %u\n", rem);
-            if (rem <= AllocateAt) {
-                // printf("allocating more\n");
-                readBuffer.reserve(readBuffer.size() + BlockSize);
-                rem = readBuffer.capacity() - readBuffer.size();
-                // printf("Rem is now %d\n", rem);
-            }
-            if (socketMode & Udp) {
-                if (isIPv6) {
-                    fromLen = sizeof(fromAddr6);
-                    eintrwrap(e, ::recvfrom(fd, readBuffer.end(), rem, 0, &fromAddr, &fromLen));
-                } else {
-                    fromLen = sizeof(fromAddr4);
-                    eintrwrap(e, ::recvfrom(fd, readBuffer.end(), rem, 0, &fromAddr, &fromLen));
+            enum { BlockSize = 1024, AllocateAt = 512 };
+            int e;
+
+            for (;;) {
+                unsigned int rem = readBuffer.capacity() - readBuffer.size();
+                if (rem <= AllocateAt) {
+                    readBuffer.reserve(readBuffer.size() + BlockSize);
+                    rem = readBuffer.capacity() - readBuffer.size();
                 }
-            } else {
-                eintrwrap(e, ::read(fd, readBuffer.end(), rem));
-            }
-            DEBUG() << "RECEIVED(2)" << rem << "BYTES" << e << errno;
-            if (e == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    break;
-                } else {
-                    // bad
-                    signalError(socketPtr, ReadError);
+                socklen_t fromLen = isIPv6 ? sizeof(fromAddr6) : sizeof(fromAddr4);
+                eintrwrap(e, ::recvfrom(fd, readBuffer.end(), rem, 0, &fromAddr, &fromLen));
+                DEBUG() << "RECEIVED(2)" << rem << "BYTES" << e << errno;
+                if (e == -1) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        break;
+                    } else {
+                        // bad
+                        signalError(socketPtr, ReadError);
+                        close();
+                        return;
+                    }
+                } else if (e == 0) {
+                    // socket closed
+                    signalDisconnected(socketPtr);
                     close();
                     return;
                 }
-            } else if (e == 0) {
-                // socket closed
-                if (total) {
-                    if (!fromLen)
-                        signalReadyRead(socketPtr, std::move(readBuffer));
-                }
-                signalDisconnected(socketPtr);
-                close();
-                return;
-            } else if (fromLen) {
                 readBuffer.resize(e);
                 signalReadyReadFrom(socketPtr, addrToString(&fromAddr, isIPv6), addrToPort(&fromAddr, isIPv6), std::move(readBuffer));
                 readBuffer.clear();
-            } else {
-                total += e;
-                readBuffer.resize(total);
             }
+        } else if (!readStream(socketPtr)) {
+            return;
         }
-        assert(total <= readBuffer.capacity());
-        if (!fromLen)
-            signalReadyRead(socketPtr, std::move(readBuffer));
 
         if (writeWait) {
             if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-                loop->updateSocket(fd, EventLoop::SocketRead|EventLoop::SocketWrite|EventLoop::SocketOneShot);
+                loop->updateSocket(fd, readMode()|EventLoop::SocketWrite|EventLoop::SocketOneShot);
             }
         }
     }
@@ -663,6 +724,7 @@ void SocketClient::socketCallback(int f, int mode)
             if (!err) {
                 // connected
                 socketState = Connected;
+                startRead();
                 signalConnected(socketPtr);
             } else {
                 // failed to connect
@@ -675,6 +737,166 @@ void SocketClient::socketCallback(int f, int mode)
     }
 }
 
+// Overflow space for readv(), one chunk per thread that reads sockets.
+// sadly GCC < 4.8 doesn't support thread_local
+enum { ReadChunkSize = 64 * 1024 };
+static pthread_key_t sReadChunkKey;
+static pthread_once_t sReadChunkOnce = PTHREAD_ONCE_INIT;
+
+static void createReadChunkKey()
+{
+    pthread_key_create(&sReadChunkKey, free);
+}
+
+static char* readChunk()
+{
+    pthread_once(&sReadChunkOnce, createReadChunkKey);
+    char* chunk = static_cast<char*>(pthread_getspecific(sReadChunkKey));
+    if (!chunk) {
+        chunk = static_cast<char*>(malloc(ReadChunkSize));
+        if (!chunk)
+            abort();
+        pthread_setspecific(sReadChunkKey, chunk);
+    }
+    return chunk;
+}
+
+void SocketClient::growReadBuffer(size_t size)
+{
+    // at least double so a large transfer takes O(log n) reallocs
+    readBuffer.reserve(std::max(size, readBuffer.capacity() * 2));
+}
+
+// Reads what's available on a stream socket. Whatever doesn't fit in the
+// spare room of readBuffer lands in the thread's overflow chunk so
+// small messages don't make the buffer grow up front and a single
+// readv() usually gets everything that's queued. The buffer only grows
+// once something lands in the chunk, then it's sized for the rest with
+// FIONREAD. Returns false if the socket was closed.
+bool SocketClient::readStream(const SocketClient::SharedPtr& socketPtr)
+{
+    enum { MinimumSpace = 1024, MaximumBatch = 1024 * 1024 };
+    char* chunk = readChunk();
+    size_t total = 0;
+    for (;;) {
+        const size_t size = readBuffer.size();
+        if (!readBuffer.capacity())
+            readBuffer.reserve(MinimumSpace);
+        const size_t space = readBuffer.capacity() - size;
+        iovec iov[2];
+        iov[0].iov_base = readBuffer.end();
+        iov[0].iov_len = space;
+        iov[1].iov_base = chunk;
+        iov[1].iov_len = ReadChunkSize;
+        ssize_t e;
+        eintrwrap(e, ::readv(fd, iov, 2));
+        DEBUG() << "RECEIVED(2)" << space << "BYTES" << e << errno;
+        if (e == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            // bad
+            signalError(socketPtr, ReadError);
+            close();
+            return false;
+        } else if (e == 0) {
+            // socket closed
+            if (total)
+                signalReadyRead(socketPtr, std::move(readBuffer));
+            signalDisconnected(socketPtr);
+            close();
+            return false;
+        }
+        total += e;
+        const size_t read = e;
+        if (read <= space) {
+            readBuffer.resize(size + read);
+        } else {
+            const size_t extra = read - space;
+            readBuffer.resize(size + space);
+            growReadBuffer(size + read);
+            memcpy(readBuffer.end(), chunk, extra);
+            readBuffer.resize(size + read);
+            int available;
+            if (::ioctl(fd, FIONREAD, &available) == 0 && available > 0)
+                growReadBuffer(readBuffer.size() + available);
+        }
+        // Keep going until EAGAIN even after a short read, with edge
+        // triggered sockets a hangup that's already queued behind the
+        // data won't be reported again. When a writer keeps up with us
+        // that can take a while, hand out what we have every so often
+        // so the buffer doesn't grow without bound.
+        if (readBuffer.size() >= MaximumBatch) {
+            signalReadyRead(socketPtr, std::move(readBuffer));
+            if (fd == -1)
+                return false;
+            total = 0;
+        }
+    }
+    signalReadyRead(socketPtr, std::move(readBuffer));
+    return true;
+}
+
+unsigned int SocketClient::readMode() const
+{
+    return asyncRead ? 0 : EventLoop::SocketRead;
+}
+
+void SocketClient::startRead()
+{
+    if (!asyncRead || readId || fd == -1)
+        return;
+    if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
+        // the read buffer is the ring's until the read completes
+        readId = loop->submitRead(fd, std::move(readBuffer), asyncReadSize, [this](int f, int result, Buffer&& buffer) {
+                readCallback(f, result, std::move(buffer));
+            });
+        if (readId == -1) {
+            // the ring is full, go back to reading when we're told to
+            readId = 0;
+            asyncRead = false;
+            loop->updateSocket(fd, readMode() | (writeWait ? EventLoop::SocketWrite|EventLoop::SocketOneShot : 0));
+        }
+    }
+}
+
+void SocketClient::cancelRead()
+{
+    if (!readId)
+        return;
+    if (EventLoop::SharedPtr loop = EventLoop::eventLoop())
+        loop->cancelIO(readId);
+    readId = 0;
+}
+
+void SocketClient::readCallback(int, int result, Buffer&& buffer)
+{
+    readId = 0;
+    std::swap(readBuffer, buffer);
+    SocketClient::SharedPtr socketPtr = shared_from_this();
+    DEBUG() << "RECEIVED(3)" << result << "BYTES";
+    if (result > 0) {
+        // ask for more while reads come back full, back off again once
+        // they don't
+        enum { MinimumReadSize = 4096, MaximumReadSize = 1024 * 1024 };
+        if (static_cast<unsigned int>(result) == asyncReadSize) {
+            asyncReadSize = std::min<unsigned int>(asyncReadSize * 2, MaximumReadSize);
+        } else if (static_cast<unsigned int>(result) < asyncReadSize / 4) {
+            asyncReadSize = std::max<unsigned int>(asyncReadSize / 2, MinimumReadSize);
+        }
+        signalReadyRead(socketPtr, std::move(readBuffer));
+        startRead();
+    } else if (!result) {
+        // socket closed
+        signalDisconnected(socketPtr);
+        close();
+    } else if (result == -EAGAIN || result == -EINTR) {
+        startRead();
+    } else {
+        signalError(socketPtr, ReadError);
+        close();
+    }
+}
+
 bool SocketClient::init(unsigned int mode)
 {
     int domain = -1, type = -1;
@@ -708,7 +930,9 @@ bool SocketClient::init(unsigned int mode)
 #endif
     if (!blocking) {
         if (EventLoop::SharedPtr loop = EventLoop::eventLoop()) {
-            loop->registerSocket(fd, EventLoop::SocketRead,
+            // streams read through the loop once they're connected
+            asyncRead = !(mode & Udp) && loop->hasAsyncIO();
+            loop->registerSocket(fd, readMode(),
                                  std::bind(&SocketClient::socketCallback, this, std::placeholders::_1, std::placeholders::_2));
             if (!setFlags(fd, O_NONBLOCK, F_GETFL, F_SETFL)) {
                 close();
@@ -4,10 +4,14 @@
 #include <memory>
 
 #include "Buffer.h"
+#include "EventLoop.h"
 #include "Rct.h"
 #include "SignalSlot.h"
 #include "String.h"
 
+struct iovec;
+struct sockaddr;
+
 class SocketClient : public std::enable_shared_from_this<SocketClient>
 {
 public:
@@ -27,7 +31,7 @@ public:
     SocketClient(int fd, unsigned int mode);
     ~SocketClient();
 
-    int takeFD() { const int f = fd; fd = -1; return f; }
+    int takeFD() { cancelRead(); const int f = fd; fd = -1; return f; }
 
     enum State { Disconnected, Connecting, Connected };
     State state() const { return socketState; }
@@ -41,7 +45,8 @@ public:
     String path() const { return (socketMode & Unix ? address : String()); }
     uint16_t port() const { return socketPort; }
 
-    bool isConnected() const { return fd != -1; }
+    // true while the host name given to connect() is being resolved
+    bool isConnected() const { return fd != -1 || socketState == Connecting; }
     int socket() const { return fd; }
 
     enum WriteMode {
@@ -56,6 +61,12 @@ public:
     // TCP/UNIX
     bool write(const void *data, unsigned int num);
     bool write(const String &data) { return write(&data[0], data.size()); }
+    // Writes the buffers in order, with a single system call if the
+    // socket takes it all. Whatever it doesn't take is copied to the
+    // write queue once.
+    bool write(const iovec* vecs, int count);
+    // Takes ownership so nothing is copied if the write has to be queued
+    bool write(Buffer&& data);
 
     String peerName(uint16_t* port = 0) const;
     String peerString() const
@@ -119,6 +130,7 @@ public:
     void setLogsEnabled(bool on) { mLogsEnabled = on; }
 private:
     bool init(unsigned int mode);
+    bool connectTo(const String& host, uint16_t port, const sockaddr* addr, size_t addrSize);
 
     int fd;
     uint16_t socketPort;
@@ -129,6 +141,17 @@ private:
     String address;
     bool blocking;
     bool mLogsEnabled;
+    // stream sockets on an io_uring loop have a read in flight instead
+    // of being polled for readability, see EventLoop::submitRead()
+    bool asyncRead;
+    int readId;
+    unsigned int asyncReadSize;
+    unsigned int readMode() const;
+    void startRead();
+    void cancelRead();
+    void readCallback(int, int result, Buffer&& buffer);
+    bool readStream(const SocketClient::SharedPtr& socketPtr);
+    void growReadBuffer(size_t size);
 
     Signal<std::function<void(const SocketClient::SharedPtr&, Buffer&&)> > signalReadyRead;
     Signal<std::function<void(const SocketClient::SharedPtr&, const String&, uint16_t, Buffer&&)> > signalReadyReadFrom;
@@ -136,15 +159,21 @@ private:
     Signal<std::function<void(const SocketClient::SharedPtr&, Error)> > signalError;
     Signal<std::function<void(const SocketClient::SharedPtr&, int)> > signalBytesWritten;
     void bytesWritten(const SocketClient::SharedPtr &socket, uint64_t bytes);
-    Buffer readBuffer, writeBuffer;
+    Buffer readBuffer;
+    // unsent data, flushed with writev(). writeOffset is how much of the
+    // first segment has been written.
+    LinkedList<Buffer> writeQueue;
     size_t writeOffset;
+    bool writeVecs(const sockaddr* addr, size_t addrSize, const iovec* vecs, int count, Buffer* owned);
+    void queueWrite(const iovec* vecs, int count, size_t skip, Buffer* owned);
+    bool flushWrites(const SocketClient::SharedPtr& socketPtr, const sockaddr* addr, size_t addrSize);
 
     int writeData(const unsigned char *data, int size);
     void socketCallback(int, int);
 
     struct TimeData {
         TimeData(uint64_t b = 0)
-            : startTime(Rct::monoMs()), endTime(0), bytes(b), completed(0)
+            : startTime(EventLoop::cachedTime()), endTime(0), bytes(b), completed(0)
         {}
 
         bool add(uint64_t &available)
@@ -156,7 +185,7 @@ private:
             assert(available > provided);
             available -= provided;
             if (needed == provided) {
-                endTime = Rct::monoMs();
+                endTime = EventLoop::cachedTime();
                 return true;
             }
             return false;
@@ -178,7 +207,6 @@ private:
 
     List<TimeData> mWrites, mPendingWrites;
 
-    friend class Resolver;
 };
 
 #endif
@@ -16,8 +16,11 @@
 #include "rct/rct-config.h"
 #include "Rct.h"
 
+// ### should be able to customize the backlog
+enum { Backlog = 128 };
+
 SocketServer::SocketServer()
-    : fd(-1), isIPv6(false)
+    : fd(-1), isIPv6(false), distribution(RoundRobin), clientSignal(new ClientSignal)
 {}
 
 SocketServer::~SocketServer()
@@ -29,6 +32,23 @@ void SocketServer::close()
 {
     if (fd == -1)
         return;
+    if (!reusePortListeners.isEmpty()) {
+        // each listener is serviced by its own loop, close it there
+        for (const auto& listener : reusePortListeners) {
+            const int sock = listener.first;
+            if (EventLoop::SharedPtr loop = listener.second.lock()) {
+                loop->callLater([sock]() {
+                        EventLoop::eventLoop()->unregisterSocket(sock);
+                        ::close(sock);
+                    });
+            } else {
+                ::close(sock);
+            }
+        }
+        reusePortListeners.clear();
+        fd = -1;
+        return;
+    }
     if (EventLoop::SharedPtr loop = EventLoop::eventLoop())
         loop->unregisterSocket(fd);
     ::close(fd);
@@ -95,9 +115,104 @@ bool SocketServer::listen(uint16_t port, Mode mode)
         addr4.sin_port = htons(port);
     }
 
+    if (group && distribution == ReusePort)
+        return listenReusePort(&addr, size);
     return commonBindAndListen(&addr, size);
 }
 
+uint16_t SocketServer::port() const
+{
+    union {
+        sockaddr_in addr4;
+        sockaddr_in6 addr6;
+        sockaddr addr;
+    };
+    socklen_t size = sizeof(addr6);
+    if (fd == -1 || ::getsockname(fd, &addr, &size) == -1)
+        return 0;
+    if (addr.sa_family == AF_INET)
+        return ntohs(addr4.sin_port);
+    if (addr.sa_family == AF_INET6)
+        return ntohs(addr6.sin6_port);
+    return 0;
+}
+
+void SocketServer::setEventLoopGroup(const EventLoopGroup::SharedPtr& g, Distribution d)
+{
+    group = g;
+    distribution = d;
+}
+
+static void acceptClients(int fd, const std::shared_ptr<SocketServer::ClientSignal>& signal)
+{
+    for (;;) {
+        int e;
+        eintrwrap(e, ::accept(fd, 0, 0));
+        if (e == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                error() << "accept() failed with errno:" << Rct::strerror();
+            return;
+        }
+        SocketClient::SharedPtr client(new SocketClient(e, SocketClient::Tcp));
+        (*signal)(client);
+    }
+}
+
+bool SocketServer::listenReusePort(sockaddr* addr, size_t size)
+{
+#ifdef HAVE_REUSEPORT
+    // fd becomes the first listener, the others are bound to the same
+    // address and each is registered with its own loop
+    for (size_t i = 0; i < group->size(); ++i) {
+        int sock = fd;
+        if (i) {
+            sock = ::socket(isIPv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+            if (sock < 0) {
+                serverError(this, InitializeError);
+                close();
+                return false;
+            }
+#ifdef HAVE_CLOEXEC
+            SocketClient::setFlags(sock, FD_CLOEXEC, F_GETFD, F_SETFD);
+#endif
+        }
+        Error err = InitializeError;
+        int flags = 1;
+        bool ok = (::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(int)) == 0
+                   && ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &flags, sizeof(int)) == 0);
+        if (ok && !(ok = (::bind(sock, addr, size) == 0)))
+            err = BindError;
+        if (ok && !i) {
+            // pick up the port in case we were asked for any port
+            socklen_t len = size;
+            ok = ::getsockname(sock, addr, &len) == 0;
+        }
+        if (ok && !(ok = (::listen(sock, Backlog) == 0)))
+            err = ListenError;
+        if (ok)
+            ok = SocketClient::setFlags(sock, O_NONBLOCK, F_GETFL, F_SETFL);
+        if (!ok) {
+            if (sock != fd)
+                ::close(sock);
+            serverError(this, err);
+            close();
+            return false;
+        }
+
+        EventLoop::SharedPtr loop = group->loop(i);
+        reusePortListeners.append(std::make_pair(sock, EventLoop::WeakPtr(loop)));
+        std::shared_ptr<ClientSignal> signal = clientSignal;
+        loop->registerSocket(sock, EventLoop::SocketRead, [sock, signal](int, unsigned int mode) {
+                if (mode & EventLoop::SocketRead)
+                    acceptClients(sock, signal);
+            });
+    }
+    return true;
+#else
+    return commonBindAndListen(addr, size);
+#endif
+}
+
 bool SocketServer::listen(const Path &p)
 {
     close();
@@ -149,8 +264,6 @@ bool SocketServer::commonBindAndListen(sockaddr* addr, size_t size)
 
 bool SocketServer::commonListen()
 {
-    // ### should be able to customize the backlog
-    enum { Backlog = 128 };
     if (::listen(fd, Backlog) < 0) {
         fprintf(stderr, "::listen() failed with errno: %s\n",
                 Rct::strerror().constData());
@@ -216,7 +329,29 @@ void SocketServer::socketCallback(int /*fd*/, int mode)
         }
 
         //EventLoop::eventLoop()->unregisterSocket( fd );
+        if (group) {
+            distribute(e);
+            continue;
+        }
         accepted.push(e);
         serverNewConnection(this);
     }
 }
+
+void SocketServer::distribute(int sock)
+{
+    EventLoop::SharedPtr loop;
+    if (group->isRunning())
+        loop = group->next(distribution == LeastLoaded ? EventLoopGroup::LeastLoaded : EventLoopGroup::RoundRobin);
+    if (!loop) {
+        ::close(sock);
+        return;
+    }
+    // the client registers with the loop of the thread that creates it
+    const unsigned int mode = path.isEmpty() ? SocketClient::Tcp : SocketClient::Unix;
+    std::shared_ptr<ClientSignal> signal = clientSignal;
+    loop->callLater([sock, mode, signal]() {
+            SocketClient::SharedPtr client(new SocketClient(sock, mode));
+            (*signal)(client);
+        });
+}
@@ -5,6 +5,8 @@
 #include <queue>
 #include <stdint.h>
 
+#include <rct/EventLoopGroup.h>
+#include <rct/List.h>
 #include <rct/Path.h>
 #include <rct/SignalSlot.h>
 #include <rct/SocketClient.h>
@@ -27,6 +29,22 @@ public:
     bool listen(const Path &path); // UNIX
     bool listenFD(int fd);         // UNIX
     bool isListening() const { return fd != -1; }
+    uint16_t port() const; // TCP
+
+    // Spreads accepted connections over the loops of group. Call before
+    // listen(). RoundRobin and LeastLoaded accept on this thread's loop
+    // and post each socket to the chosen loop. ReusePort opens one
+    // SO_REUSEPORT listener per loop and lets the kernel balance them,
+    // for UNIX sockets it falls back to RoundRobin. Connections are
+    // reported through newClient() instead of newConnection().
+    enum Distribution { RoundRobin, LeastLoaded, ReusePort };
+    void setEventLoopGroup(const EventLoopGroup::SharedPtr& group, Distribution distribution = RoundRobin);
+    EventLoopGroup::SharedPtr eventLoopGroup() const { return group; }
+
+    // Emitted on the loop the client belongs to, the client has to be
+    // used and destroyed on that loop's thread.
+    typedef Signal<std::function<void(const SocketClient::SharedPtr&)> > ClientSignal;
+    ClientSignal& newClient() { return *clientSignal; }
 
     SocketClient::SharedPtr nextConnection();
 
@@ -39,12 +57,19 @@ private:
     void socketCallback(int fd, int mode);
     bool commonBindAndListen(sockaddr* addr, size_t size);
     bool commonListen();
+    bool listenReusePort(sockaddr* addr, size_t size);
+    void distribute(int sock);
 
 private:
     int fd;
     bool isIPv6;
     Path path;
     std::queue<int> accepted;
+    EventLoopGroup::SharedPtr group;
+    Distribution distribution;
+    // shared with the callbacks running on the group's loops
+    std::shared_ptr<ClientSignal> clientSignal;
+    List<std::pair<int, EventLoop::WeakPtr> > reusePortListeners;
     Signal<std::function<void(SocketServer*)> > serverNewConnection;
     Signal<std::function<void(SocketServer*, Error)> > serverError;
 };
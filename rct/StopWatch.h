@@ -2,7 +2,6 @@
 #define StopWatch_h
 
 #include <stdint.h>
-#include <sys/time.h>
 
 #include <rct/Rct.h>
 
@@ -11,7 +10,8 @@ class StopWatch
 public:
     enum Precision {
         Millisecond,
-        Microsecond
+        Microsecond,
+        Nanosecond
     };
     StopWatch(Precision prec = Millisecond)
         : mPrecision(prec), mStart(current(prec))
@@ -30,13 +30,16 @@ public:
 
     static unsigned long long current(Precision prec)
     {
-        timeval t;
-        Rct::gettime(&t); // monotonic
-        if (prec == Millisecond) {
-            return (t.tv_sec * 1000) + (t.tv_usec / 1000);
-        } else {
-            return (t.tv_sec * 1000000) + t.tv_usec;
+        const uint64_t ns = Rct::monoNs(); // monotonic
+        switch (prec) {
+        case Millisecond:
+            return ns / 1000000;
+        case Microsecond:
+            return ns / 1000;
+        case Nanosecond:
+            break;
         }
+        return ns;
     }
 
     unsigned long long elapsed() const
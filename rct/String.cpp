@@ -5,9 +5,10 @@
 enum { BufferSize = 1024 * 32 };
 #endif
 
-String String::compress() const
+String String::compress(int level) const
 {
 #ifndef RCT_HAVE_ZLIB
+    (void)level;
     assert(0 && "Rct configured without zlib support");
     return String();
 #else
@@ -16,7 +17,7 @@ String String::compress() const
     z_stream stream;
     memset(&stream, 0, sizeof(stream));
 
-    if (::deflateInit(&stream, Z_BEST_COMPRESSION) != Z_OK)
+    if (::deflateInit(&stream, level) != Z_OK)
         return String();
 
     stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef *>(data()));
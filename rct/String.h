@@ -404,7 +404,8 @@ public:
         mString.append(ba);
     }
 
-    String compress() const;
+    // zlib's levels, 1 is the fastest and 9 the smallest
+    String compress(int level = 9) const;
     String uncompress() const { return uncompress(constData(), size()); }
     static String uncompress(const char *data, size_t size);
 
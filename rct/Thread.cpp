@@ -3,6 +3,9 @@
 #include <rct/EventLoop.h>
 #include <rct/Log.h>
 #include <rct/rct-config.h>
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#  include <sched.h>
+#endif
 
 Thread::Thread()
     : mAutoDelete(false), mRunning(false), mLoop(EventLoop::eventLoop())
@@ -18,6 +21,9 @@ Thread::~Thread()
 void* Thread::localStart(void* arg)
 {
     Thread* t = static_cast<Thread*>(arg);
+    const List<int> affinity = t->affinity();
+    if (!affinity.isEmpty())
+        t->applyAffinity(pthread_self(), affinity);
     t->run();
     EventLoop::cleanupLocalEventLoop();
     if (t->isAutoDelete()) {
@@ -37,6 +43,47 @@ static inline void initAttr(pthread_attr_t** pattr, pthread_attr_t* attr)
     }
 }
 
+bool Thread::setAffinity(const List<int> &cpus)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    std::lock_guard<std::mutex> lock(mMutex);
+    mAffinity = cpus;
+    if (mRunning)
+        return applyAffinity(mThread, cpus);
+    return true;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+bool Thread::applyAffinity(pthread_t thread, const List<int> &cpus)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpus.isEmpty()) {
+        // the kernel leaves out the ones we're not allowed on
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            CPU_SET(cpu, &set);
+    } else {
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+    }
+    if (pthread_setaffinity_np(thread, sizeof(set), &set) != 0) {
+        error() << "pthread_setaffinity_np failed";
+        return false;
+    }
+    return true;
+#else
+    (void)thread;
+    (void)cpus;
+    return false;
+#endif
+}
+
 void Thread::start(Priority priority, size_t stackSize)
 {
     pthread_attr_t attr;
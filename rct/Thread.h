@@ -5,6 +5,7 @@
 #include <pthread.h>
 
 #include <rct/EventLoop.h>
+#include <rct/List.h>
 
 class Thread
 {
@@ -30,11 +31,22 @@ public:
 
     pthread_t self() const { return mThread; }
 
+    // The cpus the thread may run on, an empty list lets it run on any.
+    // Applied when the thread starts or right away if it's running,
+    // returns false if the platform can't pin threads.
+    bool setAffinity(const List<int> &cpus);
+    List<int> affinity() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mAffinity;
+    }
+
 protected:
     virtual void run() = 0;
 
 private:
     void finish();
+    bool applyAffinity(pthread_t thread, const List<int> &cpus);
 
     static void* localStart(void* arg);
 
@@ -43,6 +55,7 @@ private:
     mutable std::mutex mMutex;
     pthread_t mThread;
     bool mRunning;
+    List<int> mAffinity;
     EventLoop::WeakPtr mLoop;
 };
 
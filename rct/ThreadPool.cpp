@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <pthread.h>
+#include <thread>
 
 #include "rct/rct-config.h"
 #if defined (OS_FreeBSD) || defined (OS_NetBSD) || defined (OS_OpenBSD)
@@ -19,15 +21,282 @@
 #include "Log.h"
 #include "Thread.h"
 
-using std::shared_ptr;
-
 ThreadPool* ThreadPool::sInstance = 0;
 
+// Chase-Lev work-stealing deque (Le et al, "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The owner pushes and pops at
+// the bottom, any thread may steal from the top. Arrays that are grown
+// out of are kept until the deque goes away since a thief may still be
+// reading from one.
+template <typename T>
+class StealingDeque
+{
+public:
+    StealingDeque()
+        : mTop(0), mBottom(0), mArray(new Array(64))
+    {
+    }
+    ~StealingDeque()
+    {
+        delete mArray.load(std::memory_order_relaxed);
+        for (Array* array : mRetired)
+            delete array;
+    }
+
+    void push(T item)
+    {
+        const int64_t b = mBottom.load(std::memory_order_relaxed);
+        const int64_t t = mTop.load(std::memory_order_acquire);
+        Array* array = mArray.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(array->mask)) {
+            Array* bigger = new Array((array->mask + 1) * 2);
+            for (int64_t i = t; i < b; ++i)
+                bigger->put(i, array->get(i));
+            mRetired.append(array);
+            array = bigger;
+            mArray.store(array, std::memory_order_release);
+        }
+        array->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only
+    T pop()
+    {
+        const int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+        Array* array = mArray.load(std::memory_order_relaxed);
+        mBottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = mTop.load(std::memory_order_relaxed);
+        T item = T();
+        if (t <= b) {
+            item = array->get(b);
+            if (t == b) {
+                // last one, race the thieves for it
+                if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    item = T();
+                mBottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            mBottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, T() if empty or another thread got there first
+    T steal()
+    {
+        int64_t t = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = mBottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return T();
+        Array* array = mArray.load(std::memory_order_acquire);
+        const T item = array->get(t);
+        if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return T();
+        return item;
+    }
+
+    bool isEmpty() const
+    {
+        return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Array
+    {
+        Array(size_t size)
+            : mask(size - 1), items(new std::atomic<T>[size])
+        {
+        }
+        ~Array()
+        {
+            delete[] items;
+        }
+        T get(int64_t idx) const { return items[idx & mask].load(std::memory_order_relaxed); }
+        void put(int64_t idx, T item) { items[idx & mask].store(item, std::memory_order_relaxed); }
+
+        const size_t mask;
+        std::atomic<T>* items;
+    };
+
+    std::atomic<int64_t> mTop, mBottom;
+    std::atomic<Array*> mArray;
+    List<Array*> mRetired;
+};
+
+enum { PriorityBands = 3, MaxStealingWorkers = 256, InjectedBatch = 32 };
+
+static inline int priorityBand(int priority)
+{
+    return priority > 0 ? 0 : (priority == 0 ? 1 : 2);
+}
+
+struct StealingWorker
+{
+    StealingWorker(ThreadPool* p, uint32_t s)
+        : pool(p), active(false), seed(s), node(0)
+    {
+    }
+
+    ThreadPool* pool;
+    bool active; // has a thread, under the pool's mutex
+    uint32_t seed;
+    std::atomic<int> node;
+    StealingDeque<ThreadPoolTask*> deques[PriorityBands];
+};
+
+// the pool thread that's calling, if any
+static pthread_key_t sCurrentThreadKey;
+static pthread_once_t sCurrentThreadOnce = PTHREAD_ONCE_INIT;
+
+static void createCurrentThreadKey()
+{
+    pthread_key_create(&sCurrentThreadKey, 0);
+}
+
+struct ThreadPool::Stealing
+{
+    Stealing()
+        : workerCount(0), injectedCount(0), backlog(0), busy(0), sleeping(0), nodes(1)
+    {
+        for (int i = 0; i < MaxStealingWorkers; ++i)
+            workers[i] = 0;
+        for (int band = 0; band < PriorityBands; ++band) {
+            const TaskQueue queue = { 0, 0, 0 };
+            injected[band] = queue;
+        }
+    }
+    ~Stealing()
+    {
+        for (int i = 0; i < workerCount.load(); ++i)
+            delete workers[i].load();
+    }
+
+    // workers are never deleted before the pool, the deque of one
+    // whose thread has been stopped is still stolen from
+    std::atomic<StealingWorker*> workers[MaxStealingWorkers];
+    std::atomic<int> workerCount;
+
+    // tasks started from other threads, linked through mPrev and mNext
+    // under the pool's mutex
+    TaskQueue injected[PriorityBands];
+    std::atomic<int> injectedCount;
+
+    void inject(ThreadPoolTask* task);
+    // the caller gets the queue's reference to the task
+    void uninject(ThreadPoolTask* task);
+
+    std::atomic<int> backlog, busy, sleeping;
+    std::atomic<int> nodes;
+
+    // takes the queue's reference to the task, true if it's ours to run
+    bool claim(ThreadPoolTask* task)
+    {
+        if (task->claim()) {
+            --backlog;
+            return true;
+        }
+        task->deref();
+        return false;
+    }
+};
+
+// Runs a Job, the task holds the only reference the pool has to it
+// and drops it only when it's released since the task may be the job's
+struct JobRunner
+{
+    JobRunner(const std::shared_ptr<ThreadPool::Job>& j)
+        : job(j)
+    {
+    }
+
+    void operator()()
+    {
+        {
+            std::lock_guard<std::mutex> lock(job->mMutex);
+            job->mState = ThreadPool::Job::Running;
+        }
+        if (job->mPriority == ThreadPool::Guaranteed) {
+            std::lock_guard<std::mutex> lock(job->mMutex);
+            job->run();
+        } else {
+            job->run();
+        }
+        std::lock_guard<std::mutex> lock(job->mMutex);
+        job->mState = ThreadPool::Job::Finished;
+    }
+
+    // a job that was removed or started again stays queued until
+    // someone comes across it, only the task it was last queued with
+    // gets to run it
+    static bool claim(ThreadPoolTask* task)
+    {
+        ThreadPoolTask* expected = task;
+        return ThreadPoolTask::Storage<JobRunner>::get(task)->job->mQueued.compare_exchange_strong(expected, 0);
+    }
+
+    // there's no Future to complete
+    static void run(ThreadPoolTask* task)
+    {
+        (*ThreadPoolTask::Storage<JobRunner>::get(task))();
+    }
+
+    static void destroy(ThreadPoolTask* task)
+    {
+        JobRunner* runner = ThreadPoolTask::Storage<JobRunner>::get(task);
+        const std::shared_ptr<ThreadPool::Job> keep = std::move(runner->job);
+        runner->~JobRunner();
+        if (task == keep->task())
+            keep->mTaskUsed.store(false, std::memory_order_release);
+    }
+
+    std::shared_ptr<ThreadPool::Job> job;
+};
+
+void ThreadPool::Stealing::inject(ThreadPoolTask* task)
+{
+    TaskQueue& queue = injected[priorityBand(task->mPriority)];
+    task->mPrev = queue.last;
+    task->mNext = 0;
+    if (queue.last) {
+        queue.last->mNext = task;
+    } else {
+        queue.first = task;
+    }
+    queue.last = task;
+    // remove() and start() take a job's task out of here right away
+    if (task->mRun == &JobRunner::run)
+        ThreadPoolTask::Storage<JobRunner>::get(task)->job->mTask = task;
+    ++injectedCount;
+}
+
+void ThreadPool::Stealing::uninject(ThreadPoolTask* task)
+{
+    TaskQueue& queue = injected[priorityBand(task->mPriority)];
+    if (task->mPrev) {
+        task->mPrev->mNext = task->mNext;
+    } else {
+        queue.first = task->mNext;
+    }
+    if (task->mNext) {
+        task->mNext->mPrev = task->mPrev;
+    } else {
+        queue.last = task->mPrev;
+    }
+    task->mPrev = task->mNext = 0;
+    if (task->mRun == &JobRunner::run)
+        ThreadPoolTask::Storage<JobRunner>::get(task)->job->mTask = 0;
+    --injectedCount;
+}
+
 class ThreadPoolThread : public Thread
 {
 public:
-    ThreadPoolThread(ThreadPool* pool);
-    ThreadPoolThread(const std::shared_ptr<ThreadPool::Job> &job);
+    ThreadPoolThread(ThreadPool* pool, StealingWorker* worker = 0);
+    ThreadPoolThread(ThreadPoolTask* task);
 
     void stop();
 
@@ -35,19 +304,26 @@ protected:
     virtual void run() override;
 
 private:
-    std::shared_ptr<ThreadPool::Job> mJob;
+    void runStealing();
+    ThreadPoolTask* takeTask();
+
+    ThreadPoolTask* mTask;
     ThreadPool* mPool;
+    StealingWorker* mWorker;
+    int mNode; // under the pool's mutex
     bool mStopped;
+
+    friend class ThreadPool;
 };
 
-ThreadPoolThread::ThreadPoolThread(ThreadPool* pool)
-    : mPool(pool), mStopped(false)
+ThreadPoolThread::ThreadPoolThread(ThreadPool* pool, StealingWorker* worker)
+    : mTask(0), mPool(pool), mWorker(worker), mNode(0), mStopped(false)
 {
     setAutoDelete(false);
 }
 
-ThreadPoolThread::ThreadPoolThread(const std::shared_ptr<ThreadPool::Job> &job)
-    : mJob(job), mPool(0), mStopped(false)
+ThreadPoolThread::ThreadPoolThread(ThreadPoolTask* task)
+    : mTask(task), mPool(0), mWorker(0), mNode(0), mStopped(false)
 {
     setAutoDelete(false);
 }
@@ -61,10 +337,16 @@ void ThreadPoolThread::stop()
 
 void ThreadPoolThread::run()
 {
-    if (mJob) {
-        mJob->mMutex.lock();
-        mJob->run();
-        mJob->mMutex.unlock();
+    if (mTask) {
+        if (mTask->claim())
+            mTask->run();
+        mTask->deref();
+        mTask = 0;
+        return;
+    }
+    pthread_setspecific(sCurrentThreadKey, this);
+    if (mWorker) {
+        runStealing();
         return;
     }
     bool first = true;
@@ -75,38 +357,120 @@ void ThreadPoolThread::run()
         } else {
             first = false;
         }
-        while (mPool->mJobs.empty() && !mStopped)
-            mPool->mCond.wait(lock);
+        if (!mPool->mTaskCount && !mStopped) {
+            ++mPool->mIdleThreads;
+            do {
+                mPool->mCond.wait(lock);
+                mPool->wokeUp();
+            } while (!mPool->mTaskCount && !mStopped);
+            --mPool->mIdleThreads;
+        }
         if (mStopped)
             break;
-        std::deque<std::shared_ptr<ThreadPool::Job> >::iterator item = mPool->mJobs.begin();
-        assert(item != mPool->mJobs.end());
-        std::shared_ptr<ThreadPool::Job> job = *item;
-        mPool->mJobs.erase(item);
-        {
-            std::lock_guard<std::mutex> joblock(job->mMutex);
-            job->mState = ThreadPool::Job::Running;
-        }
+        ThreadPoolTask* task = mPool->popTask(mNode);
+        const bool claimed = task->claim();
         ++mPool->mBusyThreads;
         lock.unlock();
-        job->run();
-        {
-            std::lock_guard<std::mutex> joblock(job->mMutex);
-            job->mState = ThreadPool::Job::Finished;
+        if (claimed)
+            task->run();
+        task->deref();
+    }
+}
+
+// Highest band first: our own deque, then the injection queue, then
+// the other workers starting at a random one, those on our node first
+ThreadPoolTask* ThreadPoolThread::takeTask()
+{
+    ThreadPool::Stealing* stealing = mPool->mStealing.get();
+    for (int band = 0; band < PriorityBands; ++band) {
+        while (ThreadPoolTask* task = mWorker->deques[band].pop()) {
+            if (stealing->claim(task))
+                return task;
+        }
+        if (stealing->injectedCount.load(std::memory_order_relaxed)) {
+            // take a batch, the rest goes on our deque for others to steal
+            std::unique_lock<std::mutex> lock(mPool->mMutex);
+            ThreadPoolTask* batch[InjectedBatch];
+            int count = 0;
+            while (count < InjectedBatch && stealing->injected[band].first) {
+                batch[count] = stealing->injected[band].first;
+                stealing->uninject(batch[count++]);
+            }
+            while (count)
+                mWorker->deques[band].push(batch[--count]);
+            lock.unlock();
+            while (ThreadPoolTask* task = mWorker->deques[band].pop()) {
+                if (stealing->claim(task))
+                    return task;
+            }
+        }
+        const int count = stealing->workerCount.load(std::memory_order_acquire);
+        mWorker->seed ^= mWorker->seed << 13;
+        mWorker->seed ^= mWorker->seed >> 17;
+        mWorker->seed ^= mWorker->seed << 5;
+        const int start = mWorker->seed % count;
+        const int node = stealing->nodes.load(std::memory_order_relaxed) > 1 ? mWorker->node.load(std::memory_order_relaxed) : -1;
+        for (int pass = node == -1 ? 1 : 0; pass < 2; ++pass) {
+            for (int i = 0; i < count; ++i) {
+                StealingWorker* victim = stealing->workers[(start + i) % count].load(std::memory_order_acquire);
+                if (victim == mWorker)
+                    continue;
+                if (node != -1 && (victim->node.load(std::memory_order_relaxed) == node) != !pass)
+                    continue;
+                while (ThreadPoolTask* task = victim->deques[band].steal()) {
+                    if (stealing->claim(task))
+                        return task;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+void ThreadPoolThread::runStealing()
+{
+    ThreadPool::Stealing* stealing = mPool->mStealing.get();
+    for (;;) {
+        ThreadPoolTask* task = takeTask();
+        if (!task) {
+            std::unique_lock<std::mutex> lock(mPool->mMutex);
+            if (mStopped)
+                break;
+            if (stealing->backlog.load()) {
+                // queued somewhere we lost a race for, try again
+                lock.unlock();
+                std::this_thread::yield();
+                continue;
+            }
+            ++stealing->sleeping;
+            while (!mStopped && !stealing->backlog.load()) {
+                mPool->mCond.wait(lock);
+                mPool->wokeUp();
+            }
+            --stealing->sleeping;
+            if (mStopped)
+                break;
+            continue;
         }
+        ++stealing->busy;
+        task->run();
+        task->deref();
+        --stealing->busy;
     }
 }
 
-ThreadPool::ThreadPool(int concurrentJobs, Thread::Priority priority, size_t threadStackSize)
-    : mConcurrentJobs(concurrentJobs), mBusyThreads(0),
-      mPriority(priority), mThreadStackSize(threadStackSize)
+ThreadPool::ThreadPool(int concurrentJobs, Thread::Priority priority, size_t threadStackSize, Scheduling scheduling)
+    : mScheduling(scheduling), mConcurrentJobs(0), mTaskAllocator(new ThreadPoolTaskAllocator),
+      mTaskCount(0), mNextNode(0), mPlacement(NoPlacement), mBusyThreads(0), mIdleThreads(0), mWakeups(0), mPriority(priority), mThreadStackSize(threadStackSize)
 {
     if (!sInstance)
         sInstance = this;
-    for (int i = 0; i < mConcurrentJobs; ++i) {
-        mThreads.push_back(new ThreadPoolThread(this));
-        mThreads.back()->start(mPriority, mThreadStackSize);
-    }
+    pthread_once(&sCurrentThreadOnce, createCurrentThreadKey);
+    if (mScheduling == WorkStealing)
+        mStealing.reset(new Stealing);
+    NodeQueue queue = { List<TaskQueue>(), 0 };
+    mNodeQueues.append(queue);
+    setConcurrentJobs(concurrentJobs);
 }
 
 ThreadPool::~ThreadPool()
@@ -114,7 +478,7 @@ ThreadPool::~ThreadPool()
     if (sInstance == this)
         sInstance = 0;
     std::unique_lock<std::mutex> lock(mMutex);
-    mJobs.clear();
+    clearTasks();
     lock.unlock();
     for (List<ThreadPoolThread*>::iterator it = mThreads.begin();
          it != mThreads.end(); ++it) {
@@ -123,16 +487,37 @@ ThreadPool::~ThreadPool()
         t->join();
         delete t;
     }
+    if (mStealing)
+        clearStealing();
+    mTaskAllocator->close();
 }
 
 void ThreadPool::setConcurrentJobs(int concurrentJobs)
 {
+    if (mStealing)
+        concurrentJobs = std::min<int>(concurrentJobs, MaxStealingWorkers);
     if (concurrentJobs == mConcurrentJobs)
         return;
     if (concurrentJobs > mConcurrentJobs) {
         std::lock_guard<std::mutex> lock(mMutex);
         for (int i = mConcurrentJobs; i < concurrentJobs; ++i) {
-            mThreads.push_back(new ThreadPoolThread(this));
+            StealingWorker* worker = 0;
+            if (mStealing) {
+                // workers of stopped threads are picked up again
+                const int count = mStealing->workerCount.load();
+                for (int w = 0; w < count && !worker; ++w) {
+                    if (!mStealing->workers[w].load()->active)
+                        worker = mStealing->workers[w].load();
+                }
+                if (!worker) {
+                    worker = new StealingWorker(this, 2654435761u * (count + 1));
+                    mStealing->workers[count].store(worker);
+                    mStealing->workerCount.store(count + 1, std::memory_order_release);
+                }
+                worker->active = true;
+            }
+            mThreads.push_back(new ThreadPoolThread(this, worker));
+            placeThread(mThreads.back(), i);
             mThreads.back()->start(mPriority, mThreadStackSize);
         }
         mConcurrentJobs = concurrentJobs;
@@ -147,47 +532,350 @@ void ThreadPool::setConcurrentJobs(int concurrentJobs)
             lock.lock();
             delete t;
         }
+        if (mStealing) {
+            // whatever is left in their deques gets stolen
+            const int count = mStealing->workerCount.load();
+            for (int w = 0; w < count; ++w)
+                mStealing->workers[w].load()->active = false;
+            for (ThreadPoolThread* t : mThreads)
+                t->mWorker->active = true;
+        }
         mConcurrentJobs = concurrentJobs;
     }
 }
 
-bool ThreadPool::jobLessThan(const std::shared_ptr<Job> &l, const std::shared_ptr<Job> &r)
+void ThreadPool::pushTask(ThreadPoolTask *task, int node)
+{
+    // few distinct priorities are in use at a time, the queues are
+    // searched from the back since most tasks go to the lowest one
+    List<TaskQueue> &queues = mNodeQueues[node].queues;
+    size_t idx = queues.size();
+    while (idx > 0 && queues[idx - 1].priority < task->mPriority)
+        --idx;
+    if (idx == 0 || queues[idx - 1].priority != task->mPriority) {
+        TaskQueue queue = { task->mPriority, task, task };
+        queues.insert(idx, queue);
+        task->mPrev = task->mNext = 0;
+    } else {
+        TaskQueue &queue = queues[idx - 1];
+        task->mPrev = queue.last;
+        task->mNext = 0;
+        queue.last->mNext = task;
+        queue.last = task;
+    }
+    if (task->mRun == &JobRunner::run)
+        ThreadPoolTask::Storage<JobRunner>::get(task)->job->mTask = task;
+    task->mNode = node;
+    ++mNodeQueues[node].count;
+    ++mTaskCount;
+}
+
+// from node's queues if there's anything there, otherwise the next
+// node's that has something
+ThreadPoolTask *ThreadPool::popTask(int node)
+{
+    assert(mTaskCount);
+    while (!mNodeQueues[node].count)
+        node = (node + 1) % mNodeQueues.size();
+    ThreadPoolTask *task = mNodeQueues[node].queues.front().first;
+    removeTask(task);
+    return task;
+}
+
+// the caller gets the queue's reference to the task
+void ThreadPool::removeTask(ThreadPoolTask *task)
+{
+    NodeQueue &node = mNodeQueues[task->mNode];
+    size_t idx = 0;
+    while (node.queues[idx].priority != task->mPriority)
+        ++idx;
+    TaskQueue &queue = node.queues[idx];
+    if (task->mPrev) {
+        task->mPrev->mNext = task->mNext;
+    } else {
+        queue.first = task->mNext;
+    }
+    if (task->mNext) {
+        task->mNext->mPrev = task->mPrev;
+    } else {
+        queue.last = task->mPrev;
+    }
+    task->mPrev = task->mNext = 0;
+    if (!queue.first)
+        node.queues.removeAt(idx);
+    if (task->mRun == &JobRunner::run)
+        ThreadPoolTask::Storage<JobRunner>::get(task)->job->mTask = 0;
+    --node.count;
+    --mTaskCount;
+}
+
+void ThreadPool::clearTasks()
+{
+    for (const NodeQueue &node : mNodeQueues) {
+        while (node.count) {
+            ThreadPoolTask *task = node.queues.back().last;
+            removeTask(task);
+            task->cancel();
+            task->deref();
+        }
+    }
+}
+
+// The job's own task unless it's still queued or running from an
+// earlier start, set up to run it
+ThreadPoolTask *ThreadPool::jobTask(const std::shared_ptr<Job> &job)
 {
-    return static_cast<unsigned>(l->mPriority) > static_cast<unsigned>(r->mPriority);
+    bool used;
+    if (mStealing) {
+        used = job->mTaskUsed.exchange(true, std::memory_order_acquire);
+    } else {
+        // called with mMutex held, the task is given back by the thread
+        // that releases it
+        used = job->mTaskUsed.load(std::memory_order_acquire);
+        if (!used)
+            job->mTaskUsed.store(true, std::memory_order_relaxed);
+    }
+    ThreadPoolTask *task;
+    if (!used) {
+        task = job->task();
+        task->reset();
+    } else {
+        task = mTaskAllocator->allocate();
+    }
+    ThreadPoolTask::Storage<JobRunner>::construct(task, JobRunner(job));
+    task->mRun = &JobRunner::run;
+    task->mDestroy = &JobRunner::destroy;
+    // SharedQueue takes a job's task out of the queue when it's
+    // started again or removed, there's nothing to claim
+    if (mStealing)
+        task->mClaim = &JobRunner::claim;
+    return task;
 }
 
 void ThreadPool::start(const std::shared_ptr<Job> &job, int priority)
 {
     job->mPriority = priority;
+    if (mStealing) {
+        ThreadPoolTask *task = jobTask(job);
+        if (job->mQueued.exchange(task)) {
+            // the task that was queued can't claim it anymore
+            --mStealing->backlog;
+            dropInjected(job);
+        }
+        startTask(task, priority);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (ThreadPoolTask *queued = job->mTask) {
+        // started again while queued
+        removeTask(queued);
+        queued->deref();
+    }
+    ThreadPoolTask *task = jobTask(job);
     if (priority == Guaranteed) {
-        ThreadPoolThread *t = new ThreadPoolThread(job);
+        lock.unlock();
+        startTask(task, priority);
+        return;
+    }
+    task->mPriority = priority;
+    queueTask(task);
+}
+
+void ThreadPool::startTask(ThreadPoolTask *task, int priority)
+{
+    task->mPriority = priority;
+    if (priority == Guaranteed) {
+        ThreadPoolThread *t = new ThreadPoolThread(task);
         t->start(mPriority, mThreadStackSize);
         return;
     }
+    if (mStealing) {
+        startStealing(task);
+        return;
+    }
 
     std::lock_guard<std::mutex> lock(mMutex);
-    if (mJobs.empty()) {
-        mJobs.push_back(job);
-    } else {
-        if (mJobs.at(mJobs.size() - 1)->mPriority >= priority) {
-            mJobs.push_back(job);
-        } else if (mJobs.at(0)->mPriority < priority) {
-            mJobs.push_front(job);
+    queueTask(task);
+}
+
+// Called with mMutex held
+void ThreadPool::queueTask(ThreadPoolTask *task)
+{
+    int node = 0;
+    if (mNodeQueues.size() > 1) {
+        ThreadPoolThread* thread = static_cast<ThreadPoolThread*>(pthread_getspecific(sCurrentThreadKey));
+        if (thread && thread->mPool == this) {
+            node = thread->mNode;
         } else {
-            mJobs.push_back(job);
-            std::sort(mJobs.begin(), mJobs.end(), jobLessThan);
+            node = mNextNode++ % mNodeQueues.size();
         }
     }
-    mCond.notify_one();
+    pushTask(task, node);
+    wakeThread(mIdleThreads);
+}
+
+// Wakes a thread unless every idle one has been woken already and
+// hasn't got around to looking at the queue, called with mMutex held
+void ThreadPool::wakeThread(int idle)
+{
+    if (idle > mWakeups) {
+        ++mWakeups;
+        mCond.notify_one();
+    }
+}
+
+void ThreadPool::wokeUp()
+{
+    if (mWakeups > 0)
+        --mWakeups;
+}
+
+void ThreadPool::startStealing(ThreadPoolTask *task)
+{
+    const int band = priorityBand(task->mPriority);
+    ThreadPoolThread* thread = static_cast<ThreadPoolThread*>(pthread_getspecific(sCurrentThreadKey));
+    if (thread && thread->mPool == this) {
+        thread->mWorker->deques[band].push(task);
+        ++mStealing->backlog;
+        if (!mStealing->sleeping.load())
+            return;
+        std::lock_guard<std::mutex> lock(mMutex);
+        wakeThread(mStealing->sleeping.load());
+    } else {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStealing->inject(task);
+        ++mStealing->backlog;
+        wakeThread(mStealing->sleeping.load());
+    }
+}
+
+// A job's task that's still in the injection queue once it can't claim
+// the job anymore. One that has been taken to a thread's deque keeps
+// its reference to the job until the thread gets to it.
+void ThreadPool::dropInjected(const std::shared_ptr<Job> &job)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (ThreadPoolTask *task = job->mTask) {
+        mStealing->uninject(task);
+        task->deref();
+    }
+}
+
+// Claims everything that's queued. The pool's threads may be taking
+// tasks at the same time, their deques are stolen from like they steal
+// from each other and what a thread gets first is its to run.
+void ThreadPool::clearStealing()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (int band = 0; band < PriorityBands; ++band) {
+        while (ThreadPoolTask *task = mStealing->injected[band].first) {
+            mStealing->uninject(task);
+            if (mStealing->claim(task)) {
+                task->cancel();
+                task->deref();
+            }
+        }
+        const int count = mStealing->workerCount.load();
+        for (int w = 0; w < count; ++w) {
+            StealingWorker* worker = mStealing->workers[w].load();
+            while (!worker->deques[band].isEmpty()) {
+                ThreadPoolTask *task = worker->deques[band].steal();
+                if (task && mStealing->claim(task)) {
+                    task->cancel();
+                    task->deref();
+                }
+            }
+        }
+    }
+}
+
+bool ThreadPool::setPlacement(Placement placement, const CpuTopology &topology)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if (placement != NoPlacement && !topology.isValid())
+        return false;
+#else
+    if (placement != NoPlacement)
+        return false;
+#endif
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPlacement = placement;
+    mTopology = placement == NoPlacement ? CpuTopology() : topology;
+    const size_t nodes = std::max<size_t>(mTopology.nodes().size(), 1);
+    if (nodes != mNodeQueues.size()) {
+        // everything that's queued goes to the first node
+        List<NodeQueue> old;
+        std::swap(old, mNodeQueues);
+        NodeQueue queue = { List<TaskQueue>(), 0 };
+        mNodeQueues.resize(nodes, queue);
+        mTaskCount = 0;
+        for (NodeQueue &node : old) {
+            for (const TaskQueue &priority : node.queues) {
+                for (ThreadPoolTask *task = priority.first; task; ) {
+                    ThreadPoolTask *next = task->mNext;
+                    pushTask(task, 0);
+                    task = next;
+                }
+            }
+        }
+    }
+    if (mStealing)
+        mStealing->nodes.store(nodes);
+    for (size_t i = 0; i < mThreads.size(); ++i)
+        placeThread(mThreads[i], i);
+    return true;
+}
+
+// Pins the idx'th thread according to the placement, called with
+// mMutex held
+void ThreadPool::placeThread(ThreadPoolThread *thread, int idx)
+{
+    int node = 0;
+    List<int> cpus;
+    switch (mPlacement) {
+    case NoPlacement:
+        break;
+    case PinPerCore: {
+        // cores in the order of their nodes
+        List<int> cores;
+        for (size_t n = 0; n < mTopology.nodes().size(); ++n) {
+            for (size_t c = 0; c < mTopology.cores().size(); ++c) {
+                if (mTopology.cpu(mTopology.cores()[c].front())->node == static_cast<int>(n))
+                    cores.append(c);
+            }
+        }
+        cpus = mTopology.cores()[cores[idx % cores.size()]];
+        node = mTopology.cpu(cpus.front())->node;
+        break; }
+    case PinPerNode:
+        node = idx % mTopology.nodes().size();
+        cpus = mTopology.nodes()[node];
+        break;
+    }
+    thread->mNode = node;
+    if (thread->mWorker)
+        thread->mWorker->node.store(node, std::memory_order_relaxed);
+    if (mPlacement != NoPlacement || !thread->affinity().isEmpty())
+        thread->setAffinity(cpus);
 }
 
 bool ThreadPool::remove(const std::shared_ptr<Job> &job)
 {
+    if (mStealing) {
+        if (!job->mQueued.exchange(0))
+            return false;
+        --mStealing->backlog;
+        dropInjected(job);
+        return true;
+    }
     std::lock_guard<std::mutex> lock(mMutex);
-    std::deque<std::shared_ptr<Job> >::iterator it = std::find(mJobs.begin(), mJobs.end(), job);
-    if (it == mJobs.end())
+    ThreadPoolTask *task = job->mTask;
+    if (!task)
         return false;
-    mJobs.erase(it);
+    // a job's task has no Future to cancel
+    removeTask(task);
+    task->deref();
     return true;
 }
 
@@ -260,25 +948,41 @@ ThreadPool* ThreadPool::instance()
     return sInstance;
 }
 
+ThreadPool* ThreadPool::current()
+{
+    pthread_once(&sCurrentThreadOnce, createCurrentThreadKey);
+    ThreadPoolThread* thread = static_cast<ThreadPoolThread*>(pthread_getspecific(sCurrentThreadKey));
+    return thread ? thread->mPool : 0;
+}
+
 ThreadPool::Job::Job()
-    : mPriority(0), mState(NotStarted)
+    : mPriority(0), mState(NotStarted), mTask(0), mQueued(0), mTaskUsed(false)
 {
+    new (&mTaskStorage) ThreadPoolTask(0);
 }
 
 void ThreadPool::clearBackLog()
 {
+    if (mStealing) {
+        clearStealing();
+        return;
+    }
     std::lock_guard<std::mutex> lock(mMutex);
-    mJobs.clear();
+    clearTasks();
 }
 
 int ThreadPool::busyThreads() const
 {
+    if (mStealing)
+        return mStealing->busy.load();
     std::lock_guard<std::mutex> lock(mMutex);
     return mBusyThreads;
 }
 
 int ThreadPool::backlogSize() const
 {
+    if (mStealing)
+        return mStealing->backlog.load();
     std::lock_guard<std::mutex> lock(mMutex);
-    return mJobs.size();
+    return mTaskCount;
 }
@@ -1,25 +1,63 @@
 #ifndef ThreadPool_h
 #define ThreadPool_h
 
+#include <atomic>
 #include <condition_variable>
-#include <deque>
 #include <memory>
 #include <mutex>
+#include <stdint.h>
+#include <type_traits>
 
+#include <rct/CpuTopology.h>
+#include <rct/Future.h>
 #include <rct/List.h>
 #include <rct/Thread.h>
 
 class ThreadPoolThread;
+struct JobRunner;
 
 class ThreadPool
 {
 public:
+    enum Scheduling {
+        SharedQueue, // one queue, by priority then in the order started
+        // A deque per thread that other threads steal from when they
+        // run dry. Jobs started from a pool thread go to its own deque,
+        // others to a shared injection queue. Priorities are grouped in
+        // bands (> 0, 0, < 0) and are only ordered per band.
+        WorkStealing
+    };
+
     ThreadPool(int concurrentJobs,
                Thread::Priority priority = Thread::Normal,
-               size_t stackSize = 0);
+               size_t stackSize = 0,
+               Scheduling scheduling = SharedQueue);
     ~ThreadPool();
 
+    Scheduling scheduling() const { return mScheduling; }
+
+    enum Placement {
+        NoPlacement,
+        // each thread is pinned to a core and its SMT siblings, cores
+        // are handed out node by node
+        PinPerCore,
+        // each thread is pinned to the cpus of a node, nodes are handed
+        // out in turn
+        PinPerNode
+    };
+
+    // Pins the pool's threads, current and future ones. With more than
+    // one node SharedQueue keeps a queue per node: jobs started from a
+    // pool thread go to its node's queue and others are spread over
+    // them. Threads take from their own node's queue first so
+    // priorities are only ordered per node. WorkStealing threads steal
+    // from threads on their own node first. Returns false if the
+    // topology is unknown or threads can't be pinned.
+    bool setPlacement(Placement placement, const CpuTopology &topology = CpuTopology::system());
+    Placement placement() const { std::lock_guard<std::mutex> lock(mMutex); return mPlacement; }
+
     void setConcurrentJobs(int concurrentJobs);
+    int concurrentJobs() const { return mConcurrentJobs; }
     void clearBackLog();
     int backlogSize() const;
 
@@ -27,7 +65,7 @@ public:
     {
     public:
         Job();
-        virtual ~Job() {}
+        virtual ~Job() { task()->~ThreadPoolTask(); }
 
         enum State {
             NotStarted,
@@ -40,34 +78,101 @@ public:
         std::mutex &mutex() const { return mMutex; }
 
     private:
+        ThreadPoolTask* task() { return reinterpret_cast<ThreadPoolTask*>(&mTaskStorage); }
+
         int mPriority;
         State mState;
         mutable std::mutex mMutex;
+        ThreadPoolTask* mTask; // the task running it while it's in the queue or WorkStealing's injection queue
+        std::atomic<ThreadPoolTask*> mQueued; // WorkStealing, the task it's queued with, claimed by whoever takes or removes it
+        // the task start() queues it with, one from the pool's freelist
+        // is used while this one is still queued or running
+        typename std::aligned_storage<sizeof(ThreadPoolTask), std::alignment_of<ThreadPoolTask>::value>::type mTaskStorage;
+        std::atomic<bool> mTaskUsed;
 
         friend class ThreadPool;
         friend class ThreadPoolThread;
+        friend struct JobRunner;
     };
 
     enum { Guaranteed = -1 };
 
+    // Starting a job that's still queued takes it out of the queue and
+    // queues it again at the new priority, behind the jobs already
+    // queued at that priority. It runs once.
     void start(const std::shared_ptr<Job> &job, int priority = 0);
 
+    // Runs func on the pool, there's no Job to allocate or lock. The
+    // future can be waited on or deliver the result to an EventLoop.
+    template <typename F>
+    Future<typename std::decay<typename std::result_of<typename std::decay<F>::type()>::type>::type>
+    submit(F &&func, int priority = 0)
+    {
+        typedef typename std::decay<typename std::result_of<typename std::decay<F>::type()>::type>::type Result;
+        ThreadPoolTask *task = mTaskAllocator->allocate();
+        task->init<F, Result>(std::forward<F>(func));
+        Future<Result> future(task);
+        startTask(task, priority);
+        return future;
+    }
+
+    // Takes a job that's queued out of the queue, false if it isn't. A
+    // WorkStealing thread that has already taken the job's task to its
+    // deque keeps a reference to the job until it gets to the task.
     bool remove(const std::shared_ptr<Job> &job);
 
     static int idealThreadCount();
     static ThreadPool* instance();
+    // the pool whose thread is calling, 0 if it's not a pool thread
+    static ThreadPool* current();
 
     int busyThreads() const;
 private:
-    static bool jobLessThan(const std::shared_ptr<Job> &l, const std::shared_ptr<Job> &r);
+    ThreadPoolTask *jobTask(const std::shared_ptr<Job> &job);
+    void startTask(ThreadPoolTask *task, int priority);
+    void queueTask(ThreadPoolTask *task);
+    void wakeThread(int idle);
+    void wokeUp();
+
+    // a FIFO per priority, tasks are linked through mPrev and mNext
+    struct TaskQueue
+    {
+        int priority;
+        ThreadPoolTask *first, *last;
+    };
+    // the queues of a node
+    struct NodeQueue
+    {
+        List<TaskQueue> queues; // highest priority first, none empty
+        int count;
+    };
+    void pushTask(ThreadPoolTask *task, int node);
+    ThreadPoolTask *popTask(int node);
+    void removeTask(ThreadPoolTask *task);
+    void clearTasks();
+
+    struct Stealing;
+    void startStealing(ThreadPoolTask *task);
+    void dropInjected(const std::shared_ptr<Job> &job);
+    void clearStealing();
+
+    void placeThread(ThreadPoolThread *thread, int idx);
 
 private:
+    const Scheduling mScheduling;
+    std::unique_ptr<Stealing> mStealing;
     int mConcurrentJobs;
     mutable std::mutex mMutex;
     std::condition_variable mCond;
-    std::deque<std::shared_ptr<Job> > mJobs;
+    ThreadPoolTaskAllocator *mTaskAllocator;
+    List<NodeQueue> mNodeQueues; // one unless threads are placed on nodes
+    int mTaskCount;
+    unsigned int mNextNode;
+    Placement mPlacement;
+    CpuTopology mTopology;
     List<ThreadPoolThread*> mThreads;
     int mBusyThreads;
+    int mIdleThreads, mWakeups;
     const Thread::Priority mPriority;
     const size_t mThreadStackSize;
 
@@ -0,0 +1,267 @@
+#include "TimerWheel.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "Timer.h"
+
+static const uint32_t Nil = 0xffffffff;
+
+// Smallest distance d in [0, Slots) such that bit (start + d) % Slots is
+// set, or -1 if no bits are set.
+template <int Words>
+static inline int distance(const uint64_t (&bits)[Words], int start)
+{
+    enum { Slots = Words * 64 };
+    const int first = start >> 6;
+    for (int i = 0; i <= Words; ++i) {
+        const int word = (first + i) % Words;
+        uint64_t w = bits[word];
+        if (i == 0) {
+            w &= ~0ull << (start & 63);
+        } else if (i == Words) {
+            w &= (1ull << (start & 63)) - 1;
+        }
+        if (w)
+            return ((word * 64 + __builtin_ctzll(w)) - start + Slots) % Slots;
+    }
+    return -1;
+}
+
+TimerWheel::TimerWheel(uint64_t now)
+    : mTick(now), mCount(0), mScheduled(0)
+{
+    clear();
+    mTick = now;
+}
+
+void TimerWheel::clear()
+{
+    mEntries.clear();
+    for (int l = 0; l < Levels; ++l) {
+        for (int s = 0; s < Slots; ++s) {
+            mSlots[l][s].head = mSlots[l][s].tail = Nil;
+        }
+    }
+    memset(mOccupied, 0, sizeof(mOccupied));
+    mFree.head = mFree.tail = Nil;
+    mCount = mScheduled = 0;
+}
+
+int TimerWheel::idOf(uint32_t index) const
+{
+    return (static_cast<int>(mEntries[index].generation) << IndexBits) | static_cast<int>(index + 1);
+}
+
+TimerWheel::Entry* TimerWheel::find(int id, uint32_t* index)
+{
+    if (id <= 0)
+        return 0;
+    const uint32_t idx = (id & ((1 << IndexBits) - 1)) - 1;
+    if (idx >= mEntries.size())
+        return 0;
+    Entry& entry = mEntries[idx];
+    if (entry.state == Free || idOf(idx) != id)
+        return 0;
+    *index = idx;
+    return &entry;
+}
+
+int TimerWheel::add(uint64_t when, int interval, unsigned int flags, std::function<void(int)>&& callback)
+{
+    uint32_t idx;
+    if (mFree.head != Nil) {
+        // reuse the least recently released entry so a given id takes
+        // as long as possible to come around again
+        idx = mFree.head;
+        mFree.head = mEntries[idx].next;
+        if (mFree.head == Nil)
+            mFree.tail = Nil;
+    } else {
+        if (mEntries.size() >= (1u << IndexBits) - 1)
+            return -1;
+        idx = mEntries.size();
+        mEntries.push_back(Entry());
+    }
+    Entry& entry = mEntries[idx];
+    entry.when = when;
+    entry.interval = interval;
+    entry.flags = flags;
+    entry.callback = std::move(callback);
+    ++mCount;
+    schedule(idx);
+    return idOf(idx);
+}
+
+void TimerWheel::schedule(uint32_t idx)
+{
+    Entry& entry = mEntries[idx];
+    uint64_t expire = entry.when < mTick ? mTick : entry.when;
+    const uint64_t delta = expire - mTick;
+    int level = 0;
+    while (level < Levels - 1 && delta >= (1ull << (Bits * (level + 1))))
+        ++level;
+    if (delta >= (1ull << (Bits * Levels))) {
+        // too far out, park it at the end of the top level and let it
+        // cascade back up from there
+        expire = mTick + (1ull << (Bits * Levels)) - 1;
+    }
+    const int slot = (expire >> (Bits * level)) & Mask;
+
+    List& list = mSlots[level][slot];
+    entry.state = Scheduled;
+    entry.level = level;
+    entry.slot = slot;
+    entry.prev = list.tail;
+    entry.next = Nil;
+    if (list.tail != Nil) {
+        mEntries[list.tail].next = idx;
+    } else {
+        list.head = idx;
+    }
+    list.tail = idx;
+    mOccupied[level][slot >> 6] |= (1ull << (slot & 63));
+    ++mScheduled;
+}
+
+void TimerWheel::unlink(uint32_t idx)
+{
+    Entry& entry = mEntries[idx];
+    assert(entry.state == Scheduled);
+    List& list = mSlots[entry.level][entry.slot];
+    if (entry.prev != Nil) {
+        mEntries[entry.prev].next = entry.next;
+    } else {
+        list.head = entry.next;
+    }
+    if (entry.next != Nil) {
+        mEntries[entry.next].prev = entry.prev;
+    } else {
+        list.tail = entry.prev;
+    }
+    if (list.head == Nil)
+        mOccupied[entry.level][entry.slot >> 6] &= ~(1ull << (entry.slot & 63));
+    --mScheduled;
+}
+
+void TimerWheel::release(uint32_t idx)
+{
+    Entry& entry = mEntries[idx];
+    entry.callback = nullptr;
+    entry.state = Free;
+    entry.generation = (entry.generation + 1) & ((1 << GenerationBits) - 1);
+    entry.next = Nil;
+    if (mFree.tail != Nil) {
+        mEntries[mFree.tail].next = idx;
+    } else {
+        mFree.head = idx;
+    }
+    mFree.tail = idx;
+    --mCount;
+}
+
+bool TimerWheel::remove(int id)
+{
+    uint32_t idx;
+    Entry* entry = find(id, &idx);
+    if (!entry)
+        return false;
+    if (entry->state == Scheduled)
+        unlink(idx);
+    release(idx);
+    return true;
+}
+
+void TimerWheel::cascade(int level, int slot)
+{
+    List& list = mSlots[level][slot];
+    uint32_t idx = list.head;
+    list.head = list.tail = Nil;
+    mOccupied[level][slot >> 6] &= ~(1ull << (slot & 63));
+    while (idx != Nil) {
+        const uint32_t next = mEntries[idx].next;
+        --mScheduled;
+        schedule(idx);
+        idx = next;
+    }
+}
+
+uint64_t TimerWheel::nextTick() const
+{
+    uint64_t best = UINT64_MAX;
+    const int d = distance(mOccupied[0], mTick & Mask);
+    if (d != -1)
+        best = mTick + d;
+    for (int level = 1; level < Levels; ++level) {
+        const int shift = Bits * level;
+        const uint64_t base = mTick >> shift;
+        // the current slot hasn't been cascaded yet if we're sitting
+        // right on its boundary
+        const bool pending = !(mTick & ((1ull << shift) - 1));
+        const int start = (base + (pending ? 0 : 1)) & Mask;
+        const int dist = distance(mOccupied[level], start);
+        if (dist != -1) {
+            const uint64_t tick = (base + dist + (pending ? 0 : 1)) << shift;
+            if (tick < best)
+                best = tick;
+        }
+    }
+    return best;
+}
+
+uint64_t TimerWheel::nextTimeout() const
+{
+    return mScheduled ? nextTick() : UINT64_MAX;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<int>& expired)
+{
+    while (mTick <= now) {
+        const uint64_t next = mScheduled ? nextTick() : UINT64_MAX;
+        if (next > now) {
+            mTick = now + 1;
+            break;
+        }
+        mTick = next;
+        const int idx = mTick & Mask;
+        if (!idx) {
+            for (int level = 1; level < Levels; ++level) {
+                const int slot = (mTick >> (Bits * level)) & Mask;
+                cascade(level, slot);
+                if (slot)
+                    break;
+            }
+        }
+        List& list = mSlots[0][idx];
+        uint32_t cur = list.head;
+        list.head = list.tail = Nil;
+        mOccupied[0][idx >> 6] &= ~(1ull << (idx & 63));
+        while (cur != Nil) {
+            Entry& entry = mEntries[cur];
+            entry.state = Expired;
+            --mScheduled;
+            expired.push_back(idOf(cur));
+            cur = entry.next;
+        }
+        ++mTick;
+    }
+}
+
+bool TimerWheel::dispatch(int id, std::function<void(int)>& callback)
+{
+    uint32_t idx;
+    Entry* entry = find(id, &idx);
+    if (!entry || entry->state != Expired)
+        return false;
+    if (entry->flags & Timer::SingleShot) {
+        callback = std::move(entry->callback);
+        release(idx);
+    } else {
+        // same drift compensation as the default backend, the next
+        // expiry is relative to when the timer was due, not to now
+        entry->when += entry->interval;
+        callback = entry->callback;
+        schedule(idx);
+    }
+    return true;
+}
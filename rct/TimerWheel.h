@@ -0,0 +1,91 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+// Hierarchical timing wheel with millisecond ticks, used as the timer
+// backend of an EventLoop initialized with EventLoop::EnableTimerWheel.
+// Adding, removing and expiring a timer are all O(1). Timers live in a
+// flat array, a timer id is its index plus a generation count so ids
+// of timers that have already been released are ignored.
+class TimerWheel
+{
+public:
+    TimerWheel(uint64_t now);
+
+    // Returns -1 if the wheel is full
+    int add(uint64_t when, int interval, unsigned int flags, std::function<void(int)>&& callback);
+    bool remove(int id);
+    void clear();
+
+    // Scheduled timers plus expired ones that haven't been dispatched yet
+    size_t size() const { return mCount; }
+
+    // Moves the wheel forward to now and appends the ids of the timers
+    // that are due in the order they expired.
+    void advance(uint64_t now, std::vector<int>& expired);
+
+    // Prepares an expired timer for firing. Single shot timers are
+    // released, interval timers are rescheduled interval ms after the
+    // time they were due. Returns false if the timer has been removed
+    // since it expired.
+    bool dispatch(int id, std::function<void(int)>& callback);
+
+    // The time the next timer is due, UINT64_MAX if there are none. May
+    // be earlier than any timer is due when timers need to cascade down
+    // from the coarser levels.
+    uint64_t nextTimeout() const;
+
+private:
+    enum {
+        Bits = 8,
+        Slots = 1 << Bits,
+        Mask = Slots - 1,
+        Levels = 4,
+        Words = Slots / 64,
+        IndexBits = 22,
+        GenerationBits = 9
+    };
+    enum State { Free, Scheduled, Expired };
+
+    struct Entry
+    {
+        Entry()
+            : when(0), interval(0), flags(0), prev(0), next(0),
+              generation(0), state(Free), level(0), slot(0)
+        {}
+
+        uint64_t when;
+        std::function<void(int)> callback;
+        int interval;
+        unsigned int flags;
+        uint32_t prev, next; // slot list, or free list for free entries
+        uint16_t generation;
+        uint8_t state, level, slot;
+    };
+
+    struct List
+    {
+        uint32_t head, tail;
+    };
+
+    int idOf(uint32_t index) const;
+    Entry* find(int id, uint32_t* index);
+    void schedule(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(int level, int slot);
+    uint64_t nextTick() const;
+
+    std::vector<Entry> mEntries;
+    List mSlots[Levels][Slots];
+    uint64_t mOccupied[Levels][Words];
+    List mFree;
+    uint64_t mTick; // the next tick to process
+    size_t mCount, mScheduled;
+};
+
+#endif
@@ -3,23 +3,33 @@
 
 #include <rct/ReadWriteLock.h>
 
+// Works with anything that has lockForWrite() and unlock(),
+// ReadWriteLock, ScalableReadWriteLock and SeqLock
 class WriteLocker
 {
 public:
-    WriteLocker(ReadWriteLock* lock)
-        : mLock(lock)
+    template <typename Lock>
+    WriteLocker(Lock* lock)
+        : mLock(lock), mUnlock(&WriteLocker::unlock<Lock>)
     {
-        if (mLock && !mLock->lockForWrite())
+        if (lock && !lock->lockForWrite())
             mLock = 0;
     }
     ~WriteLocker()
     {
         if (mLock)
-            mLock->unlock();
+            mUnlock(mLock);
     }
 
 private:
-    ReadWriteLock* mLock;
+    WriteLocker(const WriteLocker &) = delete;
+    WriteLocker &operator=(const WriteLocker &) = delete;
+
+    template <typename Lock>
+    static void unlock(void* lock) { static_cast<Lock*>(lock)->unlock(); }
+
+    void* mLock;
+    void (*mUnlock)(void*);
 
 };
 
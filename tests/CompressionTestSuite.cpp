@@ -0,0 +1,168 @@
+#include <CompressionTestSuite.h>
+#include <rct/Compression.h>
+#include <rct/ThreadPool.h>
+
+static List<String> strings()
+{
+    List<String> ret;
+    for (int i = 0; i < 50000; ++i)
+        ret.append(String::format<64>("/usr/include/some/path/file%d.h", i));
+    return ret;
+}
+
+static std::unique_ptr<Deserializer::Source> decompressor(const String &data)
+{
+    return std::unique_ptr<Deserializer::Source>(new Decompressor(data.constData(), data.size()));
+}
+
+static String decompressAll(const String &data, bool *error = 0)
+{
+    Decompressor decompressor(data.constData(), data.size());
+    String ret;
+    char buf[1000];
+    while (const int r = decompressor.read(buf, sizeof(buf)))
+        ret.append(buf, r);
+    if (error)
+        *error = decompressor.hasError();
+    return ret;
+}
+
+void
+CompressionTestSuite::testStream()
+{
+    // prepare
+    const List<String> input = strings();
+    String plain, compressed;
+    {
+        Serializer serializer(plain);
+        serializer << input << 42;
+    }
+
+    // execute
+    {
+        Serializer serializer(std::unique_ptr<Serializer::Buffer>(new Compressor(compressed)));
+        serializer << input << 42;
+    }
+    Deserializer deserializer(decompressor(compressed));
+    List<String> output;
+    int value;
+    deserializer >> output >> value;
+
+    // verify, it's a plain zlib stream
+    CPPUNIT_ASSERT(compressed.size() < plain.size() / 4);
+    CPPUNIT_ASSERT(String::uncompress(compressed.constData(), compressed.size()) == plain);
+    CPPUNIT_ASSERT(output == input);
+    CPPUNIT_ASSERT_EQUAL(42, value);
+    CPPUNIT_ASSERT(deserializer.atEnd());
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()), deserializer.pos());
+}
+
+void
+CompressionTestSuite::testStreams()
+{
+    // prepare
+    String compressed;
+    Compressor compressor(compressed, Compressor::BestLevel);
+
+    // execute
+    CPPUNIT_ASSERT(compressor.finish());
+    const size_t empty = compressed.size();
+    compressor.write("first", 5);
+    CPPUNIT_ASSERT(compressor.finish());
+    const size_t first = compressed.size();
+    compressor.write("second", 6);
+    CPPUNIT_ASSERT(compressor.finish());
+
+    // verify, a stream that was never written to isn't there and the
+    // others are read as one
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), empty);
+    CPPUNIT_ASSERT(String::uncompress(compressed.constData(), first) == "first");
+    CPPUNIT_ASSERT(decompressAll(compressed) == "firstsecond");
+    CPPUNIT_ASSERT_EQUAL(11, compressor.pos());
+    CPPUNIT_ASSERT_EQUAL(compressed.size(), compressor.compressedSize());
+}
+
+void
+CompressionTestSuite::testBlocks()
+{
+    // prepare
+    const List<String> input = strings();
+    String plain, compressed;
+    {
+        Serializer serializer(plain);
+        serializer << input;
+    }
+    ThreadPool pool(2);
+
+    // execute
+    {
+        std::unique_ptr<Compressor> compressor(new Compressor(compressed));
+        compressor->setBlockSize(64 * 1024, &pool);
+        Serializer serializer(std::move(compressor));
+        serializer << input;
+    }
+    Deserializer deserializer(decompressor(compressed));
+    List<String> output;
+    deserializer >> output;
+
+    // verify, blocks go out in order
+    CPPUNIT_ASSERT(plain.size() > 64 * 1024 * 4);
+    CPPUNIT_ASSERT(decompressAll(compressed) == plain);
+    CPPUNIT_ASSERT(output == input);
+    CPPUNIT_ASSERT(deserializer.atEnd());
+}
+
+void
+CompressionTestSuite::testFile()
+{
+    // prepare
+    const List<String> input = strings();
+    String compressed;
+    {
+        Serializer serializer(std::unique_ptr<Serializer::Buffer>(new Compressor(compressed, Compressor::DefaultLevel)));
+        serializer << input;
+    }
+    FILE *file = tmpfile();
+    CPPUNIT_ASSERT(file);
+    CPPUNIT_ASSERT_EQUAL(compressed.size(), fwrite(compressed.constData(), 1, compressed.size(), file));
+    rewind(file);
+
+    // execute
+    List<String> output;
+    {
+        Deserializer deserializer(std::unique_ptr<Deserializer::Source>(new Decompressor(file)));
+        deserializer >> output;
+        CPPUNIT_ASSERT(deserializer.atEnd());
+    }
+    fclose(file);
+
+    // verify
+    CPPUNIT_ASSERT(output == input);
+}
+
+void
+CompressionTestSuite::testDamaged()
+{
+    // prepare
+    String compressed;
+    {
+        Compressor compressor(compressed);
+        for (int i = 0; i < 1000; ++i)
+            compressor.write("some data ", 10);
+    }
+
+    // execute
+    bool truncatedError = false, damagedError = false, intactError = true;
+    const String intact = decompressAll(compressed, &intactError);
+    const String truncated = decompressAll(compressed.left(compressed.size() / 2), &truncatedError);
+    String damaged = compressed;
+    damaged[damaged.size() / 2] ^= 0xff;
+    decompressAll(damaged, &damagedError);
+
+    // verify, what could be read before it ended is there
+    CPPUNIT_ASSERT(!intactError);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10000), intact.size());
+    CPPUNIT_ASSERT(truncatedError);
+    CPPUNIT_ASSERT(truncated.size() < intact.size() && intact.startsWith(truncated));
+    CPPUNIT_ASSERT(damagedError);
+}
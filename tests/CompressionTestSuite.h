@@ -0,0 +1,23 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class CompressionTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(CompressionTestSuite);
+
+    CPPUNIT_TEST(testStream);
+    CPPUNIT_TEST(testStreams);
+    CPPUNIT_TEST(testBlocks);
+    CPPUNIT_TEST(testFile);
+    CPPUNIT_TEST(testDamaged);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    protected:
+        void testStream();
+        void testStreams();
+        void testBlocks();
+        void testFile();
+        void testDamaged();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CompressionTestSuite);
@@ -0,0 +1,214 @@
+#include <CpuTopologyTestSuite.h>
+#include <rct/CpuTopology.h>
+#include <rct/Thread.h>
+#include <rct/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Two packages on two nodes with two cores each, the SMT siblings of
+// cpu n are n and n + 4 like the kernel numbers them
+static void writeTopology(const Path &root)
+{
+    const Path cpu = root + "cpu/";
+    Path::mkdir(cpu, Path::Recursive);
+    cpu.ensureTrailingSlash();
+    Path(cpu + "online").write("0-7\n");
+    for (int id = 0; id < 8; ++id) {
+        const Path dir = cpu + "cpu" + String::number(id) + '/';
+        const int package = (id % 4) / 2;
+        const String packageCpus = package ? "2-3,6-7\n" : "0-1,4-5\n";
+        Path::mkdir(dir + "topology", Path::Recursive);
+        Path(dir + "topology/physical_package_id").write(String::number(package) + '\n');
+        Path(dir + "topology/core_id").write(String::number(id % 2) + '\n');
+
+        const char *types[] = { "Data", "Instruction", "Unified" };
+        const int levels[] = { 1, 1, 3 };
+        for (int index = 0; index < 3; ++index) {
+            const Path cache = dir + "cache/index" + String::number(index) + '/';
+            Path::mkdir(cache, Path::Recursive);
+            Path(cache + "type").write(String(types[index]) + '\n');
+            Path(cache + "level").write(String::number(levels[index]) + '\n');
+            Path(cache + "shared_cpu_list").write(levels[index] == 3 ? packageCpus : String::format<16>("%d,%d\n", id % 4, id % 4 + 4));
+        }
+    }
+    Path::mkdir(root + "node/node0", Path::Recursive);
+    Path::mkdir(root + "node/node1", Path::Recursive);
+    Path(root + "node/online").write("0-1\n");
+    Path(root + "node/node0/cpulist").write("0-1,4-5\n");
+    Path(root + "node/node1/cpulist").write("2-3,6-7\n");
+}
+
+void
+CpuTopologyTestSuite::setUp()
+{
+    char dir[] = "/tmp/rct-topology-XXXXXX";
+    CPPUNIT_ASSERT(mkdtemp(dir));
+    mRoot = Path(dir).ensureTrailingSlash();
+}
+
+void
+CpuTopologyTestSuite::tearDown()
+{
+    Path::rmdir(mRoot);
+}
+
+void
+CpuTopologyTestSuite::testParseCpuList()
+{
+    // execute
+    const List<int> cpus = CpuTopology::parseCpuList("0-3,8,10-11\n");
+    const List<int> unordered = CpuTopology::parseCpuList("5,1-2,2");
+
+    // verify
+    const int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+    CPPUNIT_ASSERT(cpus.size() == 7);
+    CPPUNIT_ASSERT(std::equal(cpus.begin(), cpus.end(), expected));
+    CPPUNIT_ASSERT(unordered.size() == 3);
+    CPPUNIT_ASSERT(unordered[0] == 1 && unordered[1] == 2 && unordered[2] == 5);
+    CPPUNIT_ASSERT(CpuTopology::parseCpuList("").isEmpty());
+    CPPUNIT_ASSERT(CpuTopology::parseCpuList("3-1").isEmpty());
+    CPPUNIT_ASSERT(CpuTopology::parseCpuList("0,x").isEmpty());
+}
+
+void
+CpuTopologyTestSuite::testRead()
+{
+#ifdef OS_Linux
+    // prepare
+    writeTopology(mRoot);
+
+    // execute
+    const CpuTopology topology = CpuTopology::read(mRoot);
+
+    // verify
+    CPPUNIT_ASSERT(topology.isValid());
+    CPPUNIT_ASSERT(topology.cpus().size() == 8);
+    CPPUNIT_ASSERT(topology.cores().size() == 4);
+    for (int core = 0; core < 4; ++core) {
+        CPPUNIT_ASSERT(topology.cores()[core].size() == 2);
+        CPPUNIT_ASSERT(topology.cores()[core][0] == core);
+        CPPUNIT_ASSERT(topology.cores()[core][1] == core + 4);
+    }
+    // the last level cache, not the L1
+    CPPUNIT_ASSERT(topology.caches().size() == 2);
+    CPPUNIT_ASSERT(topology.caches()[1].size() == 4);
+    CPPUNIT_ASSERT(topology.caches()[1][0] == 2 && topology.caches()[1][3] == 7);
+    CPPUNIT_ASSERT(topology.nodes().size() == 2);
+    CPPUNIT_ASSERT(topology.nodes()[0].size() == 4 && topology.nodes()[0][2] == 4);
+
+    const CpuTopology::Cpu *cpu = topology.cpu(6);
+    CPPUNIT_ASSERT(cpu);
+    CPPUNIT_ASSERT_EQUAL(6, cpu->id);
+    CPPUNIT_ASSERT_EQUAL(1, cpu->package);
+    CPPUNIT_ASSERT_EQUAL(2, cpu->core);
+    CPPUNIT_ASSERT_EQUAL(1, cpu->cache);
+    CPPUNIT_ASSERT_EQUAL(1, cpu->node);
+    CPPUNIT_ASSERT(!topology.cpu(8));
+#endif
+}
+
+void
+CpuTopologyTestSuite::testMissing()
+{
+#ifdef OS_Linux
+    // prepare, cpus without topology, caches or nodes
+    Path::mkdir(mRoot + "cpu", Path::Recursive);
+    Path(mRoot + "cpu/online").write("0-1\n");
+
+    // execute
+    const CpuTopology topology = CpuTopology::read(mRoot);
+    const CpuTopology empty = CpuTopology::read(mRoot + "nothing");
+
+    // verify, every cpu is a core of its own in one package and node
+    CPPUNIT_ASSERT(topology.isValid());
+    CPPUNIT_ASSERT(topology.cores().size() == 2);
+    CPPUNIT_ASSERT(topology.caches().size() == 1);
+    CPPUNIT_ASSERT(topology.nodes().size() == 1);
+    CPPUNIT_ASSERT(topology.nodes()[0].size() == 2);
+    CPPUNIT_ASSERT(!empty.isValid());
+#endif
+}
+
+static List<int> currentAffinity()
+{
+    List<int> cpus;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set))
+            cpus.append(cpu);
+    }
+#endif
+    return cpus;
+}
+
+void
+CpuTopologyTestSuite::testAffinity()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    const CpuTopology &system = CpuTopology::system();
+    if (!system.isValid())
+        return;
+
+    // prepare, the thread is already running when it's pinned
+    ThreadPool pool(1);
+
+    // execute
+    CPPUNIT_ASSERT(pool.setPlacement(ThreadPool::PinPerCore));
+    const List<int> cpus = pool.submit(&currentAffinity).get();
+
+    // verify, pinned to a core and its siblings
+    CPPUNIT_ASSERT(!cpus.isEmpty());
+    CPPUNIT_ASSERT(system.cpu(cpus.front()));
+    const List<int> &core = system.cores()[system.cpu(cpus.front())->core];
+    CPPUNIT_ASSERT(cpus.size() == core.size());
+    CPPUNIT_ASSERT(std::equal(cpus.begin(), cpus.end(), core.begin()));
+#endif
+}
+
+void
+CpuTopologyTestSuite::testPlacement()
+{
+#ifdef OS_Linux
+    // prepare, two nodes worth of queues. The fake cpus may not
+    // exist, threads that can't be pinned run wherever.
+    writeTopology(mRoot);
+    const CpuTopology topology = CpuTopology::read(mRoot);
+    ThreadPool shared(0);
+    ThreadPool stealing(3, Thread::Normal, 0, ThreadPool::WorkStealing);
+    std::atomic<int> count(0);
+    List<Future<int> > futures;
+    for (int i = 0; i < 100; ++i)
+        futures.append(shared.submit([i]() { return i; }, i % 3));
+
+    // execute, queued tasks move to the new queues
+    CPPUNIT_ASSERT(shared.setPlacement(ThreadPool::PinPerNode, topology));
+    CPPUNIT_ASSERT(stealing.setPlacement(ThreadPool::PinPerCore, topology));
+    shared.setConcurrentJobs(3);
+    for (int i = 0; i < 100; ++i) {
+        futures.append(shared.submit([&shared, &count]() {
+                    // to the thread's own node
+                    shared.submit([&count]() { ++count; });
+                    return 0;
+                }));
+        stealing.submit([&count]() { ++count; });
+    }
+    for (const Future<int> &future : futures)
+        future.wait();
+    while (count.load() < 200)
+        usleep(1000);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(ThreadPool::PinPerNode, shared.placement());
+    for (int i = 0; i < 100; ++i)
+        CPPUNIT_ASSERT_EQUAL(i, futures[i].get());
+    CPPUNIT_ASSERT_EQUAL(200, count.load());
+    CPPUNIT_ASSERT(!shared.setPlacement(ThreadPool::PinPerCore, CpuTopology()));
+    CPPUNIT_ASSERT(shared.setPlacement(ThreadPool::NoPlacement));
+#endif
+}
@@ -0,0 +1,35 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <rct/Path.h>
+
+class CpuTopologyTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(CpuTopologyTestSuite);
+
+    CPPUNIT_TEST(testParseCpuList);
+    CPPUNIT_TEST(testRead);
+    CPPUNIT_TEST(testMissing);
+    CPPUNIT_TEST(testAffinity);
+    CPPUNIT_TEST(testPlacement);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        CpuTopologyTestSuite() : mRoot() {}
+
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testParseCpuList();
+        void testRead();
+        void testMissing();
+        void testAffinity();
+        void testPlacement();
+
+    private:
+        // a fake sysfs root
+        Path mRoot;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CpuTopologyTestSuite);
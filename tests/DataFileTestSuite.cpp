@@ -0,0 +1,328 @@
+#include <DataFileTestSuite.h>
+#include <rct/Compression.h>
+#include <rct/DataFile.h>
+#include <rct/Future.h>
+#include <rct/ThreadPool.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void
+DataFileTestSuite::setUp()
+{
+    char dir[] = "/tmp/rct-datafile-XXXXXX";
+    CPPUNIT_ASSERT(mkdtemp(dir));
+    mDir = Path(dir).ensureTrailingSlash();
+}
+
+void
+DataFileTestSuite::tearDown()
+{
+    Path::rmdir(mDir);
+}
+
+void
+DataFileTestSuite::testReadWrite()
+{
+    // prepare
+    const Path path = mDir + "plain.db";
+    List<int> ints(10000);
+    for (size_t i = 0; i < ints.size(); ++i)
+        ints[i] = static_cast<int>(i * 7);
+    {
+        DataFile file(path, 3);
+        CPPUNIT_ASSERT(file.open(DataFile::Write));
+        file << String("hello") << ints;
+        CPPUNIT_ASSERT(file.flush());
+    }
+
+    // execute
+    DataFile file(path, 3);
+    CPPUNIT_ASSERT(file.open(DataFile::Read));
+    String string;
+    List<int> decoded;
+    file >> string >> decoded;
+
+    // verify
+    CPPUNIT_ASSERT(string == "hello");
+    CPPUNIT_ASSERT(decoded.size() == ints.size() && std::equal(ints.begin(), ints.end(), decoded.begin()));
+    CPPUNIT_ASSERT(file.atEnd());
+    CPPUNIT_ASSERT(file.sections().isEmpty());
+    DataFile wrongVersion(path, 4);
+    CPPUNIT_ASSERT(!wrongVersion.open(DataFile::Read));
+    CPPUNIT_ASSERT(wrongVersion.error().contains("Wrong database version"));
+}
+
+void
+DataFileTestSuite::testSections()
+{
+    // prepare
+    const Path path = mDir + "sections.db";
+    {
+        DataFile file(path, 1);
+        CPPUNIT_ASSERT(file.open(DataFile::Write));
+        file << 42;
+        file.beginSection("first");
+        file << String("one") << 1;
+        file.beginSection("second");
+        file << String("two") << 2;
+        file.beginSection("empty");
+        file.beginSection("third");
+        file << String("three");
+        CPPUNIT_ASSERT(file.flush());
+    }
+
+    // execute
+    DataFile file(path, 1);
+    CPPUNIT_ASSERT(file.open(DataFile::Read));
+    const List<String> sections = file.sections();
+    String string;
+    int value;
+
+    // verify, a section is read on its own and in order everything is
+    // there without the table
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), sections.size());
+    CPPUNIT_ASSERT(sections[0] == "first" && sections[1] == "second" && sections[2] == "empty" && sections[3] == "third");
+    CPPUNIT_ASSERT(!file.hasSection("fourth"));
+    CPPUNIT_ASSERT(!file.seek("fourth"));
+
+    CPPUNIT_ASSERT(file.seek("second"));
+    file >> string >> value;
+    CPPUNIT_ASSERT(string == "two" && value == 2);
+    CPPUNIT_ASSERT(file.atEnd());
+
+    CPPUNIT_ASSERT(file.seek("empty"));
+    CPPUNIT_ASSERT(file.atEnd());
+
+    CPPUNIT_ASSERT(file.seek("first"));
+    file >> string >> value;
+    CPPUNIT_ASSERT(string == "one" && value == 1);
+    CPPUNIT_ASSERT(file.atEnd());
+
+    DataFile sequential(path, 1);
+    CPPUNIT_ASSERT(sequential.open(DataFile::Read));
+    String one, two, three;
+    int first, second;
+    sequential >> value >> one >> first >> two >> second >> three;
+    CPPUNIT_ASSERT(value == 42 && one == "one" && first == 1 && two == "two" && second == 2 && three == "three");
+    CPPUNIT_ASSERT(sequential.atEnd());
+}
+
+void
+DataFileTestSuite::testCorrupted()
+{
+    // prepare
+    const Path path = mDir + "corrupted.db";
+    {
+        DataFile file(path, 1);
+        CPPUNIT_ASSERT(file.open(DataFile::Write));
+        file.beginSection("data");
+        file << String("data");
+        CPPUNIT_ASSERT(file.flush());
+    }
+    const String contents = path.readAll();
+    const Path empty = mDir + "empty.db";
+    CPPUNIT_ASSERT(Path::write(empty, String()));
+    // the index offset is the first thing in the 16 byte trailer
+    String badOffset = contents;
+    memset(&badOffset[badOffset.size() - 16], 0xff, 8);
+    badOffset[badOffset.size() - 16] = static_cast<char>(0xfc);
+    const Path badOffsetPath = mDir + "badoffset.db";
+    CPPUNIT_ASSERT(Path::write(badOffsetPath, badOffset));
+
+    // execute
+    CPPUNIT_ASSERT(Path::write(path, contents + "x"));
+    DataFile longer(path, 1);
+    const bool longerOpened = longer.open(DataFile::Read);
+    DataFile missing(mDir + "missing.db", 1);
+    DataFile emptyFile(empty, 1);
+    DataFile badOffsetFile(badOffsetPath, 1);
+    const bool badOffsetOpened = badOffsetFile.open(DataFile::Read);
+
+    // verify, a missing file isn't an error
+    CPPUNIT_ASSERT(!longerOpened);
+    CPPUNIT_ASSERT(longer.error().contains("corrupted"));
+    CPPUNIT_ASSERT(!missing.open(DataFile::Read));
+    CPPUNIT_ASSERT(missing.error().isEmpty());
+    CPPUNIT_ASSERT(!emptyFile.open(DataFile::Read));
+    CPPUNIT_ASSERT(!emptyFile.error().isEmpty());
+    CPPUNIT_ASSERT(!badOffsetOpened);
+    CPPUNIT_ASSERT(badOffsetFile.error().contains("Bad index"));
+}
+
+void
+DataFileTestSuite::testVerify()
+{
+    // prepare
+    const Path path = mDir + "verify.db";
+    List<int> large(3 * 1024 * 1024);
+    for (size_t i = 0; i < large.size(); ++i)
+        large[i] = static_cast<int>(i * 2654435761u);
+    {
+        DataFile file(path, 1);
+        CPPUNIT_ASSERT(file.open(DataFile::Write));
+        file.beginSection("first");
+        file << String("one");
+        file.beginSection("large");
+        file << large;
+        file.beginSection("last");
+        file << String("last");
+        CPPUNIT_ASSERT(file.flush());
+    }
+    String contents = path.readAll();
+    const size_t damaged = contents.indexOf("one");
+    CPPUNIT_ASSERT(damaged != String::npos);
+    ThreadPool pool(2);
+
+    // execute
+    DataFile intact(path, 1);
+    CPPUNIT_ASSERT(intact.open(DataFile::Read));
+    const bool intactVerified = intact.verify(&pool);
+    contents[damaged] = 'O';
+    CPPUNIT_ASSERT(Path::write(path, contents));
+    DataFile file(path, 1);
+    CPPUNIT_ASSERT(file.open(DataFile::Read));
+
+    // verify, the crc is the standard one and the large section is
+    // checked in parts. The damaged section is found without reading
+    // the others, which can still be read
+    CPPUNIT_ASSERT_EQUAL(0xe3069283u, Rct::crc32c("123456789", 9));
+    CPPUNIT_ASSERT_EQUAL(Rct::crc32c("123456789", 9), Rct::crc32cCombine(Rct::crc32c("1234", 4), Rct::crc32c("56789", 5), 5));
+    CPPUNIT_ASSERT_EQUAL(Rct::crc32c("123456789", 9), Rct::crc32c("56789", 5, Rct::crc32c("1234", 4)));
+    CPPUNIT_ASSERT(intactVerified);
+    CPPUNIT_ASSERT(!file.verifySection("first"));
+    CPPUNIT_ASSERT(file.error().contains("first"));
+    CPPUNIT_ASSERT(file.verifySection("large"));
+    CPPUNIT_ASSERT(file.verifySection("last"));
+    CPPUNIT_ASSERT(!file.verifySection("missing"));
+    CPPUNIT_ASSERT(!file.verify(&pool));
+    List<int> decoded;
+    CPPUNIT_ASSERT(file.seek("large"));
+    file >> decoded;
+    CPPUNIT_ASSERT(decoded.size() == large.size() && std::equal(large.begin(), large.end(), decoded.begin()));
+}
+
+// the version and size up front, then the contents
+static String version1(int version, const String &data)
+{
+    String contents;
+    {
+        Serializer serializer(contents);
+        serializer << version << 0;
+    }
+    contents += data;
+    String size;
+    {
+        Serializer serializer(size);
+        serializer << static_cast<int>(contents.size());
+    }
+    memcpy(contents.data() + Serializer::sizeOf<int>(), size.constData(), size.size());
+    return contents;
+}
+
+void
+DataFileTestSuite::testVersion1()
+{
+    // prepare
+    String data;
+    {
+        Serializer serializer(data);
+        serializer << String("one") << 2;
+    }
+    const Path path = mDir + "version1.db";
+    CPPUNIT_ASSERT(Path::write(path, version1(5, data)));
+
+    // execute
+    DataFile file(path, 5), wrongVersion(path, 6);
+    CPPUNIT_ASSERT(file.open(DataFile::Read));
+    String string;
+    int value = 0;
+    file >> string >> value;
+
+    // verify, there's nothing to check the contents against
+    CPPUNIT_ASSERT(string == "one" && value == 2);
+    CPPUNIT_ASSERT(file.atEnd());
+    CPPUNIT_ASSERT(file.sections().isEmpty());
+    CPPUNIT_ASSERT(file.verify());
+    CPPUNIT_ASSERT(!wrongVersion.open(DataFile::Read));
+    CPPUNIT_ASSERT(wrongVersion.error().contains("Wrong database version"));
+}
+
+void
+DataFileTestSuite::testCompressed()
+{
+    // prepare
+    List<String> strings;
+    for (int i = 0; i < 100000; ++i)
+        strings.append(String::format<64>("/usr/include/some/path/file%d.h", i));
+    const Path plainPath = mDir + "plain.db", compressedPath = mDir + "compressed.db", blocksPath = mDir + "blocks.db";
+    for (int i = 0; i < 3; ++i) {
+        DataFile file(i == 0 ? plainPath : i == 1 ? compressedPath : blocksPath, 1);
+        if (i)
+            file.setCompression(Compressor::FastLevel, i == 2 ? 256 * 1024 : 0);
+        CPPUNIT_ASSERT(file.open(DataFile::Write));
+        file << 7;
+        file.beginSection("strings");
+        file << strings;
+        file.beginSection("empty");
+        file.beginSection("value");
+        file << String("value");
+        CPPUNIT_ASSERT(file.flush());
+    }
+
+    // execute
+    DataFile compressed(compressedPath, 1), blocks(blocksPath, 1);
+    CPPUNIT_ASSERT(compressed.open(DataFile::Read));
+    CPPUNIT_ASSERT(blocks.open(DataFile::Read));
+    int value;
+    List<String> decoded, blocksDecoded;
+    String string;
+    compressed >> value >> decoded >> string;
+    const bool sequentialEnd = compressed.atEnd();
+
+    // verify, sections are compressed on their own, checked as they
+    // are in the file and read in order or by seeking
+    CPPUNIT_ASSERT(compressedPath.fileSize() < plainPath.fileSize() / 4);
+    CPPUNIT_ASSERT(value == 7 && decoded == strings && string == "value");
+    CPPUNIT_ASSERT(sequentialEnd);
+    CPPUNIT_ASSERT(compressed.verify());
+    CPPUNIT_ASSERT(compressed.seek("value"));
+    compressed >> string;
+    CPPUNIT_ASSERT(string == "value" && compressed.atEnd());
+    CPPUNIT_ASSERT(compressed.seek("empty"));
+    CPPUNIT_ASSERT(compressed.atEnd());
+    CPPUNIT_ASSERT(blocks.seek("strings"));
+    blocks >> blocksDecoded;
+    CPPUNIT_ASSERT(blocksDecoded == strings && blocks.atEnd());
+}
+
+void
+DataFileTestSuite::testCompressedFromPool()
+{
+    // prepare
+    ThreadPool pool(1);
+    const Path path = mDir + "pool.db";
+    List<String> strings;
+    for (int i = 0; i < 20000; ++i)
+        strings.append(String::format<64>("/usr/include/some/path/file%d.h", i));
+
+    // execute, the only thread of the pool can't wait for blocks that
+    // are queued behind it
+    Future<bool> written = pool.submit([&]() {
+            DataFile file(path, 1);
+            file.setCompression(Compressor::FastLevel, 16 * 1024, &pool);
+            if (!file.open(DataFile::Write))
+                return false;
+            file.beginSection("strings");
+            file << strings;
+            return file.flush();
+        });
+
+    // verify
+    CPPUNIT_ASSERT(written.get());
+    DataFile file(path, 1);
+    CPPUNIT_ASSERT(file.open(DataFile::Read));
+    List<String> decoded;
+    file >> decoded;
+    CPPUNIT_ASSERT(decoded == strings);
+}
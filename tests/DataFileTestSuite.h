@@ -0,0 +1,38 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <rct/Path.h>
+
+class DataFileTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DataFileTestSuite);
+
+    CPPUNIT_TEST(testReadWrite);
+    CPPUNIT_TEST(testSections);
+    CPPUNIT_TEST(testCorrupted);
+    CPPUNIT_TEST(testVerify);
+    CPPUNIT_TEST(testVersion1);
+    CPPUNIT_TEST(testCompressed);
+    CPPUNIT_TEST(testCompressedFromPool);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        DataFileTestSuite() : mDir() {}
+
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testReadWrite();
+        void testSections();
+        void testCorrupted();
+        void testVerify();
+        void testVersion1();
+        void testCompressed();
+        void testCompressedFromPool();
+
+    private:
+        Path mDir;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DataFileTestSuite);
@@ -0,0 +1,272 @@
+#include <DnsCacheTestSuite.h>
+#include <rct/DnsCache.h>
+#include <rct/EventLoop.h>
+#include <rct/SocketClient.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <thread>
+#include <unistd.h>
+
+// resolves every name to 127.0.0.1
+static DnsCache::Address stubLookup(const String& host, uint16_t port, int family)
+{
+    DnsCache::Address address;
+    if (host.endsWith(".test"))
+        DnsCache::parseNumeric("127.0.0.1", port, family, &address);
+    return address;
+}
+
+void
+DnsCacheTestSuite::setUp()
+{
+}
+
+void
+DnsCacheTestSuite::tearDown()
+{
+    DnsCache::instance()->setLookup(nullptr);
+}
+
+void
+DnsCacheTestSuite::testNumeric()
+{
+    // prepare
+    DnsCache cache;
+    cache.setLookup(&stubLookup);
+    DnsCache::Address v4, v6, none;
+
+    // execute
+    const bool found4 = cache.lookup("10.1.2.3", 80, AF_UNSPEC, &v4);
+    const bool found6 = cache.lookup("::1", 443, AF_UNSPEC, &v6);
+    const bool foundNone = cache.lookup("::1", 443, AF_INET, &none);
+
+    // verify
+    CPPUNIT_ASSERT(found4 && found6 && !foundNone);
+    CPPUNIT_ASSERT_EQUAL(AF_INET, v4.family());
+    CPPUNIT_ASSERT_EQUAL(80, static_cast<int>(ntohs(reinterpret_cast<const sockaddr_in*>(v4.addr())->sin_port)));
+    CPPUNIT_ASSERT_EQUAL(AF_INET6, v6.family());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), cache.lookupCount());
+}
+
+void
+DnsCacheTestSuite::testCache()
+{
+    // prepare
+    DnsCache cache;
+    cache.setLookup(&stubLookup);
+    DnsCache::Address address;
+
+    // execute
+    const bool before = cache.lookup("host.test", 80, AF_UNSPEC, &address);
+    const DnsCache::Address first = cache.resolve("host.test", 80, AF_UNSPEC);
+    const bool after = cache.lookup("host.test", 80, AF_UNSPEC, &address);
+    cache.resolve("host.test", 80, AF_UNSPEC);
+    const size_t cached = cache.lookupCount();
+    cache.resolve("host.test", 81, AF_UNSPEC);
+    const DnsCache::Address failed = cache.resolve("host.invalid", 80, AF_UNSPEC);
+    cache.resolve("host.invalid", 80, AF_UNSPEC);
+    cache.setTtl(0);
+    cache.resolve("other.test", 80, AF_UNSPEC);
+    cache.resolve("other.test", 80, AF_UNSPEC);
+
+    // verify
+    CPPUNIT_ASSERT(!before && after && first.isValid());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), cached);
+    CPPUNIT_ASSERT(!failed.isValid());
+    // new port, two misses that aren't cached, two expired entries
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(6), cache.lookupCount());
+}
+
+void
+DnsCacheTestSuite::testMaxEntries()
+{
+    // prepare
+    DnsCache cache;
+    cache.setLookup(&stubLookup);
+    cache.setMaxEntries(4);
+    DnsCache::Address address;
+
+    // execute
+    for (int i = 0; i < 10; ++i)
+        cache.resolve(String::format<32>("host%d.test", i), 80, AF_UNSPEC);
+    const size_t full = cache.size();
+    const bool last = cache.lookup("host9.test", 80, AF_UNSPEC, &address);
+    cache.setMaxEntries(2);
+
+    // verify, the name just looked up is always kept
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), full);
+    CPPUNIT_ASSERT(last);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), cache.size());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10), cache.lookupCount());
+}
+
+void
+DnsCacheTestSuite::testResolveAsync()
+{
+    // prepare
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    DnsCache cache;
+    cache.setLookup(&stubLookup);
+    int answers = 0;
+    bool onLoopThread = true;
+    const std::thread::id loopThread = std::this_thread::get_id();
+    auto callback = [&](const DnsCache::Address& address) {
+        CPPUNIT_ASSERT(address.isValid());
+        onLoopThread = onLoopThread && std::this_thread::get_id() == loopThread;
+        if (++answers == 3)
+            loop->quit();
+    };
+
+    // execute
+    for (int i = 0; i < 3; ++i)
+        cache.resolveAsync("async.test", 80, AF_UNSPEC, callback);
+    loop->exec(5000);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(3, answers);
+    CPPUNIT_ASSERT(onLoopThread);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), cache.lookupCount());
+}
+
+void
+DnsCacheTestSuite::testHosts()
+{
+    // execute, localhost comes from /etc/hosts
+    const DnsCache::Address address = DnsCache::systemLookup("localhost", 80, AF_INET);
+
+    // verify
+    CPPUNIT_ASSERT(address.isValid());
+    CPPUNIT_ASSERT_EQUAL(AF_INET, address.family());
+}
+
+void
+DnsCacheTestSuite::testUdpWrite()
+{
+    // prepare, a receiver on an ephemeral port and a client sending by name
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    DnsCache::instance()->setLookup(&stubLookup);
+    const int receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    CPPUNIT_ASSERT(::bind(receiver, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    CPPUNIT_ASSERT(::getsockname(receiver, reinterpret_cast<sockaddr*>(&addr), &size) == 0);
+    const uint16_t port = ntohs(addr.sin_port);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(::socket(AF_INET, SOCK_DGRAM, 0), SocketClient::Udp);
+
+    // execute, the first datagram waits for the name, the rest don't
+    CPPUNIT_ASSERT(client->writeTo("udp.test", port, "first"));
+    loop->registerTimer([&](int) { loop->quit(); }, 100);
+    loop->exec(5000);
+    CPPUNIT_ASSERT(client->writeTo("udp.test", port, "second"));
+    CPPUNIT_ASSERT(client->writeTo("udp.test", port, "third"));
+
+    // verify
+    String received;
+    char buf[64];
+    for (int i = 0; i < 3; ++i) {
+        const ssize_t r = ::recv(receiver, buf, sizeof(buf), 0);
+        CPPUNIT_ASSERT(r > 0);
+        received.append(buf, r);
+        received += ' ';
+    }
+    CPPUNIT_ASSERT(received == "first second third ");
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), DnsCache::instance()->lookupCount());
+    ::close(receiver);
+}
+
+void
+DnsCacheTestSuite::testUdpDnsError()
+{
+    // prepare
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    DnsCache::instance()->setLookup(&stubLookup);
+    const int receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    CPPUNIT_ASSERT(::bind(receiver, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    CPPUNIT_ASSERT(::getsockname(receiver, reinterpret_cast<sockaddr*>(&addr), &size) == 0);
+    const uint16_t port = ntohs(addr.sin_port);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(::socket(AF_INET, SOCK_DGRAM, 0), SocketClient::Udp);
+    List<SocketClient::Error> errors;
+    client->error().connect([&](const SocketClient::SharedPtr&, SocketClient::Error error) {
+            errors.append(error);
+            loop->quit();
+        });
+
+    // execute, a name that doesn't resolve only loses its own datagram
+    CPPUNIT_ASSERT(client->writeTo("nowhere.invalid", port, "lost"));
+    loop->exec(5000);
+    const bool open = client->isConnected();
+    CPPUNIT_ASSERT(client->writeTo("127.0.0.1", port, "kept"));
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), errors.size());
+    CPPUNIT_ASSERT(errors.first() == SocketClient::DnsError);
+    CPPUNIT_ASSERT(open);
+    char buf[64];
+    const ssize_t r = ::recv(receiver, buf, sizeof(buf), 0);
+    CPPUNIT_ASSERT(String(buf, r > 0 ? r : 0) == "kept");
+    ::close(receiver);
+}
+
+void
+DnsCacheTestSuite::testTcpWriteWhileResolving()
+{
+    // prepare, a listener on an ephemeral port and a name that isn't
+    // cached yet
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    DnsCache::instance()->setLookup(&stubLookup);
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    CPPUNIT_ASSERT(::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    CPPUNIT_ASSERT(::listen(listener, 1) == 0);
+    CPPUNIT_ASSERT(::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &size) == 0);
+    const uint16_t port = ntohs(addr.sin_port);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>();
+    int written = 0;
+    client->bytesWritten().connect([&](const SocketClient::SharedPtr&, int bytes) {
+            written += bytes;
+            if (written == 10)
+                loop->quit();
+        });
+
+    // execute, write right away like callers normally do
+    CPPUNIT_ASSERT(client->connect("tcp.test", port));
+    const bool connecting = client->state() == SocketClient::Connecting && client->isConnected();
+    CPPUNIT_ASSERT(client->write("01234", 5));
+    CPPUNIT_ASSERT(client->write("56789", 5));
+    loop->exec(5000);
+
+    // verify, what was written while resolving arrives once connected
+    CPPUNIT_ASSERT(connecting);
+    CPPUNIT_ASSERT_EQUAL(10, written);
+    const int accepted = ::accept(listener, 0, 0);
+    CPPUNIT_ASSERT(accepted != -1);
+    String received;
+    char buf[64];
+    while (received.size() < 10) {
+        const ssize_t r = ::recv(accepted, buf, sizeof(buf), 0);
+        if (r <= 0)
+            break;
+        received.append(buf, r);
+    }
+    CPPUNIT_ASSERT(received == "0123456789");
+    client->close();
+    ::close(accepted);
+    ::close(listener);
+}
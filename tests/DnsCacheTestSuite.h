@@ -0,0 +1,34 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class DnsCacheTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(DnsCacheTestSuite);
+
+    CPPUNIT_TEST(testNumeric);
+    CPPUNIT_TEST(testCache);
+    CPPUNIT_TEST(testMaxEntries);
+    CPPUNIT_TEST(testResolveAsync);
+    CPPUNIT_TEST(testHosts);
+    CPPUNIT_TEST(testUdpWrite);
+    CPPUNIT_TEST(testUdpDnsError);
+    CPPUNIT_TEST(testTcpWriteWhileResolving);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testNumeric();
+        void testCache();
+        void testMaxEntries();
+        void testResolveAsync();
+        void testHosts();
+        void testUdpWrite();
+        void testUdpDnsError();
+        void testTcpWriteWhileResolving();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DnsCacheTestSuite);
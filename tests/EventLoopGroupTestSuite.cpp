@@ -0,0 +1,158 @@
+#include <EventLoopGroupTestSuite.h>
+#include <rct/EventLoopGroup.h>
+#include <rct/SocketServer.h>
+
+#include <future>
+#include <set>
+#include <thread>
+
+void
+EventLoopGroupTestSuite::setUp()
+{
+}
+
+void
+EventLoopGroupTestSuite::tearDown()
+{
+}
+
+void
+EventLoopGroupTestSuite::testLoopsRunOnOwnThreads()
+{
+    // prepare
+    EventLoopGroup group;
+    CPPUNIT_ASSERT(group.start(3, EventLoop::None, false));
+
+    // execute
+    std::set<std::thread::id> threads;
+    for (size_t i = 0; i < group.size(); ++i) {
+        std::promise<bool> ran;
+        const EventLoop::SharedPtr loop = group.loop(i);
+        loop->callLater([&ran, &threads, loop]() {
+                threads.insert(std::this_thread::get_id());
+                ran.set_value(EventLoop::eventLoop() == loop);
+            });
+        CPPUNIT_ASSERT(ran.get_future().get());
+    }
+    group.stop();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), threads.size());
+    CPPUNIT_ASSERT(!threads.count(std::this_thread::get_id()));
+    CPPUNIT_ASSERT(!group.isRunning());
+}
+
+void
+EventLoopGroupTestSuite::testRoundRobin()
+{
+    // prepare
+    EventLoopGroup group;
+    group.start(2, EventLoop::None, false);
+
+    // execute / verify
+    const size_t first = group.select();
+    CPPUNIT_ASSERT(group.select() != first);
+    CPPUNIT_ASSERT_EQUAL(first, group.select());
+}
+
+void
+EventLoopGroupTestSuite::testDistributeClients()
+{
+    // prepare, the server accepts on a loop of its own
+    EventLoopGroup::SharedPtr group = std::make_shared<EventLoopGroup>();
+    group->start(2, EventLoop::None, false);
+    EventLoopGroup acceptor;
+    acceptor.start(1, EventLoop::None, false);
+
+    std::mutex mutex;
+    std::set<EventLoop::SharedPtr> loops;
+    std::promise<void> done;
+    std::promise<uint16_t> port;
+    std::unique_ptr<SocketServer> server;
+    acceptor.loop(0)->callLater([&]() {
+            server.reset(new SocketServer);
+            server->setEventLoopGroup(group, SocketServer::RoundRobin);
+            server->newClient().connect([&](const SocketClient::SharedPtr&) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    loops.insert(EventLoop::eventLoop());
+                    if (loops.size() == 2)
+                        done.set_value();
+                });
+            port.set_value(server->listen(0) ? server->port() : 0);
+        });
+    const uint16_t p = port.get_future().get();
+    CPPUNIT_ASSERT(p != 0);
+
+    // execute
+    SocketClient::SharedPtr first = std::make_shared<SocketClient>(SocketClient::Blocking);
+    SocketClient::SharedPtr second = std::make_shared<SocketClient>(SocketClient::Blocking);
+    CPPUNIT_ASSERT(first->connect("127.0.0.1", p));
+    CPPUNIT_ASSERT(second->connect("127.0.0.1", p));
+
+    // verify, one client on each loop
+    CPPUNIT_ASSERT(done.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CPPUNIT_ASSERT(loops.count(group->loop(0)));
+    CPPUNIT_ASSERT(loops.count(group->loop(1)));
+
+    std::promise<void> closed;
+    acceptor.loop(0)->callLater([&]() { server.reset(); closed.set_value(); });
+    closed.get_future().wait();
+}
+
+void
+EventLoopGroupTestSuite::testReusePort()
+{
+    // prepare, every loop accepts on a listener of its own
+    EventLoopGroup::SharedPtr group = std::make_shared<EventLoopGroup>();
+    group->start(2, EventLoop::None, false);
+    std::set<std::thread::id> groupThreads;
+    for (size_t i = 0; i < group->size(); ++i) {
+        std::promise<std::thread::id> thread;
+        group->loop(i)->callLater([&thread]() { thread.set_value(std::this_thread::get_id()); });
+        groupThreads.insert(thread.get_future().get());
+    }
+    EventLoopGroup acceptor;
+    acceptor.start(1, EventLoop::None, false);
+
+    const int count = 8;
+    std::mutex mutex;
+    int arrived = 0;
+    bool onGroupThreads = true;
+    std::promise<void> done;
+    std::promise<uint16_t> port;
+    std::unique_ptr<SocketServer> server;
+    acceptor.loop(0)->callLater([&]() {
+            server.reset(new SocketServer);
+            server->setEventLoopGroup(group, SocketServer::ReusePort);
+            server->newClient().connect([&](const SocketClient::SharedPtr&) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!groupThreads.count(std::this_thread::get_id()))
+                        onGroupThreads = false;
+                    if (++arrived == count)
+                        done.set_value();
+                });
+            port.set_value(server->listen(0) ? server->port() : 0);
+        });
+    const uint16_t p = port.get_future().get();
+    CPPUNIT_ASSERT(p != 0);
+
+    // execute
+    List<SocketClient::SharedPtr> clients;
+    for (int i = 0; i < count; ++i) {
+        clients.append(std::make_shared<SocketClient>(SocketClient::Blocking));
+        CPPUNIT_ASSERT(clients.last()->connect("127.0.0.1", p));
+    }
+
+    // verify, every client comes in through newClient() on one of the
+    // group's loops
+    CPPUNIT_ASSERT(done.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CPPUNIT_ASSERT_EQUAL(count, arrived);
+        CPPUNIT_ASSERT(onGroupThreads);
+    }
+
+    std::promise<void> closed;
+    acceptor.loop(0)->callLater([&]() { server.reset(); closed.set_value(); });
+    closed.get_future().wait();
+}
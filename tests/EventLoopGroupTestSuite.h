@@ -0,0 +1,26 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class EventLoopGroupTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(EventLoopGroupTestSuite);
+
+    CPPUNIT_TEST(testLoopsRunOnOwnThreads);
+    CPPUNIT_TEST(testRoundRobin);
+    CPPUNIT_TEST(testDistributeClients);
+    CPPUNIT_TEST(testReusePort);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testLoopsRunOnOwnThreads();
+        void testRoundRobin();
+        void testDistributeClients();
+        void testReusePort();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EventLoopGroupTestSuite);
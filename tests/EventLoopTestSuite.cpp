@@ -0,0 +1,441 @@
+#include <EventLoopTestSuite.h>
+#include <rct/EventLoopGroup.h>
+#include <rct/List.h>
+#include <rct/Rct.h>
+#include <rct/SocketClient.h>
+#include <rct/String.h>
+#include <rct/Timer.h>
+
+#include <atomic>
+#include <future>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+void
+EventLoopTestSuite::setUp()
+{
+}
+
+void
+EventLoopTestSuite::tearDown()
+{
+}
+
+void
+EventLoopTestSuite::testPostOrder()
+{
+    // prepare
+    EventLoopGroup group;
+    group.start(1, EventLoop::None, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    List<int> order;
+    std::promise<void> done;
+
+    // execute, events posted from an event run after the ones already queued
+    loop->callLater([&]() {
+            order.append(0);
+            loop->callLater([&]() { order.append(3); done.set_value(); });
+        });
+    loop->callLater([&]() { order.append(1); });
+    loop->callLater([&]() { order.append(2); });
+    done.get_future().wait();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), order.size());
+    for (int i = 0; i < 4; ++i)
+        CPPUNIT_ASSERT_EQUAL(i, order.at(i));
+}
+
+void
+EventLoopTestSuite::testPostFromThreads()
+{
+    // prepare
+    enum { Threads = 4, Count = 10000 };
+    EventLoopGroup group;
+    group.start(1, EventLoop::None, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    std::vector<int> last(Threads, -1);
+    std::atomic<int> outOfOrder(0), total(0);
+    std::promise<void> done;
+
+    // execute
+    std::vector<std::thread> threads;
+    for (int t = 0; t < Threads; ++t) {
+        threads.emplace_back([&, t]() {
+                for (int i = 0; i < Count; ++i) {
+                    loop->callLater([&, t, i]() {
+                            if (last[t] + 1 != i)
+                                ++outOfOrder;
+                            last[t] = i;
+                            if (++total == Threads * Count)
+                                done.set_value();
+                        });
+                }
+            });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // verify, nothing lost and each thread's events ran in order
+    CPPUNIT_ASSERT(done.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CPPUNIT_ASSERT_EQUAL(0, outOfOrder.load());
+}
+
+void
+EventLoopTestSuite::testPostWakeups()
+{
+    for (unsigned int flags : { static_cast<unsigned int>(EventLoop::None), static_cast<unsigned int>(EventLoop::EnableIoUring) }) {
+        // prepare
+        enum { Rounds = 20000 };
+        EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+        loop->init(flags);
+        std::atomic<int> posted(0), ran(0);
+
+        // execute, small bursts posted while the loop is busy draining
+        // the last one, each has to wake it up again
+        std::thread poster([&]() {
+                for (int round = 0; round < Rounds; ++round) {
+                    for (int i = round % 4; i >= 0; --i) {
+                        ++posted;
+                        loop->callLater([&]() { ++ran; });
+                    }
+                    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                    while (ran.load() != posted.load()) {
+                        if (std::chrono::steady_clock::now() > deadline)
+                            return;
+                        std::this_thread::yield();
+                    }
+                }
+                loop->quit();
+            });
+        loop->exec(60000);
+        poster.join();
+
+        // verify, no wakeup was lost
+        CPPUNIT_ASSERT_EQUAL(posted.load(), ran.load());
+        CPPUNIT_ASSERT_EQUAL((Rounds / 4) * (1 + 2 + 3 + 4), posted.load());
+    }
+}
+
+void
+EventLoopTestSuite::testUnregisterDuringDispatch()
+{
+    // prepare, two sockets that become readable in the same poll and
+    // unregister each other
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+    int a[2], b[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, a) == 0);
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, b) == 0);
+    int fired = 0;
+    loop->registerSocket(a[0], EventLoop::SocketRead, [&](int, unsigned int) {
+            ++fired;
+            loop->unregisterSocket(b[0]);
+        });
+    loop->registerSocket(b[0], EventLoop::SocketRead, [&](int, unsigned int) {
+            ++fired;
+            loop->unregisterSocket(a[0]);
+        });
+
+    // execute
+    CPPUNIT_ASSERT(::write(a[1], "x", 1) == 1);
+    CPPUNIT_ASSERT(::write(b[1], "x", 1) == 1);
+    loop->exec(50);
+
+    // verify, whichever ran first kept the other from running
+    CPPUNIT_ASSERT_EQUAL(1, fired);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), loop->socketCount());
+    loop->unregisterSocket(a[0]);
+    loop->unregisterSocket(b[0]);
+    for (int fd : { a[0], a[1], b[0], b[1] })
+        ::close(fd);
+}
+
+void
+EventLoopTestSuite::testReregisterDuringDispatch()
+{
+    // prepare, a callback that replaces itself while running
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    List<String> calls;
+    const String first = "first";
+    loop->registerSocket(fds[0], EventLoop::SocketRead, [&, first](int fd, unsigned int) {
+            char c;
+            CPPUNIT_ASSERT(::read(fd, &c, 1) == 1);
+            loop->unregisterSocket(fd);
+            loop->registerSocket(fd, EventLoop::SocketRead, [&](int f, unsigned int) {
+                    CPPUNIT_ASSERT(::read(f, &c, 1) == 1);
+                    calls.append("second");
+                    loop->quit();
+                });
+            // the captures of the running callback are still valid
+            calls.append(first);
+            CPPUNIT_ASSERT(::write(fds[1], "y", 1) == 1);
+        });
+
+    // execute
+    CPPUNIT_ASSERT(::write(fds[1], "x", 1) == 1);
+    loop->exec(1000);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), calls.size());
+    CPPUNIT_ASSERT(calls.at(0) == "first");
+    CPPUNIT_ASSERT(calls.at(1) == "second");
+    loop->unregisterSocket(fds[0]);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+void
+EventLoopTestSuite::testIoUringSocketModes()
+{
+    // prepare, falls back to epoll where io_uring isn't available
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::EnableIoUring);
+    CPPUNIT_ASSERT_EQUAL(loop->hasAsyncIO(), (loop->flags() & EventLoop::EnableIoUring) != 0);
+    int edge[2], level[2], oneShot[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, edge) == 0);
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, level) == 0);
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, oneShot) == 0);
+    int edgeFired = 0, levelFired = 0, oneShotFired = 0;
+    loop->registerSocket(edge[0], EventLoop::SocketRead, [&](int, unsigned int mode) {
+            CPPUNIT_ASSERT(mode & EventLoop::SocketRead);
+            ++edgeFired;
+        });
+    loop->registerSocket(level[0], EventLoop::SocketRead|EventLoop::SocketLevelTriggered, [&](int, unsigned int) {
+            ++levelFired;
+        });
+    loop->registerSocket(oneShot[0], EventLoop::SocketRead|EventLoop::SocketOneShot, [&](int, unsigned int) {
+            ++oneShotFired;
+        });
+
+    // execute, nobody reads so only the level triggered socket keeps firing
+    for (int fd : { edge[1], level[1], oneShot[1] })
+        CPPUNIT_ASSERT(::write(fd, "x", 1) == 1);
+    loop->exec(50);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(1, edgeFired);
+    CPPUNIT_ASSERT(levelFired > 1);
+    CPPUNIT_ASSERT_EQUAL(1, oneShotFired);
+
+    // execute, new data wakes the edge triggered socket up again and the
+    // one shot socket fires once more after being updated
+    CPPUNIT_ASSERT(::write(edge[1], "y", 1) == 1);
+    loop->unregisterSocket(level[0]);
+    loop->updateSocket(oneShot[0], EventLoop::SocketRead|EventLoop::SocketOneShot);
+    loop->exec(50);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(2, edgeFired);
+    CPPUNIT_ASSERT_EQUAL(2, oneShotFired);
+    loop->unregisterSocket(edge[0]);
+    loop->unregisterSocket(oneShot[0]);
+    for (int fd : { edge[0], edge[1], level[0], level[1], oneShot[0], oneShot[1] })
+        ::close(fd);
+}
+
+void
+EventLoopTestSuite::testIoUringSocketClient()
+{
+    // prepare, a client that reads through the ring if there is one
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::EnableIoUring);
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    String received;
+    bool disconnected = false;
+    client->readyRead().connect([&](const SocketClient::SharedPtr&, Buffer&& buffer) {
+            received.append(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            buffer.clear();
+            if (received.size() == 10)
+                ::close(fds[1]);
+        });
+    client->disconnected().connect([&](const SocketClient::SharedPtr&) {
+            disconnected = true;
+            loop->quit();
+        });
+
+    // execute
+    CPPUNIT_ASSERT(::write(fds[1], "01234", 5) == 5);
+    loop->callLater([&]() { CPPUNIT_ASSERT(::write(fds[1], "56789", 5) == 5); });
+    loop->exec(1000);
+
+    // verify
+    CPPUNIT_ASSERT(received == "0123456789");
+    CPPUNIT_ASSERT(disconnected);
+    CPPUNIT_ASSERT(!client->isConnected());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), loop->socketCount());
+}
+
+void
+EventLoopTestSuite::testSocketClientLargeRead()
+{
+    // prepare, more than fits in the socket buffer or a read chunk
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    String sent(4 * 1024 * 1024 + 123, '\0');
+    for (size_t i = 0; i < sent.size(); ++i)
+        sent[i] = static_cast<char>(i % 251);
+    String received;
+    client->readyRead().connect([&](const SocketClient::SharedPtr&, Buffer&& buffer) {
+            Buffer taken = std::move(buffer);
+            received.append(reinterpret_cast<const char*>(taken.data()), taken.size());
+        });
+    client->disconnected().connect([&](const SocketClient::SharedPtr&) {
+            loop->quit();
+        });
+
+    // execute
+    std::thread writer([&]() {
+            for (size_t written = 0; written < sent.size(); ) {
+                const ssize_t w = ::write(fds[1], sent.constData() + written, sent.size() - written);
+                if (w <= 0)
+                    break;
+                written += w;
+            }
+            ::close(fds[1]);
+        });
+    loop->exec(10000);
+    writer.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(sent.size(), received.size());
+    CPPUNIT_ASSERT(sent == received);
+    CPPUNIT_ASSERT(!client->isConnected());
+}
+
+void
+EventLoopTestSuite::testSocketClientSmallRead()
+{
+    // prepare
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    size_t received = 0, capacity = 0;
+    client->readyRead().connect([&](const SocketClient::SharedPtr&, Buffer&& buffer) {
+            Buffer taken = std::move(buffer);
+            received += taken.size();
+            capacity = std::max(capacity, taken.capacity());
+            if (received == 100)
+                loop->quit();
+        });
+
+    // execute
+    const String sent(100, 'x');
+    CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(sent.size()), ::write(fds[1], sent.constData(), sent.size()));
+    loop->exec(10000);
+    ::close(fds[1]);
+
+    // verify, reading until EAGAIN doesn't grow the buffer
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(100), received);
+    CPPUNIT_ASSERT(capacity <= 1024);
+}
+
+void
+EventLoopTestSuite::testSocketClientWriteQueue()
+{
+    // prepare, a peer that doesn't read until everything's been written
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    size_t written = 0;
+    bool done = false;
+    String expected;
+    client->bytesWritten().connect([&](const SocketClient::SharedPtr&, int bytes) {
+            written += bytes;
+            if (done && written == expected.size())
+                loop->quit();
+        });
+
+    // execute, header and body pairs, a few owned buffers and plain writes
+    for (int i = 0; i < 2000; ++i) {
+        const String header = String::format<16>("%05d", i);
+        const String body(i % 1000 + 1, static_cast<char>('a' + i % 26));
+        expected += header + body;
+        if (i % 3 == 0) {
+            iovec vecs[2];
+            vecs[0].iov_base = const_cast<char*>(header.constData());
+            vecs[0].iov_len = header.size();
+            vecs[1].iov_base = const_cast<char*>(body.constData());
+            vecs[1].iov_len = body.size();
+            CPPUNIT_ASSERT(client->write(vecs, 2));
+        } else if (i % 3 == 1) {
+            Buffer buffer;
+            buffer.resize(header.size() + body.size());
+            memcpy(buffer.data(), header.constData(), header.size());
+            memcpy(buffer.data() + header.size(), body.constData(), body.size());
+            CPPUNIT_ASSERT(client->write(std::move(buffer)));
+        } else {
+            CPPUNIT_ASSERT(client->write(header));
+            CPPUNIT_ASSERT(client->write(body));
+        }
+    }
+    CPPUNIT_ASSERT(written < expected.size());
+    done = true;
+
+    String received;
+    std::thread reader([&]() {
+            char buf[16384];
+            while (received.size() < expected.size()) {
+                const ssize_t r = ::read(fds[1], buf, sizeof(buf));
+                if (r <= 0)
+                    break;
+                received.append(buf, r);
+            }
+        });
+    loop->exec(10000);
+    reader.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(expected.size(), written);
+    CPPUNIT_ASSERT(received == expected);
+    ::close(fds[1]);
+}
+
+void
+EventLoopTestSuite::testCachedTime()
+{
+    // prepare
+    EventLoopGroup group;
+    group.start(1, EventLoop::CoarseClock, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    uint64_t registered = 0, fired = 0, cached = 0, now = 0;
+    std::promise<void> done;
+
+    // execute
+    loop->callLater([&]() {
+            registered = Rct::monoMs();
+            loop->registerTimer([&](int) {
+                    fired = Rct::monoMs();
+                    cached = EventLoop::cachedTime();
+                    now = loop->now();
+                    done.set_value();
+                }, 20, Timer::SingleShot);
+        });
+    done.get_future().wait();
+
+    // verify, timers go by the precise clock
+    CPPUNIT_ASSERT(fired >= registered + 20);
+    CPPUNIT_ASSERT_EQUAL(now, cached);
+    CPPUNIT_ASSERT(cached <= fired);
+    CPPUNIT_ASSERT(fired - cached < 20);
+    // not running a loop, straight from the clock
+    const uint64_t before = Rct::monoMs();
+    const uint64_t outside = EventLoop::cachedTime();
+    CPPUNIT_ASSERT(outside >= before && outside - before < 20);
+    const uint64_t coarse = Rct::coarseMonoMs();
+    CPPUNIT_ASSERT(coarse <= Rct::monoNs() / 1000000 && Rct::monoMs() - coarse < 50);
+}
@@ -0,0 +1,40 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class EventLoopTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(EventLoopTestSuite);
+
+    CPPUNIT_TEST(testPostOrder);
+    CPPUNIT_TEST(testPostFromThreads);
+    CPPUNIT_TEST(testPostWakeups);
+    CPPUNIT_TEST(testUnregisterDuringDispatch);
+    CPPUNIT_TEST(testReregisterDuringDispatch);
+    CPPUNIT_TEST(testIoUringSocketModes);
+    CPPUNIT_TEST(testIoUringSocketClient);
+    CPPUNIT_TEST(testSocketClientLargeRead);
+    CPPUNIT_TEST(testSocketClientSmallRead);
+    CPPUNIT_TEST(testSocketClientWriteQueue);
+    CPPUNIT_TEST(testCachedTime);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testPostOrder();
+        void testPostFromThreads();
+        void testPostWakeups();
+        void testUnregisterDuringDispatch();
+        void testReregisterDuringDispatch();
+        void testIoUringSocketModes();
+        void testIoUringSocketClient();
+        void testSocketClientLargeRead();
+        void testSocketClientSmallRead();
+        void testSocketClientWriteQueue();
+        void testCachedTime();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EventLoopTestSuite);
@@ -0,0 +1,239 @@
+#include <LogFileTestSuite.h>
+#include <rct/Log.h>
+#include <rct/LogFile.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static String line(int idx)
+{
+    return String::format<64>("line %04d of the log\n", idx);
+}
+
+void
+LogFileTestSuite::setUp()
+{
+    char dir[] = "/tmp/rct-logfile-XXXXXX";
+    CPPUNIT_ASSERT(mkdtemp(dir));
+    mDir = Path(dir).ensureTrailingSlash();
+}
+
+void
+LogFileTestSuite::tearDown()
+{
+    Path::rmdir(mDir);
+}
+
+void
+LogFileTestSuite::testWrite()
+{
+    // prepare
+    const Path path = mDir + "write.log";
+    LogFile file;
+    file.setSegmentSize(getpagesize());
+    String expected;
+
+    // execute, lines straddle the segments
+    CPPUNIT_ASSERT(file.open(path, LogFile::Truncate));
+    for (int i = 0; i < 1000; ++i) {
+        const String l = line(i);
+        const iovec vecs[] = { { const_cast<char*>(l.constData()), 5 }, { const_cast<char*>(l.constData() + 5), l.size() - 5 } };
+        file.write(vecs, 2);
+        expected += l;
+    }
+
+    // verify, the mapping is visible before the file is closed, the
+    // segment isn't sparse and the zeroes are cut off once it's closed
+    CPPUNIT_ASSERT_EQUAL(expected.size(), file.size());
+    CPPUNIT_ASSERT(path.readAll().startsWith(expected));
+    struct stat st;
+    CPPUNIT_ASSERT(!::stat(path.constData(), &st));
+    CPPUNIT_ASSERT(static_cast<size_t>(st.st_blocks) * 512 >= static_cast<size_t>(st.st_size));
+    file.close();
+    CPPUNIT_ASSERT(path.readAll() == expected);
+}
+
+void
+LogFileTestSuite::testAppend()
+{
+    // prepare, a file a crash left with its segment not cut back
+    const Path path = mDir + "append.log";
+    String crashed = line(0);
+    crashed.resize(crashed.size() + 100);
+    CPPUNIT_ASSERT(path.write(crashed));
+    LogFile file;
+
+    // execute
+    CPPUNIT_ASSERT(file.open(path, LogFile::Append));
+    file.write(line(1).constData(), line(1).size());
+    file.close();
+
+    // verify
+    CPPUNIT_ASSERT(path.readAll() == line(0) + line(1));
+}
+
+void
+LogFileTestSuite::testRotate()
+{
+    // prepare, a file from a previous run
+    const Path path = mDir + "rotate.log";
+    CPPUNIT_ASSERT(path.write(line(-1)));
+    LogFile file;
+    file.setMaxSize(line(0).size() * 10);
+    file.setMaxFiles(3);
+
+    // execute
+    CPPUNIT_ASSERT(file.open(path, LogFile::Rotate));
+    for (int i = 0; i < 55; ++i)
+        file.write(line(i).constData(), line(i).size());
+    file.close();
+
+    // verify, the previous run's file went to .1, each rotated file
+    // holds ten lines and the oldest are gone
+    CPPUNIT_ASSERT_EQUAL(6, file.lastIndex());
+    for (int index = 1; index <= 3; ++index)
+        CPPUNIT_ASSERT(!Path(path + String::format<16>(".%d", index)).exists());
+    for (int index = 4; index <= 6; ++index) {
+        const String contents = Path(path + String::format<16>(".%d", index)).readAll();
+        CPPUNIT_ASSERT(contents.startsWith(line((index - 2) * 10)));
+        CPPUNIT_ASSERT_EQUAL(line(0).size() * 10, contents.size());
+    }
+    CPPUNIT_ASSERT(path.readAll() == line(50) + line(51) + line(52) + line(53) + line(54));
+}
+
+void
+LogFileTestSuite::testPrepared()
+{
+    // prepare
+    const Path path = mDir + "prepared.log";
+    LogFile file;
+    file.setSegmentSize(getpagesize());
+    file.setMaxSize(getpagesize() * 3);
+    String expected;
+
+    // execute, the thread has the next segment and file ready before
+    // the writes get there
+    CPPUNIT_ASSERT(file.open(path, LogFile::Truncate));
+    file.waitForRotations();
+    const bool nextFile = Path(path + ".next").exists();
+    for (int i = 0; i < 1000; ++i) {
+        file.write(line(i).constData(), line(i).size());
+        expected += line(i);
+        file.waitForRotations();
+    }
+    file.close();
+
+    // verify
+    CPPUNIT_ASSERT(nextFile);
+    CPPUNIT_ASSERT_EQUAL(1, file.lastIndex());
+    CPPUNIT_ASSERT(Path(path + ".1").readAll() + path.readAll() == expected);
+    CPPUNIT_ASSERT(!Path(path + ".next").exists());
+}
+
+void
+LogFileTestSuite::testPreparedFileGone()
+{
+    // prepare, the prepared file can't be moved in place
+    const Path path = mDir + "gone.log";
+    LogFile file;
+    file.setSegmentSize(getpagesize());
+    file.setMaxSize(getpagesize() * 3);
+    String expected;
+    CPPUNIT_ASSERT(file.open(path, LogFile::Truncate));
+    file.waitForRotations();
+    CPPUNIT_ASSERT(Path::rm(path + ".next"));
+
+    // execute
+    for (int i = 0; file.lastIndex() < 1; ++i) {
+        file.write(line(i).constData(), line(i).size());
+        expected += line(i);
+        file.waitForRotations();
+    }
+    const bool nextFile = Path(path + ".next").exists();
+    file.close();
+
+    // verify, a fresh one is prepared for the next rotation
+    CPPUNIT_ASSERT(nextFile);
+    CPPUNIT_ASSERT(Path(path + ".1").readAll() + path.readAll() == expected);
+    CPPUNIT_ASSERT(!Path(path + ".next").exists());
+}
+
+void
+LogFileTestSuite::testLowerMaxFiles()
+{
+    // prepare
+    const Path path = mDir + "lower.log";
+    LogFile file;
+    file.setMaxSize(line(0).size() * 10);
+    file.setMaxFiles(5);
+    CPPUNIT_ASSERT(file.open(path, LogFile::Truncate));
+    for (int i = 0; i < 55; ++i)
+        file.write(line(i).constData(), line(i).size());
+    file.waitForRotations();
+    int before = 0;
+    for (int index = 1; index <= 5; ++index)
+        before += Path(path + String::format<16>(".%d", index)).exists();
+
+    // execute, the next rotation drops everything beyond the new limit
+    file.setMaxFiles(2);
+    for (int i = 55; i < 65; ++i)
+        file.write(line(i).constData(), line(i).size());
+    file.close();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(5, before);
+    CPPUNIT_ASSERT_EQUAL(6, file.lastIndex());
+    for (int index = 1; index <= 4; ++index)
+        CPPUNIT_ASSERT(!Path(path + String::format<16>(".%d", index)).exists());
+    CPPUNIT_ASSERT(Path(path + ".5").exists() && Path(path + ".6").exists());
+}
+
+void
+LogFileTestSuite::testCompress()
+{
+#ifdef RCT_HAVE_ZLIB
+    // prepare
+    const Path path = mDir + "compress.log";
+    LogFile file;
+    file.setMaxSize(line(0).size() * 100);
+    file.setCompress(true);
+
+    // execute
+    CPPUNIT_ASSERT(file.open(path, LogFile::Truncate));
+    for (int i = 0; i < 150; ++i)
+        file.write(line(i).constData(), line(i).size());
+    file.waitForRotations();
+
+    // verify
+    const String compressed = Path(path + ".1.gz").readAll();
+    CPPUNIT_ASSERT(!Path(path + ".1").exists());
+    CPPUNIT_ASSERT(compressed.size() > 2 && compressed.size() < line(0).size() * 100);
+    CPPUNIT_ASSERT(static_cast<unsigned char>(compressed[0]) == 0x1f && static_cast<unsigned char>(compressed[1]) == 0x8b);
+    file.close();
+#endif
+}
+
+void
+LogFileTestSuite::testLogging()
+{
+    // prepare
+    const Path path = mDir + "logging.log";
+    setLogRotation(200, 0, 2);
+
+    // execute
+    CPPUNIT_ASSERT(initLogging("test", DontRotate, LogLevel::Error, path, LogLevel::Error));
+    for (int i = 0; i < 100; ++i)
+        error() << "line" << i;
+    cleanupLogging();
+
+    // verify, about 800 bytes make three rotated files and the first
+    // of them is gone
+    CPPUNIT_ASSERT(path.readAll().endsWith("line 99\n"));
+    CPPUNIT_ASSERT(!Path(path + ".1").exists());
+    for (int index = 2; index <= 3; ++index) {
+        const Path rotated = path + String::format<16>(".%d", index);
+        CPPUNIT_ASSERT(rotated.exists());
+        CPPUNIT_ASSERT(rotated.fileSize() <= 200);
+    }
+}
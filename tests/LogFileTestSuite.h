@@ -0,0 +1,40 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <rct/Path.h>
+
+class LogFileTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(LogFileTestSuite);
+
+    CPPUNIT_TEST(testWrite);
+    CPPUNIT_TEST(testAppend);
+    CPPUNIT_TEST(testRotate);
+    CPPUNIT_TEST(testPrepared);
+    CPPUNIT_TEST(testPreparedFileGone);
+    CPPUNIT_TEST(testLowerMaxFiles);
+    CPPUNIT_TEST(testCompress);
+    CPPUNIT_TEST(testLogging);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        LogFileTestSuite() : mDir() {}
+
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testWrite();
+        void testAppend();
+        void testRotate();
+        void testPrepared();
+        void testPreparedFileGone();
+        void testLowerMaxFiles();
+        void testCompress();
+        void testLogging();
+
+    private:
+        Path mDir;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogFileTestSuite);
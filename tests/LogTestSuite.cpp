@@ -0,0 +1,199 @@
+#include <LogTestSuite.h>
+#include <rct/Log.h>
+
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// lines per thread logging "<thread> <line>", -1 if one is out of order
+static List<int> countLines(const Path &file, int threads)
+{
+    List<int> counts(threads, 0);
+    for (const String &line : file.readAll().split('\n', String::SkipEmpty)) {
+        int thread, idx;
+        if (sscanf(line.constData(), "%d %d", &thread, &idx) != 2 || thread < 0 || thread >= threads)
+            continue;
+        if (counts[thread] != -1)
+            counts[thread] = idx == counts[thread] ? idx + 1 : -1;
+    }
+    return counts;
+}
+
+static void logFrom(int threads, int lines)
+{
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([i, lines]() {
+                    for (int idx = 0; idx < lines; ++idx)
+                        error("%d %d", i, idx);
+                }));
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void
+LogTestSuite::setUp()
+{
+    char dir[] = "/tmp/rct-log-XXXXXX";
+    CPPUNIT_ASSERT(mkdtemp(dir));
+    mDir = Path(dir).ensureTrailingSlash();
+}
+
+void
+LogTestSuite::tearDown()
+{
+    cleanupLogging();
+    Path::rmdir(mDir);
+}
+
+void
+LogTestSuite::testStream()
+{
+    // prepare
+    enum LogTestFlag { A = 0x1, B = 0x4 };
+    String numbers, floats, containers;
+    List<int> list;
+    list << 1 << -2;
+    Map<String, int> map;
+    map["a"] = 1;
+
+    // execute
+    Log(&numbers) << 0 << -1 << INT_MIN << LLONG_MIN << ULLONG_MAX << static_cast<uint8_t>(7) << static_cast<int16_t>(-300);
+    Log(&floats) << 0.5 << 1e20 << -2.0f << static_cast<long double>(3.25);
+    {
+        Log log(&containers, LogOutput::NoTypename);
+        log << "x" << list << map << Flags<LogTestFlag>(B) << Path("/tmp") << 'c' << true;
+    }
+
+    // verify
+    CPPUNIT_ASSERT(numbers == String("0 -1 -2147483648 -9223372036854775808 18446744073709551615 7 -300"));
+    CPPUNIT_ASSERT(floats == String("0.5 1e+20 -2 3.25"));
+    CPPUNIT_ASSERT(containers == String("x1, -2a: 1 0x4 /tmp c true"));
+    CPPUNIT_ASSERT(Log::toString(list) == String("List<int>(1, -2)"));
+}
+
+void
+LogTestSuite::testSync()
+{
+    // prepare
+    const Path file = mDir + "sync.log";
+    CPPUNIT_ASSERT(initLogging("test", DontRotate, LogLevel::Error, file, LogLevel::Debug));
+
+    // execute
+    error("0 0");
+    debug("0 1");
+    verboseDebug("0 2");
+    warning() << 0 << 2;
+    const Log disabled(LogLevel::VerboseDebug);
+
+    // verify
+    CPPUNIT_ASSERT(!disabled.spacing());
+    CPPUNIT_ASSERT(testLog(LogLevel::Debug));
+    CPPUNIT_ASSERT(!testLog(LogLevel::VerboseDebug));
+    CPPUNIT_ASSERT(!testLog(LogLevel::None));
+    CPPUNIT_ASSERT_EQUAL(3, countLines(file, 1)[0]);
+}
+
+void
+LogTestSuite::testAsync()
+{
+    // prepare
+    enum { Threads = 4, Lines = 5000 };
+    const Path file = mDir + "async.log";
+    const uint64_t dropped = droppedLogLines();
+    CPPUNIT_ASSERT(initLogging("test", DontRotate | LogAsync | LogAsyncBlock, LogLevel::Error, file, LogLevel::Error));
+
+    // execute
+    logFrom(Threads, Lines);
+    flushLogs();
+
+    // verify, nothing is lost and every thread's lines are in order
+    const List<int> counts = countLines(file, Threads);
+    for (int i = 0; i < Threads; ++i)
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(Lines), counts[i]);
+    CPPUNIT_ASSERT_EQUAL(dropped, droppedLogLines());
+}
+
+void
+LogTestSuite::testAsyncDropped()
+{
+    // prepare
+    enum { Threads = 4, Lines = 50000 };
+    const Path file = mDir + "dropped.log";
+    const uint64_t dropped = droppedLogLines();
+    CPPUNIT_ASSERT(initLogging("test", DontRotate | LogAsync, LogLevel::Error, file, LogLevel::Error));
+
+    // execute
+    logFrom(Threads, Lines);
+    cleanupLogging();
+
+    // verify, lines are either written or counted as dropped, and
+    // the drops are reported in the log
+    int written = 0;
+    unsigned long long reported = 0;
+    for (const String &line : file.readAll().split('\n', String::SkipEmpty)) {
+        unsigned long long count;
+        if (sscanf(line.constData(), "%llu log lines dropped", &count) == 1 && line.endsWith("dropped")) {
+            reported += count;
+        } else {
+            ++written;
+        }
+    }
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(Threads * Lines), written + droppedLogLines() - dropped);
+    CPPUNIT_ASSERT_EQUAL(static_cast<unsigned long long>(droppedLogLines() - dropped), reported);
+}
+
+void
+LogTestSuite::testAsyncLongLine()
+{
+    // prepare
+    const Path file = mDir + "long.log";
+    const String line = "0 1 " + String(100 * 1024, 'x');
+    CPPUNIT_ASSERT(initLogging("test", DontRotate | LogAsync | LogAsyncBlock, LogLevel::Error, file, LogLevel::Error));
+
+    // execute
+    error("0 0");
+    logDirect(LogLevel::Error, line);
+    error("0 2");
+    flushLogs();
+
+    // verify, the long line is whole and in order
+    const List<String> lines = file.readAll().split('\n', String::SkipEmpty);
+    CPPUNIT_ASSERT_EQUAL(3, countLines(file, 1)[0]);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), lines.size());
+    CPPUNIT_ASSERT(lines[1] == line);
+}
+
+void
+LogTestSuite::testAsyncCrash()
+{
+    // prepare
+    enum { Lines = 1000 };
+    const Path file = mDir + "crash.log";
+
+    // execute, the child crashes with lines still queued
+    const pid_t pid = fork();
+    CPPUNIT_ASSERT(pid != -1);
+    if (!pid) {
+        signal(SIGSEGV, SIG_DFL);
+        if (initLogging("test", DontRotate | LogAsync | LogAsyncBlock, LogLevel::Error, file, LogLevel::Error)) {
+            for (int idx = 0; idx < Lines; ++idx)
+                error("0 %d", idx);
+            raise(SIGSEGV);
+        }
+        _exit(1);
+    }
+    int status;
+    CPPUNIT_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+
+    // verify
+    CPPUNIT_ASSERT(WIFSIGNALED(status));
+    CPPUNIT_ASSERT_EQUAL(SIGSEGV, WTERMSIG(status));
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(Lines), countLines(file, 1)[0]);
+}
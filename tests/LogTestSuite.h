@@ -0,0 +1,36 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <rct/Path.h>
+
+class LogTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(LogTestSuite);
+
+    CPPUNIT_TEST(testStream);
+    CPPUNIT_TEST(testSync);
+    CPPUNIT_TEST(testAsync);
+    CPPUNIT_TEST(testAsyncDropped);
+    CPPUNIT_TEST(testAsyncLongLine);
+    CPPUNIT_TEST(testAsyncCrash);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        LogTestSuite() : mDir() {}
+
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testStream();
+        void testSync();
+        void testAsync();
+        void testAsyncDropped();
+        void testAsyncLongLine();
+        void testAsyncCrash();
+
+    private:
+        Path mDir;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogTestSuite);
@@ -0,0 +1,124 @@
+#include <ParallelTestSuite.h>
+#include <rct/Hash.h>
+#include <rct/Map.h>
+#include <rct/Parallel.h>
+#include <rct/String.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+void
+ParallelTestSuite::setUp()
+{
+}
+
+void
+ParallelTestSuite::tearDown()
+{
+}
+
+void
+ParallelTestSuite::testFor()
+{
+    // prepare
+    ThreadPool pool(4);
+    List<int> hits(10000, 0);
+    List<int> values(1000, 1);
+    std::atomic<int> sum(0);
+
+    // execute
+    Rct::parallelFor(0, hits.size(), 7, [&hits](size_t idx) { ++hits[idx]; }, &pool);
+    Rct::parallelFor(values, 0, [](int &value) { value *= 3; }, &pool);
+    Rct::parallelFor(values, 10, [&sum](const int &value) { sum += value; }, &pool);
+
+    // verify, every index exactly once
+    CPPUNIT_ASSERT(std::count(hits.begin(), hits.end(), 1) == 10000);
+    CPPUNIT_ASSERT_EQUAL(3000, sum.load());
+}
+
+void
+ParallelTestSuite::testMap()
+{
+    // prepare
+    ThreadPool pool(3, Thread::Normal, 0, ThreadPool::WorkStealing);
+    List<String> strings;
+    Hash<String, int> hash;
+    Map<int, int> map;
+    for (int i = 0; i < 5000; ++i) {
+        strings.append(String::number(i));
+        hash[String::number(i)] = i;
+        map[i] = i * 2;
+    }
+
+    // execute
+    const List<size_t> sizes = Rct::parallelMap(strings, 16, [](const String &string) { return string.size(); }, &pool);
+    const List<int> values = Rct::parallelMap(hash, 0, [](const std::pair<const String, int> &item) { return item.second; }, &pool);
+    const List<int> doubled = Rct::parallelMap(map, 0, [](const std::pair<const int, int> &item) { return item.second; }, &pool);
+
+    // verify, in the container's order
+    CPPUNIT_ASSERT_EQUAL(strings.size(), sizes.size());
+    for (size_t i = 0; i < strings.size(); ++i)
+        CPPUNIT_ASSERT_EQUAL(strings[i].size(), sizes[i]);
+    size_t idx = 0;
+    for (const auto &item : hash)
+        CPPUNIT_ASSERT_EQUAL(item.second, values[idx++]);
+    for (int i = 0; i < 5000; ++i)
+        CPPUNIT_ASSERT_EQUAL(i * 2, doubled[i]);
+}
+
+void
+ParallelTestSuite::testReduce()
+{
+    // prepare
+    ThreadPool pool(4);
+    List<String> letters;
+    for (int i = 0; i < 2600; ++i)
+        letters.append(String(1, 'a' + (i % 26)));
+    String expected;
+    for (const String &letter : letters)
+        expected += letter;
+
+    // execute, concatenation isn't commutative
+    const String joined = Rct::parallelReduce(letters, 13, String(),
+                                              [](const String &letter) { return letter; },
+                                              [](const String &l, const String &r) { return l + r; }, &pool);
+    const int total = Rct::parallelReduce(List<int>(), 0, 42,
+                                          [](int value) { return value; },
+                                          [](int l, int r) { return l + r; }, &pool);
+
+    // verify
+    CPPUNIT_ASSERT(expected == joined);
+    CPPUNIT_ASSERT_EQUAL(42, total);
+}
+
+void
+ParallelTestSuite::testNested()
+{
+    // prepare, fewer threads than outer chunks
+    ThreadPool pool(2);
+    std::atomic<int> count(0);
+
+    // execute
+    Rct::parallelFor(0, 16, 1, [&](size_t) {
+            Rct::parallelFor(0, 100, 1, [&](size_t) { ++count; }, &pool);
+        }, &pool);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(1600, count.load());
+}
+
+void
+ParallelTestSuite::testSmall()
+{
+    // prepare
+    ThreadPool pool(4);
+    const std::thread::id caller = std::this_thread::get_id();
+    bool inline_ = true;
+
+    // execute, fits in one chunk
+    Rct::parallelFor(0, 10, 10, [&](size_t) { inline_ = inline_ && std::this_thread::get_id() == caller; }, &pool);
+
+    // verify
+    CPPUNIT_ASSERT(inline_);
+}
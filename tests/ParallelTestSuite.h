@@ -0,0 +1,28 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class ParallelTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ParallelTestSuite);
+
+    CPPUNIT_TEST(testFor);
+    CPPUNIT_TEST(testMap);
+    CPPUNIT_TEST(testReduce);
+    CPPUNIT_TEST(testNested);
+    CPPUNIT_TEST(testSmall);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testFor();
+        void testMap();
+        void testReduce();
+        void testNested();
+        void testSmall();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ParallelTestSuite);
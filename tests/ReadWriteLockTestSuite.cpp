@@ -0,0 +1,187 @@
+#include <ReadWriteLockTestSuite.h>
+#include <rct/ReadLocker.h>
+#include <rct/ScalableReadWriteLock.h>
+#include <rct/SeqLock.h>
+#include <rct/WriteLocker.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void
+ReadWriteLockTestSuite::setUp()
+{
+}
+
+void
+ReadWriteLockTestSuite::tearDown()
+{
+}
+
+void
+ReadWriteLockTestSuite::testLockers()
+{
+    // prepare
+    ReadWriteLock lock;
+    ScalableReadWriteLock scalable;
+    SeqLock<int> seq(1);
+
+    // execute, verify
+    {
+        ReadLocker read(&lock);
+        ReadLocker scalableRead(&scalable);
+        ReadLocker seqRead(&seq);
+        CPPUNIT_ASSERT(!lock.tryLockForWrite());
+        CPPUNIT_ASSERT(!scalable.tryLockForWrite());
+        CPPUNIT_ASSERT(scalable.tryLockForRead());
+        scalable.unlock();
+    }
+    {
+        WriteLocker write(&lock);
+        WriteLocker scalableWrite(&scalable);
+        WriteLocker seqWrite(&seq);
+        CPPUNIT_ASSERT(!lock.tryLockForRead());
+        CPPUNIT_ASSERT(!scalable.tryLockForRead());
+        seq.set(2);
+    }
+    CPPUNIT_ASSERT(scalable.tryLockForWrite());
+    scalable.unlock();
+    CPPUNIT_ASSERT_EQUAL(2, seq.load());
+}
+
+void
+ReadWriteLockTestSuite::testReaders()
+{
+    // prepare
+    ScalableReadWriteLock lock;
+    std::atomic<int> inside(0), most(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+
+    // execute, every reader stays until all of them got in
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread([&]() {
+                    while (!go.load())
+                        std::this_thread::yield();
+                    ReadLocker locker(&lock);
+                    const int count = ++inside;
+                    if (count > most.load())
+                        most = count;
+                    while (most.load() < 4)
+                        std::this_thread::yield();
+                    --inside;
+                }));
+    }
+    go = true;
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(4, most.load());
+    CPPUNIT_ASSERT(lock.tryLockForWrite());
+    lock.unlock();
+}
+
+void
+ReadWriteLockTestSuite::testWriters()
+{
+    // prepare, writers keep a and b equal
+    ScalableReadWriteLock lock;
+    int a = 0, b = 0;
+    std::atomic<int> torn(0);
+    std::vector<std::thread> threads;
+
+    // execute
+    for (int i = 0; i < 4; ++i) {
+        threads.push_back(std::thread([&, i]() {
+                    for (int j = 0; j < 2000; ++j) {
+                        if ((i + j) % 4 == 0) {
+                            WriteLocker locker(&lock);
+                            ++a;
+                            std::this_thread::yield();
+                            ++b;
+                        } else {
+                            ReadLocker locker(&lock);
+                            if (a != b)
+                                ++torn;
+                        }
+                    }
+                }));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(0, torn.load());
+    CPPUNIT_ASSERT_EQUAL(2000, a);
+    CPPUNIT_ASSERT_EQUAL(2000, b);
+}
+
+void
+ReadWriteLockTestSuite::testTimeout()
+{
+    // prepare
+    ScalableReadWriteLock lock;
+    SeqLock<int> seq;
+    CPPUNIT_ASSERT(lock.lockForRead());
+    CPPUNIT_ASSERT(seq.lockForRead());
+
+    // execute, from another thread since readers don't know who they are
+    bool writeLocked = true, seqLocked = true, readLocked = false;
+    std::thread thread([&]() {
+            writeLocked = lock.lockForWrite(20);
+            seqLocked = seq.lockForWrite(20);
+            // the writer gave up, readers aren't held back anymore
+            readLocked = lock.lockForRead(20);
+            if (readLocked)
+                lock.unlock();
+        });
+    thread.join();
+    lock.unlock();
+    seq.unlock();
+
+    // verify
+    CPPUNIT_ASSERT(!writeLocked);
+    CPPUNIT_ASSERT(!seqLocked);
+    CPPUNIT_ASSERT(readLocked);
+    CPPUNIT_ASSERT(lock.lockForWrite(20));
+    lock.unlock();
+}
+
+struct Pair
+{
+    long long first, second, third;
+};
+
+void
+ReadWriteLockTestSuite::testSeqLock()
+{
+    // prepare, the writer keeps the members equal
+    Pair initial = { 0, 0, 0 };
+    SeqLock<Pair> seq(initial);
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> readers;
+
+    // execute
+    for (int i = 0; i < 3; ++i) {
+        readers.push_back(std::thread([&]() {
+                    while (!done.load()) {
+                        const Pair pair = seq.load();
+                        if (pair.first != pair.second || pair.second != pair.third)
+                            ++torn;
+                    }
+                }));
+    }
+    for (long long i = 1; i <= 20000; ++i) {
+        const Pair pair = { i, i, i };
+        seq.store(pair);
+    }
+    done = true;
+    for (std::thread &thread : readers)
+        thread.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(0, torn.load());
+    CPPUNIT_ASSERT_EQUAL(20000ll, seq.load().third);
+}
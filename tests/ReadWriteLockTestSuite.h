@@ -0,0 +1,28 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class ReadWriteLockTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ReadWriteLockTestSuite);
+
+    CPPUNIT_TEST(testLockers);
+    CPPUNIT_TEST(testReaders);
+    CPPUNIT_TEST(testWriters);
+    CPPUNIT_TEST(testTimeout);
+    CPPUNIT_TEST(testSeqLock);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testLockers();
+        void testReaders();
+        void testWriters();
+        void testTimeout();
+        void testSeqLock();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ReadWriteLockTestSuite);
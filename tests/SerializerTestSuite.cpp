@@ -0,0 +1,162 @@
+#include <SerializerTestSuite.h>
+#include <rct/Serializer.h>
+
+#include <algorithm>
+
+class CountingBuffer : public Serializer::Buffer
+{
+public:
+    CountingBuffer(String &out, int &writes)
+        : mOut(out), mWrites(writes)
+    {}
+
+    virtual bool write(const void *data, int len) override
+    {
+        ++mWrites;
+        mOut.append(static_cast<const char*>(data), len);
+        return true;
+    }
+    virtual int pos() const override { return mOut.size(); }
+
+private:
+    String &mOut;
+    int &mWrites;
+};
+
+void
+SerializerTestSuite::setUp()
+{
+}
+
+void
+SerializerTestSuite::tearDown()
+{
+}
+
+void
+SerializerTestSuite::testBulkList()
+{
+    // prepare
+    List<uint64_t> list;
+    for (uint64_t i = 0; i < 1000; ++i)
+        list.append(i * 0x100000001ull);
+
+    // execute
+    String encoded, itemByItem;
+    {
+        Serializer serializer(encoded);
+        serializer << list << List<int>();
+    }
+    {
+        Serializer serializer(itemByItem);
+        serializer << static_cast<uint32_t>(list.size());
+        for (uint64_t value : list)
+            serializer << value;
+        serializer << static_cast<uint32_t>(0);
+    }
+    List<uint64_t> decoded;
+    List<int> empty;
+    Deserializer deserializer(encoded);
+    deserializer >> decoded >> empty;
+
+    // verify, the bytes are the same as item by item
+    CPPUNIT_ASSERT(encoded == itemByItem);
+    CPPUNIT_ASSERT(decoded.size() == list.size());
+    CPPUNIT_ASSERT(std::equal(decoded.begin(), decoded.end(), list.begin()));
+    CPPUNIT_ASSERT(empty.isEmpty());
+    CPPUNIT_ASSERT(deserializer.atEnd());
+}
+
+void
+SerializerTestSuite::testNestedList()
+{
+    // prepare
+    Map<String, List<int> > map;
+    map["a"] << 1 << -2 << 3;
+    map["b"];
+    List<String> strings;
+    strings << "x" << "" << "yz";
+
+    // execute
+    String encoded;
+    {
+        Serializer serializer(encoded);
+        serializer << map << strings;
+    }
+    Map<String, List<int> > decodedMap;
+    List<String> decodedStrings;
+    Deserializer deserializer(encoded);
+    deserializer >> decodedMap >> decodedStrings;
+
+    // verify
+    CPPUNIT_ASSERT(decodedMap.size() == 2);
+    CPPUNIT_ASSERT(decodedMap["a"].size() == 3 && decodedMap["a"][1] == -2);
+    CPPUNIT_ASSERT(decodedMap["b"].isEmpty());
+    CPPUNIT_ASSERT(decodedStrings.size() == strings.size());
+    CPPUNIT_ASSERT(std::equal(decodedStrings.begin(), decodedStrings.end(), strings.begin()));
+    CPPUNIT_ASSERT(deserializer.atEnd());
+}
+
+void
+SerializerTestSuite::testStringOutput()
+{
+    // prepare
+    String out("x"), large(100000, 'y');
+    std::string stdOut;
+
+    // execute
+    Serializer serializer(out);
+    serializer << 1 << String("abc");
+    const int pos = serializer.pos();
+    const String copy = out;
+    serializer << large;
+    const size_t size = out.size();
+    Serializer stdSerializer(stdOut);
+    stdSerializer << 1;
+
+    // verify, strings are appended to right away and are never larger
+    // than what has been written
+    CPPUNIT_ASSERT_EQUAL(12, pos);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(12), copy.size());
+    CPPUNIT_ASSERT(copy.startsWith("x"));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(12 + 4 + 100000), size);
+    CPPUNIT_ASSERT(out.endsWith(large));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), stdOut.size());
+    CPPUNIT_ASSERT(serializer.flush());
+    CPPUNIT_ASSERT_EQUAL(size, out.size());
+    CPPUNIT_ASSERT(!serializer.hasError());
+}
+
+void
+SerializerTestSuite::testBuffered()
+{
+    // prepare
+    String out, large(100000, 'x');
+    int writes = 0;
+
+    // execute
+    Serializer serializer(std::unique_ptr<Serializer::Buffer>(new CountingBuffer(out, writes)));
+    for (int i = 0; i < 1000; ++i)
+        serializer << i << static_cast<uint8_t>(i);
+    const int pos = serializer.pos();
+    const int pendingWrites = writes;
+    serializer << large;
+    CPPUNIT_ASSERT(serializer.flush());
+
+    // verify, small fields go out a window at a time, large ones right
+    // away, pos() counts what hasn't gone out yet
+    CPPUNIT_ASSERT_EQUAL(5000, pos);
+    CPPUNIT_ASSERT_EQUAL(1, pendingWrites);
+    CPPUNIT_ASSERT_EQUAL(3, writes);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5000 + 4 + 100000), out.size());
+    Deserializer deserializer(out);
+    for (int i = 0; i < 1000; ++i) {
+        int value;
+        uint8_t byte;
+        deserializer >> value >> byte;
+        CPPUNIT_ASSERT(value == i && byte == static_cast<uint8_t>(i));
+    }
+    String decoded;
+    deserializer >> decoded;
+    CPPUNIT_ASSERT(decoded == large);
+}
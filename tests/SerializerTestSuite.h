@@ -0,0 +1,26 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class SerializerTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SerializerTestSuite);
+
+    CPPUNIT_TEST(testBulkList);
+    CPPUNIT_TEST(testNestedList);
+    CPPUNIT_TEST(testStringOutput);
+    CPPUNIT_TEST(testBuffered);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testBulkList();
+        void testNestedList();
+        void testStringOutput();
+        void testBuffered();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SerializerTestSuite);
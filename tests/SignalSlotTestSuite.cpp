@@ -0,0 +1,124 @@
+#include <SignalSlotTestSuite.h>
+#include <rct/List.h>
+#include <rct/SignalSlot.h>
+
+#include <atomic>
+#include <thread>
+
+void
+SignalSlotTestSuite::setUp()
+{
+}
+
+void
+SignalSlotTestSuite::tearDown()
+{
+}
+
+void
+SignalSlotTestSuite::testEmitOrder()
+{
+    // prepare
+    Signal<std::function<void(int)> > signal;
+    List<int> calls;
+    signal.connect([&calls](int v) { calls.append(v); });
+    signal.connect([&calls](int v) { calls.append(v * 10); });
+    signal.connect([&calls](int v) { calls.append(v * 100); });
+
+    // execute
+    signal(2);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), calls.size());
+    CPPUNIT_ASSERT_EQUAL(2, calls.at(0));
+    CPPUNIT_ASSERT_EQUAL(20, calls.at(1));
+    CPPUNIT_ASSERT_EQUAL(200, calls.at(2));
+}
+
+void
+SignalSlotTestSuite::testDisconnect()
+{
+    // prepare
+    Signal<std::function<void()> > signal;
+    int a = 0, b = 0;
+    const auto keyA = signal.connect([&a]() { ++a; });
+    signal.connect([&b]() { ++b; });
+
+    // execute
+    signal();
+    CPPUNIT_ASSERT(signal.disconnect(keyA));
+    CPPUNIT_ASSERT(!signal.disconnect(keyA));
+    signal();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(1, a);
+    CPPUNIT_ASSERT_EQUAL(2, b);
+    CPPUNIT_ASSERT_EQUAL(1, signal.disconnect());
+    CPPUNIT_ASSERT_EQUAL(0, signal.disconnect());
+    signal();
+    CPPUNIT_ASSERT_EQUAL(2, b);
+}
+
+void
+SignalSlotTestSuite::testDisconnectDuringEmit()
+{
+    // prepare
+    Signal<std::function<void()> > signal;
+    int a = 0, b = 0;
+    signal.connect([&a, &signal]() { ++a; signal.disconnect(); });
+    signal.connect([&b]() { ++b; });
+
+    // execute
+    signal();
+    signal();
+
+    // verify: the emission that was in flight still reaches every slot
+    CPPUNIT_ASSERT_EQUAL(1, a);
+    CPPUNIT_ASSERT_EQUAL(1, b);
+}
+
+void
+SignalSlotTestSuite::testConnectDuringEmit()
+{
+    // prepare
+    Signal<std::function<void()> > signal;
+    int a = 0, b = 0;
+    signal.connect([&]() {
+            if (!a++)
+                signal.connect([&b]() { ++b; });
+        });
+
+    // execute
+    signal();
+    signal();
+
+    // verify: a slot connected during emission fires from the next one
+    CPPUNIT_ASSERT_EQUAL(2, a);
+    CPPUNIT_ASSERT_EQUAL(1, b);
+}
+
+void
+SignalSlotTestSuite::testConcurrentEmit()
+{
+    // prepare
+    Signal<std::function<void()> > signal;
+    std::atomic<int> count(0);
+    std::atomic<bool> done(false);
+    signal.connect([&count]() { ++count; });
+
+    // execute
+    enum { Emits = 100000 };
+    std::thread emitter([&]() {
+            for (int i = 0; i < Emits; ++i)
+                signal();
+            done = true;
+        });
+    while (!done) {
+        const auto key = signal.connect([]() {});
+        signal.disconnect(key);
+    }
+    emitter.join();
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(Emits), count.load());
+}
@@ -0,0 +1,28 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class SignalSlotTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(SignalSlotTestSuite);
+
+    CPPUNIT_TEST(testEmitOrder);
+    CPPUNIT_TEST(testDisconnect);
+    CPPUNIT_TEST(testDisconnectDuringEmit);
+    CPPUNIT_TEST(testConnectDuringEmit);
+    CPPUNIT_TEST(testConcurrentEmit);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testEmitOrder();
+        void testDisconnect();
+        void testDisconnectDuringEmit();
+        void testConnectDuringEmit();
+        void testConcurrentEmit();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SignalSlotTestSuite);
@@ -0,0 +1,346 @@
+#include <ThreadPoolTestSuite.h>
+#include <rct/EventLoop.h>
+#include <rct/String.h>
+#include <rct/ThreadPool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class FunctionJob : public ThreadPool::Job
+{
+public:
+    FunctionJob(std::function<void()>&& func)
+        : mFunc(std::move(func))
+    {
+    }
+
+protected:
+    virtual void run() override
+    {
+        mFunc();
+    }
+
+private:
+    std::function<void()> mFunc;
+};
+
+// blocks the pool's threads until released
+class Gate
+{
+public:
+    Gate() : mOpen(false) {}
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mOpen)
+            mCond.wait(lock);
+    }
+    void open()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mOpen = true;
+        mCond.notify_all();
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mOpen;
+};
+
+static bool waitFor(const std::atomic<int>& value, int expected)
+{
+    for (int i = 0; i < 5000; ++i) {
+        if (value.load() == expected)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return value.load() == expected;
+}
+
+void
+ThreadPoolTestSuite::setUp()
+{
+}
+
+void
+ThreadPoolTestSuite::tearDown()
+{
+}
+
+void
+ThreadPoolTestSuite::testRun()
+{
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        // prepare
+        ThreadPool pool(4, Thread::Normal, 0, mode);
+        std::atomic<int> count(0);
+
+        // execute
+        for (int i = 0; i < 1000; ++i)
+            pool.start(std::make_shared<FunctionJob>([&count]() { ++count; }), (i % 3) * 2 - 2);
+        pool.start(std::make_shared<FunctionJob>([&count]() { ++count; }), ThreadPool::Guaranteed);
+
+        // verify
+        CPPUNIT_ASSERT_EQUAL(mode, pool.scheduling());
+        CPPUNIT_ASSERT(waitFor(count, 1001));
+        CPPUNIT_ASSERT_EQUAL(0, pool.backlogSize());
+    }
+}
+
+void
+ThreadPoolTestSuite::testSpawn()
+{
+    // prepare
+    ThreadPool pool(3, Thread::Normal, 0, ThreadPool::WorkStealing);
+    std::atomic<int> count(0);
+    std::function<void(int)> spawn = [&](int depth) {
+        ++count;
+        if (depth < 10) {
+            pool.start(std::make_shared<FunctionJob>(std::bind(spawn, depth + 1)));
+            pool.start(std::make_shared<FunctionJob>(std::bind(spawn, depth + 1)));
+        }
+    };
+
+    // execute
+    pool.start(std::make_shared<FunctionJob>(std::bind(spawn, 0)));
+
+    // verify, a binary tree of depth 10
+    CPPUNIT_ASSERT(waitFor(count, 2047));
+    CPPUNIT_ASSERT_EQUAL(0, pool.backlogSize());
+}
+
+void
+ThreadPoolTestSuite::testRemove()
+{
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        // prepare
+        ThreadPool pool(1, Thread::Normal, 0, mode);
+        Gate gate;
+        std::atomic<int> started(0), count(0);
+        pool.start(std::make_shared<FunctionJob>([&]() { ++started; gate.wait(); }));
+        CPPUNIT_ASSERT(waitFor(started, 1));
+        std::shared_ptr<ThreadPool::Job> jobs[4];
+        for (int i = 0; i < 4; ++i) {
+            jobs[i] = std::make_shared<FunctionJob>([&count]() { ++count; });
+            pool.start(jobs[i]);
+        }
+
+        // execute
+        const int backlog = pool.backlogSize();
+        const int busy = pool.busyThreads();
+        const bool removed = pool.remove(jobs[1]);
+        const bool removedAgain = pool.remove(jobs[1]);
+        const long uses = jobs[1].use_count();
+        gate.open();
+
+        // verify, the pool lets go of the removed job right away
+        CPPUNIT_ASSERT_EQUAL(4, backlog);
+        CPPUNIT_ASSERT_EQUAL(1, busy);
+        CPPUNIT_ASSERT(removed && !removedAgain);
+        CPPUNIT_ASSERT_EQUAL(1l, uses);
+        CPPUNIT_ASSERT(waitFor(count, 3));
+        CPPUNIT_ASSERT_EQUAL(ThreadPool::Job::NotStarted, jobs[1]->state());
+        CPPUNIT_ASSERT_EQUAL(0, pool.backlogSize());
+    }
+}
+
+void
+ThreadPoolTestSuite::testRestart()
+{
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        // prepare
+        ThreadPool pool(1, Thread::Normal, 0, mode);
+        Gate gate;
+        std::atomic<int> started(0), count(0);
+        pool.start(std::make_shared<FunctionJob>([&]() { ++started; gate.wait(); }));
+        CPPUNIT_ASSERT(waitFor(started, 1));
+        std::mutex mutex;
+        std::vector<int> order;
+        std::shared_ptr<ThreadPool::Job> jobs[3];
+        for (int i = 0; i < 3; ++i) {
+            jobs[i] = std::make_shared<FunctionJob>([&, i]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    order.push_back(i);
+                    ++count;
+                });
+            pool.start(jobs[i]);
+        }
+
+        // execute
+        pool.start(jobs[2], 5);
+        pool.start(jobs[2], 5);
+        const int backlog = pool.backlogSize();
+        gate.open();
+
+        // verify, queued again at the new priority and only run once
+        CPPUNIT_ASSERT_EQUAL(3, backlog);
+        CPPUNIT_ASSERT(waitFor(count, 3));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const int expected[] = { 2, 0, 1 };
+        std::lock_guard<std::mutex> lock(mutex);
+        CPPUNIT_ASSERT(std::vector<int>(expected, expected + 3) == order);
+        CPPUNIT_ASSERT_EQUAL(0, pool.backlogSize());
+    }
+}
+
+void
+ThreadPoolTestSuite::testPriority()
+{
+    // prepare
+    ThreadPool pool(1);
+    Gate gate;
+    std::atomic<int> started(0), count(0);
+    pool.start(std::make_shared<FunctionJob>([&]() { ++started; gate.wait(); }));
+    CPPUNIT_ASSERT(waitFor(started, 1));
+    std::mutex mutex;
+    std::vector<int> order;
+    const int priorities[] = { 0, 5, -2, 5, 1, 0, -2, 7, 1, 0 };
+    std::shared_ptr<ThreadPool::Job> jobs[10];
+    for (int i = 0; i < 10; ++i) {
+        jobs[i] = std::make_shared<FunctionJob>([&, i]() {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(i);
+                ++count;
+            });
+        pool.start(jobs[i], priorities[i]);
+    }
+
+    // execute
+    pool.remove(jobs[4]);
+    pool.remove(jobs[7]);
+    gate.open();
+
+    // verify, highest priority first and in the order started within one
+    CPPUNIT_ASSERT(waitFor(count, 8));
+    const int expected[] = { 1, 3, 8, 0, 5, 9, 2, 6 };
+    CPPUNIT_ASSERT(std::vector<int>(expected, expected + 8) == order);
+}
+
+void
+ThreadPoolTestSuite::testResize()
+{
+    // prepare
+    ThreadPool pool(4, Thread::Normal, 0, ThreadPool::WorkStealing);
+    std::atomic<int> count(0);
+    std::function<void(int)> spawn = [&](int depth) {
+        ++count;
+        if (depth < 8) {
+            pool.start(std::make_shared<FunctionJob>(std::bind(spawn, depth + 1)));
+            pool.start(std::make_shared<FunctionJob>(std::bind(spawn, depth + 1)));
+        }
+    };
+
+    // execute, jobs left in the deques of stopped threads still run
+    pool.start(std::make_shared<FunctionJob>(std::bind(spawn, 0)));
+    pool.setConcurrentJobs(1);
+    const bool shrunk = waitFor(count, 511);
+    pool.setConcurrentJobs(2);
+    pool.start(std::make_shared<FunctionJob>([&count]() { ++count; }));
+
+    // verify
+    CPPUNIT_ASSERT(shrunk);
+    CPPUNIT_ASSERT(waitFor(count, 512));
+}
+
+void
+ThreadPoolTestSuite::testSubmit()
+{
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        // prepare
+        ThreadPool pool(2, Thread::Normal, 0, mode);
+        std::atomic<int> count(0);
+        const String big(1000, 'b');
+        char padding[256] = { 'p' };
+
+        // execute, small and large callables and results
+        List<Future<int> > squares;
+        for (int i = 0; i < 100; ++i)
+            squares.append(pool.submit([i]() { return i * i; }));
+        Future<String> copy = pool.submit([big, padding]() { return big + padding[0]; });
+        Future<void> none = pool.submit([&count]() { ++count; });
+        Future<int> guaranteed = pool.submit([]() { return 7; }, ThreadPool::Guaranteed);
+
+        // verify
+        for (int i = 0; i < 100; ++i)
+            CPPUNIT_ASSERT_EQUAL(i * i, squares[i].get());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1001), copy.get().size());
+        none.wait();
+        CPPUNIT_ASSERT(none.isDone() && !none.isCancelled());
+        CPPUNIT_ASSERT_EQUAL(1, count.load());
+        CPPUNIT_ASSERT_EQUAL(7, guaranteed.get());
+    }
+}
+
+void
+ThreadPoolTestSuite::testSubmitThen()
+{
+    // prepare
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init();
+    ThreadPool pool(2);
+    const std::thread::id loopThread = std::this_thread::get_id();
+    bool onLoopThread = true;
+    int sum = 0, results = 0;
+
+    // execute, some finish before then() is called
+    List<Future<int> > futures;
+    for (int i = 1; i <= 10; ++i)
+        futures.append(pool.submit([i]() { return i; }));
+    futures.first().wait();
+    for (Future<int>& future : futures) {
+        future.then(loop, [&](const int& value) {
+                onLoopThread = onLoopThread && std::this_thread::get_id() == loopThread;
+                sum += value;
+                if (++results == 10)
+                    loop->quit();
+            });
+    }
+    loop->exec(5000);
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(10, results);
+    CPPUNIT_ASSERT_EQUAL(55, sum);
+    CPPUNIT_ASSERT(onLoopThread);
+}
+
+void
+ThreadPoolTestSuite::testSubmitCancel()
+{
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        // prepare
+        Future<int> queued, dropped;
+        std::atomic<int> started(0);
+        {
+            ThreadPool pool(1, Thread::Normal, 0, mode);
+            Gate gate;
+            Future<void> blocker = pool.submit([&]() { ++started; gate.wait(); });
+            CPPUNIT_ASSERT(waitFor(started, 1));
+            queued = pool.submit([]() { return 1; });
+
+            // execute
+            pool.clearBackLog();
+            dropped = pool.submit([]() { return 2; });
+            gate.open();
+            blocker.wait();
+            CPPUNIT_ASSERT(!blocker.isCancelled());
+        }
+
+        // verify, the futures outlive the pool
+        CPPUNIT_ASSERT(queued.isDone() && queued.isCancelled());
+        CPPUNIT_ASSERT(dropped.isDone());
+        if (!dropped.isCancelled())
+            CPPUNIT_ASSERT_EQUAL(2, dropped.get());
+    }
+}
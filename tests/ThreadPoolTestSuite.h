@@ -0,0 +1,36 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class ThreadPoolTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(ThreadPoolTestSuite);
+
+    CPPUNIT_TEST(testRun);
+    CPPUNIT_TEST(testSpawn);
+    CPPUNIT_TEST(testRemove);
+    CPPUNIT_TEST(testRestart);
+    CPPUNIT_TEST(testPriority);
+    CPPUNIT_TEST(testResize);
+    CPPUNIT_TEST(testSubmit);
+    CPPUNIT_TEST(testSubmitThen);
+    CPPUNIT_TEST(testSubmitCancel);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testRun();
+        void testSpawn();
+        void testRemove();
+        void testRestart();
+        void testPriority();
+        void testResize();
+        void testSubmit();
+        void testSubmitThen();
+        void testSubmitCancel();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ThreadPoolTestSuite);
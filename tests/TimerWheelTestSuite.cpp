@@ -0,0 +1,173 @@
+#include <TimerWheelTestSuite.h>
+#include <rct/Timer.h>
+#include <rct/TimerWheel.h>
+
+#include <stdint.h>
+#include <vector>
+
+// fires whatever is due at now, returns the ids in the order they fired
+static std::vector<int> fire(TimerWheel& wheel, uint64_t now)
+{
+    std::vector<int> expired, fired;
+    wheel.advance(now, expired);
+    std::function<void(int)> cb;
+    for (int id : expired) {
+        if (wheel.dispatch(id, cb)) {
+            cb(id);
+            fired.push_back(id);
+        }
+    }
+    return fired;
+}
+
+void
+TimerWheelTestSuite::setUp()
+{
+}
+
+void
+TimerWheelTestSuite::tearDown()
+{
+}
+
+void
+TimerWheelTestSuite::testSingleShot()
+{
+    // prepare
+    TimerWheel wheel(1000);
+    int calls = 0;
+    const int a = wheel.add(1010, 10, Timer::SingleShot, [&calls](int) { ++calls; });
+    const int b = wheel.add(1005, 5, Timer::SingleShot, [&calls](int) { ++calls; });
+
+    // execute
+    const std::vector<int> early = fire(wheel, 1004);
+    const std::vector<int> first = fire(wheel, 1007);
+    const std::vector<int> second = fire(wheel, 2000);
+
+    // verify
+    CPPUNIT_ASSERT(early.empty());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), first.size());
+    CPPUNIT_ASSERT_EQUAL(b, first.at(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), second.size());
+    CPPUNIT_ASSERT_EQUAL(a, second.at(0));
+    CPPUNIT_ASSERT_EQUAL(2, calls);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), wheel.size());
+}
+
+void
+TimerWheelTestSuite::testInterval()
+{
+    // prepare
+    TimerWheel wheel(0);
+    const int id = wheel.add(100, 100, 0, [](int) {});
+
+    // execute, the first round fires late
+    const std::vector<int> late = fire(wheel, 130);
+    const std::vector<int> early = fire(wheel, 199);
+    const std::vector<int> onTime = fire(wheel, 200);
+
+    // verify, the next expiry is based on when the timer was due
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), late.size());
+    CPPUNIT_ASSERT(early.empty());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), onTime.size());
+    CPPUNIT_ASSERT_EQUAL(id, onTime.at(0));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), wheel.size());
+}
+
+void
+TimerWheelTestSuite::testRemove()
+{
+    // prepare
+    TimerWheel wheel(0);
+    bool removedFired = false;
+    const int a = wheel.add(10, 10, Timer::SingleShot, [&removedFired](int) { removedFired = true; });
+    const int b = wheel.add(10, 10, Timer::SingleShot, [](int) {});
+    const int c = wheel.add(20, 20, 0, [](int) {});
+
+    // execute
+    CPPUNIT_ASSERT(wheel.remove(a));
+    std::vector<int> expired;
+    wheel.advance(20, expired);
+    // removing a timer after it expired but before it fired
+    CPPUNIT_ASSERT(wheel.remove(c));
+    std::function<void(int)> cb;
+    const bool firedB = wheel.dispatch(b, cb);
+    const bool firedC = wheel.dispatch(c, cb);
+
+    // verify
+    CPPUNIT_ASSERT(!removedFired);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), expired.size());
+    CPPUNIT_ASSERT(firedB);
+    CPPUNIT_ASSERT(!firedC);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), wheel.size());
+}
+
+void
+TimerWheelTestSuite::testStaleId()
+{
+    // prepare
+    TimerWheel wheel(0);
+    const int a = wheel.add(10, 10, Timer::SingleShot, [](int) {});
+    fire(wheel, 10);
+
+    // execute, the new timer reuses the released slot
+    const int b = wheel.add(20, 10, Timer::SingleShot, [](int) {});
+
+    // verify
+    CPPUNIT_ASSERT(a != b);
+    CPPUNIT_ASSERT(!wheel.remove(a));
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), wheel.size());
+    CPPUNIT_ASSERT(wheel.remove(b));
+}
+
+void
+TimerWheelTestSuite::testFarTimers()
+{
+    // prepare, timers on every level of the wheel in reverse order
+    const uint64_t start = 12345;
+    TimerWheel wheel(start);
+    const uint64_t delays[] = { 1ull << 33, 20000000, 70000, 300, 7 };
+    std::vector<int> ids;
+    for (uint64_t delay : delays)
+        ids.push_back(wheel.add(start + delay, 0, Timer::SingleShot, [](int) {}));
+
+    // execute, step through the wheel the way an event loop would
+    std::vector<int> order;
+    std::vector<uint64_t> times;
+    uint64_t now = start;
+    while (wheel.size()) {
+        const uint64_t next = wheel.nextTimeout();
+        CPPUNIT_ASSERT(next != UINT64_MAX);
+        now = next;
+        for (int id : fire(wheel, now)) {
+            order.push_back(id);
+            times.push_back(now);
+        }
+    }
+
+    // verify
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5), order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const size_t idx = order.size() - 1 - i;
+        CPPUNIT_ASSERT_EQUAL(ids.at(idx), order.at(i));
+        CPPUNIT_ASSERT_EQUAL(start + delays[idx], times.at(i));
+    }
+}
+
+void
+TimerWheelTestSuite::testNextTimeout()
+{
+    // prepare
+    TimerWheel wheel(500);
+
+    // execute / verify
+    CPPUNIT_ASSERT_EQUAL(UINT64_MAX, wheel.nextTimeout());
+    const int id = wheel.add(520, 20, Timer::SingleShot, [](int) {});
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(520), wheel.nextTimeout());
+    // timers in the past are due on the next tick
+    wheel.add(100, 0, Timer::SingleShot, [](int) {});
+    CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(500), wheel.nextTimeout());
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), fire(wheel, 500).size());
+    CPPUNIT_ASSERT(wheel.remove(id));
+    CPPUNIT_ASSERT_EQUAL(UINT64_MAX, wheel.nextTimeout());
+}
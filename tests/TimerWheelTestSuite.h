@@ -0,0 +1,30 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TimerWheelTestSuite : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(TimerWheelTestSuite);
+
+    CPPUNIT_TEST(testSingleShot);
+    CPPUNIT_TEST(testInterval);
+    CPPUNIT_TEST(testRemove);
+    CPPUNIT_TEST(testStaleId);
+    CPPUNIT_TEST(testFarTimers);
+    CPPUNIT_TEST(testNextTimeout);
+
+    CPPUNIT_TEST_SUITE_END();
+
+    public:
+        void setUp();
+        void tearDown();
+
+    protected:
+        void testSingleShot();
+        void testInterval();
+        void testRemove();
+        void testStaleId();
+        void testFarTimers();
+        void testNextTimeout();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TimerWheelTestSuite);
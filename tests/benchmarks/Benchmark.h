@@ -0,0 +1,66 @@
+#ifndef Benchmark_h
+#define Benchmark_h
+
+// Small helpers shared by the benchmarks in this directory. Each
+// benchmark is a standalone executable that prints one line per
+// measurement. An optional first argument scales the iteration count.
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rct/List.h>
+
+namespace Benchmark {
+
+inline uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t iterations(int argc, char **argv, uint64_t defaultCount)
+{
+    if (argc > 1) {
+        const long long count = atoll(argv[1]);
+        if (count > 0)
+            return count;
+    }
+    return defaultCount;
+}
+
+// keeps the optimizer from dropping work whose result is unused
+template <typename T>
+inline void use(const T &t)
+{
+    asm volatile("" : : "g"(&t) : "memory");
+}
+
+template <typename Func>
+inline double nsPerOp(uint64_t count, Func &&func)
+{
+    const uint64_t start = nowNs();
+    for (uint64_t i = 0; i < count; ++i)
+        func();
+    return static_cast<double>(nowNs() - start) / count;
+}
+
+inline uint64_t percentile(List<uint64_t> &samples, double pct)
+{
+    if (samples.isEmpty())
+        return 0;
+    const size_t idx = std::min<size_t>(samples.size() - 1, static_cast<size_t>(samples.size() * pct / 100.0));
+    std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+    return samples[idx];
+}
+
+inline void report(const char *name, double value, const char *unit)
+{
+    printf("%-48s %14.2f %s\n", name, value, unit);
+    fflush(stdout);
+}
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "Benchmark.h"
+
+#include <future>
+#include <time.h>
+
+#include <rct/EventLoop.h>
+#include <rct/EventLoopGroup.h>
+#include <rct/Rct.h>
+#include <rct/StopWatch.h>
+
+// ns per call for the ways of asking what time it is
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 10000000);
+    uint64_t sum = 0;
+
+#ifdef CLOCK_MONOTONIC_RAW
+    Benchmark::report("clock_gettime(CLOCK_MONOTONIC_RAW)", Benchmark::nsPerOp(count, [&]() {
+                timespec spec;
+                clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+                sum += spec.tv_nsec;
+            }), "ns/call");
+#endif
+    Benchmark::report("Rct::gettime", Benchmark::nsPerOp(count, [&]() {
+                timeval time;
+                Rct::gettime(&time);
+                sum += time.tv_usec;
+            }), "ns/call");
+    Benchmark::report("Rct::monoMs", Benchmark::nsPerOp(count, [&]() { sum += Rct::monoMs(); }), "ns/call");
+    Benchmark::report("Rct::monoNs", Benchmark::nsPerOp(count, [&]() { sum += Rct::monoNs(); }), "ns/call");
+    Benchmark::report("Rct::coarseMonoMs", Benchmark::nsPerOp(count, [&]() { sum += Rct::coarseMonoMs(); }), "ns/call");
+    Benchmark::report("StopWatch::current(Millisecond)", Benchmark::nsPerOp(count, [&]() {
+                sum += StopWatch::current(StopWatch::Millisecond);
+            }), "ns/call");
+    Benchmark::report("StopWatch::current(Nanosecond)", Benchmark::nsPerOp(count, [&]() {
+                sum += StopWatch::current(StopWatch::Nanosecond);
+            }), "ns/call");
+    Benchmark::report("EventLoop::cachedTime, no loop", Benchmark::nsPerOp(count, [&]() {
+                sum += EventLoop::cachedTime();
+            }), "ns/call");
+
+    EventLoopGroup group;
+    group.start(1, EventLoop::CoarseClock, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    std::promise<void> done;
+    loop->callLater([&]() {
+            Benchmark::report("EventLoop::cachedTime, in loop", Benchmark::nsPerOp(count, [&]() {
+                        sum += EventLoop::cachedTime();
+                    }), "ns/call");
+            Benchmark::report("EventLoop::now", Benchmark::nsPerOp(count, [&]() {
+                        sum += loop->now();
+                    }), "ns/call");
+            done.set_value();
+        });
+    done.get_future().wait();
+    Benchmark::use(sum);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "Benchmark.h"
+
+#include <rct/Compression.h>
+#include <rct/DataFile.h>
+#include <rct/ThreadPool.h>
+
+// Serialized data compressed at a few levels: with String::compress() on
+// the whole thing, the way it used to be done, streamed through a
+// Compressor, in blocks on a pool and as a DataFile. Speeds are in MB of
+// uncompressed data. The first argument is the size in MB.
+
+static double mbPerSecond(size_t bytes, uint64_t start)
+{
+    return bytes / (1024.0 * 1024.0) / ((Benchmark::nowNs() - start) / 1000000000.0);
+}
+
+static void compress(String &out, int level, ThreadPool *pool, const List<String> &strings, const List<int> &ints)
+{
+    std::unique_ptr<Compressor> compressor(new Compressor(out, level));
+    if (pool)
+        compressor->setBlockSize(1024 * 1024, pool);
+    std::unique_ptr<Serializer::Buffer> buffer(std::move(compressor));
+    Serializer serializer(std::move(buffer));
+    serializer << strings << ints;
+}
+
+static void report(const char *what, int level, double value, const char *unit)
+{
+    Benchmark::report(String::format<96>("%s, level %d", what, level).constData(), value, unit);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t mb = Benchmark::iterations(argc, argv, 64);
+    List<String> strings;
+    List<int> ints;
+    while (strings.size() * 40 < mb * 1024 * 1024 / 2)
+        strings.append(String::format<64>("/usr/include/some/path/file%zu.h", strings.size()));
+    ints.resize(mb * 1024 * 1024 / 2 / sizeof(int));
+    for (size_t i = 0; i < ints.size(); ++i)
+        ints[i] = static_cast<int>(i % 4096);
+
+    String data;
+    {
+        Serializer serializer(data);
+        serializer << strings << ints;
+    }
+    printf("%.1f MB serialized\n", data.size() / (1024.0 * 1024.0));
+
+    char dir[] = "/tmp/rct-compression-benchmark-XXXXXX";
+    if (!mkdtemp(dir))
+        return 1;
+    const Path path = Path(dir).ensureTrailingSlash() + "bench.db";
+    ThreadPool pool(ThreadPool::idealThreadCount());
+
+    const int levels[] = { Compressor::FastLevel, Compressor::DefaultLevel, Compressor::BestLevel };
+    for (const int level : levels) {
+        uint64_t start = Benchmark::nowNs();
+        const String whole = data.compress(level);
+        report("String::compress", level, mbPerSecond(data.size(), start), "MB/s");
+        start = Benchmark::nowNs();
+        Benchmark::use(whole.uncompress());
+        report("String::uncompress", level, mbPerSecond(data.size(), start), "MB/s");
+
+        String streamed;
+        start = Benchmark::nowNs();
+        compress(streamed, level, 0, strings, ints);
+        report("stream, serialize and compress", level, mbPerSecond(data.size(), start), "MB/s");
+        report("stream, ratio", level, static_cast<double>(data.size()) / streamed.size(), "x");
+        start = Benchmark::nowNs();
+        {
+            List<String> s;
+            List<int> i;
+            std::unique_ptr<Deserializer::Source> source(new Decompressor(streamed.constData(), streamed.size()));
+            Deserializer deserializer(std::move(source));
+            deserializer >> s >> i;
+            Benchmark::use(s);
+            Benchmark::use(i);
+        }
+        report("stream, uncompress and deserialize", level, mbPerSecond(data.size(), start), "MB/s");
+
+        String blocks;
+        start = Benchmark::nowNs();
+        compress(blocks, level, &pool, strings, ints);
+        report(String::format<64>("1MB blocks, %d threads", pool.concurrentJobs()).constData(), level,
+               mbPerSecond(data.size(), start), "MB/s");
+
+        start = Benchmark::nowNs();
+        {
+            DataFile file(path, 1);
+            file.setCompression(level);
+            if (!file.open(DataFile::Write))
+                return 1;
+            file.beginSection("strings");
+            file << strings;
+            file.beginSection("ints");
+            file << ints;
+            file.flush();
+        }
+        report("DataFile, write", level, mbPerSecond(data.size(), start), "MB/s");
+        start = Benchmark::nowNs();
+        {
+            List<String> s;
+            List<int> i;
+            DataFile file(path, 1);
+            if (!file.open(DataFile::Read))
+                return 1;
+            file >> s >> i;
+            Benchmark::use(s);
+            Benchmark::use(i);
+        }
+        report("DataFile, read", level, mbPerSecond(data.size(), start), "MB/s");
+    }
+    Path::rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "Benchmark.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+#include <rct/Connection.h>
+#include <rct/EventLoop.h>
+#include <rct/ResponseMessage.h>
+#include <rct/String.h>
+
+// Messages decoded per second by a Connection reading from a UNIX
+// socketpair. Another thread writes the encoded messages back to back so
+// most of them arrive within one read while some straddle two.
+static double run(size_t messageSize, int messages)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    client->setLogsEnabled(false);
+    std::shared_ptr<Connection> connection = Connection::create(client);
+    int received = 0;
+    size_t bytes = 0;
+    connection->newMessage().connect([&](const std::shared_ptr<Message> &message, const std::shared_ptr<Connection> &) {
+            bytes += std::static_pointer_cast<ResponseMessage>(message)->data().size();
+            if (++received == messages)
+                loop->quit();
+        });
+
+    // what Connection::send() writes, the frame size then the version,
+    // id and flags, then the message
+    String frame;
+    {
+        String value;
+        {
+            Serializer serializer(value);
+            ResponseMessage(String(messageSize, 'r')).encode(serializer);
+        }
+        Serializer serializer(frame);
+        const uint32_t size = value.size() + sizeof(int) + 2;
+        serializer.write(&size, sizeof(size));
+        serializer << 0 << static_cast<uint8_t>(ResponseMessage::MessageId) << static_cast<uint8_t>(0);
+        serializer.write(value.constData(), value.size());
+    }
+
+    const uint64_t start = Benchmark::nowNs();
+    std::thread writer([&frame, fds, messages]() {
+            for (int i = 0; i < messages; ++i) {
+                for (size_t written = 0; written < frame.size(); ) {
+                    const ssize_t w = ::write(fds[1], frame.constData() + written, frame.size() - written);
+                    if (w <= 0) {
+                        perror("write");
+                        exit(1);
+                    }
+                    written += w;
+                }
+            }
+        });
+    loop->exec();
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    writer.join();
+    Benchmark::use(bytes);
+    connection.reset();
+    client.reset();
+    ::close(fds[1]);
+    return messages / (static_cast<double>(elapsed) / 1000000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    const int messages = Benchmark::iterations(argc, argv, 500000);
+    Benchmark::report("100B messages", run(100, messages), "messages/s");
+    Benchmark::report("1MB messages", run(1024 * 1024, std::max(messages / 1000, 50)), "messages/s");
+    return 0;
+}
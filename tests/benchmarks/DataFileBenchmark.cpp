@@ -0,0 +1,178 @@
+#include "Benchmark.h"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <rct/DataFile.h>
+#include <rct/ThreadPool.h>
+
+// Load time and peak memory for a DataFile read from a String copy of the
+// file, the way it used to be, and from a mapping of it, decoding all
+// of it or just a small section. Cold means out of the page cache. The
+// first argument is the size of the file in MB. Also the time it takes
+// to write it and how fast the checksums are verified.
+
+enum {
+    Version = 1,
+    // magic, format, version, crc
+    HeaderSize = 16
+};
+
+static long status(const char *field)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return 0;
+    char line[256];
+    long ret = 0;
+    const size_t len = strlen(field);
+    while (fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, field, len) && line[len] == ':') {
+            ret = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+static void dropCache(const Path &path)
+{
+    const int fd = open(path.constData(), O_RDONLY);
+    if (fd != -1) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+struct Contents
+{
+    List<int> ints;
+    List<String> strings;
+    Map<String, int> small;
+};
+
+static void decodeAll(Deserializer &deserializer, Contents &contents)
+{
+    deserializer >> contents.ints >> contents.strings >> contents.small;
+}
+
+// each load runs in a process of its own with the peak RSS reset, it
+// includes the pages of the file that are mapped
+static void run(const char *name, const Path &path, bool cold, std::function<void(Contents &)> &&load)
+{
+    if (cold)
+        dropCache(path);
+    else
+        Benchmark::use(path.readAll());
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (!pid) {
+        FILE *f = fopen("/proc/self/clear_refs", "w");
+        if (f) {
+            fputs("5", f);
+            fclose(f);
+        }
+        const long before = status("VmRSS");
+        const uint64_t start = Benchmark::nowNs();
+        {
+            Contents contents;
+            load(contents);
+            Benchmark::use(contents);
+        }
+        const double ms = (Benchmark::nowNs() - start) / 1000000.0;
+        const long peak = status("VmHWM");
+        Benchmark::report(String::format<96>("%s, %s", name, cold ? "cold" : "warm").constData(), ms, "ms");
+        Benchmark::report(String::format<96>("%s, %s, peak RSS growth", name, cold ? "cold" : "warm").constData(), (peak - before) / 1024.0, "MB");
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t mb = Benchmark::iterations(argc, argv, 256);
+    char dir[] = "/tmp/rct-datafile-benchmark-XXXXXX";
+    if (!mkdtemp(dir))
+        return 1;
+    const Path path = Path(dir).ensureTrailingSlash() + "bench.db";
+    const pid_t writer = fork();
+    if (!writer) {
+        Contents contents;
+        contents.ints.resize(mb * 1024 * 1024 / 2 / sizeof(int));
+        for (size_t i = 0; i < contents.ints.size(); ++i)
+            contents.ints[i] = static_cast<int>(i * 2654435761u);
+        while (contents.strings.size() * 40 < mb * 1024 * 1024 / 2)
+            contents.strings.append(String::format<64>("/usr/include/some/path/file%zu.h", contents.strings.size()));
+        for (int i = 0; i < 1000; ++i)
+            contents.small[String::format<32>("key%d", i)] = i;
+        const uint64_t start = Benchmark::nowNs();
+        DataFile file(path, Version);
+        if (!file.open(DataFile::Write))
+            _exit(1);
+        file.beginSection("ints");
+        file << contents.ints;
+        file.beginSection("strings");
+        file << contents.strings;
+        file.beginSection("small");
+        file << contents.small;
+        const bool ok = file.flush();
+        Benchmark::report("write, checksummed and synced", (Benchmark::nowNs() - start) / 1000000.0, "ms");
+        _exit(ok ? 0 : 1);
+    }
+    int status;
+    if (waitpid(writer, &status, 0) != writer || !WIFEXITED(status) || WEXITSTATUS(status))
+        return 1;
+    printf("%s: %.1f MB\n", path.constData(), path.fileSize() / (1024.0 * 1024.0));
+
+    for (int cold = 1; cold >= 0; --cold) {
+        run("readAll, decode all", path, cold, [&path](Contents &contents) {
+                const String data = path.readAll();
+                Deserializer deserializer(data);
+                char header[HeaderSize];
+                deserializer.read(header, sizeof(header));
+                decodeAll(deserializer, contents);
+            });
+        run("mmap, decode all", path, cold, [&path](Contents &contents) {
+                DataFile file(path, Version);
+                file.open(DataFile::Read);
+                file >> contents.ints >> contents.strings >> contents.small;
+            });
+        run("readAll, small section", path, cold, [&path](Contents &contents) {
+                // everything has to be read and decoded to get to it
+                const String data = path.readAll();
+                Deserializer deserializer(data);
+                char header[HeaderSize];
+                deserializer.read(header, sizeof(header));
+                decodeAll(deserializer, contents);
+                contents.ints.clear();
+                contents.strings.clear();
+            });
+        run("mmap, small section", path, cold, [&path](Contents &contents) {
+                DataFile file(path, Version);
+                file.open(DataFile::Read);
+                file.seek("small");
+                file >> contents.small;
+            });
+    }
+
+    DataFile file(path, Version);
+    if (file.open(DataFile::Read)) {
+        Benchmark::use(path.readAll());
+        ThreadPool inline0(0);
+        uint64_t start = Benchmark::nowNs();
+        bool ok = file.verify(&inline0);
+        Benchmark::report("verify, one thread", path.fileSize() / (1024.0 * 1024.0) / ((Benchmark::nowNs() - start) / 1000000000.0), "MB/s");
+        ThreadPool pool(ThreadPool::idealThreadCount());
+        start = Benchmark::nowNs();
+        ok = file.verify(&pool) && ok;
+        Benchmark::report(String::format<64>("verify, %d threads", pool.concurrentJobs()).constData(),
+                          path.fileSize() / (1024.0 * 1024.0) / ((Benchmark::nowNs() - start) / 1000000000.0), "MB/s");
+        if (!ok)
+            printf("verify failed: %s\n", file.error().constData());
+    }
+    Path::rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "Benchmark.h"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include <rct/EventLoop.h>
+#include <rct/SocketClient.h>
+#include <rct/String.h>
+
+static uint64_t cpuNs()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+// Ping pong of 32 byte messages over socketpairs with a SocketClient on
+// each end, all on one loop. Every pair has one message in flight so
+// each round the loop has a few hundred sockets to read from and write
+// to. With the io_uring backend the reads are completions of recvs
+// queued on the ring, with epoll they're a read() after each wakeup.
+static void run(unsigned int flags, int pairs, int messages, double &wall, double &cpu, bool &ring)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(flags);
+    ring = loop->hasAsyncIO();
+
+    enum { MessageSize = 32 };
+    const String message(MessageSize, 'm');
+    std::vector<SocketClient::SharedPtr> clients;
+    int received = 0;
+    for (int i = 0; i < pairs; ++i) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+            perror("socketpair");
+            exit(1);
+        }
+        SocketClient::SharedPtr ping = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+        SocketClient::SharedPtr pong = std::make_shared<SocketClient>(fds[1], SocketClient::Unix);
+        ping->setLogsEnabled(false);
+        pong->setLogsEnabled(false);
+        pong->readyRead().connect([](const SocketClient::SharedPtr &socket, Buffer &&buffer) {
+                socket->write(buffer.data(), buffer.size());
+                buffer.clear();
+            });
+        ping->readyRead().connect([&, messages](const SocketClient::SharedPtr &socket, Buffer &&buffer) {
+                for (size_t n = 0; n < buffer.size(); n += MessageSize) {
+                    if (++received == messages) {
+                        loop->quit();
+                        break;
+                    }
+                    socket->write(message);
+                }
+                buffer.clear();
+            });
+        clients.push_back(ping);
+        clients.push_back(pong);
+    }
+
+    const uint64_t start = Benchmark::nowNs(), startCpu = cpuNs();
+    for (size_t i = 0; i < clients.size(); i += 2)
+        clients[i]->write(message);
+    loop->exec();
+    wall = static_cast<double>(Benchmark::nowNs() - start) / messages;
+    cpu = static_cast<double>(cpuNs() - startCpu) / messages;
+    clients.clear();
+}
+
+// Same ping pong on the loop's socket API alone. With epoll the sockets
+// are registered for reads and drained with read() then answered with a
+// write(). With io_uring every read and write is submitted to the ring so
+// a round of the loop takes a single io_uring_enter().
+static void runRaw(unsigned int flags, int pairs, int messages, double &wall, double &cpu, bool &ring)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(flags);
+    ring = loop->hasAsyncIO();
+
+    enum { MessageSize = 32, ReadSize = 4096 };
+    std::vector<int> fds(pairs * 2);
+    int received = 0;
+    auto send = [&loop, ring](int fd, size_t size) {
+        if (ring) {
+            Buffer buffer;
+            buffer.resize(size);
+            memset(buffer.data(), 'm', size);
+            loop->submitWrite(fd, std::move(buffer), [](int, int, Buffer &&) { });
+        } else {
+            char data[MessageSize * 16];
+            memset(data, 'm', size);
+            Benchmark::use(::write(fd, data, size));
+        }
+    };
+    // called with the number of bytes read from fds[i], odd sockets echo
+    auto handle = [&](int i, size_t size) {
+        if (i & 1) {
+            send(fds[i], size);
+            return;
+        }
+        for (size_t n = 0; n < size; n += MessageSize) {
+            if (++received == messages) {
+                loop->quit();
+                return;
+            }
+            send(fds[i], MessageSize);
+        }
+    };
+    std::function<void(int, Buffer &&)> read = [&](int i, Buffer &&buffer) {
+        buffer.clear();
+        loop->submitRead(fds[i], std::move(buffer), ReadSize, [&, i](int, int result, Buffer &&b) {
+                if (result > 0) {
+                    handle(i, result);
+                    read(i, std::move(b));
+                }
+            });
+    };
+    for (int i = 0; i < pairs; ++i) {
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[i * 2]) == -1) {
+            perror("socketpair");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < pairs * 2; ++i) {
+        if (ring) {
+            read(i, Buffer());
+        } else {
+            loop->registerSocket(fds[i], EventLoop::SocketRead, [&, i](int fd, unsigned int) {
+                    char data[ReadSize];
+                    for (;;) {
+                        const ssize_t r = ::read(fd, data, sizeof(data));
+                        if (r <= 0)
+                            break;
+                        handle(i, r);
+                    }
+                });
+        }
+    }
+    const uint64_t start = Benchmark::nowNs(), startCpu = cpuNs();
+    for (int i = 0; i < pairs; ++i)
+        send(fds[i * 2], MessageSize);
+    loop->exec();
+    wall = static_cast<double>(Benchmark::nowNs() - start) / messages;
+    cpu = static_cast<double>(cpuNs() - startCpu) / messages;
+    for (int fd : fds) {
+        loop->unregisterSocket(fd);
+        ::close(fd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const int messages = Benchmark::iterations(argc, argv, 500000);
+    const int pairs[] = { 1, 256 };
+    const struct { unsigned int flags; const char *name; } backends[] = {
+        { EventLoop::None, "epoll" },
+        { EventLoop::EnableIoUring, "io_uring" }
+    };
+    for (int raw = 0; raw < 2; ++raw) {
+        for (int p : pairs) {
+            for (const auto &backend : backends) {
+                double wall, cpu;
+                bool ring;
+                if (raw) {
+                    runRaw(backend.flags, p, messages, wall, cpu, ring);
+                } else {
+                    run(backend.flags, p, messages, wall, cpu, ring);
+                }
+                if ((backend.flags & EventLoop::EnableIoUring) && !ring) {
+                    printf("io_uring not available, skipped\n");
+                    continue;
+                }
+                const char *api = raw ? "EventLoop" : "SocketClient";
+                Benchmark::report(String::format<64>("%s %s, %d pairs", api, backend.name, p).constData(), wall, "ns/message");
+                Benchmark::report(String::format<64>("%s %s, %d pairs, cpu", api, backend.name, p).constData(), cpu, "ns/message");
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <rct/Log.h>
+#include <rct/Path.h>
+#include <rct/String.h>
+
+// Lines per second into a log file from 1 to 16 threads, logging right
+// away and through the LogAsync writer, through a FILE and a rotated
+// LogFile, and how quickly a level nobody listens to is turned away
+static double run(int threads, uint64_t lines, LogLevel level)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&, i]() {
+                    ++ready;
+                    while (!go.load())
+                        std::this_thread::yield();
+                    for (uint64_t l = 0; l < lines; ++l)
+                        log(level, "thread %d line %llu", i, static_cast<unsigned long long>(l));
+                }));
+    }
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    const uint64_t start = Benchmark::nowNs();
+    go = true;
+    for (std::thread &worker : workers)
+        worker.join();
+    flushLogs();
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    return (lines * threads) / (static_cast<double>(elapsed) / 1000000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t lines = Benchmark::iterations(argc, argv, 100000);
+    char dir[] = "/tmp/rct-logbench-XXXXXX";
+    if (!mkdtemp(dir))
+        return 1;
+    const Path file = Path(dir) + "/bench.log";
+
+    struct {
+        const char *name;
+        Flags<LogFlag> flags;
+        bool rotate;
+    } const modes[] = {
+        { "sync", DontRotate, false },
+        { "LogAsync", DontRotate | LogAsync, false },
+        { "LogAsyncBlock", DontRotate | LogAsync | LogAsyncBlock, false },
+        { "sync, rotated", DontRotate | LogCompress, true },
+        { "LogAsyncBlock, rotated", DontRotate | LogAsync | LogAsyncBlock | LogCompress, true }
+    };
+    for (const auto &mode : modes) {
+        for (int threads = 1; threads <= 16; threads *= 2) {
+            if (mode.rotate)
+                setLogRotation(16 * 1024 * 1024, 0, 4);
+            initLogging("bench", mode.flags, LogLevel::Error, file, LogLevel::Error);
+            const uint64_t dropped = droppedLogLines();
+            const double rate = run(threads, lines, LogLevel::Error);
+            Benchmark::report(String::format<64>("%d threads, %s", threads, mode.name).constData(), rate, "lines/s");
+            if (droppedLogLines() != dropped)
+                printf("    %llu lines dropped\n", static_cast<unsigned long long>(droppedLogLines() - dropped));
+            cleanupLogging();
+        }
+    }
+
+    initLogging("bench", DontRotate | LogAsync, LogLevel::Error, file, LogLevel::Error);
+    Benchmark::report("debug() below the log level", Benchmark::nsPerOp(lines * 100, []() {
+                debug("thread %d line %d", 0, 0);
+            }), "ns/line");
+    cleanupLogging();
+    Path::rmdir(dir);
+    return 0;
+}
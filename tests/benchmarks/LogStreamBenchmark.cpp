@@ -0,0 +1,44 @@
+#include "Benchmark.h"
+
+#include <stdlib.h>
+
+#include <rct/Log.h>
+#include <rct/Path.h>
+#include <rct/String.h>
+
+// ns per error() << "x" << n << path line, formatted into a String, to a
+// log file and for a level nobody takes
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 1000000);
+    char dir[] = "/tmp/rct-logstream-XXXXXX";
+    if (!mkdtemp(dir))
+        return 1;
+    const Path file = Path(dir) + "/bench.log";
+    const Path path = "/usr/include/stdio.h";
+    const List<int> list = { 1, 2, 3 };
+    uint64_t n = 0;
+
+    Benchmark::report("Log(String *) << \"x\" << n << path", Benchmark::nsPerOp(count, [&]() {
+                String out;
+                Log(&out) << "open" << ++n << path;
+                Benchmark::use(out);
+            }), "ns/line");
+    Benchmark::report("Log(String *) << double << List<int>", Benchmark::nsPerOp(count, [&]() {
+                String out;
+                Log(&out) << 3.25 << list;
+                Benchmark::use(out);
+            }), "ns/line");
+
+    initLogging("bench", DontRotate, LogLevel::Error, file, LogLevel::Error);
+    Benchmark::report("error() << \"x\" << n << path, to a file", Benchmark::nsPerOp(count, [&]() {
+                error() << "open" << ++n << path;
+            }), "ns/line");
+    Benchmark::report("debug() << \"x\" << n << path, disabled", Benchmark::nsPerOp(count * 10, [&]() {
+                debug() << "open" << ++n << path;
+            }), "ns/line");
+    cleanupLogging();
+    Path::rmdir(dir);
+    Benchmark::use(n);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <rct/Parallel.h>
+#include <rct/String.h>
+#include <rct/ThreadPool.h>
+
+static List<String> makeStrings(size_t count)
+{
+    List<String> strings;
+    strings.reserve(count);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < count; ++i) {
+        String string(16 + (i % 48), ' ');
+        for (size_t c = 0; c < string.size(); ++c) {
+            seed = seed * 1103515245 + 12345;
+            string[c] = 'a' + (seed >> 16) % 26;
+        }
+        strings.append(string);
+    }
+    return strings;
+}
+
+static uint64_t fnv(const String &string)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < string.size(); ++i) {
+        hash ^= static_cast<unsigned char>(string[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Sorts chunks on the pool and merges them pairwise, each round of
+// merges on the pool as well
+static void parallelSort(List<String> &strings, size_t chunks, ThreadPool *pool)
+{
+    const size_t count = strings.size();
+    const size_t chunkSize = (count + chunks - 1) / chunks;
+    Rct::parallelFor(0, chunks, 1, [&](size_t chunk) {
+            const size_t begin = std::min(chunk * chunkSize, count);
+            const size_t end = std::min(begin + chunkSize, count);
+            std::sort(strings.begin() + begin, strings.begin() + end);
+        }, pool);
+    for (size_t width = chunkSize; width < count; width *= 2) {
+        const size_t merges = (count + width * 2 - 1) / (width * 2);
+        Rct::parallelFor(0, merges, 1, [&](size_t merge) {
+                const size_t begin = merge * width * 2;
+                const size_t middle = std::min(begin + width, count);
+                const size_t end = std::min(begin + width * 2, count);
+                std::inplace_merge(strings.begin() + begin, strings.begin() + middle, strings.begin() + end);
+            }, pool);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = Benchmark::iterations(argc, argv, 1000000);
+    const List<String> input = makeStrings(count);
+    const int maxThreads = std::max(ThreadPool::idealThreadCount(), 4);
+
+    double serialSort, serialHash;
+    {
+        List<String> strings = input;
+        uint64_t start = Benchmark::nowNs();
+        std::sort(strings.begin(), strings.end());
+        serialSort = (Benchmark::nowNs() - start) / 1000000.0;
+        start = Benchmark::nowNs();
+        uint64_t sum = 0;
+        for (const String &string : input)
+            sum += fnv(string);
+        Benchmark::use(sum);
+        serialHash = (Benchmark::nowNs() - start) / 1000000.0;
+        Benchmark::report("sort, serial", serialSort, "ms");
+        Benchmark::report("hash, serial", serialHash, "ms");
+    }
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ThreadPool pool(threads);
+        List<String> strings = input;
+        uint64_t start = Benchmark::nowNs();
+        parallelSort(strings, threads * 4, &pool);
+        const double sort = (Benchmark::nowNs() - start) / 1000000.0;
+        if (!std::is_sorted(strings.begin(), strings.end())) {
+            fprintf(stderr, "not sorted\n");
+            return 1;
+        }
+
+        start = Benchmark::nowNs();
+        const uint64_t sum = Rct::parallelReduce(input, 0, static_cast<uint64_t>(0), fnv,
+                                                 std::plus<uint64_t>(), &pool);
+        Benchmark::use(sum);
+        const double hash = (Benchmark::nowNs() - start) / 1000000.0;
+
+        Benchmark::report(String::format<64>("sort, %d threads", threads).constData(), sort, "ms");
+        Benchmark::report(String::format<64>("sort, %d threads, speedup", threads).constData(), serialSort / sort, "x");
+        Benchmark::report(String::format<64>("hash, %d threads", threads).constData(), hash, "ms");
+        Benchmark::report(String::format<64>("hash, %d threads, speedup", threads).constData(), serialHash / hash, "x");
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <rct/EventLoopGroup.h>
+#include <rct/String.h>
+
+// Cross thread post() traffic into an EventLoop: how many events a loop
+// takes in with producers flooding it, how many sleep/wakeup round
+// trips two loops manage, and how long an event waits to be run.
+
+static double postsPerSecond(int producers, uint64_t count)
+{
+    EventLoopGroup group;
+    group.start(1, EventLoop::None, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    std::atomic<uint64_t> done(0);
+    std::promise<void> finished;
+    const uint64_t total = count * producers;
+
+    const uint64_t start = Benchmark::nowNs();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back(std::thread([&]() {
+                    for (uint64_t i = 0; i < count; ++i) {
+                        loop->callLater([&]() {
+                                if (++done == total)
+                                    finished.set_value();
+                            });
+                    }
+                }));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    finished.get_future().wait();
+    return total * 1000000000.0 / (Benchmark::nowNs() - start);
+}
+
+// A posts to B, B posts back to A. Both loops sleep in between so
+// every post is a wakeup.
+static double wakeupsPerSecond(uint64_t count)
+{
+    EventLoopGroup group;
+    group.start(2, EventLoop::None, false);
+    const EventLoop::SharedPtr a = group.loop(0), b = group.loop(1);
+    std::promise<void> finished;
+    std::function<void(uint64_t)> ping;
+    ping = [&](uint64_t remaining) {
+        if (!remaining) {
+            finished.set_value();
+            return;
+        }
+        const EventLoop::SharedPtr target = EventLoop::eventLoop() == a ? b : a;
+        target->callLater([&ping, remaining]() { ping(remaining - 1); });
+    };
+    const uint64_t start = Benchmark::nowNs();
+    a->callLater([&ping, count]() { ping(count); });
+    finished.get_future().wait();
+    return count * 1000000000.0 / (Benchmark::nowNs() - start);
+}
+
+// time from post() to the event running, for posts spaced out so the
+// loop is asleep for each (idle) or in bursts of 64 (busy)
+static void latency(bool burst, uint64_t count, uint64_t &p50, uint64_t &p99)
+{
+    EventLoopGroup group;
+    group.start(1, EventLoop::None, false);
+    const EventLoop::SharedPtr loop = group.loop(0);
+    List<uint64_t> samples;
+    samples.reserve(count);
+    std::atomic<uint64_t> done(0);
+    const uint64_t batch = burst ? 64 : 1;
+    for (uint64_t i = 0; i < count; i += batch) {
+        const uint64_t end = std::min(i + batch, count);
+        for (uint64_t j = i; j < end; ++j) {
+            const uint64_t posted = Benchmark::nowNs();
+            loop->callLater([&samples, &done, posted]() {
+                    samples.append(Benchmark::nowNs() - posted);
+                    ++done;
+                });
+        }
+        while (done < end)
+            std::this_thread::yield();
+        if (!burst)
+            usleep(20);
+    }
+    group.stop();
+    p99 = Benchmark::percentile(samples, 99);
+    p50 = Benchmark::percentile(samples, 50);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 200000);
+    const int producers[] = { 1, 4 };
+    for (int p : producers) {
+        Benchmark::report(String::format<64>("post, %d producer(s)", p).constData(),
+                          postsPerSecond(p, count / p), "posts/s");
+    }
+    Benchmark::report("ping pong between two loops", wakeupsPerSecond(count / 10), "wakeups/s");
+    const bool bursts[] = { false, true };
+    for (bool burst : bursts) {
+        uint64_t p50, p99;
+        latency(burst, burst ? count : count / 20, p50, p99);
+        Benchmark::report(String::format<64>("post latency p50, %s", burst ? "bursts of 64" : "idle loop").constData(), p50, "ns");
+        Benchmark::report(String::format<64>("post latency p99, %s", burst ? "bursts of 64" : "idle loop").constData(), p99, "ns");
+    }
+    return 0;
+}
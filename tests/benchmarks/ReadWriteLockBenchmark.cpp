@@ -0,0 +1,80 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <rct/ReadLocker.h>
+#include <rct/ScalableReadWriteLock.h>
+#include <rct/SeqLock.h>
+#include <rct/String.h>
+
+struct Table
+{
+    long long values[4];
+};
+
+// Lookups per second into a table guarded by a lock, every thread only
+// reads. With a single shared lock word the readers take turns on its
+// cache line, the scalable lock and the seqlock shouldn't care how
+// many readers there are.
+template <typename Read>
+static double run(int threads, uint64_t reads, Read read)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&, i]() {
+                    ++ready;
+                    while (!go.load())
+                        std::this_thread::yield();
+                    long long sum = 0;
+                    for (uint64_t r = 0; r < reads; ++r)
+                        sum += read((i + r) % 4);
+                    Benchmark::use(sum);
+                }));
+    }
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    const uint64_t start = Benchmark::nowNs();
+    go = true;
+    for (std::thread &worker : workers)
+        worker.join();
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    return (reads * threads) / (static_cast<double>(elapsed) / 1000000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t reads = Benchmark::iterations(argc, argv, 1000000);
+    Table table = { { 1, 2, 3, 4 } };
+    std::mutex mutex;
+    ReadWriteLock lock;
+    ScalableReadWriteLock scalable;
+    SeqLock<Table> seq(table);
+
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        Benchmark::report(String::format<64>("%d threads, std::mutex", threads).constData(),
+                          run(threads, reads, [&](int idx) {
+                                  std::lock_guard<std::mutex> locker(mutex);
+                                  return table.values[idx];
+                              }), "reads/s");
+        Benchmark::report(String::format<64>("%d threads, ReadWriteLock", threads).constData(),
+                          run(threads, reads, [&](int idx) {
+                                  ReadLocker locker(&lock);
+                                  return table.values[idx];
+                              }), "reads/s");
+        Benchmark::report(String::format<64>("%d threads, ScalableReadWriteLock", threads).constData(),
+                          run(threads, reads, [&](int idx) {
+                                  ReadLocker locker(&scalable);
+                                  return table.values[idx];
+                              }), "reads/s");
+        Benchmark::report(String::format<64>("%d threads, SeqLock", threads).constData(),
+                          run(threads, reads, [&](int idx) {
+                                  return seq.load().values[idx];
+                              }), "reads/s");
+    }
+    return 0;
+}
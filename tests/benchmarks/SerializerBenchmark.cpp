@@ -0,0 +1,79 @@
+#include "Benchmark.h"
+
+#include <rct/Serializer.h>
+
+// MB/s encoding and decoding into a String for a list of ints, a list
+// of strings, a map of lists and lots of small fields, and encoding
+// small fields into a FILE
+template <typename T>
+static void run(const char *name, const T &value, uint64_t rounds)
+{
+    String encoded;
+    {
+        Serializer serializer(encoded);
+        serializer << value;
+    }
+    const double mb = encoded.size() * rounds / (1024.0 * 1024.0);
+
+    const uint64_t encodeStart = Benchmark::nowNs();
+    for (uint64_t i = 0; i < rounds; ++i) {
+        String out;
+        Serializer serializer(out);
+        serializer << value;
+        Benchmark::use(out);
+    }
+    const double encodeSeconds = (Benchmark::nowNs() - encodeStart) / 1000000000.0;
+
+    const uint64_t decodeStart = Benchmark::nowNs();
+    for (uint64_t i = 0; i < rounds; ++i) {
+        T out;
+        Deserializer deserializer(encoded.constData(), encoded.size());
+        deserializer >> out;
+        Benchmark::use(out);
+    }
+    const double decodeSeconds = (Benchmark::nowNs() - decodeStart) / 1000000000.0;
+
+    Benchmark::report(String::format<64>("%s, encode", name).constData(), mb / encodeSeconds, "MB/s");
+    Benchmark::report(String::format<64>("%s, decode", name).constData(), mb / decodeSeconds, "MB/s");
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t rounds = Benchmark::iterations(argc, argv, 20);
+
+    List<int> ints(1000000);
+    for (size_t i = 0; i < ints.size(); ++i)
+        ints[i] = static_cast<int>(i * 2654435761u);
+    run("List<int> 1M", ints, rounds);
+
+    List<String> strings;
+    for (int i = 0; i < 100000; ++i)
+        strings.append(String::format<64>("/usr/include/some/path/file%d.h", i));
+    run("List<String> 100k", strings, rounds);
+
+    Map<String, List<int> > map;
+    for (int i = 0; i < 10000; ++i) {
+        List<int> &list = map[String::format<32>("key%d", i)];
+        for (int j = 0; j < 100; ++j)
+            list.append(i * j);
+    }
+    run("Map<String, List<int> > 10k x 100", map, rounds);
+
+    List<std::pair<int, uint8_t> > pairs(1000000);
+    for (size_t i = 0; i < pairs.size(); ++i)
+        pairs[i] = std::make_pair(static_cast<int>(i), static_cast<uint8_t>(i));
+    run("List<pair<int, uint8_t> > 1M", pairs, rounds);
+
+    FILE *null = fopen("/dev/null", "w");
+    if (null) {
+        const uint64_t start = Benchmark::nowNs();
+        for (uint64_t i = 0; i < rounds; ++i) {
+            Serializer serializer(null);
+            serializer << pairs;
+        }
+        const double seconds = (Benchmark::nowNs() - start) / 1000000000.0;
+        Benchmark::report("List<pair<int, uint8_t> > 1M, encode to FILE", pairs.size() * 5 * rounds / (1024.0 * 1024.0) / seconds, "MB/s");
+        fclose(null);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "Benchmark.h"
+
+#include <map>
+#include <mutex>
+
+#include <rct/SignalSlot.h>
+#include <rct/String.h>
+
+// The emission path Signal used before connections were published as
+// snapshots: copy the whole map under the mutex on every emit.
+template <typename Signature>
+class CopyingSignal
+{
+public:
+    CopyingSignal() : id(0) { }
+
+    template <typename Call>
+    unsigned int connect(Call &&call)
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        connections.insert(std::make_pair(++id, std::forward<Call>(call)));
+        return id;
+    }
+
+    template <typename... Args>
+    void operator()(Args &&... args)
+    {
+        std::map<unsigned int, Signature> conn;
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            conn = connections;
+        }
+        for (auto &connection : conn) {
+            connection.second(std::forward<Args>(args)...);
+        }
+    }
+
+private:
+    unsigned int id;
+    std::mutex mutex;
+    std::map<unsigned int, Signature> connections;
+};
+
+template <typename SignalType>
+static double emitCost(int slots, uint64_t count)
+{
+    SignalType signal;
+    int hits = 0;
+    for (int i = 0; i < slots; ++i)
+        signal.connect([&hits](int v) { hits += v; });
+    const double ns = Benchmark::nsPerOp(count, [&signal]() { signal(1); });
+    Benchmark::use(hits);
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 1000000);
+    const int slots[] = { 0, 1, 4, 64 };
+    for (int s : slots) {
+        const uint64_t n = s > 4 ? count / 16 : count;
+        Benchmark::report(String::format<64>("emit, %d slots, copying map", s).constData(),
+                          emitCost<CopyingSignal<std::function<void(int)> > >(s, n), "ns/emit");
+        Benchmark::report(String::format<64>("emit, %d slots, snapshot", s).constData(),
+                          emitCost<Signal<std::function<void(int)> > >(s, n), "ns/emit");
+    }
+    return 0;
+}
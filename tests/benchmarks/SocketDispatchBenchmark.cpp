@@ -0,0 +1,87 @@
+#include "Benchmark.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include <rct/EventLoop.h>
+#include <rct/String.h>
+
+static uint64_t userNs()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000000000ull + usage.ru_utime.tv_usec * 1000ull;
+}
+
+// 10k registered sockets (both ends of 5k socketpairs) each receiving a
+// 1 byte ping per round. The writes happen before the loop runs so the
+// measured time is epoll_wait() plus dispatch, and with readBytes the
+// read() the callback does. The time spent in the kernel swamps the
+// dispatch itself so user cpu time is reported too.
+static void nsPerEvent(int sockets, int rounds, bool readBytes, double &wall, double &user)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+
+    std::vector<int> fds(sockets);
+    for (int i = 0; i < sockets; i += 2) {
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[i]) == -1) {
+            perror("socketpair");
+            exit(1);
+        }
+    }
+    int fired = 0;
+    for (int fd : fds) {
+        loop->registerSocket(fd, EventLoop::SocketRead, [&fired, &loop, sockets, readBytes](int f, unsigned int) {
+                if (readBytes) {
+                    char c;
+                    Benchmark::use(::read(f, &c, 1));
+                }
+                if (++fired == sockets)
+                    loop->quit();
+            });
+    }
+
+    uint64_t elapsed = 0, elapsedUser = 0;
+    const char ping = 'p';
+    for (int r = 0; r < rounds; ++r) {
+        fired = 0;
+        for (int i = 0; i < sockets; ++i)
+            Benchmark::use(::write(fds[i ^ 1], &ping, 1));
+        const uint64_t start = Benchmark::nowNs(), startUser = userNs();
+        loop->exec();
+        elapsed += Benchmark::nowNs() - start;
+        elapsedUser += userNs() - startUser;
+    }
+    for (int fd : fds) {
+        loop->unregisterSocket(fd);
+        ::close(fd);
+    }
+    const double events = static_cast<double>(sockets) * rounds;
+    wall = elapsed / events;
+    user = elapsedUser / events;
+}
+
+int main(int argc, char **argv)
+{
+    const int rounds = Benchmark::iterations(argc, argv, 50);
+    int sockets = 10000;
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < static_cast<rlim_t>(sockets) + 64)
+            sockets = (limit.rlim_cur - 64) & ~1;
+    }
+    const bool reads[] = { false, true };
+    for (bool readBytes : reads) {
+        double wall, user;
+        nsPerEvent(sockets, rounds, readBytes, wall, user);
+        const char *what = readBytes ? "wait + dispatch + read" : "wait + dispatch";
+        Benchmark::report(String::format<64>("%s, %d sockets", what, sockets).constData(), wall, "ns/event");
+        Benchmark::report(String::format<64>("%s, %d sockets, user cpu", what, sockets).constData(), user, "ns/event");
+    }
+    return 0;
+}
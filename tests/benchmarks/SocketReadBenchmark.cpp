@@ -0,0 +1,78 @@
+#include "Benchmark.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+#include <rct/EventLoop.h>
+#include <rct/SocketClient.h>
+#include <rct/String.h>
+
+// Throughput of a SocketClient reading from a UNIX socketpair. Another
+// thread writes payloads of a fixed size with blocking writes, the
+// client takes the read buffer on every readyRead like Connection does.
+// Large payloads show how quickly the read buffer grows to fit them,
+// small ones how many readyReads a burst of messages turns into.
+static void run(size_t payload, size_t total, double &mbps, double &callbacksPerPayload)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    client->setLogsEnabled(false);
+    size_t received = 0, callbacks = 0;
+    client->readyRead().connect([&](const SocketClient::SharedPtr &, Buffer &&buffer) {
+            Buffer taken = std::move(buffer);
+            if (!taken.isEmpty()) {
+                ++callbacks;
+                received += taken.size();
+                if (received >= total)
+                    loop->quit();
+            }
+        });
+
+    const uint64_t start = Benchmark::nowNs();
+    std::thread writer([payload, total, fds]() {
+            std::vector<char> data(payload, 'p');
+            for (size_t sent = 0; sent < total; sent += payload) {
+                size_t written = 0;
+                while (written < payload) {
+                    const ssize_t w = ::write(fds[1], &data[written], payload - written);
+                    if (w <= 0) {
+                        perror("write");
+                        exit(1);
+                    }
+                    written += w;
+                }
+            }
+        });
+    loop->exec();
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    writer.join();
+    client.reset();
+    ::close(fds[1]);
+
+    mbps = (static_cast<double>(total) / (1024 * 1024)) / (static_cast<double>(elapsed) / 1000000000.0);
+    callbacksPerPayload = static_cast<double>(callbacks) / (total / payload);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t megabytes = Benchmark::iterations(argc, argv, 512);
+    const size_t payloads[] = { 1024, 64 * 1024, 16 * 1024 * 1024 };
+    for (size_t payload : payloads) {
+        const size_t total = std::max<size_t>(megabytes * 1024 * 1024 / payload, 1) * payload;
+        double mbps, callbacks;
+        run(payload, total, mbps, callbacks);
+        Benchmark::report(String::format<64>("%zuKB payloads", payload / 1024).constData(), mbps, "MB/s");
+        Benchmark::report(String::format<64>("%zuKB payloads, readyRead", payload / 1024).constData(), callbacks, "calls/payload");
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "Benchmark.h"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <set>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <rct/EventLoopGroup.h>
+#include <rct/SocketServer.h>
+#include <rct/String.h>
+
+// Accepts and echo traffic through a SocketServer that spreads its
+// connections over an EventLoopGroup. The server's own loop runs in a
+// group of one, the load is generated with blocking sockets on the
+// main thread.
+struct Server
+{
+    Server(SocketServer::Distribution distribution, int loops, bool echo)
+        : accepted(0)
+    {
+        group = std::make_shared<EventLoopGroup>();
+        group->start(loops);
+        acceptLoop.start(1);
+        std::promise<uint16_t> port;
+        acceptLoop.loop(0)->callLater([this, distribution, echo, &port]() {
+                server.reset(new SocketServer);
+                server->setEventLoopGroup(group, distribution);
+                server->newClient().connect([this, echo](const SocketClient::SharedPtr& client) {
+                        client->setLogsEnabled(false);
+                        ++accepted;
+                        if (!echo)
+                            return;
+                        client->readyRead().connect([](const SocketClient::SharedPtr& c, Buffer&& buffer) {
+                                c->write(buffer.data(), buffer.size());
+                                buffer.clear();
+                            });
+                        client->disconnected().connect([this](const SocketClient::SharedPtr& c) {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                clients.erase(c);
+                            });
+                        std::lock_guard<std::mutex> lock(mutex);
+                        clients.insert(client);
+                    });
+                server->listen(0);
+                port.set_value(server->port());
+            });
+        serverPort = port.get_future().get();
+    }
+
+    ~Server()
+    {
+        std::promise<void> closed;
+        acceptLoop.loop(0)->callLater([this, &closed]() {
+                server.reset();
+                closed.set_value();
+            });
+        closed.get_future().wait();
+        acceptLoop.stop();
+        group->stop();
+        clients.clear();
+    }
+
+    int connect() const
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(serverPort);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            perror("connect");
+            exit(1);
+        }
+        // reset on close so the accept run doesn't pile up TIME_WAITs
+        linger l = { 1, 0 };
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    EventLoopGroup::SharedPtr group;
+    EventLoopGroup acceptLoop;
+    std::unique_ptr<SocketServer> server;
+    uint16_t serverPort;
+    std::atomic<uint64_t> accepted;
+    std::mutex mutex;
+    std::set<SocketClient::SharedPtr> clients;
+};
+
+static double acceptsPerSecond(SocketServer::Distribution distribution, int loops, uint64_t count)
+{
+    Server server(distribution, loops, false);
+    const uint64_t start = Benchmark::nowNs();
+    // connect in batches well below the listen backlog and let the
+    // server catch up, otherwise connect() blocks on a full backlog
+    enum { Batch = 32 };
+    for (uint64_t i = 0; i < count; i += Batch) {
+        const uint64_t end = std::min<uint64_t>(i + Batch, count);
+        for (uint64_t j = i; j < end; ++j)
+            ::close(server.connect());
+        while (server.accepted < end)
+            usleep(10);
+    }
+    return count * 1000000000.0 / (Benchmark::nowNs() - start);
+}
+
+static double echoMBps(SocketServer::Distribution distribution, int loops, uint64_t rounds)
+{
+    enum { Connections = 16, MessageSize = 4096 };
+    Server server(distribution, loops, true);
+    int fds[Connections];
+    for (int i = 0; i < Connections; ++i)
+        fds[i] = server.connect();
+    while (server.accepted < Connections)
+        usleep(100);
+
+    char out[MessageSize], in[MessageSize];
+    memset(out, 'x', sizeof(out));
+    const uint64_t start = Benchmark::nowNs();
+    for (uint64_t r = 0; r < rounds; ++r) {
+        for (int i = 0; i < Connections; ++i) {
+            if (::write(fds[i], out, sizeof(out)) != sizeof(out)) {
+                perror("write");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < Connections; ++i) {
+            size_t got = 0;
+            while (got < sizeof(in)) {
+                const ssize_t rc = ::read(fds[i], in + got, sizeof(in) - got);
+                if (rc <= 0) {
+                    perror("read");
+                    exit(1);
+                }
+                got += rc;
+            }
+        }
+    }
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    for (int i = 0; i < Connections; ++i)
+        ::close(fds[i]);
+    return (2.0 * rounds * Connections * MessageSize) / (1024 * 1024) / (elapsed / 1000000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 5000);
+    const int loops[] = { 1, 2, 4 };
+    const struct {
+        SocketServer::Distribution distribution;
+        const char *name;
+    } modes[] = {
+        { SocketServer::RoundRobin, "round robin" },
+        { SocketServer::LeastLoaded, "least loaded" },
+        { SocketServer::ReusePort, "SO_REUSEPORT" }
+    };
+    for (const auto &mode : modes) {
+        for (int l : loops) {
+            Benchmark::report(String::format<64>("accept, %s, %d loops", mode.name, l).constData(),
+                              acceptsPerSecond(mode.distribution, l, count), "accepts/s");
+            Benchmark::report(String::format<64>("echo 16x4KB, %s, %d loops", mode.name, l).constData(),
+                              echoMBps(mode.distribution, l, count / 5), "MB/s");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "Benchmark.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <thread>
+
+#include <rct/EventLoop.h>
+#include <rct/SocketClient.h>
+#include <rct/String.h>
+
+// Messages of a 4 byte header and a body written by a SocketClient to a
+// UNIX socketpair, the way Connection sends them. Another thread reads
+// them, slower than they're written so the client's write queue fills
+// up. Compares writing header and body separately with a single
+// scatter-gather write.
+static double run(bool vectored, int messages, size_t bodySize)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(EventLoop::None);
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+    SocketClient::SharedPtr client = std::make_shared<SocketClient>(fds[0], SocketClient::Unix);
+    client->setLogsEnabled(false);
+    const size_t total = messages * (bodySize + 4);
+    size_t written = 0;
+    bool queued = false;
+    client->bytesWritten().connect([&](const SocketClient::SharedPtr &, int bytes) {
+            written += bytes;
+            if (queued && written == total)
+                loop->quit();
+        });
+
+    std::thread reader([fds, total]() {
+            char data[4096];
+            for (size_t read = 0; read < total; ) {
+                const ssize_t r = ::read(fds[1], data, sizeof(data));
+                if (r <= 0)
+                    break;
+                read += r;
+            }
+        });
+
+    const String body(bodySize, 'b');
+    const uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < messages; ++i) {
+        const uint32_t header = bodySize;
+        if (vectored) {
+            iovec vecs[2];
+            vecs[0].iov_base = const_cast<uint32_t *>(&header);
+            vecs[0].iov_len = sizeof(header);
+            vecs[1].iov_base = const_cast<char *>(body.constData());
+            vecs[1].iov_len = body.size();
+            client->write(vecs, 2);
+        } else {
+            client->write(&header, sizeof(header));
+            client->write(body);
+        }
+    }
+    queued = true;
+    if (written < total)
+        loop->exec();
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    reader.join();
+    client.reset();
+    ::close(fds[1]);
+    return static_cast<double>(elapsed) / messages;
+}
+
+int main(int argc, char **argv)
+{
+    const int messages = Benchmark::iterations(argc, argv, 200000);
+    const size_t bodies[] = { 100, 4096, 65536 };
+    for (size_t body : bodies) {
+        const int count = body > 4096 ? messages / 16 : messages;
+        Benchmark::report(String::format<64>("%zuB body, header and body", body).constData(), run(false, count, body), "ns/message");
+        Benchmark::report(String::format<64>("%zuB body, scatter-gather", body).constData(), run(true, count, body), "ns/message");
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <rct/String.h>
+#include <rct/ThreadPool.h>
+
+class CountJob : public ThreadPool::Job
+{
+public:
+    CountJob(ThreadPool* pool, std::atomic<int>* count, int children)
+        : mPool(pool), mCount(count), mChildren(children)
+    {
+    }
+
+protected:
+    virtual void run() override
+    {
+        for (int i = 0; i < mChildren; ++i)
+            mPool->start(std::make_shared<CountJob>(mPool, mCount, 0));
+        ++*mCount;
+    }
+
+private:
+    ThreadPool* mPool;
+    std::atomic<int>* mCount;
+    const int mChildren;
+};
+
+// Jobs per second through a pool of the given size. Either all jobs are
+// started from the main thread, or a few are and each of them starts
+// the rest from inside the pool, the way recursive work is split up.
+static double run(ThreadPool::Scheduling scheduling, int threads, int jobs, bool spawned)
+{
+    ThreadPool pool(threads, Thread::Normal, 0, scheduling);
+    std::atomic<int> count(0);
+    const int parents = spawned ? 64 : jobs;
+    const int children = spawned ? jobs / parents - 1 : 0;
+    const int total = parents * (children + 1);
+
+    const uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < parents; ++i)
+        pool.start(std::make_shared<CountJob>(&pool, &count, children));
+    while (count.load() < total)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    const uint64_t elapsed = Benchmark::nowNs() - start;
+    return total / (static_cast<double>(elapsed) / 1000000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    const int jobs = Benchmark::iterations(argc, argv, 200000);
+    const int maxThreads = std::max(ThreadPool::idealThreadCount(), 4);
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        for (int spawned = 0; spawned < 2; ++spawned) {
+            const char *source = spawned ? "spawned" : "external";
+            Benchmark::report(String::format<64>("%d threads, %s, shared queue", threads, source).constData(),
+                              run(ThreadPool::SharedQueue, threads, jobs, spawned), "jobs/s");
+            Benchmark::report(String::format<64>("%d threads, %s, work stealing", threads, source).constData(),
+                              run(ThreadPool::WorkStealing, threads, jobs, spawned), "jobs/s");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "Benchmark.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include <rct/String.h>
+#include <rct/ThreadPool.h>
+
+class IdleJob : public ThreadPool::Job
+{
+protected:
+    virtual void run() override {}
+};
+
+// keeps the pool's only thread busy so started jobs stay queued
+class BlockingJob : public ThreadPool::Job
+{
+public:
+    BlockingJob() : mRunning(false), mReleased(false) {}
+
+    void waitUntilRunning()
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (!mRunning)
+            mCond.wait(lock);
+    }
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mReleased = true;
+        mCond.notify_all();
+    }
+
+protected:
+    virtual void run() override
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        mRunning = true;
+        mCond.notify_all();
+        while (!mReleased)
+            mCond.wait(lock);
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mRunning, mReleased;
+};
+
+static int priority(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return static_cast<int>((seed >> 16) % 16);
+}
+
+// Time to start and to remove a job with a random priority while the
+// given number of jobs with mixed priorities are queued.
+static void run(int backlog, int samples, double &startNs, double &removeNs)
+{
+    ThreadPool pool(1);
+    std::shared_ptr<BlockingJob> blocker = std::make_shared<BlockingJob>();
+    pool.start(blocker);
+    blocker->waitUntilRunning();
+
+    uint32_t seed = 1;
+    for (int i = 0; i < backlog; ++i)
+        pool.start(std::make_shared<IdleJob>(), priority(seed));
+
+    List<std::shared_ptr<ThreadPool::Job> > jobs;
+    for (int i = 0; i < samples; ++i)
+        jobs.append(std::make_shared<IdleJob>());
+    List<int> priorities;
+    for (int i = 0; i < samples; ++i)
+        priorities.append(priority(seed));
+
+    uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < samples; ++i)
+        pool.start(jobs[i], priorities[i]);
+    startNs = static_cast<double>(Benchmark::nowNs() - start) / samples;
+
+    start = Benchmark::nowNs();
+    for (int i = 0; i < samples; ++i)
+        pool.remove(jobs[i]);
+    removeNs = static_cast<double>(Benchmark::nowNs() - start) / samples;
+
+    pool.clearBackLog();
+    blocker->release();
+}
+
+int main(int argc, char **argv)
+{
+    const int samples = Benchmark::iterations(argc, argv, 1000);
+    const int backlogs[] = { 100, 1000, 10000, 50000 };
+    for (int backlog : backlogs) {
+        double startNs, removeNs;
+        run(backlog, samples, startNs, removeNs);
+        Benchmark::report(String::format<64>("start, %d queued", backlog).constData(), startNs, "ns/job");
+        Benchmark::report(String::format<64>("remove, %d queued", backlog).constData(), removeNs, "ns/job");
+    }
+    return 0;
+}
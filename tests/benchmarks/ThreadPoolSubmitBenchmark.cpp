@@ -0,0 +1,84 @@
+#include "Benchmark.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <rct/String.h>
+#include <rct/ThreadPool.h>
+
+class CountJob : public ThreadPool::Job
+{
+public:
+    CountJob(std::atomic<int>* count)
+        : mCount(count)
+    {
+    }
+
+protected:
+    virtual void run() override
+    {
+        ++*mCount;
+    }
+
+private:
+    std::atomic<int>* mCount;
+};
+
+static void waitFor(const std::atomic<int>& count, int expected)
+{
+    while (count.load() < expected)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+// Cost per trivial unit of work through a pool, from being started
+// until it has run, as a Job subclass and as a submitted callable.
+static double runJobs(ThreadPool::Scheduling scheduling, int count)
+{
+    ThreadPool pool(1, Thread::Normal, 0, scheduling);
+    std::atomic<int> done(0);
+    const uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < count; ++i)
+        pool.start(std::make_shared<CountJob>(&done));
+    waitFor(done, count);
+    return static_cast<double>(Benchmark::nowNs() - start) / count;
+}
+
+static double runSubmit(ThreadPool::Scheduling scheduling, int count)
+{
+    ThreadPool pool(1, Thread::Normal, 0, scheduling);
+    std::atomic<int> done(0);
+    const uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < count; ++i)
+        pool.submit([&done]() { ++done; });
+    waitFor(done, count);
+    return static_cast<double>(Benchmark::nowNs() - start) / count;
+}
+
+static double runSubmitFutures(ThreadPool::Scheduling scheduling, int count)
+{
+    ThreadPool pool(1, Thread::Normal, 0, scheduling);
+    List<Future<int> > futures;
+    futures.reserve(count);
+    const uint64_t start = Benchmark::nowNs();
+    for (int i = 0; i < count; ++i)
+        futures.append(pool.submit([i]() { return i; }));
+    int64_t sum = 0;
+    for (const Future<int>& future : futures)
+        sum += future.get();
+    Benchmark::use(sum);
+    return static_cast<double>(Benchmark::nowNs() - start) / count;
+}
+
+int main(int argc, char **argv)
+{
+    const int count = Benchmark::iterations(argc, argv, 1000000);
+    const ThreadPool::Scheduling modes[] = { ThreadPool::SharedQueue, ThreadPool::WorkStealing };
+    for (ThreadPool::Scheduling mode : modes) {
+        const char *name = mode == ThreadPool::SharedQueue ? "shared queue" : "work stealing";
+        Benchmark::report(String::format<64>("%s, Job", name).constData(), runJobs(mode, count), "ns/task");
+        Benchmark::report(String::format<64>("%s, submit", name).constData(), runSubmit(mode, count), "ns/task");
+        Benchmark::report(String::format<64>("%s, submit and get", name).constData(), runSubmitFutures(mode, count), "ns/task");
+    }
+    return 0;
+}
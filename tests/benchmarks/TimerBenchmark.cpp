@@ -0,0 +1,54 @@
+#include "Benchmark.h"
+
+#include <memory>
+#include <time.h>
+
+#include <rct/EventLoop.h>
+#include <rct/String.h>
+#include <rct/Timer.h>
+
+// Registers count single shot timers spread over the next second,
+// cancels every other one and runs the loop until the rest have fired.
+static void run(const char *backend, unsigned int flags, uint64_t count)
+{
+    EventLoop::SharedPtr loop = std::make_shared<EventLoop>();
+    loop->init(flags);
+
+    uint64_t remaining = count - count / 2;
+    std::function<void(int)> callback = [&remaining, &loop](int) {
+        if (!--remaining)
+            loop->quit();
+    };
+
+    List<int> ids(count);
+    uint64_t start = Benchmark::nowNs();
+    for (uint64_t i = 0; i < count; ++i) {
+        std::function<void(int)> cb = callback;
+        ids[i] = loop->registerTimer(std::move(cb), (i * 7919) % 1000, Timer::SingleShot);
+    }
+    const double reg = static_cast<double>(Benchmark::nowNs() - start) / count;
+
+    start = Benchmark::nowNs();
+    for (uint64_t i = 0; i < count; i += 2)
+        loop->unregisterTimer(ids[i]);
+    const double cancel = static_cast<double>(Benchmark::nowNs() - start) / (count / 2);
+
+    // the loop sleeps between timeouts so count cpu time, not wall time
+    const clock_t cpu = clock();
+    loop->exec(5000);
+    const double fired = static_cast<double>(clock() - cpu) * 1000000000.0 / CLOCKS_PER_SEC / (count - count / 2);
+
+    Benchmark::report(String::format<64>("register, %s", backend).constData(), reg, "ns/timer");
+    Benchmark::report(String::format<64>("cancel, %s", backend).constData(), cancel, "ns/timer");
+    Benchmark::report(String::format<64>("fire, %s", backend).constData(), fired, "cpu ns/timer");
+    if (remaining)
+        printf("%llu timers did not fire\n", static_cast<unsigned long long>(remaining));
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t count = Benchmark::iterations(argc, argv, 1000000);
+    run("multiset", EventLoop::None, count);
+    run("timer wheel", EventLoop::EnableTimerWheel, count);
+    return 0;
+}